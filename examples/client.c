@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/mcp_client.h"
+
+#define N_CALLS 1000
+
+typedef struct {
+    int completed;
+    int failed;
+} stats_t;
+
+// runs on the MQTT callback thread while other calls are still in flight
+void on_add(void *ctx, const mcp_client_response_t *response)
+{
+    stats_t *stats = (stats_t *) ctx;
+
+    if (response->error != 0) {
+        printf("add failed: %d %s\n", response->error, response->message);
+        stats->failed++;
+    }
+    stats->completed++;
+}
+
+void on_presence(void *ctx, const mcp_server_info_t *server, bool online)
+{
+    (void) ctx;
+    printf("%s (%s) is %s\n", server->server_name, server->server_id,
+           online ? "online" : "offline");
+}
+
+void mcp_client_example()
+{
+    mcp_client_t *client = mcp_client_init(
+        "Example Client", "tcp://broker.emqx.io:1883", "example_caller", NULL,
+        NULL, NULL);
+
+    mcp_client_on_presence(client, on_presence, NULL);
+    if (mcp_client_connect(client, 5000) != 0) {
+        printf("Failed to connect\n");
+        mcp_client_close(client);
+        return;
+    }
+
+    mcp_client_session_t *session =
+        mcp_client_open(client, NULL, "ESP32 Demo Server Name", 5000);
+    if (session == NULL) {
+        printf("Server did not answer\n");
+        mcp_client_close(client);
+        return;
+    }
+
+    // wait for a single answer
+    mcp_future_t *future = mcp_future_create();
+    mcp_client_list_tools(session, NULL, mcp_future_callback, future);
+    if (mcp_future_wait(future, 5000) == 0) {
+        const mcp_client_response_t *response = mcp_future_response(future);
+        printf("tools: %.*s\n", (int) response->result_len,
+               response->result);
+    }
+    mcp_future_free(future);
+
+    // the session listed its tools, so the registry knows who provides them
+    char server_id[128], server_name[128];
+    if (mcp_client_find_tool(client, "add", server_id, sizeof(server_id),
+                             server_name, sizeof(server_name)) == 0) {
+        printf("add is provided by %s (%s)\n", server_name, server_id);
+    }
+
+    // or keep many calls in flight on the same session
+    stats_t stats = { 0 };
+    for (int i = 0; i < N_CALLS; i++) {
+        char arguments[64];
+        snprintf(arguments, sizeof(arguments), "{\"a\":%d,\"b\":%d}", i, i);
+        mcp_client_call_tool(session, "add", arguments, on_add, &stats);
+    }
+
+    future = mcp_future_create();
+    mcp_client_call_tool(session, "add", "{\"a\":1,\"b\":2}",
+                         mcp_future_callback, future);
+    mcp_future_wait(future, 10000);
+    mcp_future_free(future);
+    printf("%d calls completed, %d failed\n", stats.completed, stats.failed);
+
+    mcp_client_session_close(session);
+    mcp_client_close(client);
+}
+
+int main()
+{
+    mcp_client_example();
+
+    return 0;
+}
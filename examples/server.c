@@ -5,30 +5,31 @@
 #include <unistd.h>
 
 #include "../include/mcp.h"
+#include "../include/mcp_result.h"
 #include "../include/mcp_server.h"
 
+static volatile sig_atomic_t running = 1;
+
 void signal_handler(int sig)
 {
     (void) sig;
+    running = 0;
 }
 
-const char *add_numbers(int n_args, property_t *args)
+int add_numbers(int n_args, property_t *args, mcp_result_t *result)
 {
     (void) n_args;
-    int a = args[0].value.integer_value;
-    int b = args[1].value.integer_value;
-
-    int result = a + b;
+    long long a = args[0].value.integer_value;
+    long long b = args[1].value.integer_value;
 
-    char *response = malloc(32);
-    snprintf(response, 32, "%d", result);
-    return response;
+    // formatted straight into the response, nothing to allocate or free
+    return mcp_result_printf(result, "%lld", a + b);
 }
 
 mcp_tool_t tool = {
     .name           = "add",
     .description    = "Adds two numbers",
-    .call           = add_numbers,
+    .invoke         = add_numbers,
     .property_count = 2,
     .properties =
         (property_t[]) {
@@ -55,16 +56,24 @@ void mcp_server_example()
 
     mcp_server_register_tool(server, 1, &tool);
 
-    mcp_server_run(server);
+    // everything runs on this thread, the MQTT client only queues messages
+    if (mcp_server_start(server) < 0) {
+        mcp_server_close(server);
+        return;
+    }
+    while (running) {
+        mcp_server_process(server, 1000);
+    }
+    mcp_server_stop(server, 5000);
+    mcp_server_close(server);
 }
 
 int main()
 {
-    mcp_server_example();
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
 
-    while (1) {
-        sleep(1);
-    }
+    mcp_server_example();
 
     return 0;
 }
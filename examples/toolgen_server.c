@@ -0,0 +1,45 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../include/mcp.h"
+#include "../include/mcp_result.h"
+#include "../include/mcp_server.h"
+#include "example_tools.h"
+
+// handlers receive arguments already decoded by the generated binders and
+// write their results straight into the response
+
+int add_numbers(const example_add_args_t *args, mcp_result_t *result)
+{
+    return mcp_result_printf(result, "%lld", args->a + args->b);
+}
+
+int example_greet(const example_greet_args_t *args, mcp_result_t *result)
+{
+    char greeting[64];
+
+    snprintf(greeting, sizeof(greeting), "Hello, %s!", args->name);
+    for (char *p = greeting; args->shout && *p; p++) {
+        *p = (char) toupper((unsigned char) *p);
+    }
+    return mcp_result_text(result, greeting);
+}
+
+int main()
+{
+    mcp_server_t *server = mcp_server_init(
+        "Generated Tools Demo", "Tools compiled by mcp-toolgen",
+        "tcp://broker.emqx.io:1883", "toolgen_client", NULL, NULL, NULL);
+
+    // the generated table is const and registered without copying
+    mcp_server_register_static_tools(server, EXAMPLE_N_TOOLS, example_tools);
+
+    mcp_server_run(server);
+
+    while (1) {
+        sleep(1);
+    }
+
+    return 0;
+}
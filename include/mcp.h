@@ -8,22 +8,79 @@ typedef enum {
     PROPERTY_REAL,
     PROPERTY_INTEGER,
     PROPERTY_BOOLEAN,
+    PROPERTY_ARRAY,
+    PROPERTY_OBJECT,
 } property_type_e;
 
+typedef struct property property_t;
+
+/*
+ * Elements of an array argument. Scalars are packed into one flat buffer of
+ * the item type, arrays and objects are nested properties.
+ */
+typedef struct {
+    property_type_e item_type;
+    int             count;
+    union {
+        double     *reals;
+        long long  *integers;
+        bool       *booleans;
+        char      **strings;
+        property_t *items;
+    };
+} property_array_t;
+
+/* Members of an object argument, in the order of the schema. */
+typedef struct {
+    int         count;
+    property_t *properties;
+} property_object_t;
+
 typedef union {
-    double    real_value;
-    long long integer_value;
-    char     *string_value;
-    bool      boolean_value;
+    double            real_value;
+    long long         integer_value;
+    char             *string_value;
+    bool              boolean_value;
+    property_array_t  array_value;
+    property_object_t object_value;
 } property_value_u;
 
-typedef struct {
+/*
+ * Describes an argument in a tool's schema and carries its value in a call.
+ * Tools receive their arguments in schema order, matched by name; an optional
+ * argument the client left out has present unset, unless it has a default.
+ */
+struct property {
     char *name;
     char *description;
 
     property_type_e  type;
-    property_value_u value;
-} property_t;
+    property_value_u value; // the default when has_default is set
+
+    bool optional;
+    bool has_default; // scalar types only
+    bool present;     // set in calls only
+
+    int          n_enum; // allowed values of a string
+    const char **enum_values;
+
+    property_t *items; // schema of PROPERTY_ARRAY elements
+
+    int         property_count; // schema of PROPERTY_OBJECT members
+    property_t *properties;
+};
+
+typedef struct mcp_result mcp_result_t; // see mcp_result.h
+
+/*
+ * Tools of a higher priority get a larger share of the workers when calls
+ * queue up; lower ones still run, only less often.
+ */
+typedef enum {
+    MCP_PRIORITY_NORMAL = 0,
+    MCP_PRIORITY_HIGH,
+    MCP_PRIORITY_LOW,
+} mcp_priority_e;
 
 typedef struct {
     char *name;
@@ -32,7 +89,29 @@ typedef struct {
     int         property_count;
     property_t *properties;
 
+    // the returned text is neither copied ahead of time nor freed
     const char *(*call)(int n_args, property_t *args);
+    // writes the result straight into the response, takes precedence over
+    // call; returns 0, or a negative value when the tool failed
+    int (*invoke)(int n_args, property_t *args, mcp_result_t *result);
+
+    // filled in by mcp-toolgen: the tools/list entry serialized at build time
+    // and a binder that decodes the arguments object JSON into a typed struct
+    // for its handler; call_json takes precedence over invoke and call
+    const char *schema_json;
+    int (*call_json)(const char *arguments, mcp_result_t *result);
+
+    int            timeout_ms; // 0 uses the server default
+    mcp_priority_e priority;
+
+    // the result depends on the arguments alone: repeated calls with equal
+    // arguments are answered from the memo cache for memo_ttl_ms, or until
+    // evicted when it is 0; they still count against rate_limit
+    bool pure;
+    int  memo_ttl_ms;
+
+    double rate_limit; // calls per second across all clients, 0 = unlimited
+    int    rate_burst; // calls admitted at once before rate_limit applies
 } mcp_tool_t;
 
 typedef struct {
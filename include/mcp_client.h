@@ -0,0 +1,129 @@
+#ifndef MQTT_MCP_CLIENT_H
+#define MQTT_MCP_CLIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct mcp_client         mcp_client_t;
+typedef struct mcp_client_session mcp_client_session_t;
+typedef struct mcp_future         mcp_future_t;
+
+/*
+ * Outcome of a request: the JSON text of its result, or the JSON-RPC error
+ * the server answered with. Requests that never got an answer because the
+ * connection or session went away fail with MCP_CLIENT_CLOSED.
+ */
+#define MCP_CLIENT_CLOSED (-32000)
+
+typedef struct {
+    int         error; // 0, or a JSON-RPC error code
+    const char *message;
+    const char *result; // not terminated, NULL on error
+    size_t      result_len;
+} mcp_client_response_t;
+
+/*
+ * Completion callbacks run on the MQTT callback thread, or on the thread
+ * that cancels the request or closes its session. They may issue further
+ * requests but must not block, open or close sessions; the response is only
+ * valid during the call.
+ */
+typedef void (*mcp_client_callback)(void                        *ctx,
+                                    const mcp_client_response_t *response);
+
+/* A live server as it announced itself on its presence topic. */
+typedef struct {
+    const char        *server_id;
+    const char        *server_name;
+    const char        *description; // NULL when offline or not announced
+    int                n_roles;
+    const char *const *roles;
+} mcp_server_info_t;
+
+/*
+ * Called on the MQTT callback thread for every presence message, as servers
+ * announce themselves and go away; server is only valid during the call.
+ */
+typedef void (*mcp_client_presence_fn)(void                    *ctx,
+                                       const mcp_server_info_t *server,
+                                       bool                     online);
+
+mcp_client_t *mcp_client_init(const char *name, const char *broker_uri,
+                              const char *client_id, const char *user,
+                              const char *password, const char *cert);
+void          mcp_client_close(mcp_client_t *client);
+
+void mcp_client_on_presence(mcp_client_t *client, mcp_client_presence_fn fn,
+                            void *ctx);
+/* Sent as _meta.timeout of every tools/call, 0 leaves it to the server. */
+int mcp_client_set_call_timeout(mcp_client_t *client, int timeout_ms);
+int mcp_client_set_reconnect(mcp_client_t *client, int min_ms, int max_ms);
+
+/*
+ * Connects to the broker and starts discovering servers, waiting up to
+ * timeout_ms for the connection. Returns 0 once connected.
+ */
+int mcp_client_connect(mcp_client_t *client, int timeout_ms);
+
+/*
+ * Lookups in the registry of live servers, answered without a round trip to
+ * the broker: they copy the id (and name) of a server into the buffers and
+ * return -1 when none is known or a buffer is too small. Tools are known
+ * from the tools/list every session fetches after initialize and again on
+ * notifications/tools/list_changed.
+ */
+int mcp_client_find_server(mcp_client_t *client, const char *server_name,
+                           char *server_id, size_t size);
+int mcp_client_find_tool(mcp_client_t *client, const char *tool_name,
+                         char *server_id, size_t id_size, char *server_name,
+                         size_t name_size);
+
+/*
+ * Initializes a session with a server, waiting up to timeout_ms for it to be
+ * discovered and answer. A NULL server_id picks any server of that name.
+ */
+mcp_client_session_t *mcp_client_open(mcp_client_t *client,
+                                      const char   *server_id,
+                                      const char *server_name, int timeout_ms);
+/* Fails the requests of the session still pending with MCP_CLIENT_CLOSED. */
+void mcp_client_session_close(mcp_client_session_t *session);
+
+/*
+ * Requests are pipelined: each returns as soon as it is published, with its
+ * id (> 0) or -1, and any number of them may be outstanding on a session.
+ * arguments is the JSON text of an object, or NULL. A cursor of NULL asks
+ * for the first page of a list.
+ */
+long long mcp_client_call_tool(mcp_client_session_t *session, const char *name,
+                               const char *arguments,
+                               mcp_client_callback callback, void *ctx);
+long long mcp_client_read_resource(mcp_client_session_t *session,
+                                   const char *uri,
+                                   mcp_client_callback callback, void *ctx);
+long long mcp_client_list_tools(mcp_client_session_t *session,
+                                const char *cursor,
+                                mcp_client_callback callback, void *ctx);
+long long mcp_client_list_resources(mcp_client_session_t *session,
+                                    const char          *cursor,
+                                    mcp_client_callback  callback, void *ctx);
+/*
+ * Sends notifications/cancelled for a pending request, which completes at
+ * once with -32800. Returns -1 when it was already answered.
+ */
+int mcp_client_cancel(mcp_client_session_t *session, long long id);
+
+/*
+ * Futures for callers that would rather wait: mcp_future_callback completes
+ * the future passed as ctx. Wait returns 0 once the response arrived and -1
+ * on timeout (a timeout_ms < 0 waits forever). A future is freed by its
+ * caller, also when the request is still pending. Create returns NULL when
+ * out of memory, as does mcp_client_init.
+ */
+mcp_future_t *mcp_future_create(void);
+void          mcp_future_callback(void                        *ctx,
+                                  const mcp_client_response_t *response);
+int           mcp_future_wait(mcp_future_t *future, int timeout_ms);
+const mcp_client_response_t *mcp_future_response(const mcp_future_t *future);
+void                         mcp_future_free(mcp_future_t *future);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef MQTT_MCP_JSON_H
+#define MQTT_MCP_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Pull reader over JSON text, used by the decoders mcp-toolgen generates to
+ * fill typed argument structs straight from a request without building a
+ * tree. The text must be NUL terminated. Every function returns 0 on success
+ * and -1 on malformed input, except mcp_json_object_next.
+ */
+typedef struct {
+    const char *pos;
+    const char *end;
+} mcp_json_reader_t;
+
+void mcp_json_reader_init(mcp_json_reader_t *reader, const char *json);
+
+int mcp_json_object_begin(mcp_json_reader_t *reader);
+/*
+ * Moves to the next member of the current object: returns 1 with its key
+ * (not unescaped) when there is one, whose value must then be read or
+ * skipped, 0 after the closing brace and -1 on malformed input.
+ */
+int  mcp_json_object_next(mcp_json_reader_t *reader, const char **key,
+                          size_t *key_len);
+bool mcp_json_key_is(const char *key, size_t key_len, const char *name);
+
+int mcp_json_read_string(mcp_json_reader_t *reader, char **value);
+int mcp_json_read_real(mcp_json_reader_t *reader, double *value);
+int mcp_json_read_integer(mcp_json_reader_t *reader, long long *value);
+int mcp_json_read_boolean(mcp_json_reader_t *reader, bool *value);
+int mcp_json_skip(mcp_json_reader_t *reader);
+
+int mcp_json_array_begin(mcp_json_reader_t *reader);
+/*
+ * Moves to the next element of the current array: returns 1 when there is
+ * one, which must then be read or skipped, 0 after the closing bracket and -1
+ * on malformed input.
+ */
+int mcp_json_array_next(mcp_json_reader_t *reader);
+
+/*
+ * Read a whole array of one scalar type into a flat buffer released with a
+ * single mcp_json_free(), NULL for an empty array. The strings of
+ * mcp_json_read_strings share the allocation of their pointers.
+ */
+int mcp_json_read_reals(mcp_json_reader_t *reader, double **values,
+                        int *count);
+int mcp_json_read_integers(mcp_json_reader_t *reader, long long **values,
+                           int *count);
+int mcp_json_read_booleans(mcp_json_reader_t *reader, bool **values,
+                           int *count);
+int mcp_json_read_strings(mcp_json_reader_t *reader, char ***values,
+                          int *count);
+
+/*
+ * Releases what the readers allocated, strings included, which come from the
+ * library's pools in a static memory build.
+ */
+void mcp_json_free(void *p);
+
+/* Index of value in values, or -1 when it is not one of them. */
+int mcp_json_enum_index(const char *value, int n_values, const char **values);
+
+/*
+ * Escaping for the inside of a JSON string: mcp_json_escaped_size tells how
+ * many bytes mcp_json_escape writes for len bytes of s.
+ */
+size_t mcp_json_escaped_size(const char *s, size_t len);
+size_t mcp_json_escape(char *out, const char *s, size_t len);
+
+/* Whether len bytes of s are well-formed UTF-8. */
+bool mcp_json_valid_utf8(const char *s, size_t len);
+/*
+ * Whether arrays and objects in len bytes of s nest no deeper than
+ * max_depth, found by a scan of the bytes that stops at the first level
+ * too deep; the text is not validated.
+ */
+bool mcp_json_depth_within(const char *s, size_t len, int max_depth);
+
+/*
+ * Escaping and validation use the widest vector kernel the CPU supports:
+ * "avx2" or "sse4.2" on x86, else "scalar". Setting one, for benchmarks,
+ * returns -1 when the CPU lacks it.
+ */
+const char *mcp_json_kernel(void);
+int         mcp_json_set_kernel(const char *name);
+
+#endif
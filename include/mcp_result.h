@@ -0,0 +1,44 @@
+#ifndef MQTT_MCP_RESULT_H
+#define MQTT_MCP_RESULT_H
+
+#include <stddef.h>
+
+#include "mcp.h"
+
+/*
+ * Writer handed to mcp_tool_t.invoke, bound to the buffer of the response
+ * being built: content items are serialized into it as they are added, so
+ * the tool needs no buffers of its own and the result is never copied into
+ * an intermediate tree. Small results fit into storage on the worker's
+ * stack and cause no allocation at all.
+ *
+ * All functions return 0 on success and -1 for a result that was already
+ * completed, or that outgrew the memory there is; such a result is answered
+ * with an error.
+ */
+
+// returned by invoke or call_json to answer with a JSON-RPC Invalid params
+// error instead of a result
+#define MCP_RESULT_INVALID_PARAMS (-32602)
+
+/*
+ * Appends to the current text item, starting one when the previous item is
+ * not text. JSON documents go out as text too.
+ */
+int mcp_result_text(mcp_result_t *result, const char *text);
+int mcp_result_write(mcp_result_t *result, const char *data, size_t len);
+int mcp_result_printf(mcp_result_t *result, const char *format, ...);
+/* Ends the current text item, so the next text starts a new one. */
+int mcp_result_text_end(mcp_result_t *result);
+
+/* Adds an image item, base64 encoding data straight into the response. */
+int mcp_result_image(mcp_result_t *result, const char *mime_type,
+                     const void *data, size_t size);
+/* Adds a link to a resource, mime_type may be NULL. */
+int mcp_result_resource_link(mcp_result_t *result, const char *uri,
+                             const char *name, const char *mime_type);
+
+/* Marks the result as a tool error, its content describes the error. */
+int mcp_result_error(mcp_result_t *result);
+
+#endif
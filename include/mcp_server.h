@@ -2,8 +2,10 @@
 #define MQTT_MCP_SERVER_H
 
 #include "mcp.h"
+#include "mcp_trace.h"
 
 typedef struct mcp_server mcp_server_t;
+typedef struct mcp_call   mcp_call_t;
 
 mcp_server_t *mcp_server_init(const char *name, const char *description,
                               const char *broker_uri, const char *client_id,
@@ -13,12 +15,230 @@ void          mcp_server_close(mcp_server_t *server);
 
 int mcp_server_register_tool(mcp_server_t *server, int n_tools,
                              mcp_tool_t *tools);
+int mcp_server_add_tool(mcp_server_t *server, const mcp_tool_t *tool);
+int mcp_server_remove_tool(mcp_server_t *server, const char *name);
 
 typedef const char *(*mcp_resource_read)(const char *uri);
 int mcp_server_register_resources(mcp_server_t *server, int n_resources,
                                   mcp_resource_t   *resources,
                                   mcp_resource_read read_callback);
 
+/*
+ * Like the register functions above, but the tables (and every string they
+ * point to) are used in place instead of being copied, so they must stay
+ * valid and unchanged until the server is closed or they are replaced.
+ */
+int mcp_server_register_static_tools(mcp_server_t *server, int n_tools,
+                                     const mcp_tool_t *tools);
+int mcp_server_register_static_resources(mcp_server_t *server,
+                                         int n_resources,
+                                         const mcp_resource_t *resources,
+                                         mcp_resource_read     read_callback);
+
+int mcp_server_set_workers(mcp_server_t *server, int n_workers);
+int mcp_server_set_call_timeout(mcp_server_t *server, int timeout_ms);
+/*
+ * Progress a tool reports is sent at most once per interval_ms for each call;
+ * whatever it reports in between is coalesced into the next notification.
+ */
+int mcp_server_set_progress_interval(mcp_server_t *server, int interval_ms);
+/*
+ * Duplicates of a tools/call (same client and request id) arriving within
+ * ttl_ms of its response are answered from the cache instead of running the
+ * tool again. A capacity of 0 disables the cache.
+ */
+int mcp_server_set_response_cache(mcp_server_t *server, int capacity,
+                                  int ttl_ms);
+/*
+ * Results of tools marked pure are remembered by tool and decoded arguments,
+ * up to capacity of them, least recently used first out; calls that hit skip
+ * the workers and the tool, but still count against the rate limits. A
+ * capacity of 0 disables it. The counters tell how well it works.
+ */
+int  mcp_server_set_memo_cache(mcp_server_t *server, int capacity);
+void mcp_server_memo_stats(mcp_server_t *server, long long *hits,
+                           long long *misses);
+
+/*
+ * Records spans of requests on session topics, see mcp_trace.h, and hands
+ * them to export. Requests whose traceparent user property is sampled are
+ * always recorded, others at sample_ratio (0 to 1); their responses carry a
+ * traceparent naming the server span. A NULL export turns tracing off, as
+ * does a failure to allocate the recorder, which returns -1.
+ */
+int mcp_server_set_tracing(mcp_server_t *server, double sample_ratio,
+                           mcp_span_export_fn export, void *ctx);
+
+/*
+ * Keeps responses and notifications that cannot be published while the
+ * broker is unreachable in a ring file of size bytes at path, replayed in
+ * order once connected again, also after a restart. When the ring is full
+ * the oldest messages are dropped; a ttl_s other than 0 drops messages older
+ * than ttl_s seconds and sends the rest with the time they have left as
+ * message expiry. A NULL path turns spooling off.
+ */
+int mcp_server_set_spool(mcp_server_t *server, const char *path, size_t size,
+                         int ttl_s);
+
+typedef enum {
+    MCP_RATE_LIMIT_GLOBAL = 0, // all tools/call requests of the server
+    MCP_RATE_LIMIT_SESSION,    // tools/call requests of each client
+} mcp_rate_limit_scope_e;
+
+/*
+ * Limits tools/call to rate requests per second with bursts of up to burst
+ * requests; per-tool limits are set in mcp_tool_t. Throttled requests get a
+ * -32005 error whose data carries retryAfterMs. A rate of 0 removes the limit.
+ */
+int mcp_server_set_rate_limit(mcp_server_t          *server,
+                              mcp_rate_limit_scope_e scope, double rate,
+                              int burst);
+
+/*
+ * tools/list and resources/list return at most page_size entries and a
+ * nextCursor for the rest. A page size of 0 lists everything at once.
+ */
+int mcp_server_set_page_size(mcp_server_t *server, int page_size);
+
+/*
+ * After losing the broker the server reconnects after a random delay below a
+ * bound that doubles from min_ms up to max_ms per failed attempt. The broker
+ * keeps the server's subscriptions for expiry_s seconds after a disconnect;
+ * if it did not, the session topics of all known clients are resubscribed.
+ */
+int mcp_server_set_reconnect(mcp_server_t *server, int min_ms, int max_ms);
+int mcp_server_set_session_expiry(mcp_server_t *server, int expiry_s);
+
+/*
+ * Serves clients over n_shards MQTT connections, one per core to use, each
+ * with its own callback thread, session table and response cache. The first
+ * connects with the client id, the others with "-<index>" appended; clients
+ * are assigned to one by a hash of their client id when they initialize.
+ * The first shard also takes initialize requests and client presence.
+ */
+int mcp_server_set_shards(mcp_server_t *server, int n_shards);
+
+/*
+ * Once roles are registered every client has to name one in the MCP-RBAC-ROLE
+ * user property of its initialize request, and its requests are limited to
+ * the methods, tools and resources matched by the role's glob patterns.
+ */
+int mcp_server_register_roles(mcp_server_t *server, int n_roles,
+                              mcp_mqtt_role_t *roles);
+
 int mcp_server_run(mcp_server_t *server);
 
+/*
+ * Event loop mode, in place of mcp_server_run: the MQTT threads only queue
+ * what arrives, and decoding, dispatch, tool execution, timeouts and
+ * reconnects all happen in mcp_server_process on the caller's thread.
+ * mcp_server_start connects and returns a file descriptor that is readable
+ * while work is waiting, for an epoll or libuv loop to watch; the loop also
+ * has to call mcp_server_process within mcp_server_timeout milliseconds (-1
+ * when nothing is timed). mcp_server_process waits up to timeout_ms (-1 for
+ * no limit, 0 not at all) and returns the number of events and calls
+ * handled, or -1 once stopped.
+ */
+int mcp_server_start(mcp_server_t *server);
+int mcp_server_process(mcp_server_t *server, int timeout_ms);
+int mcp_server_timeout(mcp_server_t *server);
+
+/*
+ * Turns new requests away, waits up to timeout_ms for the accepted ones to
+ * be answered (processing them in event loop mode), then clears the
+ * server's presence and disconnects. Returns -1 when calls were left
+ * unanswered. Not to be called from a tool; close the server afterwards.
+ */
+int mcp_server_stop(mcp_server_t *server, int timeout_ms);
+
+typedef struct {
+    size_t max_payload;   // bytes of one message
+    int    max_depth;     // nesting of arrays and objects
+    int    max_arguments; // members of the kwargs of a tools/call
+    size_t max_in_flight; // bytes held by the requests being served
+    int    max_sessions;  // clients with a session, across all shards
+    int    max_calls;     // requests queued for or run by the workers
+} mcp_limits_t;
+
+/*
+ * Bounds what a message may cost, a 0 leaving that limit off. Size and
+ * nesting are checked, and the payload reserved in the budget, before a
+ * message is parsed; requests over a limit are answered with an error. A
+ * request holds its payload and the JSON tree decoded from it until it is
+ * answered. This also starts counting what cJSON allocates, process wide,
+ * so call it before any server or client of the process is running.
+ *
+ * A build with MCP_STATIC_MEMORY starts out with the limits its pools were
+ * sized for, and payload, arguments, sessions and calls are held within
+ * them: a 0 or a larger value stands for the compiled size.
+ */
+int mcp_server_set_limits(mcp_server_t *server, const mcp_limits_t *limits);
+
+typedef struct {
+    size_t    in_flight;      // bytes held by requests being served
+    size_t    in_flight_peak;
+    size_t    json_in_use;    // of cJSON, process wide, once limits are set
+    size_t    json_peak;
+    long long rejected;       // messages over a limit
+    size_t    pool_used;      // of the static pools, 0 without them
+    size_t    pool_size;
+    long long pool_exhausted; // allocations no pool had a block for
+} mcp_memory_stats_t;
+
+void mcp_server_memory_stats(mcp_server_t *server, mcp_memory_stats_t *stats);
+
+/*
+ * Records every message reaching the server, and every message it
+ * publishes, to a binary capture at path with arrival times, topics,
+ * payloads and user properties. A NULL path stops capturing.
+ */
+int mcp_server_set_capture(mcp_server_t *server, const char *path);
+
+typedef struct {
+    long long requests;   // with an id on session topics
+    long long responses;  // paired with their request
+    double    seconds;    // from the first request to the last response
+    double    throughput; // responses per second
+    double    p50_ms;
+    double    p99_ms;
+    double    max_ms;
+} mcp_replay_run_t;
+
+typedef struct {
+    long long        messages; // fed to the server
+    mcp_replay_run_t recorded; // as captured
+    mcp_replay_run_t replayed;
+} mcp_replay_stats_t;
+
+/*
+ * Runs the server without a broker on the messages of a capture, instead of
+ * mcp_server_run, at speed times the recorded pace or as fast as possible
+ * for a speed of 0. Waits for the responses, which are not published, and
+ * prints their latency and throughput next to the captured ones. Register
+ * the same tools and settings as the captured server; close it afterwards.
+ */
+int mcp_server_replay(mcp_server_t *server, const char *path, double speed,
+                      mcp_replay_stats_t *stats);
+
+/*
+ * Tools run on worker threads. A tool can fetch the call it is serving and
+ * poll it to stop early once the client cancelled it or its deadline passed;
+ * its result is then discarded.
+ */
+mcp_call_t *mcp_call_current(void);
+bool        mcp_call_cancelled(const mcp_call_t *call);
+long long   mcp_call_remaining_ms(const mcp_call_t *call);
+
+/*
+ * While it runs, a tool may report progress (notifications/progress, total
+ * <= 0 when unknown) and send partial text content ahead of its result
+ * (notifications/tools/partial), both keyed by the progressToken of the
+ * request. Returns -1 when the client did not ask for progress, the call
+ * was already answered or the memory pools could not take the text. Only
+ * the thread running the tool may report.
+ */
+int mcp_call_progress(mcp_call_t *call, double progress, double total,
+                      const char *message);
+int mcp_call_partial(mcp_call_t *call, const char *text);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef MQTT_MCP_TRACE_H
+#define MQTT_MCP_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A finished span of a traced request. Every sampled request on a session
+ * topic yields one span for the whole request, child of the span in the
+ * W3C traceparent user property of the MQTT message when it carried one,
+ * and a span for each phase it went through: "decode", "auth", "queue",
+ * "tool", "encode" and "publish" (lists and reads run as "list" or "read"
+ * in place of "tool" and "encode").
+ */
+typedef struct {
+    uint8_t trace_id[16];
+    uint8_t span_id[8];
+    uint8_t parent_id[8]; // all zero for a request that started the trace
+    bool    request;      // the span of the whole request, else a phase
+    char    name[32];     // the method for the request, else the phase
+    char    tool[64];     // tools/call only, "" otherwise
+    int64_t start_ns;     // since the Unix epoch
+    int64_t end_ns;
+} mcp_span_t;
+
+/*
+ * Receives spans in batches on a thread of the recorder, never on the
+ * threads serving requests; spans are only valid during the call.
+ */
+typedef void (*mcp_span_export_fn)(void *ctx, int n_spans,
+                                   const mcp_span_t *spans);
+
+/*
+ * Exporter writing every batch as a line of OTLP/JSON (an
+ * ExportTraceServiceRequest), the format OpenTelemetry collectors read with
+ * their file receiver. Pass mcp_trace_file_export and the handle to
+ * mcp_server_set_tracing, and close the handle after the server.
+ */
+typedef struct mcp_trace_file mcp_trace_file_t;
+
+mcp_trace_file_t *mcp_trace_file_open(const char *path,
+                                      const char *service_name);
+void mcp_trace_file_export(void *ctx, int n_spans, const mcp_span_t *spans);
+void mcp_trace_file_close(mcp_trace_file_t *file);
+
+#endif
@@ -0,0 +1,767 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "call.h"
+#include "mem.h"
+
+// shares of the workers while every class has calls queued
+static const int class_weights[CALL_N_CLASSES] = { 8, 4, 2, 1 };
+
+/* The calls one session has queued in one class. */
+typedef struct call_flow {
+    char        *topic;
+    call_class_e cls;
+    mcp_call_t  *head;
+    mcp_call_t  *tail;
+
+    struct call_flow *hash_next;
+    struct call_flow *ring_next;
+} call_flow_t;
+
+typedef struct {
+    call_flow_t *ring; // served last, its ring_next is served next
+    int          n_queued;
+    int          credit; // calls left in this round of weighted sharing
+} call_class_t;
+
+struct call_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cond;
+    pthread_cond_t  watch_cond;
+    bool            stopping;
+
+    call_class_t  classes[CALL_N_CLASSES];
+    int           n_flows;
+    int           n_flow_buckets;
+    call_flow_t **flows; // by class and session topic
+    mcp_call_t   *inflight;
+    int           n_inflight;
+    int           max_inflight; // 0 without a limit
+
+    // tools may take all workers but one, which stays free for queries
+    int n_tools_running;
+    int max_tools_running;
+
+    int        n_workers;
+    pthread_t *workers;
+    pthread_t  watchdog;
+
+    call_execute_fn execute;
+    call_abort_fn   abort;
+    call_notify_fn  notify;
+    void           *ctx;
+};
+
+static _Thread_local mcp_call_t *current_call = NULL;
+
+int64_t call_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* The parts every call has, NULL when the pools cannot take them. */
+static mcp_call_t *call_alloc(const char *topic, const jsonrpc_id_t *id)
+{
+    mcp_call_t *call = mem_calloc(1, sizeof(mcp_call_t));
+
+    if (call == NULL) {
+        return NULL;
+    }
+    atomic_init(&call->state, CALL_QUEUED);
+    atomic_init(&call->cancelled, false);
+    atomic_init(&call->refs, 1);
+    call->topic = mem_strdup(topic);
+    call->id    = jsonrpc_id_dup(id);
+    if (call->topic == NULL || call->id == NULL) {
+        mem_free(call->topic);
+        jsonrpc_id_free(call->id);
+        mem_free(call);
+        return NULL;
+    }
+    return call;
+}
+
+mcp_call_t *call_create(const char *topic, const jsonrpc_id_t *id,
+                        catalog_snapshot_t *catalog, mcp_tool_t *tool,
+                        int n_args, property_t *args, char *arguments,
+                        int64_t deadline_ms)
+{
+    mcp_call_t *call = call_alloc(topic, id);
+
+    if (call == NULL) {
+        return NULL;
+    }
+    call->deadline_ms = deadline_ms;
+    call->catalog     = catalog;
+    call->tool        = tool;
+    call->n_args      = n_args;
+    call->args        = args;
+    call->arguments   = arguments;
+
+    switch (tool->priority) {
+    case MCP_PRIORITY_HIGH:
+        call->cls = CALL_CLASS_TOOL_HIGH;
+        break;
+    case MCP_PRIORITY_LOW:
+        call->cls = CALL_CLASS_TOOL_LOW;
+        break;
+    default:
+        call->cls = CALL_CLASS_TOOL;
+        break;
+    }
+    return call;
+}
+
+mcp_call_t *call_create_query(const char *topic, const jsonrpc_id_t *id,
+                              catalog_snapshot_t *catalog, int role,
+                              call_query_e query, char *arg)
+{
+    mcp_call_t *call = call_alloc(topic, id);
+
+    if (call == NULL) {
+        return NULL;
+    }
+    call->catalog   = catalog;
+    call->cls       = CALL_CLASS_QUERY;
+    call->query     = query;
+    call->query_arg = arg;
+    call->role      = role;
+
+    return call;
+}
+
+void call_free(mcp_call_t *call)
+{
+    if (call == NULL) {
+        return;
+    }
+    mem_free(call->topic);
+    jsonrpc_id_free(call->id);
+    jsonrpc_tool_call_args_free(call->n_args, call->args);
+    mem_free(call->arguments);
+    mem_free(call->query_arg);
+    memo_key_free(&call->memo);
+    trace_end(call->trace, trace_clock(call->trace));
+    mem_free(call->progress_token);
+    mem_free(call->progress_message);
+    mem_free(call->partial);
+    catalog_release(call->catalog);
+    if (call->budget != NULL) {
+        atomic_fetch_sub(call->budget, call->charge);
+    }
+    mem_free(call);
+}
+
+bool call_finish(mcp_call_t *call)
+{
+    int expected = CALL_RUNNING;
+    return atomic_compare_exchange_strong(&call->state, &expected, CALL_DONE);
+}
+
+static void call_notify(mcp_call_t *call, jsonrpc_t *notification)
+{
+    char *json = jsonrpc_encode(notification);
+
+    if (json == NULL) {
+        return; // skipped, the next one or the response catches up
+    }
+    call->pool->notify(call->pool->ctx, call, json);
+    call->notified_ms = call_now_ms();
+    mem_free(json);
+}
+
+/*
+ * Sends what was reported since the last notification, unless that went out
+ * less than the progress interval ago. Everything reported in between is
+ * coalesced: the latest progress replaces earlier ones and partial content
+ * is concatenated.
+ */
+static void progress_flush(mcp_call_t *call)
+{
+    if (call_now_ms() - call->notified_ms < call->progress_interval_ms) {
+        return;
+    }
+    if (call->partial_len > 0) {
+        call->partial[call->partial_len] = '\0';
+        call_notify(call, jsonrpc_partial_notification(call->progress_token,
+                                                       call->partial));
+        call->partial_len = 0;
+    }
+    if (call->progress_pending) {
+        call_notify(call, jsonrpc_progress_notification(
+                              call->progress_token, call->progress,
+                              call->progress_total, call->progress_message));
+        call->progress_pending = false;
+    }
+}
+
+void call_flush(mcp_call_t *call)
+{
+    if (call->progress_token != NULL && call->partial_len > 0) {
+        // the final response follows, only content is worth sending
+        call->notified_ms      = 0;
+        call->progress_pending = false;
+        progress_flush(call);
+    }
+}
+
+static void call_release(mcp_call_t *call)
+{
+    if (atomic_fetch_sub(&call->refs, 1) == 1) {
+        call_free(call);
+    }
+}
+
+/*
+ * Marks a call aborted and adds it to the list of those to answer, which
+ * call_answer_aborts does once the pool lock is released. The list holds a
+ * reference, as a worker may free the call meanwhile.
+ */
+static bool call_abort(mcp_call_t *call, call_abort_reason_e reason,
+                       mcp_call_t **aborted)
+{
+    int expected = CALL_QUEUED;
+    if (!atomic_compare_exchange_strong(&call->state, &expected,
+                                        CALL_ABORTED)) {
+        if (expected != CALL_RUNNING ||
+            !atomic_compare_exchange_strong(&call->state, &expected,
+                                            CALL_ABORTED)) {
+            return false; // already answered
+        }
+    }
+    atomic_fetch_add(&call->refs, 1);
+    call->abort_reason = reason;
+    call->abort_next   = *aborted;
+    *aborted           = call;
+    return true;
+}
+
+static void call_answer_aborts(call_pool_t *pool, mcp_call_t *aborted)
+{
+    while (aborted) {
+        mcp_call_t *next = aborted->abort_next;
+        pool->abort(pool->ctx, aborted, aborted->abort_reason);
+        call_release(aborted);
+        aborted = next;
+    }
+}
+
+static void inflight_unlink(call_pool_t *pool, mcp_call_t *call)
+{
+    pool->n_inflight--;
+    if (call->prev) {
+        call->prev->next = call->next;
+    } else {
+        pool->inflight = call->next;
+    }
+    if (call->next) {
+        call->next->prev = call->prev;
+    }
+}
+
+static uint64_t flow_hash(call_class_e cls, const char *topic)
+{
+    uint64_t hash = 14695981039346656037ULL ^ (uint64_t) cls; // FNV-1a
+
+    for (const char *p = topic; *p; p++) {
+        hash = (hash ^ (unsigned char) *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static call_flow_t **flow_slot(call_pool_t *pool, call_class_e cls,
+                               const char *topic)
+{
+    call_flow_t **slot =
+        &pool->flows[flow_hash(cls, topic) & (pool->n_flow_buckets - 1)];
+
+    while (*slot &&
+           ((*slot)->cls != cls || strcmp((*slot)->topic, topic) != 0)) {
+        slot = &(*slot)->hash_next;
+    }
+    return slot;
+}
+
+/* Keeps the buckets as they are when the pools cannot take more. */
+static void flows_grow(call_pool_t *pool)
+{
+    int           n_buckets = pool->n_flow_buckets * 2;
+    call_flow_t **buckets   = mem_calloc(n_buckets, sizeof(call_flow_t *));
+
+    if (buckets == NULL) {
+        return;
+    }
+    for (int i = 0; i < pool->n_flow_buckets; i++) {
+        call_flow_t *flow = pool->flows[i];
+        while (flow) {
+            call_flow_t  *next = flow->hash_next;
+            call_flow_t **slot =
+                &buckets[flow_hash(flow->cls, flow->topic) & (n_buckets - 1)];
+            flow->hash_next = *slot;
+            *slot           = flow;
+            flow            = next;
+        }
+    }
+    mem_free(pool->flows);
+    pool->flows          = buckets;
+    pool->n_flow_buckets = n_buckets;
+}
+
+static int call_enqueue(call_pool_t *pool, mcp_call_t *call)
+{
+    call_class_t *cls  = &pool->classes[call->cls];
+    call_flow_t **slot = flow_slot(pool, call->cls, call->topic);
+
+    if (*slot == NULL) {
+        if (pool->n_flows >= pool->n_flow_buckets) {
+            flows_grow(pool);
+            slot = flow_slot(pool, call->cls, call->topic);
+        }
+        call_flow_t *flow = mem_calloc(1, sizeof(call_flow_t));
+        char        *copy = mem_strdup(call->topic);
+        if (flow == NULL || copy == NULL) {
+            mem_free(flow);
+            mem_free(copy);
+            return -1;
+        }
+        flow->topic = copy;
+        flow->cls   = call->cls;
+        *slot       = flow;
+        pool->n_flows++;
+
+        // a session that had nothing queued is served next
+        if (cls->ring) {
+            flow->ring_next      = cls->ring->ring_next;
+            cls->ring->ring_next = flow;
+        } else {
+            flow->ring_next = flow;
+            cls->ring       = flow;
+        }
+    }
+
+    call_flow_t *flow = *slot;
+    call->queue_next  = NULL;
+    if (flow->tail) {
+        flow->tail->queue_next = call;
+    } else {
+        flow->head = call;
+    }
+    flow->tail = call;
+    cls->n_queued++;
+    return 0;
+}
+
+/* Takes the next call of a class, one per session in turn. */
+static mcp_call_t *class_pop(call_pool_t *pool, call_class_t *cls)
+{
+    call_flow_t *flow = cls->ring->ring_next;
+    mcp_call_t  *call = flow->head;
+
+    flow->head = call->queue_next;
+    cls->n_queued--;
+    if (flow->head) {
+        cls->ring = flow;
+        return call;
+    }
+
+    if (flow == cls->ring) {
+        cls->ring = NULL;
+    } else {
+        cls->ring->ring_next = flow->ring_next;
+    }
+    call_flow_t **slot = flow_slot(pool, flow->cls, flow->topic);
+    *slot              = flow->hash_next;
+    pool->n_flows--;
+    mem_free(flow->topic);
+    mem_free(flow);
+    return call;
+}
+
+static bool class_ready(const call_pool_t *pool, int cls)
+{
+    return pool->classes[cls].n_queued > 0 &&
+           (cls == CALL_CLASS_QUERY ||
+            pool->n_tools_running < pool->max_tools_running);
+}
+
+/*
+ * Weighted round robin over the classes: each takes up to its weight in
+ * calls per round, the round starts over once none that could run has
+ * credit left.
+ */
+static mcp_call_t *call_dequeue(call_pool_t *pool)
+{
+    for (int round = 0; round < 2; round++) {
+        bool ready = false;
+        for (int i = 0; i < CALL_N_CLASSES; i++) {
+            call_class_t *cls = &pool->classes[i];
+            if (!class_ready(pool, i)) {
+                continue;
+            }
+            if (cls->credit > 0) {
+                cls->credit--;
+                if (i != CALL_CLASS_QUERY) {
+                    pool->n_tools_running++;
+                }
+                return class_pop(pool, cls);
+            }
+            ready = true;
+        }
+        if (!ready) {
+            return NULL;
+        }
+        for (int i = 0; i < CALL_N_CLASSES; i++) {
+            pool->classes[i].credit = class_weights[i];
+        }
+    }
+    return NULL;
+}
+
+/* Runs a dequeued call on the calling thread and frees it. */
+static void call_run(call_pool_t *pool, mcp_call_t *call)
+{
+    if (call->deadline_ms != 0 && call_now_ms() >= call->deadline_ms) {
+        mcp_call_t *aborted = NULL;
+        call_abort(call, CALL_TIMED_OUT, &aborted);
+        call_answer_aborts(pool, aborted);
+    }
+
+    int expected = CALL_QUEUED;
+    if (atomic_compare_exchange_strong(&call->state, &expected,
+                                       CALL_RUNNING)) {
+        current_call = call;
+        pool->execute(pool->ctx, call);
+        current_call = NULL;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    inflight_unlink(pool, call);
+    if (call->cls != CALL_CLASS_QUERY) {
+        pool->n_tools_running--;
+        // a tool may be waiting for this worker
+        pthread_cond_signal(&pool->work_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    call_release(call);
+}
+
+static void *call_worker(void *arg)
+{
+    call_pool_t *pool = arg;
+
+    for (;;) {
+        mcp_call_t *call = NULL;
+
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stopping && (call = call_dequeue(pool)) == NULL) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        if (pool->stopping) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        call_run(pool, call);
+    }
+}
+
+/*
+ * Aborts the calls past their deadline, to be answered once the lock is
+ * released. Returns the next deadline or 0.
+ */
+static int64_t expire_calls(call_pool_t *pool, int64_t now,
+                            mcp_call_t **aborted)
+{
+    int64_t next = 0;
+
+    for (mcp_call_t *call = pool->inflight; call; call = call->next) {
+        if (call->deadline_ms == 0) {
+            continue;
+        }
+        if (call->deadline_ms <= now) {
+            call_abort(call, CALL_TIMED_OUT, aborted);
+        } else if (next == 0 || call->deadline_ms < next) {
+            next = call->deadline_ms;
+        }
+    }
+    return next;
+}
+
+static void *call_watchdog(void *arg)
+{
+    call_pool_t *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stopping) {
+        mcp_call_t *aborted = NULL;
+        int64_t     now     = call_now_ms();
+        int64_t     next    = expire_calls(pool, now, &aborted);
+
+        if (aborted) {
+            pthread_mutex_unlock(&pool->lock);
+            call_answer_aborts(pool, aborted);
+            pthread_mutex_lock(&pool->lock);
+        } else if (next == 0) {
+            pthread_cond_wait(&pool->watch_cond, &pool->lock);
+        } else {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            int64_t wait_ms = next - now;
+            ts.tv_sec += wait_ms / 1000;
+            ts.tv_nsec += (wait_ms % 1000) * 1000000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&pool->watch_cond, &pool->lock, &ts);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+call_pool_t *call_pool_create(int n_workers, call_execute_fn execute,
+                              call_abort_fn abort, call_notify_fn notify,
+                              void *ctx)
+{
+    if (n_workers < 0 || execute == NULL || abort == NULL || notify == NULL) {
+        return NULL;
+    }
+
+    call_pool_t *pool = mem_calloc(1, sizeof(call_pool_t));
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->watch_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pool->execute           = execute;
+    pool->abort             = abort;
+    pool->notify            = notify;
+    pool->ctx               = ctx;
+    pool->n_flow_buckets    = 16;
+    pool->flows             = mem_calloc(pool->n_flow_buckets,
+                                         sizeof(call_flow_t *));
+    pool->max_tools_running = n_workers > 1 ? n_workers - 1 : 1;
+    pool->n_workers         = n_workers;
+    pool->workers           = mem_calloc(n_workers, sizeof(pthread_t));
+    for (int i = 0; i < n_workers; i++) {
+        pthread_create(&pool->workers[i], NULL, call_worker, pool);
+    }
+    if (n_workers > 0) {
+        pthread_create(&pool->watchdog, NULL, call_watchdog, pool);
+    }
+
+    return pool;
+}
+
+void call_pool_destroy(call_pool_t *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_cond_broadcast(&pool->watch_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->n_workers; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    if (pool->n_workers > 0) {
+        pthread_join(pool->watchdog, NULL);
+    }
+
+    // whatever is still queued never started
+    for (int i = 0; i < CALL_N_CLASSES; i++) {
+        call_class_t *cls = &pool->classes[i];
+        while (cls->n_queued > 0) {
+            call_release(class_pop(pool, cls));
+        }
+    }
+    mem_free(pool->flows);
+
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->watch_cond);
+    pthread_mutex_destroy(&pool->lock);
+    mem_free(pool->workers);
+    mem_free(pool);
+}
+
+int call_pool_submit(call_pool_t *pool, mcp_call_t *call)
+{
+    pthread_mutex_lock(&pool->lock);
+    if (pool->stopping) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    if (pool->max_inflight > 0 && pool->n_inflight >= pool->max_inflight) {
+        pthread_mutex_unlock(&pool->lock);
+        return -2;
+    }
+    if (call_enqueue(pool, call) != 0) {
+        pthread_mutex_unlock(&pool->lock);
+        return -3;
+    }
+
+    call->pool = pool;
+    call->prev = NULL;
+    call->next = pool->inflight;
+    if (pool->inflight) {
+        pool->inflight->prev = call;
+    }
+    pool->inflight = call;
+    pool->n_inflight++;
+
+    pthread_cond_signal(&pool->work_cond);
+    if (call->deadline_ms != 0) {
+        pthread_cond_signal(&pool->watch_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+int call_pool_run(call_pool_t *pool, int64_t *next_deadline_ms)
+{
+    mcp_call_t *aborted = NULL;
+    int         n_run   = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    expire_calls(pool, call_now_ms(), &aborted);
+    int n_queued = 0;
+    for (int i = 0; i < CALL_N_CLASSES; i++) {
+        n_queued += pool->classes[i].n_queued;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    call_answer_aborts(pool, aborted);
+
+    // calls queued by the ones run here wait for the next turn
+    mcp_call_t *call;
+    pthread_mutex_lock(&pool->lock);
+    while (n_run < n_queued && (call = call_dequeue(pool)) != NULL) {
+        pthread_mutex_unlock(&pool->lock);
+        call_run(pool, call);
+        n_run++;
+        pthread_mutex_lock(&pool->lock);
+    }
+    aborted           = NULL;
+    *next_deadline_ms = expire_calls(pool, call_now_ms(), &aborted);
+    pthread_mutex_unlock(&pool->lock);
+    call_answer_aborts(pool, aborted);
+    return n_run;
+}
+
+int call_pool_pending(call_pool_t *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    int n_pending = pool->n_inflight;
+    pthread_mutex_unlock(&pool->lock);
+    return n_pending;
+}
+
+void call_pool_set_capacity(call_pool_t *pool, int max_calls)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->max_inflight = max_calls;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+bool call_pool_cancel(call_pool_t *pool, const char *topic,
+                      const jsonrpc_id_t *id)
+{
+    mcp_call_t *aborted   = NULL;
+    bool        cancelled = false;
+
+    pthread_mutex_lock(&pool->lock);
+    for (mcp_call_t *call = pool->inflight; call; call = call->next) {
+        if (strcmp(call->topic, topic) == 0 &&
+            jsonrpc_id_equal(call->id, id)) {
+            atomic_store(&call->cancelled, true);
+            cancelled = call_abort(call, CALL_CANCELLED, &aborted);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    call_answer_aborts(pool, aborted);
+
+    return cancelled;
+}
+
+mcp_call_t *mcp_call_current(void)
+{
+    return current_call;
+}
+
+bool mcp_call_cancelled(const mcp_call_t *call)
+{
+    if (call == NULL) {
+        return false;
+    }
+    return atomic_load(&call->cancelled) ||
+           atomic_load(&call->state) == CALL_ABORTED;
+}
+
+long long mcp_call_remaining_ms(const mcp_call_t *call)
+{
+    if (call == NULL || call->deadline_ms == 0) {
+        return -1;
+    }
+    int64_t remaining = call->deadline_ms - call_now_ms();
+    return remaining > 0 ? remaining : 0;
+}
+
+/* Progress goes out only while the call runs and its client asked for it. */
+static bool progress_wanted(const mcp_call_t *call)
+{
+    return call != NULL && call->progress_token != NULL &&
+           atomic_load(&call->state) == CALL_RUNNING;
+}
+
+int mcp_call_progress(mcp_call_t *call, double progress, double total,
+                      const char *message)
+{
+    if (!progress_wanted(call)) {
+        return -1;
+    }
+
+    mem_free(call->progress_message);
+    call->progress_pending = true;
+    call->progress         = progress;
+    call->progress_total   = total;
+    call->progress_message = message ? mem_strdup(message) : NULL;
+    progress_flush(call);
+    return 0;
+}
+
+int mcp_call_partial(mcp_call_t *call, const char *text)
+{
+    if (!progress_wanted(call)) {
+        return -1;
+    }
+
+    size_t len = strlen(text);
+    if (call->partial_len + len + 1 > call->partial_cap) {
+        size_t cap     = (call->partial_len + len + 1) * 2;
+        char  *partial = mem_realloc(call->partial, cap);
+        if (partial == NULL) {
+            return -1;
+        }
+        call->partial     = partial;
+        call->partial_cap = cap;
+    }
+    memcpy(call->partial + call->partial_len, text, len);
+    call->partial_len += len;
+    progress_flush(call);
+    return 0;
+}
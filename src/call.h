@@ -0,0 +1,167 @@
+#ifndef MCP_CALL_H
+#define MCP_CALL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "catalog.h"
+#include "jsonrpc.h"
+#include "mcp_server.h"
+#include "memo.h"
+#include "trace.h"
+
+typedef enum {
+    CALL_QUEUED = 0,
+    CALL_RUNNING,
+    CALL_DONE,
+    CALL_ABORTED,
+} call_state_e;
+
+typedef enum {
+    CALL_TIMED_OUT = 0,
+    CALL_CANCELLED,
+} call_abort_reason_e;
+
+/*
+ * Scheduling classes, most urgent first. The classes share the workers by
+ * weight so none of them starves, and within a class the sessions with work
+ * queued take turns. Control traffic (initialize, presence, notifications)
+ * never queues: it is answered on the MQTT thread as soon as it arrives.
+ */
+typedef enum {
+    CALL_CLASS_QUERY = 0, // tools/list, resources/list, resources/read
+    CALL_CLASS_TOOL_HIGH,
+    CALL_CLASS_TOOL,
+    CALL_CLASS_TOOL_LOW,
+    CALL_N_CLASSES,
+} call_class_e;
+
+typedef enum {
+    CALL_QUERY_NONE = 0, // a tools/call
+    CALL_QUERY_LIST_TOOLS,
+    CALL_QUERY_LIST_RESOURCES,
+    CALL_QUERY_READ_RESOURCE,
+} call_query_e;
+
+/*
+ * A tools/call request accepted for execution. The call owns everything it
+ * needs to run and answer after the MQTT message has been released: the
+ * response topic, a copy of the request id, the decoded arguments and a
+ * reference on the catalog snapshot the tool was resolved in.
+ */
+struct mcp_call {
+    atomic_int  state;
+    atomic_bool cancelled;
+    int64_t     deadline_ms; // monotonic, 0 means no deadline
+
+    char         *topic;
+    jsonrpc_id_t *id;
+
+    catalog_snapshot_t *catalog;
+    mcp_tool_t         *tool;
+    int                 n_args;
+    property_t         *args;
+    char               *arguments; // JSON text for tools with call_json
+    memo_key_t          memo;      // set for pure tools, to store the result
+
+    // queries run no tool, they carry the cursor or uri to answer with
+    call_class_e cls;
+    call_query_e query;
+    char        *query_arg;
+    int          role;
+
+    // sampled requests: ended by the worker, or when an aborted call is freed
+    trace_request_t *trace;
+    int64_t          queued_ns;
+
+    // bytes of the request held against the memory budget until it is freed
+    atomic_size_t *budget;
+    size_t         charge;
+
+    // progress reporting, only touched by the thread running the tool
+    char   *progress_token; // JSON, NULL when the client did not ask for it
+    int     progress_interval_ms;
+    int64_t notified_ms;
+    bool    progress_pending;
+    double  progress;
+    double  progress_total;
+    char   *progress_message;
+    char   *partial; // content held back until the interval has passed
+    size_t  partial_len;
+    size_t  partial_cap;
+
+    struct call_pool *pool;
+    struct mcp_call  *prev;
+    struct mcp_call  *next;
+    struct mcp_call  *queue_next; // in the queue of its session
+
+    // the pool's reference and those of aborts answered outside its lock
+    atomic_int          refs;
+    call_abort_reason_e abort_reason;
+    struct mcp_call    *abort_next;
+};
+
+typedef struct call_pool call_pool_t;
+
+/*
+ * Runs the tool, or answers the query, and publishes the result if
+ * call_finish() succeeds.
+ */
+typedef void (*call_execute_fn)(void *ctx, mcp_call_t *call);
+/*
+ * Answers a call that expired or was cancelled before it finished. Runs
+ * without the pool lock held, so it may publish and enter the pool again.
+ */
+typedef void (*call_abort_fn)(void *ctx, mcp_call_t *call,
+                              call_abort_reason_e reason);
+/* Publishes a notification about a running call to its client. */
+typedef void (*call_notify_fn)(void *ctx, const mcp_call_t *call,
+                               const char *notification);
+
+int64_t call_now_ms(void);
+
+/*
+ * The call takes over catalog, args and arguments. Returns NULL when the
+ * memory pools are exhausted, leaving them with the caller.
+ */
+mcp_call_t *call_create(const char *topic, const jsonrpc_id_t *id,
+                        catalog_snapshot_t *catalog, mcp_tool_t *tool,
+                        int n_args, property_t *args, char *arguments,
+                        int64_t deadline_ms);
+/* A list or read answered on a worker, arg is taken over unless NULL. */
+mcp_call_t *call_create_query(const char *topic, const jsonrpc_id_t *id,
+                              catalog_snapshot_t *catalog, int role,
+                              call_query_e query, char *arg);
+void        call_free(mcp_call_t *call);
+
+bool call_finish(mcp_call_t *call);
+/* Sends partial content still held back, ahead of the final response. */
+void call_flush(mcp_call_t *call);
+
+/*
+ * A pool of 0 workers runs nothing by itself: its owner runs the queued
+ * calls with call_pool_run, on its own thread.
+ */
+call_pool_t *call_pool_create(int n_workers, call_execute_fn execute,
+                              call_abort_fn abort, call_notify_fn notify,
+                              void *ctx);
+void         call_pool_destroy(call_pool_t *pool);
+/*
+ * Returns -1 while stopping, -2 when max_calls are already pending and -3
+ * when the memory pools cannot take the session's queue.
+ */
+int          call_pool_submit(call_pool_t *pool, mcp_call_t *call);
+bool         call_pool_cancel(call_pool_t *pool, const char *topic,
+                              const jsonrpc_id_t *id);
+/*
+ * Answers expired calls, then runs the calls queued so far on the calling
+ * thread. Returns how many ran, with the next deadline of a call still
+ * waiting in next_deadline_ms (0 when none has one).
+ */
+int call_pool_run(call_pool_t *pool, int64_t *next_deadline_ms);
+/* Calls accepted but not finished yet, queued or running. */
+int  call_pool_pending(call_pool_t *pool);
+void call_pool_set_capacity(call_pool_t *pool, int max_calls); // 0: no limit
+
+#endif
@@ -0,0 +1,236 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "mem.h"
+
+#define CAPTURE_MAGIC   "MCPCAPT"
+#define CAPTURE_VERSION 1
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    int64_t  start_ns; // wall clock at the start of the capture
+} capture_header_t;
+
+/*
+ * Followed by the topic, the payload and then for every property the
+ * lengths of its key and value as two uint16_t and their bytes.
+ */
+typedef struct {
+    uint8_t  kind;
+    uint8_t  reserved;
+    uint16_t n_props;
+    uint32_t topic_len;
+    uint32_t payload_len;
+    uint32_t props_len;
+    int64_t  time_ns;
+} capture_record_header_t;
+
+struct capture {
+    pthread_mutex_t lock;
+    FILE           *file;
+    struct timespec start;
+};
+
+struct capture_reader {
+    FILE               *file;
+    char               *buf; // topic and payload of the last record
+    size_t              buf_size;
+    capture_property_t *props;
+    int                 props_size;
+};
+
+capture_t *capture_open(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Failed to open capture %s\n", path);
+        return NULL;
+    }
+
+    struct timespec  now;
+    capture_header_t header = { .magic = CAPTURE_MAGIC };
+    header.version          = CAPTURE_VERSION;
+    clock_gettime(CLOCK_REALTIME, &now);
+    header.start_ns = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        return NULL;
+    }
+
+    capture_t *capture = mem_calloc(1, sizeof(capture_t));
+    capture->file      = file;
+    clock_gettime(CLOCK_MONOTONIC, &capture->start);
+    pthread_mutex_init(&capture->lock, NULL);
+    return capture;
+}
+
+void capture_close(capture_t *capture)
+{
+    if (capture == NULL) {
+        return;
+    }
+    fclose(capture->file);
+    pthread_mutex_destroy(&capture->lock);
+    mem_free(capture);
+}
+
+static bool is_user_property(const MQTTProperty *prop)
+{
+    return prop->identifier == MQTTPROPERTY_CODE_USER_PROPERTY;
+}
+
+void capture_message(capture_t *capture, capture_kind_e kind,
+                     const char *topic, const char *payload, size_t len,
+                     const MQTTProperties *props)
+{
+    if (capture == NULL) {
+        return;
+    }
+
+    struct timespec         now;
+    capture_record_header_t header = { .kind = (uint8_t) kind };
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    header.time_ns = (int64_t) (now.tv_sec - capture->start.tv_sec) *
+                         1000000000 +
+                     (now.tv_nsec - capture->start.tv_nsec);
+    header.topic_len   = (uint32_t) strlen(topic);
+    header.payload_len = (uint32_t) len;
+    for (int i = 0; props && i < props->count; i++) {
+        if (is_user_property(&props->array[i])) {
+            header.n_props++;
+            header.props_len += 2 * sizeof(uint16_t) +
+                                props->array[i].value.data.len +
+                                props->array[i].value.value.len;
+        }
+    }
+
+    // the lock keeps the records of concurrent publishers apart
+    pthread_mutex_lock(&capture->lock);
+    fwrite(&header, sizeof(header), 1, capture->file);
+    fwrite(topic, 1, header.topic_len, capture->file);
+    fwrite(payload, 1, len, capture->file);
+    for (int i = 0; props && i < props->count; i++) {
+        const MQTTProperty *prop = &props->array[i];
+        if (is_user_property(prop)) {
+            uint16_t lens[2] = { (uint16_t) prop->value.data.len,
+                                 (uint16_t) prop->value.value.len };
+            fwrite(lens, sizeof(lens), 1, capture->file);
+            fwrite(prop->value.data.data, 1, lens[0], capture->file);
+            fwrite(prop->value.value.data, 1, lens[1], capture->file);
+        }
+    }
+    pthread_mutex_unlock(&capture->lock);
+}
+
+capture_reader_t *capture_reader_open(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("Failed to open capture %s\n", path);
+        return NULL;
+    }
+
+    capture_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CAPTURE_VERSION) {
+        printf("Not a capture: %s\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    capture_reader_t *reader = mem_calloc(1, sizeof(capture_reader_t));
+    reader->file             = file;
+    return reader;
+}
+
+void capture_reader_close(capture_reader_t *reader)
+{
+    if (reader == NULL) {
+        return;
+    }
+    fclose(reader->file);
+    mem_free(reader->buf);
+    mem_free(reader->props);
+    mem_free(reader);
+}
+
+int capture_next(capture_reader_t *reader, capture_record_t *record)
+{
+    capture_record_header_t header;
+
+    if (fread(&header, sizeof(header), 1, reader->file) != 1) {
+        return feof(reader->file) ? 0 : -1;
+    }
+    if (header.kind != CAPTURE_IN && header.kind != CAPTURE_OUT) {
+        return -1;
+    }
+
+    // topic, payload and properties, each string followed by its NUL
+    size_t size = (size_t) header.topic_len + header.payload_len +
+                  header.props_len + 2 + 2 * (size_t) header.n_props;
+    if (size > reader->buf_size) {
+        char *buf = mem_realloc(reader->buf, size);
+        if (buf == NULL) {
+            return -1;
+        }
+        reader->buf      = buf;
+        reader->buf_size = size;
+    }
+    if (header.n_props > reader->props_size) {
+        capture_property_t *props =
+            mem_realloc(reader->props, header.n_props * sizeof(*props));
+        if (props == NULL) {
+            return -1;
+        }
+        reader->props      = props;
+        reader->props_size = header.n_props;
+    }
+
+    char *pos = reader->buf;
+    if (fread(pos, 1, header.topic_len, reader->file) != header.topic_len) {
+        return -1;
+    }
+    record->topic = pos;
+    pos += header.topic_len;
+    *pos++ = '\0';
+    if (fread(pos, 1, header.payload_len, reader->file) !=
+        header.payload_len) {
+        return -1;
+    }
+    record->payload = pos;
+    pos += header.payload_len;
+    *pos++ = '\0';
+
+    for (int i = 0; i < header.n_props; i++) {
+        uint16_t lens[2];
+        if (fread(lens, sizeof(lens), 1, reader->file) != 1 ||
+            (size_t) (pos - reader->buf) + lens[0] + lens[1] + 2 > size ||
+            fread(pos, 1, lens[0], reader->file) != lens[0]) {
+            return -1;
+        }
+        reader->props[i].key = pos;
+        pos += lens[0];
+        *pos++ = '\0';
+        if (fread(pos, 1, lens[1], reader->file) != lens[1]) {
+            return -1;
+        }
+        reader->props[i].value = pos;
+        pos += lens[1];
+        *pos++ = '\0';
+    }
+
+    record->kind    = (capture_kind_e) header.kind;
+    record->time_ns = header.time_ns;
+    record->len     = header.payload_len;
+    record->n_props = header.n_props;
+    record->props   = reader->props;
+    return 1;
+}
@@ -0,0 +1,51 @@
+#ifndef MCP_CAPTURE_H
+#define MCP_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <MQTTAsync.h>
+
+typedef enum {
+    CAPTURE_IN  = 1, // reached msg_arrvd
+    CAPTURE_OUT = 2, // handed to the MQTT client
+} capture_kind_e;
+
+/*
+ * Binary log of the traffic of a server: a header then one record per
+ * message with its direction, the time since the capture started, the
+ * topic, the payload and the user properties. Writing is thread safe.
+ */
+typedef struct capture capture_t;
+
+capture_t *capture_open(const char *path);
+void       capture_close(capture_t *capture);
+/* Does nothing for a NULL capture; props may be NULL. */
+void capture_message(capture_t *capture, capture_kind_e kind,
+                     const char *topic, const char *payload, size_t len,
+                     const MQTTProperties *props);
+
+typedef struct {
+    char *key;
+    char *value;
+} capture_property_t;
+
+/* A record read back, valid until the next capture_next. */
+typedef struct {
+    capture_kind_e      kind;
+    int64_t             time_ns;
+    char               *topic;   // NUL terminated
+    char               *payload; // NUL terminated, len bytes before it
+    size_t              len;
+    int                 n_props;
+    capture_property_t *props;
+} capture_record_t;
+
+typedef struct capture_reader capture_reader_t;
+
+capture_reader_t *capture_reader_open(const char *path);
+void              capture_reader_close(capture_reader_t *reader);
+/* Returns 1 with the next record, 0 at the end and -1 on a corrupt file. */
+int capture_next(capture_reader_t *reader, capture_record_t *record);
+
+#endif
@@ -0,0 +1,1187 @@
+#include <pthread.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "catalog.h"
+#include "jsonrpc.h"
+#include "mem.h"
+
+/*
+ * Writers are serialized by write_lock and publish a freshly built snapshot
+ * with a single atomic store. Readers never block: they announce themselves
+ * in the reader counter of the current epoch parity, take a reference on the
+ * published snapshot and leave again. After publishing, a writer flips the
+ * epoch and waits for the readers of the previous parity to drain, at which
+ * point nobody can still be about to take a reference on the old snapshot and
+ * the catalog's own reference can be dropped.
+ */
+struct catalog {
+    _Atomic(catalog_snapshot_t *) current;
+
+    atomic_uint_fast64_t epoch;
+    atomic_int           readers[2];
+
+    pthread_mutex_t write_lock;
+    uint64_t        version;
+    rbac_t         *rbac;
+    int             page_size;
+};
+
+/* Open addressing table from names (tools) or URIs (resources) to indices. */
+struct catalog_index {
+    int  mask;
+    int *slots; // index + 1, 0 marks an empty slot
+};
+
+/*
+ * Page bodies and the cursors leading to them, serialized once per list and
+ * role. Entries the role may not see are left out, so pages start wherever
+ * the previous one ended instead of at multiples of the page size.
+ */
+struct catalog_pages {
+    int    n_pages;
+    int   *starts; // index of the first entry on each page
+    char **items;
+    char **cursors; // cursors[i] leads to page i, cursors[0] is NULL
+};
+
+static char *dup_or_null(const char *s)
+{
+    return s ? mem_strdup(s) : NULL;
+}
+
+static property_t *properties_copy(int n, const property_t *src);
+
+static void properties_free(int n, property_t *properties);
+
+/*
+ * Returns -1 when a copy failed. dst then owns only what was copied, so
+ * properties_free can take it either way.
+ */
+static int property_copy(property_t *dst, const property_t *src)
+{
+    bool string_default = src->has_default && src->type == PROPERTY_STRING;
+
+    *dst                = *src;
+    dst->enum_values    = NULL;
+    dst->n_enum         = 0;
+    dst->items          = NULL;
+    dst->properties     = NULL;
+    dst->property_count = 0;
+    dst->name           = dup_or_null(src->name);
+    dst->description    = dup_or_null(src->description);
+    if (string_default) {
+        dst->value.string_value = dup_or_null(src->value.string_value);
+    }
+    if ((src->name && !dst->name) || (src->description && !dst->description) ||
+        (string_default && src->value.string_value &&
+         !dst->value.string_value)) {
+        return -1;
+    }
+    if (src->n_enum > 0) {
+        char **values = mem_calloc(src->n_enum, sizeof(char *));
+        if (values == NULL) {
+            return -1;
+        }
+        dst->enum_values = (const char **) values;
+        for (; dst->n_enum < src->n_enum; dst->n_enum++) {
+            values[dst->n_enum] = mem_strdup(src->enum_values[dst->n_enum]);
+            if (values[dst->n_enum] == NULL) {
+                return -1;
+            }
+        }
+    }
+    if (src->items) {
+        dst->items = mem_calloc(1, sizeof(property_t));
+        if (dst->items == NULL || property_copy(dst->items, src->items) != 0) {
+            return -1;
+        }
+    }
+    if (src->property_count > 0) {
+        dst->properties =
+            properties_copy(src->property_count, src->properties);
+        if (dst->properties == NULL) {
+            return -1;
+        }
+        dst->property_count = src->property_count;
+    }
+    return 0;
+}
+
+/* NULL for none, or when a copy failed. */
+static property_t *properties_copy(int n, const property_t *src)
+{
+    if (n <= 0) {
+        return NULL;
+    }
+
+    property_t *dst = mem_calloc(n, sizeof(property_t));
+    if (dst == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < n; i++) {
+        if (property_copy(&dst[i], &src[i]) != 0) {
+            properties_free(i + 1, dst);
+            return NULL;
+        }
+    }
+    return dst;
+}
+
+static void properties_free(int n, property_t *properties)
+{
+    for (int i = 0; i < n; i++) {
+        property_t *property = &properties[i];
+
+        mem_free(property->name);
+        mem_free(property->description);
+        if (property->has_default && property->type == PROPERTY_STRING) {
+            mem_free(property->value.string_value);
+        }
+        for (int k = 0; k < property->n_enum; k++) {
+            mem_free((char *) property->enum_values[k]);
+        }
+        mem_free(property->enum_values);
+        if (property->items) {
+            properties_free(1, property->items);
+        }
+        properties_free(property->property_count, property->properties);
+    }
+    mem_free(properties);
+}
+
+/* Like property_copy, what failed is left for tool_free. */
+static int tool_copy(mcp_tool_t *dst, const mcp_tool_t *src)
+{
+    *dst             = *src;
+    dst->name        = mem_strdup(src->name);
+    dst->description = dup_or_null(src->description);
+    dst->properties  = properties_copy(src->property_count, src->properties);
+    if (dst->properties == NULL) {
+        dst->property_count = 0;
+    }
+    if (dst->name == NULL || (src->description && !dst->description) ||
+        dst->property_count != src->property_count) {
+        return -1;
+    }
+    return 0;
+}
+
+static void tool_free(mcp_tool_t *tool)
+{
+    mem_free(tool->name);
+    mem_free(tool->description);
+    properties_free(tool->property_count, tool->properties);
+}
+
+static int resource_copy(mcp_resource_t *dst, const mcp_resource_t *src)
+{
+    dst->uri         = mem_strdup(src->uri);
+    dst->name        = mem_strdup(src->name);
+    dst->description = dup_or_null(src->description);
+    dst->mime_type   = dup_or_null(src->mime_type);
+    dst->title       = dup_or_null(src->title);
+    if (!dst->uri || !dst->name || (src->description && !dst->description) ||
+        (src->mime_type && !dst->mime_type) || (src->title && !dst->title)) {
+        return -1;
+    }
+    return 0;
+}
+
+static void resource_free(mcp_resource_t *resource)
+{
+    mem_free(resource->uri);
+    mem_free(resource->name);
+    mem_free(resource->description);
+    mem_free(resource->mime_type);
+    mem_free(resource->title);
+}
+
+/*
+ * Tools without a rate limit carry no state at all, for the others NULL
+ * means the state could not be allocated.
+ */
+static catalog_tool_state_t *tool_state_create(const mcp_tool_t *tool)
+{
+    if (tool->rate_limit <= 0) {
+        return NULL;
+    }
+
+    catalog_tool_state_t *state = mem_calloc(1, sizeof(catalog_tool_state_t));
+    if (state == NULL) {
+        return NULL;
+    }
+
+    atomic_init(&state->refs, 1);
+    rate_limit_init(&state->limit, tool->rate_limit, tool->rate_burst);
+    return state;
+}
+
+static void tool_state_release(catalog_tool_state_t *state)
+{
+    if (state && atomic_fetch_sub(&state->refs, 1) == 1) {
+        mem_free(state);
+    }
+}
+
+static void pages_free(catalog_pages_t *pages)
+{
+    if (pages == NULL) {
+        return;
+    }
+    for (int i = 0; i < pages->n_pages; i++) {
+        mem_free(pages->items[i]);
+        mem_free(pages->cursors[i]);
+    }
+    mem_free(pages->starts);
+    mem_free(pages->items);
+    mem_free(pages->cursors);
+    mem_free(pages);
+}
+
+static void views_free(catalog_snapshot_t *snapshot)
+{
+    for (int i = 0; i < CATALOG_LISTS; i++) {
+        for (int view = 0; snapshot->pages[i] && view < snapshot->n_views;
+             view++) {
+            pages_free(atomic_load(&snapshot->pages[i][view]));
+        }
+        mem_free(snapshot->pages[i]);
+        snapshot->pages[i] = NULL;
+    }
+}
+
+/* One set of pages per role and one for sessions without a role. */
+static int views_alloc(catalog_snapshot_t *snapshot, int n_views)
+{
+    views_free(snapshot);
+    snapshot->n_views = n_views;
+    for (int i = 0; i < CATALOG_LISTS; i++) {
+        snapshot->pages[i] =
+            mem_calloc(n_views, sizeof(_Atomic(catalog_pages_t *)));
+        if (snapshot->pages[i] == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void index_free(catalog_index_t *index)
+{
+    if (index) {
+        mem_free(index->slots);
+        mem_free(index);
+    }
+}
+
+static void snapshot_free(catalog_snapshot_t *snapshot)
+{
+    views_free(snapshot);
+    for (int i = 0; i < CATALOG_LISTS; i++) {
+        index_free(atomic_load(&snapshot->index[i]));
+    }
+    for (int i = 0; i < snapshot->n_tools; i++) {
+        if (!snapshot->static_tools) {
+            tool_free(&snapshot->tools[i]);
+        }
+        tool_state_release(snapshot->tool_state[i]);
+    }
+    if (!snapshot->static_tools) {
+        mem_free(snapshot->tools);
+    }
+    mem_free(snapshot->tool_state);
+
+    if (!snapshot->static_resources) {
+        for (int i = 0; i < snapshot->n_resources; i++) {
+            resource_free(&snapshot->resources[i]);
+        }
+        mem_free(snapshot->resources);
+    }
+
+    rbac_release(snapshot->rbac);
+    mem_free(snapshot->rbac_tools);
+    mem_free(snapshot->rbac_resources);
+
+    mem_free(snapshot);
+}
+
+/*
+ * Static tables are referenced in place, the others get owned arrays. NULL
+ * when the memory pools cannot take them.
+ */
+static catalog_snapshot_t *snapshot_alloc(int n_tools, bool static_tools,
+                                          int n_resources,
+                                          bool static_resources)
+{
+    catalog_snapshot_t *snapshot = mem_calloc(1, sizeof(catalog_snapshot_t));
+    if (snapshot == NULL) {
+        return NULL;
+    }
+
+    atomic_init(&snapshot->refs, 1);
+    snapshot->static_tools     = static_tools;
+    snapshot->static_resources = static_resources;
+    if (n_tools > 0) {
+        if (!static_tools) {
+            snapshot->tools = mem_calloc(n_tools, sizeof(mcp_tool_t));
+        }
+        snapshot->tool_state =
+            mem_calloc(n_tools, sizeof(catalog_tool_state_t *));
+        if ((!static_tools && snapshot->tools == NULL) ||
+            snapshot->tool_state == NULL) {
+            snapshot_free(snapshot);
+            return NULL;
+        }
+    }
+    snapshot->n_tools = n_tools;
+    if (n_resources > 0 && !static_resources) {
+        snapshot->resources = mem_calloc(n_resources, sizeof(mcp_resource_t));
+        if (snapshot->resources == NULL) {
+            snapshot_free(snapshot);
+            return NULL;
+        }
+    }
+    snapshot->n_resources = n_resources;
+    if (views_alloc(snapshot, 1) != 0) {
+        snapshot_free(snapshot);
+        return NULL;
+    }
+    return snapshot;
+}
+
+/* Gives dst the resources of src, sharing them when they are static. */
+static int carry_resources(catalog_snapshot_t       *dst,
+                           const catalog_snapshot_t *src)
+{
+    if (src->static_resources) {
+        dst->resources = src->resources;
+        return 0;
+    }
+    for (int i = 0; i < src->n_resources; i++) {
+        if (resource_copy(&dst->resources[i], &src->resources[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Copies tools into dst starting at index first, reusing prev's state.
+ * Returns -1 when a copy failed, dst is freed whole by the caller then.
+ */
+static int copy_tools(catalog_snapshot_t *dst, int first, int n_tools,
+                      const mcp_tool_t *tools, const catalog_snapshot_t *prev)
+{
+    bool from_prev = n_tools > 0 && tools >= prev->tools &&
+                     tools < prev->tools + prev->n_tools;
+
+    for (int i = 0; i < n_tools; i++) {
+        mcp_tool_t *tool = &dst->tools[first + i];
+        if (tool_copy(tool, &tools[i]) != 0) {
+            return -1;
+        }
+
+        const mcp_tool_t *old =
+            from_prev ? &tools[i] : catalog_find_tool(prev, tool->name);
+        catalog_tool_state_t *state =
+            old ? catalog_tool_state(prev, old) : NULL;
+        if (state && rate_limit_same(&state->limit, tool->rate_limit,
+                                     tool->rate_burst)) {
+            atomic_fetch_add(&state->refs, 1);
+            dst->tool_state[first + i] = state;
+        } else {
+            dst->tool_state[first + i] = tool_state_create(tool);
+            if (dst->tool_state[first + i] == NULL && tool->rate_limit > 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Gives dst the tools of src, sharing them when they are static. */
+static int carry_tools(catalog_snapshot_t *dst, const catalog_snapshot_t *src)
+{
+    if (!src->static_tools) {
+        return copy_tools(dst, 0, src->n_tools, src->tools, src);
+    }
+    dst->tools = src->tools;
+    for (int i = 0; i < src->n_tools; i++) {
+        dst->tool_state[i] = src->tool_state[i];
+        if (dst->tool_state[i]) {
+            atomic_fetch_add(&dst->tool_state[i]->refs, 1);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Same content as cur, for changes to settings compiled into snapshots.
+ * NULL when it cannot be allocated.
+ */
+static catalog_snapshot_t *snapshot_republish(const catalog_snapshot_t *cur)
+{
+    catalog_snapshot_t *next =
+        snapshot_alloc(cur->n_tools, cur->static_tools, cur->n_resources,
+                       cur->static_resources);
+    if (next != NULL &&
+        (carry_tools(next, cur) != 0 || carry_resources(next, cur) != 0)) {
+        snapshot_free(next);
+        return NULL;
+    }
+    return next;
+}
+
+static void catalog_synchronize(catalog_t *catalog)
+{
+    uint_fast64_t epoch = atomic_fetch_add(&catalog->epoch, 1);
+
+    while (atomic_load(&catalog->readers[epoch & 1]) != 0) {
+        sched_yield();
+    }
+}
+
+/*
+ * Must be called with write_lock held. Takes snapshot, which may be NULL
+ * when it could not be built; returns -1 then or when what is compiled into
+ * it cannot be allocated, leaving the current snapshot published.
+ */
+static int catalog_publish(catalog_t *catalog, catalog_snapshot_t *snapshot)
+{
+    if (snapshot == NULL) {
+        return -1;
+    }
+    snapshot->page_size = catalog->page_size;
+    if (catalog->rbac) {
+        snapshot->rbac       = rbac_retain(catalog->rbac);
+        snapshot->rbac_tools = rbac_compile_tools(
+            catalog->rbac, snapshot->n_tools, snapshot->tools);
+        snapshot->rbac_resources = rbac_compile_resources(
+            catalog->rbac, snapshot->n_resources, snapshot->resources);
+        if (snapshot->rbac_tools == NULL || snapshot->rbac_resources == NULL ||
+            views_alloc(snapshot, catalog->rbac->n_roles + 1) != 0) {
+            snapshot_free(snapshot);
+            return -1;
+        }
+    }
+    snapshot->version = ++catalog->version;
+
+    catalog_snapshot_t *old = atomic_exchange(&catalog->current, snapshot);
+    catalog_synchronize(catalog);
+    catalog_release(old);
+    return 0;
+}
+
+catalog_t *catalog_create(void)
+{
+    catalog_t          *catalog  = mem_calloc(1, sizeof(catalog_t));
+    catalog_snapshot_t *snapshot = snapshot_alloc(0, false, 0, false);
+
+    if (catalog == NULL || snapshot == NULL) {
+        mem_free(catalog);
+        catalog_release(snapshot);
+        return NULL;
+    }
+    atomic_init(&catalog->current, snapshot);
+    atomic_init(&catalog->epoch, 0);
+    atomic_init(&catalog->readers[0], 0);
+    atomic_init(&catalog->readers[1], 0);
+    pthread_mutex_init(&catalog->write_lock, NULL);
+
+    return catalog;
+}
+
+void catalog_destroy(catalog_t *catalog)
+{
+    if (catalog == NULL) {
+        return;
+    }
+    catalog_release(atomic_load(&catalog->current));
+    rbac_release(catalog->rbac);
+    pthread_mutex_destroy(&catalog->write_lock);
+    mem_free(catalog);
+}
+
+catalog_snapshot_t *catalog_acquire(catalog_t *catalog)
+{
+    for (;;) {
+        uint_fast64_t epoch = atomic_load(&catalog->epoch);
+
+        atomic_fetch_add(&catalog->readers[epoch & 1], 1);
+        if (atomic_load(&catalog->epoch) == epoch) {
+            catalog_snapshot_t *snapshot = atomic_load(&catalog->current);
+            atomic_fetch_add(&snapshot->refs, 1);
+            atomic_fetch_sub(&catalog->readers[epoch & 1], 1);
+            return snapshot;
+        }
+        // a writer flipped the epoch under us, retry in the new one
+        atomic_fetch_sub(&catalog->readers[epoch & 1], 1);
+    }
+}
+
+catalog_snapshot_t *catalog_retain(catalog_snapshot_t *snapshot)
+{
+    atomic_fetch_add(&snapshot->refs, 1);
+    return snapshot;
+}
+
+void catalog_release(catalog_snapshot_t *snapshot)
+{
+    if (snapshot && atomic_fetch_sub(&snapshot->refs, 1) == 1) {
+        snapshot_free(snapshot);
+    }
+}
+
+int catalog_set_tools(catalog_t *catalog, int n_tools, const mcp_tool_t *tools)
+{
+    if (n_tools < 0 || (n_tools > 0 && tools == NULL)) {
+        return -1;
+    }
+    for (int i = 0; i < n_tools; i++) {
+        if (tools[i].name == NULL) {
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&catalog->write_lock);
+    catalog_snapshot_t *cur  = atomic_load(&catalog->current);
+    catalog_snapshot_t *next = snapshot_alloc(n_tools, false, cur->n_resources,
+                                              cur->static_resources);
+    if (next && (copy_tools(next, 0, n_tools, tools, cur) != 0 ||
+                 carry_resources(next, cur) != 0)) {
+        catalog_release(next);
+        next = NULL;
+    }
+    int ret = catalog_publish(catalog, next);
+    pthread_mutex_unlock(&catalog->write_lock);
+
+    return ret;
+}
+
+int catalog_set_static_tools(catalog_t *catalog, int n_tools,
+                             const mcp_tool_t *tools)
+{
+    if (n_tools < 0 || (n_tools > 0 && tools == NULL)) {
+        return -1;
+    }
+    for (int i = 0; i < n_tools; i++) {
+        if (tools[i].name == NULL) {
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&catalog->write_lock);
+    catalog_snapshot_t *cur  = atomic_load(&catalog->current);
+    catalog_snapshot_t *next = snapshot_alloc(n_tools, true, cur->n_resources,
+                                              cur->static_resources);
+    for (int i = 0; next && i < n_tools; i++) {
+        next->tool_state[i] = tool_state_create(&tools[i]);
+        if (next->tool_state[i] == NULL && tools[i].rate_limit > 0) {
+            catalog_release(next);
+            next = NULL;
+        }
+    }
+    if (next) {
+        // snapshots never write through tools, the table stays untouched
+        next->tools = (mcp_tool_t *) tools;
+        if (carry_resources(next, cur) != 0) {
+            catalog_release(next);
+            next = NULL;
+        }
+    }
+    int ret = catalog_publish(catalog, next);
+    pthread_mutex_unlock(&catalog->write_lock);
+
+    return ret;
+}
+
+int catalog_add_tool(catalog_t *catalog, const mcp_tool_t *tool)
+{
+    if (tool == NULL || tool->name == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&catalog->write_lock);
+    catalog_snapshot_t *cur = atomic_load(&catalog->current);
+    if (catalog_find_tool(cur, tool->name) != NULL) {
+        pthread_mutex_unlock(&catalog->write_lock);
+        return -2; // tool already registered
+    }
+
+    catalog_snapshot_t *next = snapshot_alloc(
+        cur->n_tools + 1, false, cur->n_resources, cur->static_resources);
+    if (next && (copy_tools(next, 0, cur->n_tools, cur->tools, cur) != 0 ||
+                 copy_tools(next, cur->n_tools, 1, tool, cur) != 0 ||
+                 carry_resources(next, cur) != 0)) {
+        catalog_release(next);
+        next = NULL;
+    }
+    int ret = catalog_publish(catalog, next);
+    pthread_mutex_unlock(&catalog->write_lock);
+
+    return ret;
+}
+
+int catalog_remove_tool(catalog_t *catalog, const char *name)
+{
+    if (name == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&catalog->write_lock);
+    catalog_snapshot_t *cur     = atomic_load(&catalog->current);
+    mcp_tool_t         *removed = catalog_find_tool(cur, name);
+    if (removed == NULL) {
+        pthread_mutex_unlock(&catalog->write_lock);
+        return -2; // no such tool
+    }
+
+    catalog_snapshot_t *next = snapshot_alloc(
+        cur->n_tools - 1, false, cur->n_resources, cur->static_resources);
+    int n = (int) (removed - cur->tools);
+    if (next && (copy_tools(next, 0, n, cur->tools, cur) != 0 ||
+                 copy_tools(next, n, cur->n_tools - n - 1, removed + 1,
+                            cur) != 0 ||
+                 carry_resources(next, cur) != 0)) {
+        catalog_release(next);
+        next = NULL;
+    }
+    int ret = catalog_publish(catalog, next);
+    pthread_mutex_unlock(&catalog->write_lock);
+
+    return ret;
+}
+
+int catalog_set_resources(catalog_t *catalog, int n_resources,
+                          const mcp_resource_t *resources)
+{
+    if (n_resources < 0 || (n_resources > 0 && resources == NULL)) {
+        return -1;
+    }
+    for (int i = 0; i < n_resources; i++) {
+        if (resources[i].uri == NULL || resources[i].name == NULL) {
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&catalog->write_lock);
+    catalog_snapshot_t *cur  = atomic_load(&catalog->current);
+    catalog_snapshot_t *next = snapshot_alloc(cur->n_tools, cur->static_tools,
+                                              n_resources, false);
+    int ret = next ? carry_tools(next, cur) : -1;
+    for (int i = 0; ret == 0 && i < n_resources; i++) {
+        ret = resource_copy(&next->resources[i], &resources[i]);
+    }
+    if (next && ret != 0) {
+        catalog_release(next);
+        next = NULL;
+    }
+    ret = catalog_publish(catalog, next);
+    pthread_mutex_unlock(&catalog->write_lock);
+
+    return ret;
+}
+
+int catalog_set_static_resources(catalog_t *catalog, int n_resources,
+                                 const mcp_resource_t *resources)
+{
+    if (n_resources < 0 || (n_resources > 0 && resources == NULL)) {
+        return -1;
+    }
+    for (int i = 0; i < n_resources; i++) {
+        if (resources[i].uri == NULL || resources[i].name == NULL) {
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&catalog->write_lock);
+    catalog_snapshot_t *cur  = atomic_load(&catalog->current);
+    catalog_snapshot_t *next = snapshot_alloc(cur->n_tools, cur->static_tools,
+                                              n_resources, true);
+    if (next && carry_tools(next, cur) != 0) {
+        catalog_release(next);
+        next = NULL;
+    }
+    if (next) {
+        next->resources = (mcp_resource_t *) resources;
+    }
+    int ret = catalog_publish(catalog, next);
+    pthread_mutex_unlock(&catalog->write_lock);
+
+    return ret;
+}
+
+int catalog_set_rbac(catalog_t *catalog, rbac_t *rbac)
+{
+    pthread_mutex_lock(&catalog->write_lock);
+    rbac_t *old   = catalog->rbac;
+    catalog->rbac = rbac_retain(rbac);
+
+    catalog_snapshot_t *cur = atomic_load(&catalog->current);
+    int ret = catalog_publish(catalog, snapshot_republish(cur));
+    if (ret != 0) {
+        rbac_release(catalog->rbac); // the published snapshot still uses old
+        catalog->rbac = old;
+    } else {
+        rbac_release(old);
+    }
+    pthread_mutex_unlock(&catalog->write_lock);
+
+    return ret;
+}
+
+int catalog_set_page_size(catalog_t *catalog, int page_size)
+{
+    if (page_size < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&catalog->write_lock);
+    int old            = catalog->page_size;
+    catalog->page_size = page_size;
+
+    catalog_snapshot_t *cur = atomic_load(&catalog->current);
+    int ret = catalog_publish(catalog, snapshot_republish(cur));
+    if (ret != 0) {
+        catalog->page_size = old;
+    }
+    pthread_mutex_unlock(&catalog->write_lock);
+
+    return ret;
+}
+
+static int list_length(const catalog_snapshot_t *snapshot, catalog_list_e list)
+{
+    return list == CATALOG_TOOLS ? snapshot->n_tools : snapshot->n_resources;
+}
+
+static const char *list_key(const catalog_snapshot_t *snapshot,
+                            catalog_list_e list, int index)
+{
+    return list == CATALOG_TOOLS ? snapshot->tools[index].name
+                                 : snapshot->resources[index].uri;
+}
+
+static bool list_visible(const catalog_snapshot_t *snapshot,
+                         catalog_list_e list, int role, int index)
+{
+    if (list == CATALOG_TOOLS) {
+        return catalog_tool_allowed(snapshot, role, &snapshot->tools[index]);
+    }
+    return catalog_resource_allowed(snapshot, role,
+                                    &snapshot->resources[index]);
+}
+
+/* The first entry at or after index the role may see, or the list length. */
+static int list_next_visible(const catalog_snapshot_t *snapshot,
+                             catalog_list_e list, int role, int index)
+{
+    int n = list_length(snapshot, list);
+
+    while (index < n && !list_visible(snapshot, list, role, index)) {
+        index++;
+    }
+    return index;
+}
+
+/*
+ * Serializes up to n entries the role may see, starting at index first.
+ * *next is set to the next entry it may see after them, or the list length.
+ */
+static char *list_items(const catalog_snapshot_t *snapshot,
+                        catalog_list_e list, int role, int first, int n,
+                        int *next)
+{
+    int len = list_length(snapshot, list);
+
+    if (snapshot->rbac == NULL) {
+        // every entry is visible, serialize the range in place
+        n     = len - first < n ? len - first : n;
+        *next = first + n;
+        if (list == CATALOG_TOOLS) {
+            return jsonrpc_tool_list_items(n, snapshot->tools + first);
+        }
+        return jsonrpc_resource_list_items(n, snapshot->resources + first);
+    }
+
+    size_t entry = list == CATALOG_TOOLS ? sizeof(mcp_tool_t)
+                                         : sizeof(mcp_resource_t);
+    char  *subset = mem_alloc(entry * (n > 0 ? n : 1));
+    int    count  = 0;
+    int    i      = first;
+    if (subset == NULL) {
+        return NULL;
+    }
+    for (; i < len && count < n; i++) {
+        if (list_visible(snapshot, list, role, i)) {
+            const char *src = list == CATALOG_TOOLS
+                                  ? (const char *) &snapshot->tools[i]
+                                  : (const char *) &snapshot->resources[i];
+            memcpy(subset + count * entry, src, entry); // shallow, not owned
+            count++;
+        }
+    }
+    *next = list_next_visible(snapshot, list, role, i);
+
+    char *items = list == CATALOG_TOOLS
+                      ? jsonrpc_tool_list_items(count, (mcp_tool_t *) subset)
+                      : jsonrpc_resource_list_items(
+                            count, (mcp_resource_t *) subset);
+    mem_free(subset);
+    return items;
+}
+
+static uint64_t key_hash(const char *key)
+{
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+
+    for (const char *p = key; *p; p++) {
+        hash = (hash ^ (unsigned char) *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* NULL when the memory pools cannot take the index. */
+static catalog_index_t *index_build(const catalog_snapshot_t *snapshot,
+                                    catalog_list_e            list)
+{
+    catalog_index_t *index = mem_calloc(1, sizeof(catalog_index_t));
+    int              n     = list_length(snapshot, list);
+    int              size  = 1;
+
+    if (index == NULL) {
+        return NULL;
+    }
+    while (size < 2 * n) {
+        size <<= 1;
+    }
+    index->mask  = size - 1;
+    index->slots = mem_calloc(size, sizeof(int));
+    if (index->slots == NULL) {
+        mem_free(index);
+        return NULL;
+    }
+    for (int i = 0; i < n; i++) {
+        uint64_t slot = key_hash(list_key(snapshot, list, i)) & index->mask;
+        while (index->slots[slot] != 0) {
+            slot = (slot + 1) & index->mask;
+        }
+        index->slots[slot] = i + 1;
+    }
+    return index;
+}
+
+/*
+ * Looks key up through the index built the first time the list is searched,
+ * or by a scan while the memory pools cannot take the index.
+ */
+static int list_index(const catalog_snapshot_t *snapshot, catalog_list_e list,
+                      const char *key)
+{
+    // the lazily built index is the only part of a snapshot that changes
+    _Atomic(catalog_index_t *) *cache =
+        &((catalog_snapshot_t *) snapshot)->index[list];
+
+    catalog_index_t *index = atomic_load(cache);
+    if (index == NULL) {
+        // racing readers may both build, the loser frees its copy
+        catalog_index_t *built = index_build(snapshot, list);
+        if (built == NULL) {
+            for (int i = 0; i < list_length(snapshot, list); i++) {
+                if (strcmp(list_key(snapshot, list, i), key) == 0) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+        if (atomic_compare_exchange_strong(cache, &index, built)) {
+            index = built;
+        } else {
+            index_free(built);
+        }
+    }
+
+    uint64_t slot = key_hash(key) & index->mask;
+    while (index->slots[slot] != 0) {
+        int i = index->slots[slot] - 1;
+        if (strcmp(list_key(snapshot, list, i), key) == 0) {
+            return i;
+        }
+        slot = (slot + 1) & index->mask;
+    }
+    return -1;
+}
+
+/* Cursors are "<version>:<offset>:<key>" hex encoded to keep them opaque. */
+static char *cursor_encode(const catalog_snapshot_t *snapshot,
+                           catalog_list_e list, int index)
+{
+    const char *key = list_key(snapshot, list, index);
+    char        plain[64];
+    int         n   = snprintf(plain, sizeof(plain), "%" PRIu64 ":%d:",
+                               snapshot->version, index);
+    size_t      len = strlen(key);
+    char       *cursor = mem_alloc(2 * (n + len) + 1);
+    char       *p      = cursor;
+
+    if (cursor == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < n; i++, p += 2) {
+        sprintf(p, "%02x", (unsigned char) plain[i]);
+    }
+    for (size_t i = 0; i < len; i++, p += 2) {
+        sprintf(p, "%02x", (unsigned char) key[i]);
+    }
+    *p = '\0';
+    return cursor;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/* Decodes a cursor in place, *key points into it afterwards. */
+static int cursor_decode(char *cursor, uint64_t *version, int *index,
+                         const char **key)
+{
+    size_t len = strlen(cursor);
+    if (len == 0 || len % 2 != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < len / 2; i++) {
+        int hi = hex_digit(cursor[2 * i]);
+        int lo = hex_digit(cursor[2 * i + 1]);
+        if (hi < 0 || lo < 0 || (hi == 0 && lo == 0)) {
+            return -1;
+        }
+        cursor[i] = (char) (hi << 4 | lo);
+    }
+    cursor[len / 2] = '\0';
+
+    char *end;
+    *version = strtoull(cursor, &end, 10);
+    if (end == cursor || *end != ':') {
+        return -1;
+    }
+    char *start = end + 1;
+    long  n     = strtol(start, &end, 10);
+    if (end == start || *end != ':' || n <= 0 || n > INT32_MAX) {
+        return -1;
+    }
+    *index = (int) n;
+    *key   = end + 1;
+    return 0;
+}
+
+static int page_size(const catalog_snapshot_t *snapshot, catalog_list_e list)
+{
+    int n = list_length(snapshot, list);
+
+    return snapshot->page_size > 0 ? snapshot->page_size : n;
+}
+
+/* NULL when the memory pools cannot take every page. */
+static catalog_pages_t *pages_build(const catalog_snapshot_t *snapshot,
+                                    catalog_list_e list, int role)
+{
+    catalog_pages_t *pages = mem_calloc(1, sizeof(catalog_pages_t));
+    int              n     = list_length(snapshot, list);
+    int              size  = page_size(snapshot, list);
+    int              max   = n > 0 ? (n + size - 1) / size : 1;
+    int              first = list_next_visible(snapshot, list, role, 0);
+
+    if (pages == NULL) {
+        return NULL;
+    }
+    pages->starts  = mem_calloc(max, sizeof(int));
+    pages->items   = mem_calloc(max, sizeof(char *));
+    pages->cursors = mem_calloc(max, sizeof(char *));
+    if (pages->starts == NULL || pages->items == NULL ||
+        pages->cursors == NULL) {
+        pages_free(pages);
+        return NULL;
+    }
+    do { // "[]" when nothing is visible
+        int i            = pages->n_pages++;
+        pages->starts[i] = first;
+        pages->items[i] =
+            list_items(snapshot, list, role, first, size, &first);
+        if (i > 0) {
+            pages->cursors[i] = cursor_encode(snapshot, list, pages->starts[i]);
+        }
+        if (pages->items[i] == NULL || (i > 0 && pages->cursors[i] == NULL)) {
+            pages_free(pages);
+            return NULL;
+        }
+    } while (first < n);
+    return pages;
+}
+
+/*
+ * Sessions without a role share the first view with the roleless catalog.
+ * NULL when the memory pools cannot take the pages, nothing is cached then.
+ */
+static catalog_pages_t *snapshot_pages(catalog_snapshot_t *snapshot,
+                                       catalog_list_e list, int role)
+{
+    if (snapshot->pages[list] == NULL) {
+        return NULL;
+    }
+
+    _Atomic(catalog_pages_t *) *slot =
+        &snapshot->pages[list][snapshot->rbac ? role + 1 : 0];
+
+    catalog_pages_t *pages = atomic_load(slot);
+    if (pages) {
+        return pages;
+    }
+
+    // racing readers may both build, the loser frees its copy
+    catalog_pages_t *built    = pages_build(snapshot, list, role);
+    catalog_pages_t *expected = NULL;
+    if (built == NULL) {
+        return NULL;
+    }
+    if (atomic_compare_exchange_strong(slot, &expected, built)) {
+        return built;
+    }
+    pages_free(built);
+    return expected;
+}
+
+/* The page starting at index, or -1 when index falls inside one. */
+static int page_at(const catalog_pages_t *pages, int index)
+{
+    int lo = 0;
+    int hi = pages->n_pages;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (pages->starts[mid] < index) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < pages->n_pages && pages->starts[lo] == index ? lo : -1;
+}
+
+int catalog_list_page(catalog_snapshot_t *snapshot, catalog_list_e list,
+                      int role, const char *cursor, catalog_page_t *page)
+{
+    catalog_pages_t *pages = snapshot_pages(snapshot, list, role);
+    int              n     = list_length(snapshot, list);
+
+    memset(page, 0, sizeof(catalog_page_t));
+    if (pages == NULL) {
+        return -2;
+    }
+    if (cursor == NULL) {
+        page->items       = pages->items[0];
+        page->next_cursor = pages->n_pages > 1 ? mem_strdup(pages->cursors[1])
+                                               : NULL;
+        return pages->n_pages > 1 && page->next_cursor == NULL ? -2 : 0;
+    }
+
+    char       *plain = mem_strdup(cursor);
+    uint64_t    version;
+    int         index;
+    const char *key;
+    if (plain == NULL) {
+        return -2;
+    }
+    if (cursor_decode(plain, &version, &index, &key) != 0) {
+        mem_free(plain);
+        return -1;
+    }
+    if (version != snapshot->version) {
+        // the catalog changed since, resume at the entry the cursor names
+        int found = list_index(snapshot, list, key);
+        if (found >= 0) {
+            index = found;
+        }
+    }
+    mem_free(plain);
+
+    index = list_next_visible(snapshot, list, role, index);
+    int i = index < n ? page_at(pages, index) : -1;
+    bool more = false;
+    if (index >= n) {
+        page->items = "[]";
+    } else if (i >= 0) {
+        more              = i + 1 < pages->n_pages;
+        page->items       = pages->items[i];
+        page->next_cursor = more ? mem_strdup(pages->cursors[i + 1]) : NULL;
+    } else {
+        int next  = n;
+        page->buf = list_items(snapshot, list, role, index,
+                               page_size(snapshot, list), &next);
+        more              = next < n;
+        page->items       = page->buf;
+        page->next_cursor = more ? cursor_encode(snapshot, list, next) : NULL;
+    }
+    if (page->items == NULL || (more && page->next_cursor == NULL)) {
+        catalog_page_free(page);
+        memset(page, 0, sizeof(catalog_page_t));
+        return -2;
+    }
+    return 0;
+}
+
+void catalog_page_free(catalog_page_t *page)
+{
+    mem_free(page->next_cursor);
+    mem_free(page->buf);
+}
+
+mcp_tool_t *catalog_find_tool(const catalog_snapshot_t *snapshot,
+                              const char               *name)
+{
+    int i = list_index(snapshot, CATALOG_TOOLS, name);
+    return i >= 0 ? &snapshot->tools[i] : NULL;
+}
+
+catalog_tool_state_t *catalog_tool_state(const catalog_snapshot_t *snapshot,
+                                         const mcp_tool_t         *tool)
+{
+    return snapshot->tool_state[tool - snapshot->tools];
+}
+
+mcp_resource_t *catalog_find_resource(const catalog_snapshot_t *snapshot,
+                                      const char               *uri)
+{
+    int i = list_index(snapshot, CATALOG_RESOURCES, uri);
+    return i >= 0 ? &snapshot->resources[i] : NULL;
+}
+
+bool catalog_tool_allowed(const catalog_snapshot_t *snapshot, int role,
+                          const mcp_tool_t *tool)
+{
+    if (snapshot->rbac == NULL) {
+        return true;
+    }
+    return role >= 0 && rbac_test(snapshot->rbac_tools, snapshot->n_tools,
+                                  role, (int) (tool - snapshot->tools));
+}
+
+bool catalog_resource_allowed(const catalog_snapshot_t *snapshot, int role,
+                              const mcp_resource_t *resource)
+{
+    if (snapshot->rbac == NULL) {
+        return true;
+    }
+    return role >= 0 &&
+           rbac_test(snapshot->rbac_resources, snapshot->n_resources, role,
+                     (int) (resource - snapshot->resources));
+}
@@ -0,0 +1,115 @@
+#ifndef MCP_CATALOG_H
+#define MCP_CATALOG_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "mcp.h"
+#include "rate_limit.h"
+#include "rbac.h"
+
+/*
+ * Runtime state of a tool that outlives catalog updates: snapshots share it
+ * for as long as the tool stays registered with the same configuration.
+ */
+typedef struct catalog_tool_state {
+    atomic_int   refs;
+    rate_limit_t limit;
+} catalog_tool_state_t;
+
+typedef enum {
+    CATALOG_TOOLS = 0,
+    CATALOG_RESOURCES,
+    CATALOG_LISTS,
+} catalog_list_e;
+
+typedef struct catalog_index catalog_index_t;
+typedef struct catalog_pages catalog_pages_t;
+
+/* One page of a list, items is a serialized JSON array. */
+typedef struct {
+    const char *items;
+    char       *next_cursor; // NULL on the last page
+    char       *buf;         // backs items when built on demand
+} catalog_page_t;
+
+/*
+ * Immutable view of the registered tools and resources. A snapshot is never
+ * modified after it is published, so readers may use it without locking for
+ * as long as they hold a reference.
+ */
+typedef struct catalog_snapshot {
+    atomic_int refs;
+    uint64_t   version;
+
+    int                    n_tools;
+    bool                   static_tools; // tools belongs to the application
+    mcp_tool_t            *tools;
+    catalog_tool_state_t **tool_state;   // NULL entries for unlimited tools
+
+    int             n_resources;
+    bool            static_resources;
+    mcp_resource_t *resources;
+
+    rbac_t   *rbac; // NULL when no roles are registered
+    uint64_t *rbac_tools;
+    uint64_t *rbac_resources;
+
+    int                         page_size; // 0 lists everything at once
+    int                         n_views;   // 1, or each role plus no role
+    _Atomic(catalog_pages_t *) *pages[CATALOG_LISTS]; // per view, lazily
+    _Atomic(catalog_index_t *)  index[CATALOG_LISTS]; // built on first use
+} catalog_snapshot_t;
+
+typedef struct catalog catalog_t;
+
+catalog_t *catalog_create(void);
+void       catalog_destroy(catalog_t *catalog);
+
+catalog_snapshot_t *catalog_acquire(catalog_t *catalog);
+catalog_snapshot_t *catalog_retain(catalog_snapshot_t *snapshot);
+void                catalog_release(catalog_snapshot_t *snapshot);
+
+/*
+ * Each change publishes a new snapshot. -1 for bad arguments or when the
+ * memory pools cannot take the snapshot, which leaves the current one as it
+ * was; catalog_add_tool and catalog_remove_tool return -2 for a name that
+ * is taken or unknown.
+ */
+int catalog_set_tools(catalog_t *catalog, int n_tools, const mcp_tool_t *tools);
+int catalog_set_static_tools(catalog_t *catalog, int n_tools,
+                             const mcp_tool_t *tools);
+int catalog_add_tool(catalog_t *catalog, const mcp_tool_t *tool);
+int catalog_remove_tool(catalog_t *catalog, const char *name);
+int catalog_set_resources(catalog_t *catalog, int n_resources,
+                          const mcp_resource_t *resources);
+int catalog_set_static_resources(catalog_t *catalog, int n_resources,
+                                 const mcp_resource_t *resources);
+int catalog_set_rbac(catalog_t *catalog, rbac_t *rbac);
+int catalog_set_page_size(catalog_t *catalog, int page_size);
+
+mcp_tool_t     *catalog_find_tool(const catalog_snapshot_t *snapshot,
+                                  const char               *name);
+catalog_tool_state_t *catalog_tool_state(const catalog_snapshot_t *snapshot,
+                                         const mcp_tool_t         *tool);
+mcp_resource_t       *catalog_find_resource(const catalog_snapshot_t *snapshot,
+                                            const char               *uri);
+
+/*
+ * Looks up the page a list request's cursor (NULL for the first page) points
+ * at, holding only the entries role may see. Cursors name the version,
+ * offset and first entry of their page, so a cursor handed out before a
+ * catalog update resumes at the same entry. Returns -1 for a cursor this
+ * catalog never issued and -2 when the memory pools cannot take the page.
+ */
+int  catalog_list_page(catalog_snapshot_t *snapshot, catalog_list_e list,
+                       int role, const char *cursor, catalog_page_t *page);
+void catalog_page_free(catalog_page_t *page);
+
+/* role is an index into snapshot->rbac, or -1 for a session without one. */
+bool catalog_tool_allowed(const catalog_snapshot_t *snapshot, int role,
+                          const mcp_tool_t *tool);
+bool catalog_resource_allowed(const catalog_snapshot_t *snapshot, int role,
+                              const mcp_resource_t *resource);
+
+#endif
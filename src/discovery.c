@@ -0,0 +1,354 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "discovery.h"
+#include "mem.h"
+
+typedef struct discovery_server {
+    char  *server_id;
+    char  *server_name;
+    char  *description;
+    int    n_roles;
+    char **roles;
+    int    n_tools;
+    char **tools; // NULL until a session listed them
+
+    struct discovery_server *next;
+} discovery_server_t;
+
+typedef struct tool_ref {
+    const char         *name; // one of server->tools
+    discovery_server_t *server;
+
+    struct tool_ref *next;
+} tool_ref_t;
+
+struct discovery {
+    pthread_rwlock_t lock;
+
+    int                  n_buckets;
+    int                  n_servers;
+    discovery_server_t **servers; // by name
+
+    int          n_tool_buckets;
+    int          n_tools;
+    tool_ref_t **tools; // by tool name
+};
+
+static uint64_t name_hash(const char *name)
+{
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+
+    for (const char *p = name; *p; p++) {
+        hash = (hash ^ (unsigned char) *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static discovery_server_t **server_slot(discovery_t *discovery,
+                                        const char  *server_name,
+                                        const char  *server_id)
+{
+    discovery_server_t **slot =
+        &discovery->servers[name_hash(server_name) &
+                            (discovery->n_buckets - 1)];
+
+    while (*slot) {
+        if (strcmp((*slot)->server_name, server_name) == 0 &&
+            (server_id == NULL || strcmp((*slot)->server_id, server_id) == 0)) {
+            break;
+        }
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+static void servers_grow(discovery_t *discovery)
+{
+    int                  n_buckets = discovery->n_buckets * 2;
+    discovery_server_t **buckets =
+        mem_calloc(n_buckets, sizeof(discovery_server_t *));
+
+    if (buckets == NULL) {
+        return; // longer chains, every server is still found
+    }
+    for (int i = 0; i < discovery->n_buckets; i++) {
+        discovery_server_t *server = discovery->servers[i];
+        while (server) {
+            discovery_server_t  *next = server->next;
+            discovery_server_t **slot =
+                &buckets[name_hash(server->server_name) & (n_buckets - 1)];
+            server->next = *slot;
+            *slot        = server;
+            server       = next;
+        }
+    }
+    mem_free(discovery->servers);
+    discovery->servers   = buckets;
+    discovery->n_buckets = n_buckets;
+}
+
+static void tools_grow(discovery_t *discovery)
+{
+    int          n_buckets = discovery->n_tool_buckets * 2;
+    tool_ref_t **buckets   = mem_calloc(n_buckets, sizeof(tool_ref_t *));
+
+    if (buckets == NULL) {
+        return;
+    }
+    for (int i = 0; i < discovery->n_tool_buckets; i++) {
+        tool_ref_t *ref = discovery->tools[i];
+        while (ref) {
+            tool_ref_t  *next = ref->next;
+            tool_ref_t **slot =
+                &buckets[name_hash(ref->name) & (n_buckets - 1)];
+            ref->next = *slot;
+            *slot     = ref;
+            ref       = next;
+        }
+    }
+    mem_free(discovery->tools);
+    discovery->tools          = buckets;
+    discovery->n_tool_buckets = n_buckets;
+}
+
+static void tools_index(discovery_t *discovery, discovery_server_t *server)
+{
+    for (int i = 0; i < server->n_tools; i++) {
+        if (discovery->n_tools >= discovery->n_tool_buckets) {
+            tools_grow(discovery);
+        }
+
+        tool_ref_t *ref = mem_calloc(1, sizeof(tool_ref_t));
+        if (ref == NULL) {
+            continue; // not found by name, tools_unindex passes it over
+        }
+        tool_ref_t **slot = &discovery->tools[name_hash(server->tools[i]) &
+                                              (discovery->n_tool_buckets - 1)];
+        ref->name   = server->tools[i];
+        ref->server = server;
+        ref->next   = *slot;
+        *slot       = ref;
+        discovery->n_tools++;
+    }
+}
+
+static void tools_unindex(discovery_t *discovery, discovery_server_t *server)
+{
+    for (int i = 0; i < server->n_tools; i++) {
+        tool_ref_t **slot = &discovery->tools[name_hash(server->tools[i]) &
+                                              (discovery->n_tool_buckets - 1)];
+        while (*slot && (*slot)->name != server->tools[i]) {
+            slot = &(*slot)->next;
+        }
+        if (*slot) {
+            tool_ref_t *ref = *slot;
+            *slot           = ref->next;
+            mem_free(ref);
+            discovery->n_tools--;
+        }
+    }
+}
+
+static void strings_free(int n, char **strings)
+{
+    for (int i = 0; i < n; i++) {
+        mem_free(strings[i]);
+    }
+    mem_free(strings);
+}
+
+static void server_free(discovery_server_t *server)
+{
+    mem_free(server->server_id);
+    mem_free(server->server_name);
+    mem_free(server->description);
+    strings_free(server->n_roles, server->roles);
+    strings_free(server->n_tools, server->tools);
+    mem_free(server);
+}
+
+discovery_t *discovery_create(void)
+{
+    discovery_t *discovery = mem_calloc(1, sizeof(discovery_t));
+    if (discovery == NULL) {
+        return NULL;
+    }
+
+    discovery->n_buckets      = 16;
+    discovery->servers        = mem_calloc(discovery->n_buckets,
+                                           sizeof(discovery_server_t *));
+    discovery->n_tool_buckets = 64;
+    discovery->tools =
+        mem_calloc(discovery->n_tool_buckets, sizeof(tool_ref_t *));
+    if (discovery->servers == NULL || discovery->tools == NULL) {
+        mem_free(discovery->servers);
+        mem_free(discovery->tools);
+        mem_free(discovery);
+        return NULL;
+    }
+    pthread_rwlock_init(&discovery->lock, NULL);
+    return discovery;
+}
+
+void discovery_destroy(discovery_t *discovery)
+{
+    if (discovery == NULL) {
+        return;
+    }
+    for (int i = 0; i < discovery->n_tool_buckets; i++) {
+        tool_ref_t *ref = discovery->tools[i];
+        while (ref) {
+            tool_ref_t *next = ref->next;
+            mem_free(ref);
+            ref = next;
+        }
+    }
+    for (int i = 0; i < discovery->n_buckets; i++) {
+        discovery_server_t *server = discovery->servers[i];
+        while (server) {
+            discovery_server_t *next = server->next;
+            server_free(server);
+            server = next;
+        }
+    }
+    mem_free(discovery->tools);
+    mem_free(discovery->servers);
+    pthread_rwlock_destroy(&discovery->lock);
+    mem_free(discovery);
+}
+
+bool discovery_online(discovery_t *discovery, const mcp_server_info_t *server)
+{
+    bool created = false;
+
+    pthread_rwlock_wrlock(&discovery->lock);
+    discovery_server_t **slot =
+        server_slot(discovery, server->server_name, server->server_id);
+    if (*slot == NULL) {
+        if (discovery->n_servers >= discovery->n_buckets) {
+            servers_grow(discovery);
+            slot = server_slot(discovery, server->server_name,
+                               server->server_id);
+        }
+        discovery_server_t *entry = mem_calloc(1, sizeof(discovery_server_t));
+        if (entry == NULL) {
+            pthread_rwlock_unlock(&discovery->lock);
+            return false; // left unknown, as if its presence was lost
+        }
+        entry->server_id   = mem_strdup(server->server_id);
+        entry->server_name = mem_strdup(server->server_name);
+        if (entry->server_id == NULL || entry->server_name == NULL) {
+            server_free(entry);
+            pthread_rwlock_unlock(&discovery->lock);
+            return false;
+        }
+        *slot = entry;
+        discovery->n_servers++;
+        created = true;
+    }
+
+    // what does not fit is left out, the server stays known by name
+    discovery_server_t *entry = *slot;
+    mem_free(entry->description);
+    strings_free(entry->n_roles, entry->roles);
+    entry->description = server->description ? mem_strdup(server->description)
+                                             : NULL;
+    entry->n_roles     = 0;
+    entry->roles       = mem_calloc(server->n_roles, sizeof(char *));
+    for (int i = 0; entry->roles && i < server->n_roles; i++) {
+        char *role = mem_strdup(server->roles[i]);
+        if (role != NULL) {
+            entry->roles[entry->n_roles++] = role;
+        }
+    }
+    pthread_rwlock_unlock(&discovery->lock);
+
+    return created;
+}
+
+bool discovery_offline(discovery_t *discovery, const char *server_id,
+                       const char *server_name)
+{
+    pthread_rwlock_wrlock(&discovery->lock);
+    discovery_server_t **slot =
+        server_slot(discovery, server_name, server_id);
+    discovery_server_t *server = *slot;
+    if (server) {
+        *slot = server->next;
+        tools_unindex(discovery, server);
+        server_free(server);
+        discovery->n_servers--;
+    }
+    pthread_rwlock_unlock(&discovery->lock);
+
+    return server != NULL;
+}
+
+void discovery_set_tools(discovery_t *discovery, const char *server_id,
+                         const char *server_name, int n_tools, char **tools)
+{
+    pthread_rwlock_wrlock(&discovery->lock);
+    discovery_server_t *server =
+        *server_slot(discovery, server_name, server_id);
+    if (server == NULL) {
+        // went offline while its tools were listed
+        pthread_rwlock_unlock(&discovery->lock);
+        strings_free(n_tools, tools);
+        return;
+    }
+
+    tools_unindex(discovery, server);
+    strings_free(server->n_tools, server->tools);
+    server->n_tools = n_tools;
+    server->tools   = tools;
+    tools_index(discovery, server);
+    pthread_rwlock_unlock(&discovery->lock);
+}
+
+static int copy_string(char *buf, size_t size, const char *s)
+{
+    size_t len = strlen(s);
+
+    if (len >= size) {
+        return -1;
+    }
+    memcpy(buf, s, len + 1);
+    return 0;
+}
+
+int discovery_find_server(discovery_t *discovery, const char *server_name,
+                          const char *server_id, char *found, size_t size)
+{
+    int ret = -1;
+
+    pthread_rwlock_rdlock(&discovery->lock);
+    discovery_server_t *server =
+        *server_slot(discovery, server_name, server_id);
+    if (server) {
+        ret = copy_string(found, size, server->server_id);
+    }
+    pthread_rwlock_unlock(&discovery->lock);
+    return ret;
+}
+
+int discovery_find_tool(discovery_t *discovery, const char *tool_name,
+                        char *server_id, size_t id_size, char *server_name,
+                        size_t name_size)
+{
+    int ret = -1;
+
+    pthread_rwlock_rdlock(&discovery->lock);
+    tool_ref_t *ref = discovery->tools[name_hash(tool_name) &
+                                       (discovery->n_tool_buckets - 1)];
+    while (ref && strcmp(ref->name, tool_name) != 0) {
+        ref = ref->next;
+    }
+    if (ref && copy_string(server_id, id_size, ref->server->server_id) == 0) {
+        ret = copy_string(server_name, name_size, ref->server->server_name);
+    }
+    pthread_rwlock_unlock(&discovery->lock);
+    return ret;
+}
@@ -0,0 +1,40 @@
+#ifndef MCP_DISCOVERY_H
+#define MCP_DISCOVERY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "mcp_client.h"
+
+/*
+ * Registry of the live servers a client learned about from their presence
+ * messages, indexed by server name and by the names of the tools they
+ * listed. Updates come from the MQTT callback thread while any thread may
+ * look up, so the registry sits behind a reader-writer lock.
+ */
+typedef struct discovery discovery_t;
+
+discovery_t *discovery_create(void);
+void         discovery_destroy(discovery_t *discovery);
+
+/* Records or updates a server, returns true when it was not known. */
+bool discovery_online(discovery_t *discovery, const mcp_server_info_t *server);
+/* Forgets a server with its tools, returns true when it was known. */
+bool discovery_offline(discovery_t *discovery, const char *server_id,
+                       const char *server_name);
+/* Replaces the tools of a known server, taking ownership of tools. */
+void discovery_set_tools(discovery_t *discovery, const char *server_id,
+                         const char *server_name, int n_tools, char **tools);
+
+/*
+ * Copy the id (and name) of a matching server into the buffers, returning -1
+ * when none is known or a buffer is too small. A NULL server_id matches any
+ * server called server_name.
+ */
+int discovery_find_server(discovery_t *discovery, const char *server_name,
+                          const char *server_id, char *found, size_t size);
+int discovery_find_tool(discovery_t *discovery, const char *tool_name,
+                        char *server_id, size_t id_size, char *server_name,
+                        size_t name_size);
+
+#endif
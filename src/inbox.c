@@ -0,0 +1,112 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "inbox.h"
+#include "mem.h"
+
+struct inbox {
+    pthread_mutex_t lock;
+    inbox_event_t  *head;
+    inbox_event_t  *tail;
+    int             fds[2]; // read, write
+};
+
+inbox_t *inbox_create(void)
+{
+    inbox_t *inbox = mem_calloc(1, sizeof(inbox_t));
+
+    if (inbox == NULL) {
+        return NULL;
+    }
+    if (pipe(inbox->fds) != 0) {
+        printf("Failed to create the event pipe\n");
+        mem_free(inbox);
+        return NULL;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(inbox->fds[i], F_SETFL, O_NONBLOCK);
+        fcntl(inbox->fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    pthread_mutex_init(&inbox->lock, NULL);
+    return inbox;
+}
+
+void inbox_destroy(inbox_t *inbox)
+{
+    if (inbox == NULL) {
+        return;
+    }
+    inbox_event_t *event = inbox_take(inbox);
+    while (event) {
+        inbox_event_t *next = event->next;
+        inbox_event_free(event);
+        event = next;
+    }
+    close(inbox->fds[0]);
+    close(inbox->fds[1]);
+    pthread_mutex_destroy(&inbox->lock);
+    mem_free(inbox);
+}
+
+int inbox_fd(inbox_t *inbox)
+{
+    return inbox->fds[0];
+}
+
+void inbox_post(inbox_t *inbox, inbox_event_t *event)
+{
+    event->next = NULL;
+
+    pthread_mutex_lock(&inbox->lock);
+    bool wake = inbox->head == NULL;
+    if (inbox->tail) {
+        inbox->tail->next = event;
+    } else {
+        inbox->head = event;
+    }
+    inbox->tail = event;
+    // one byte while events wait, taking them empties the pipe again
+    if (wake) {
+        char byte = 1;
+        if (write(inbox->fds[1], &byte, 1) < 0) {
+            printf("Failed to wake the event loop\n");
+        }
+    }
+    pthread_mutex_unlock(&inbox->lock);
+}
+
+inbox_event_t *inbox_take(inbox_t *inbox)
+{
+    char buf[16];
+
+    pthread_mutex_lock(&inbox->lock);
+    inbox_event_t *events = inbox->head;
+    inbox->head           = NULL;
+    inbox->tail           = NULL;
+    while (read(inbox->fds[0], buf, sizeof(buf)) > 0) {
+    }
+    pthread_mutex_unlock(&inbox->lock);
+    return events;
+}
+
+bool inbox_empty(inbox_t *inbox)
+{
+    pthread_mutex_lock(&inbox->lock);
+    bool empty = inbox->head == NULL;
+    pthread_mutex_unlock(&inbox->lock);
+    return empty;
+}
+
+void inbox_event_free(inbox_event_t *event)
+{
+    if (event->message) {
+        MQTTAsync_freeMessage(&event->message);
+    }
+    if (event->topic) {
+        MQTTAsync_free(event->topic);
+    }
+    mem_free(event);
+}
@@ -0,0 +1,43 @@
+#ifndef MCP_INBOX_H
+#define MCP_INBOX_H
+
+#include <stdbool.h>
+
+#include <MQTTAsync.h>
+
+typedef enum {
+    INBOX_MESSAGE = 0,
+    INBOX_CONNECTED,
+    INBOX_CONNECTION_LOST,
+    INBOX_CONNECT_FAILED,
+} inbox_kind_e;
+
+/* What a paho callback saw, to be handled later on another thread. */
+typedef struct inbox_event {
+    struct inbox_event *next;
+    inbox_kind_e        kind;
+    void               *ctx;
+    char               *topic; // messages, owned as paho hands them over
+    int                 topic_len;
+    MQTTAsync_message  *message;
+    int                 code; // session present, or the failure code
+} inbox_event_t;
+
+/*
+ * Events posted by the MQTT threads in order, and a pipe that is readable
+ * while any are waiting, for the thread taking them to poll.
+ */
+typedef struct inbox inbox_t;
+
+inbox_t *inbox_create(void);
+/* Frees the events never taken. */
+void inbox_destroy(inbox_t *inbox);
+int  inbox_fd(inbox_t *inbox);
+
+void inbox_post(inbox_t *inbox, inbox_event_t *event);
+/* Takes all events posted so far, oldest first, or NULL. */
+inbox_event_t *inbox_take(inbox_t *inbox);
+bool           inbox_empty(inbox_t *inbox);
+void           inbox_event_free(inbox_event_t *event);
+
+#endif
@@ -1,3 +1,5 @@
+#include <inttypes.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,6 +8,8 @@
 #include "cjson/cJSON.h"
 
 #include "jsonrpc.h"
+#include "mcp_json.h"
+#include "mem.h"
 
 struct jsonrpc_id {
     enum {
@@ -32,6 +36,7 @@ struct jsonrpc_result {
             int64_t code;
             char   *message;
             char   *data;
+            cJSON  *detail; // structured data, takes precedence over data
         } error;
         cJSON *obj;
     } resp;
@@ -42,12 +47,120 @@ struct jsonrpc {
 
     char  *method;
     cJSON *params;
+    cJSON *root; // of a decoded message, params and result belong to it
 
     jsonrpc_result_t result;
+
+    size_t failed; // memory_failed when it was built
 };
 
+/*
+ * cJSON allocations once tracking is on: counted by the usable size of each
+ * block, so freeing needs no header, overall and per thread.
+ */
+static atomic_bool          memory_tracked;
+static atomic_llong         memory_in_use;
+static atomic_llong         memory_peak;
+static _Thread_local size_t memory_allocated;
+static _Thread_local size_t memory_failed; // allocations the pools refused
+
+static void *tracked_malloc(size_t size)
+{
+    void *p = mem_alloc(size);
+
+    if (p != NULL) {
+        long long n      = (long long) mem_size(p);
+        long long in_use = atomic_fetch_add(&memory_in_use, n) + n;
+        long long peak   = atomic_load(&memory_peak);
+        while (in_use > peak &&
+               !atomic_compare_exchange_weak(&memory_peak, &peak, in_use)) {
+        }
+        memory_allocated += (size_t) n;
+    } else {
+        memory_failed++;
+    }
+    return p;
+}
+
+static void tracked_free(void *p)
+{
+    if (p != NULL) {
+        atomic_fetch_sub(&memory_in_use, (long long) mem_size(p));
+        mem_free(p);
+    }
+}
+
+/* Printed text is handed to callers that release it with mem_free(). */
+static char *print_json(const cJSON *json)
+{
+    char *text = cJSON_PrintUnformatted(json);
+
+    if (text != NULL && atomic_load(&memory_tracked)) {
+        atomic_fetch_sub(&memory_in_use, (long long) mem_size(text));
+    }
+    return text;
+}
+
+void jsonrpc_track_memory(void)
+{
+    cJSON_Hooks hooks = { .malloc_fn = tracked_malloc,
+                          .free_fn   = tracked_free };
+
+    if (!atomic_exchange(&memory_tracked, true)) {
+        cJSON_InitHooks(&hooks);
+    }
+}
+
+void jsonrpc_memory_usage(size_t *in_use, size_t *peak)
+{
+    long long n = atomic_load(&memory_in_use);
+
+    // blocks allocated before tracking started are freed uncounted
+    *in_use = n > 0 ? (size_t) n : 0;
+    *peak   = (size_t) atomic_load(&memory_peak);
+}
+
+size_t jsonrpc_memory_allocated(void)
+{
+    return memory_allocated;
+}
+
+/*
+ * A message to build. Where the pools run out cJSON leaves that part of the
+ * tree out, so jsonrpc_encode drops a message if any allocation was refused
+ * since, instead of sending it incomplete.
+ */
+static jsonrpc_t *jsonrpc_alloc(void)
+{
+    jsonrpc_t *jsonrpc = mem_calloc(1, sizeof(jsonrpc_t));
+
+    if (jsonrpc != NULL) {
+        jsonrpc->failed = memory_failed;
+    }
+    return jsonrpc;
+}
+
+/* Attaches item to object, or frees it when either is missing. */
+static void add_item(cJSON *object, const char *key, cJSON *item)
+{
+    if (!cJSON_AddItemToObject(object, key, item)) {
+        cJSON_Delete(item);
+    }
+}
+
+static void add_element(cJSON *array, cJSON *item)
+{
+    if (!cJSON_AddItemToArray(array, item)) {
+        cJSON_Delete(item);
+    }
+}
+
 char *jsonrpc_encode(jsonrpc_t *jsonrpc)
 {
+    if (jsonrpc == NULL) {
+        return NULL; // the pools could not take the message
+    }
+
     cJSON *root = cJSON_CreateObject();
 
     cJSON_AddStringToObject(root, "jsonrpc", "2.0");
@@ -55,7 +168,7 @@ char *jsonrpc_encode(jsonrpc_t *jsonrpc)
         cJSON_AddStringToObject(root, "method", jsonrpc->method);
     }
     if (jsonrpc->params) {
-        cJSON_AddItemToObject(root, "params", jsonrpc->params);
+        add_item(root, "params", jsonrpc->params);
     }
     if (jsonrpc->id.id_type == JSONRPC_ID_INT) {
         cJSON_AddNumberToObject(root, "id", jsonrpc->id.id.i);
@@ -63,7 +176,7 @@ char *jsonrpc_encode(jsonrpc_t *jsonrpc)
         cJSON_AddStringToObject(root, "id", jsonrpc->id.id.s);
     }
     if (jsonrpc->result.result_type == JSONRPC_RESULT_RESULT) {
-        cJSON_AddItemToObject(root, "result", jsonrpc->result.resp.obj);
+        add_item(root, "result", jsonrpc->result.resp.obj);
     } else if (jsonrpc->result.result_type == JSONRPC_RESULT_ERROR) {
         cJSON *error = cJSON_CreateObject();
         cJSON_AddNumberToObject(error, "code", jsonrpc->result.resp.error.code);
@@ -71,34 +184,47 @@ char *jsonrpc_encode(jsonrpc_t *jsonrpc)
             cJSON_AddStringToObject(error, "message",
                                     jsonrpc->result.resp.error.message);
         }
-        if (jsonrpc->result.resp.error.data) {
+        if (jsonrpc->result.resp.error.detail) {
+            add_item(error, "data", jsonrpc->result.resp.error.detail);
+        } else if (jsonrpc->result.resp.error.data) {
             cJSON_AddStringToObject(error, "data",
                                     jsonrpc->result.resp.error.data);
         }
-        cJSON_AddItemToObject(root, "error", error);
+        add_item(root, "error", error);
+        mem_free(jsonrpc->result.resp.error.message);
     }
 
-    char *result = cJSON_PrintUnformatted(root);
+    char *result = print_json(root);
     cJSON_Delete(root);
-    free(jsonrpc);
+    if (result != NULL && memory_failed != jsonrpc->failed) {
+        mem_free(result); // some part of the message is missing
+        result = NULL;
+    }
+    mem_free(jsonrpc);
 
     return result;
 }
 
-jsonrpc_t *jsonrpc_decode(const char *json_str)
+jsonrpc_t *jsonrpc_decode(const char *json, size_t len)
 {
-    cJSON *root = cJSON_Parse(json_str);
+    // MQTT payloads are not NUL terminated, nothing past len is read
+    cJSON *root = cJSON_ParseWithLength(json, len);
     if (!root) {
         return NULL;
     }
 
-    jsonrpc_t *jsonrpc = calloc(1, sizeof(jsonrpc_t));
+    jsonrpc_t *jsonrpc = mem_calloc(1, sizeof(jsonrpc_t));
+    if (jsonrpc == NULL) {
+        cJSON_Delete(root);
+        return NULL;
+    }
+    jsonrpc->root = root;
 
     cJSON *jsonrpc_version = cJSON_GetObjectItem(root, "jsonrpc");
     if (!cJSON_IsString(jsonrpc_version) ||
         strcmp(jsonrpc_version->valuestring, "2.0") != 0) {
         cJSON_Delete(root);
-        free(jsonrpc);
+        mem_free(jsonrpc);
         return NULL;
     }
 
@@ -108,26 +234,27 @@ jsonrpc_t *jsonrpc_decode(const char *json_str)
         jsonrpc->id.id.i    = id->valueint;
     } else if (cJSON_IsString(id)) {
         jsonrpc->id.id_type = JSONRPC_ID_STRING;
-        jsonrpc->id.id.s    = strdup(id->valuestring);
+        jsonrpc->id.id.s    = mem_strdup(id->valuestring);
     } else {
         jsonrpc->id.id_type = JSONRPC_ID_NONE;
     }
 
     cJSON *method = cJSON_GetObjectItem(root, "method");
     if (cJSON_IsString(method)) {
-        jsonrpc->method = strdup(method->valuestring);
+        jsonrpc->method = mem_strdup(method->valuestring);
     }
-
-    cJSON *params = cJSON_GetObjectItem(root, "params");
-    if (params) {
-        jsonrpc->params = params; // ownership is transferred to jsonrpc
+    if ((jsonrpc->id.id_type == JSONRPC_ID_STRING && !jsonrpc->id.id.s) ||
+        (cJSON_IsString(method) && !jsonrpc->method)) {
+        jsonrpc_decode_free(jsonrpc); // dropped like a message not decoded
+        return NULL;
     }
 
+    jsonrpc->params = cJSON_GetObjectItem(root, "params");
+
     cJSON *result = cJSON_GetObjectItem(root, "result");
     if (result) {
         jsonrpc->result.result_type = JSONRPC_RESULT_RESULT;
-        jsonrpc->result.resp.obj =
-            result; // ownership is transferred to jsonrpc
+        jsonrpc->result.resp.obj    = result;
     } else {
         cJSON *error = cJSON_GetObjectItem(root, "error");
         if (error) {
@@ -137,16 +264,15 @@ jsonrpc_t *jsonrpc_decode(const char *json_str)
             cJSON *message = cJSON_GetObjectItem(error, "message");
             if (message && cJSON_IsString(message)) {
                 jsonrpc->result.resp.error.message =
-                    strdup(message->valuestring);
+                    mem_strdup(message->valuestring);
             }
             cJSON *data = cJSON_GetObjectItem(error, "data");
             if (data && cJSON_IsString(data)) {
-                jsonrpc->result.resp.error.data = strdup(data->valuestring);
+                jsonrpc->result.resp.error.data = mem_strdup(data->valuestring);
             }
         }
     }
 
-    // cJSON_Delete(root);
     return jsonrpc;
 }
 
@@ -157,26 +283,21 @@ void jsonrpc_decode_free(jsonrpc_t *jsonrpc)
     }
 
     if (jsonrpc->id.id_type == JSONRPC_ID_STRING && jsonrpc->id.id.s) {
-        free(jsonrpc->id.id.s);
+        mem_free(jsonrpc->id.id.s);
     }
 
     if (jsonrpc->method) {
-        free(jsonrpc->method);
+        mem_free(jsonrpc->method);
     }
 
-    // if (jsonrpc->params) {
-    // cJSON_Delete(jsonrpc->params);
-    //}
-
     if (jsonrpc->result.result_type == JSONRPC_RESULT_ERROR) {
-        free(jsonrpc->result.resp.error.message);
-        free(jsonrpc->result.resp.error.data);
-    } else if (jsonrpc->result.result_type == JSONRPC_RESULT_RESULT &&
-               jsonrpc->result.resp.obj) {
-        //   cJSON_Delete(jsonrpc->result.resp.obj);
+        mem_free(jsonrpc->result.resp.error.message);
+        mem_free(jsonrpc->result.resp.error.data);
     }
 
-    free(jsonrpc);
+    // the decoded tree was kept until now, params and result point into it
+    cJSON_Delete(jsonrpc->root);
+    mem_free(jsonrpc);
 }
 
 char *jsonrpc_get_method(const jsonrpc_t *jsonrpc)
@@ -203,15 +324,146 @@ bool jsonrpc_id_exists(const jsonrpc_id_t *id)
     return id->id_type != JSONRPC_ID_NONE;
 }
 
+bool jsonrpc_id_equal(const jsonrpc_id_t *a, const jsonrpc_id_t *b)
+{
+    if (a == NULL || b == NULL || a->id_type != b->id_type) {
+        return false;
+    }
+    switch (a->id_type) {
+    case JSONRPC_ID_INT:
+        return a->id.i == b->id.i;
+    case JSONRPC_ID_STRING:
+        return strcmp(a->id.s, b->id.s) == 0;
+    default:
+        return false;
+    }
+}
+
+uint64_t jsonrpc_id_hash(const jsonrpc_id_t *id)
+{
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+
+    if (id->id_type == JSONRPC_ID_STRING) {
+        for (const char *p = id->id.s; *p; p++) {
+            hash = (hash ^ (unsigned char) *p) * 1099511628211ULL;
+        }
+    } else if (id->id_type == JSONRPC_ID_INT) {
+        uint64_t v = (uint64_t) id->id.i;
+        for (int i = 0; i < 8; i++) {
+            hash = (hash ^ (v & 0xff)) * 1099511628211ULL;
+            v >>= 8;
+        }
+    }
+    return hash;
+}
+
+jsonrpc_id_t *jsonrpc_id_dup(const jsonrpc_id_t *id)
+{
+    jsonrpc_id_t *dup = mem_calloc(1, sizeof(jsonrpc_id_t));
+
+    if (dup == NULL) {
+        return NULL;
+    }
+    *dup = *id;
+    if (id->id_type == JSONRPC_ID_STRING) {
+        dup->id.s = mem_strdup(id->id.s);
+        if (dup->id.s == NULL) {
+            mem_free(dup);
+            return NULL;
+        }
+    }
+    return dup;
+}
+
+void jsonrpc_id_free(jsonrpc_id_t *id)
+{
+    if (id == NULL) {
+        return;
+    }
+    if (id->id_type == JSONRPC_ID_STRING) {
+        mem_free(id->id.s);
+    }
+    mem_free(id);
+}
+
+size_t jsonrpc_id_print(const jsonrpc_id_t *id, char *buf, size_t size)
+{
+    char   num[24];
+    size_t len;
+
+    switch (id->id_type) {
+    case JSONRPC_ID_INT:
+        len = (size_t) snprintf(num, sizeof(num), "%" PRId64, id->id.i);
+        break;
+    case JSONRPC_ID_STRING: {
+        size_t raw    = strlen(id->id.s);
+        size_t quoted = mcp_json_escaped_size(id->id.s, raw) + 2;
+        if (quoted <= size) {
+            buf[0] = '"';
+            mcp_json_escape(buf + 1, id->id.s, raw);
+            buf[quoted - 1] = '"';
+        }
+        return quoted;
+    }
+    default:
+        strcpy(num, "null");
+        len = 4;
+        break;
+    }
+    if (len <= size) {
+        memcpy(buf, num, len);
+    }
+    return len;
+}
+
+int jsonrpc_get_meta_int(const jsonrpc_t *jsonrpc, const char *key,
+                         long long *value)
+{
+    if (jsonrpc == NULL || !cJSON_IsObject(jsonrpc->params)) {
+        return -1;
+    }
+
+    cJSON *meta = cJSON_GetObjectItem(jsonrpc->params, "_meta");
+    if (!cJSON_IsObject(meta)) {
+        return -2;
+    }
+
+    cJSON *item = cJSON_GetObjectItem(meta, key);
+    if (!cJSON_IsNumber(item)) {
+        return -3;
+    }
+
+    *value = (long long) item->valuedouble;
+    return 0;
+}
+
+char *jsonrpc_progress_token(const jsonrpc_t *jsonrpc)
+{
+    if (jsonrpc == NULL || !cJSON_IsObject(jsonrpc->params)) {
+        return NULL;
+    }
+
+    cJSON *meta  = cJSON_GetObjectItem(jsonrpc->params, "_meta");
+    cJSON *token = cJSON_GetObjectItem(meta, "progressToken");
+    if (!cJSON_IsString(token) && !cJSON_IsNumber(token)) {
+        return NULL;
+    }
+    return print_json(token);
+}
+
 jsonrpc_t *jsonrpc_server_online(const char *server_name,
                                  const char *description, int n_roles,
                                  mcp_mqtt_role_t *roles)
 {
-    jsonrpc_t *jsonrpc    = calloc(1, sizeof(jsonrpc_t));
-    cJSON     *root       = cJSON_CreateObject();
-    cJSON     *meta       = cJSON_CreateObject();
-    cJSON     *rbac       = cJSON_CreateObject();
-    cJSON     *json_roles = cJSON_CreateArray();
+    jsonrpc_t *jsonrpc = jsonrpc_alloc();
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
+
+    cJSON *root       = cJSON_CreateObject();
+    cJSON *meta       = cJSON_CreateObject();
+    cJSON *rbac       = cJSON_CreateObject();
+    cJSON *json_roles = cJSON_CreateArray();
 
     jsonrpc->id.id_type = JSONRPC_ID_NONE;
     jsonrpc->method     = "notifications/server/online";
@@ -228,55 +480,131 @@ jsonrpc_t *jsonrpc_server_online(const char *server_name,
         if (roles[i].n_allowed_methods > 0) {
             cJSON *methods = cJSON_CreateArray();
             for (int j = 0; j < roles[i].n_allowed_methods; j++) {
-                cJSON_AddItemToArray(
-                    methods, cJSON_CreateString(roles[i].allowed_methods[j]));
+                add_element(methods,
+                            cJSON_CreateString(roles[i].allowed_methods[j]));
             }
-            cJSON_AddItemToObject(role, "allowed_methods", methods);
+            add_item(role, "allowed_methods", methods);
         }
 
         if (roles[i].n_allowed_tools > 0) {
             cJSON *tools = cJSON_CreateArray();
             for (int j = 0; j < roles[i].n_allowed_tools; j++) {
-                cJSON_AddItemToArray(
-                    tools, cJSON_CreateString(roles[i].allowed_tools[j]));
+                add_element(tools,
+                            cJSON_CreateString(roles[i].allowed_tools[j]));
             }
-            cJSON_AddItemToObject(role, "allowed_tools", tools);
+            add_item(role, "allowed_tools", tools);
         }
 
         if (roles[i].n_allowed_resources > 0) {
             cJSON *resources = cJSON_CreateArray();
             for (int j = 0; j < roles[i].n_allowed_resources; j++) {
-                cJSON_AddItemToArray(
-                    resources,
-                    cJSON_CreateString(roles[i].allowed_resources[j]));
+                add_element(resources,
+                            cJSON_CreateString(roles[i].allowed_resources[j]));
             }
-            cJSON_AddItemToObject(role, "allowed_resources", resources);
+            add_item(role, "allowed_resources", resources);
         }
 
-        cJSON_AddItemToArray(json_roles, role);
+        add_element(json_roles, role);
     }
 
-    cJSON_AddItemToObject(rbac, "roles", json_roles);
-    cJSON_AddItemToObject(meta, "rbac", rbac);
+    add_item(rbac, "roles", json_roles);
+    add_item(meta, "rbac", rbac);
 
     cJSON_AddStringToObject(root, "server_name", server_name);
     if (description) {
         cJSON_AddStringToObject(root, "description", description);
     }
-    cJSON_AddItemToObject(root, "meta", meta);
+    add_item(root, "meta", meta);
+    return jsonrpc;
+}
+
+jsonrpc_t *jsonrpc_notification(const char *method)
+{
+    jsonrpc_t *jsonrpc = jsonrpc_alloc();
+
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
+    jsonrpc->id.id_type         = JSONRPC_ID_NONE;
+    jsonrpc->method             = (char *) method;
+    jsonrpc->result.result_type = JSONRPC_RESULT_NONE;
+
+    return jsonrpc;
+}
+
+jsonrpc_t *jsonrpc_progress_notification(const char *token, double progress,
+                                         double total, const char *message)
+{
+    jsonrpc_t *jsonrpc = jsonrpc_notification("notifications/progress");
+
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
+    jsonrpc->params = cJSON_CreateObject();
+    add_item(jsonrpc->params, "progressToken", cJSON_CreateRaw(token));
+    cJSON_AddNumberToObject(jsonrpc->params, "progress", progress);
+    if (total > 0) {
+        cJSON_AddNumberToObject(jsonrpc->params, "total", total);
+    }
+    if (message) {
+        cJSON_AddStringToObject(jsonrpc->params, "message", message);
+    }
+    return jsonrpc;
+}
+
+jsonrpc_t *jsonrpc_partial_notification(const char *token, const char *text)
+{
+    jsonrpc_t *jsonrpc = jsonrpc_notification("notifications/tools/partial");
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
+
+    cJSON *content = cJSON_CreateArray();
+    cJSON *item    = cJSON_CreateObject();
+
+    cJSON_AddStringToObject(item, "type", "text");
+    cJSON_AddStringToObject(item, "text", text);
+    add_element(content, item);
+
+    jsonrpc->params = cJSON_CreateObject();
+    add_item(jsonrpc->params, "progressToken", cJSON_CreateRaw(token));
+    add_item(jsonrpc->params, "content", content);
     return jsonrpc;
 }
 
 jsonrpc_t *jsonrpc_error_response(const jsonrpc_id_t *id, int code,
                                   const char *message)
 {
-    jsonrpc_t *jsonrpc = calloc(1, sizeof(jsonrpc_t));
+    jsonrpc_t *jsonrpc = jsonrpc_alloc();
 
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
     jsonrpc->id                        = *id;
     jsonrpc->result.result_type        = JSONRPC_RESULT_ERROR;
     jsonrpc->result.resp.error.code    = code;
-    jsonrpc->result.resp.error.message = message ? strdup(message) : NULL;
+    jsonrpc->result.resp.error.message = message ? mem_strdup(message) : NULL;
     jsonrpc->result.resp.error.data    = NULL;
+    if (message && jsonrpc->result.resp.error.message == NULL) {
+        mem_free(jsonrpc);
+        return NULL;
+    }
+
+    return jsonrpc;
+}
+
+jsonrpc_t *jsonrpc_retry_error_response(const jsonrpc_id_t *id, int code,
+                                        const char *message,
+                                        long long   retry_after_ms)
+{
+    jsonrpc_t *jsonrpc = jsonrpc_error_response(id, code, message);
+
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
+    jsonrpc->result.resp.error.detail = cJSON_CreateObject();
+    cJSON_AddNumberToObject(jsonrpc->result.resp.error.detail, "retryAfterMs",
+                            (double) retry_after_ms);
 
     return jsonrpc;
 }
@@ -284,7 +612,10 @@ jsonrpc_t *jsonrpc_error_response(const jsonrpc_id_t *id, int code,
 jsonrpc_t *jsonrpc_init_response(const jsonrpc_id_t *id, bool tools,
                                  bool resources)
 {
-    jsonrpc_t *jsonrpc          = calloc(1, sizeof(jsonrpc_t));
+    jsonrpc_t *jsonrpc = jsonrpc_alloc();
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
     jsonrpc->id                 = *id;
     jsonrpc->result.result_type = JSONRPC_RESULT_RESULT;
     jsonrpc->result.resp.obj    = cJSON_CreateObject();
@@ -298,230 +629,1081 @@ jsonrpc_t *jsonrpc_init_response(const jsonrpc_id_t *id, bool tools,
     if (resources) {
         cJSON *resources = cJSON_CreateObject();
         cJSON_AddBoolToObject(resources, "listChanged", true);
-        cJSON_AddItemToObject(capabilities, "resources", resources);
+        add_item(capabilities, "resources", resources);
     }
 
     if (tools) {
         cJSON *tools = cJSON_CreateObject();
         cJSON_AddBoolToObject(tools, "listChanged", true);
-        cJSON_AddItemToObject(capabilities, "tools", tools);
+        add_item(capabilities, "tools", tools);
     }
 
     cJSON_AddStringToObject(jsonrpc->result.resp.obj, "protocolVersion",
                             "2024-11-05");
-    cJSON_AddItemToObject(jsonrpc->result.resp.obj, "serverInfo", server_info);
-    cJSON_AddItemToObject(jsonrpc->result.resp.obj, "capabilities",
-                          capabilities);
+    add_item(jsonrpc->result.resp.obj, "serverInfo", server_info);
+    add_item(jsonrpc->result.resp.obj, "capabilities", capabilities);
 
     return jsonrpc;
 }
 
-jsonrpc_t *jsonrpc_tool_list_response(const jsonrpc_id_t *id, int n_tools,
-                                      mcp_tool_t *tools)
-{
-    jsonrpc_t *jsonrpc          = calloc(1, sizeof(jsonrpc_t));
-    jsonrpc->id                 = *id;
-    jsonrpc->result.result_type = JSONRPC_RESULT_RESULT;
-    jsonrpc->result.resp.obj    = cJSON_CreateObject();
-
-    cJSON *tools_array = cJSON_CreateArray();
+static void properties_to_json(cJSON *schema, int n,
+                               const property_t *properties);
 
-    for (int i = 0; i < n_tools; i++) {
-        cJSON *tool          = cJSON_CreateObject();
-        cJSON *input_schema  = cJSON_CreateObject();
-        cJSON *required_args = cJSON_CreateArray();
-        cJSON *properities   = cJSON_CreateObject();
+static cJSON *property_to_json(const property_t *property)
+{
+    static const char *const types[] = {
+        [PROPERTY_STRING] = "string",   [PROPERTY_REAL] = "number",
+        [PROPERTY_INTEGER] = "integer", [PROPERTY_BOOLEAN] = "boolean",
+        [PROPERTY_ARRAY] = "array",     [PROPERTY_OBJECT] = "object",
+    };
+    cJSON *item = cJSON_CreateObject();
+
+    if (property->description) {
+        cJSON_AddStringToObject(item, "description", property->description);
+    }
+    cJSON_AddStringToObject(item, "type", types[property->type]);
 
-        cJSON_AddStringToObject(tool, "name", tools[i].name);
-        if (tools[i].description) {
-            cJSON_AddStringToObject(tool, "description", tools[i].description);
+    if (property->n_enum > 0) {
+        cJSON *values = cJSON_CreateArray();
+        for (int i = 0; i < property->n_enum; i++) {
+            add_element(values, cJSON_CreateString(property->enum_values[i]));
         }
+        add_item(item, "enum", values);
+    }
+    if (property->has_default) {
+        switch (property->type) {
+        case PROPERTY_STRING:
+            cJSON_AddStringToObject(item, "default",
+                                    property->value.string_value);
+            break;
+        case PROPERTY_REAL:
+            cJSON_AddNumberToObject(item, "default",
+                                    property->value.real_value);
+            break;
+        case PROPERTY_INTEGER:
+            cJSON_AddNumberToObject(item, "default",
+                                    (double) property->value.integer_value);
+            break;
+        case PROPERTY_BOOLEAN:
+            cJSON_AddBoolToObject(item, "default",
+                                  property->value.boolean_value);
+            break;
+        default:
+            break;
+        }
+    }
+    if (property->type == PROPERTY_ARRAY && property->items) {
+        add_item(item, "items", property_to_json(property->items));
+    } else if (property->type == PROPERTY_OBJECT) {
+        properties_to_json(item, property->property_count,
+                           property->properties);
+    }
+    return item;
+}
 
-        for (int k = 0; k < tools[i].property_count; k++) {
-            cJSON *arg = cJSON_CreateObject();
-
-            if (tools[i].properties[k].description) {
-                cJSON_AddStringToObject(arg, "description",
-                                        tools[i].properties[k].description);
-            }
-            switch (tools[i].properties[k].type) {
-            case PROPERTY_STRING:
-                cJSON_AddStringToObject(arg, "type", "string");
-                break;
-            case PROPERTY_REAL:
-                cJSON_AddStringToObject(arg, "type", "number");
-                break;
-            case PROPERTY_INTEGER:
-                cJSON_AddStringToObject(arg, "type", "integer");
-                break;
-            case PROPERTY_BOOLEAN:
-                cJSON_AddBoolToObject(arg, "type", true);
-                break;
-            }
+static void properties_to_json(cJSON *schema, int n,
+                               const property_t *properties)
+{
+    cJSON *required_args = cJSON_CreateArray();
+    cJSON *properities   = cJSON_CreateObject();
 
-            cJSON_AddItemToArray(
-                required_args, cJSON_CreateString(tools[i].properties[k].name));
-            cJSON_AddItemToObject(properities, tools[i].properties[k].name,
-                                  arg);
+    for (int k = 0; k < n; k++) {
+        if (!properties[k].optional && !properties[k].has_default) {
+            add_element(required_args, cJSON_CreateString(properties[k].name));
         }
-
-        cJSON_AddStringToObject(input_schema, "type", "object");
-        cJSON_AddItemToObject(input_schema, "properties", properities);
-        cJSON_AddItemToObject(input_schema, "required", required_args);
-        cJSON_AddItemToObject(tool, "inputSchema", input_schema);
-        cJSON_AddItemToArray(tools_array, tool);
+        add_item(properities, properties[k].name,
+                 property_to_json(&properties[k]));
     }
 
-    cJSON_AddItemToObject(jsonrpc->result.resp.obj, "tools", tools_array);
-    return jsonrpc;
+    add_item(schema, "properties", properities);
+    add_item(schema, "required", required_args);
 }
 
-int jsonrpc_tool_call_decode(const jsonrpc_t *jsonrpc, char **function_name,
-                             int *n_args, property_t **args)
+static cJSON *tool_to_json(const mcp_tool_t *tool)
 {
-    if (jsonrpc == NULL || jsonrpc->params == NULL ||
-        cJSON_IsObject(jsonrpc->params) == false) {
-        return -1; // Invalid JSON-RPC or no parameters
-    }
+    cJSON *item         = cJSON_CreateObject();
+    cJSON *input_schema = cJSON_CreateObject();
 
-    cJSON *name = cJSON_GetObjectItem(jsonrpc->params, "name");
-    if (name == NULL || !cJSON_IsString(name)) {
-        return -2;
+    cJSON_AddStringToObject(item, "name", tool->name);
+    if (tool->description) {
+        cJSON_AddStringToObject(item, "description", tool->description);
     }
 
-    cJSON *json_args = cJSON_GetObjectItem(jsonrpc->params, "arguments");
-    if (json_args == NULL || !cJSON_IsObject(json_args)) {
-        return -3;
-    }
-    cJSON *json_kwargs = cJSON_GetObjectItem(json_args, "kwargs");
-    if (json_kwargs == NULL || !cJSON_IsObject(json_kwargs)) {
-        return -10;
-    }
+    cJSON_AddStringToObject(input_schema, "type", "object");
+    properties_to_json(input_schema, tool->property_count, tool->properties);
+    add_item(item, "inputSchema", input_schema);
+    return item;
+}
 
-    *n_args        = 0;
-    cJSON *current = json_kwargs->child;
-    while (current != NULL) {
-        (*n_args)++;
-        *args = realloc(*args, (*n_args) * sizeof(property_t));
-        property_t *current_arg = &(*args)[*n_args - 1];
-
-        current_arg->name = current->string ? strdup(current->string) : NULL;
-        if (cJSON_IsString(current)) {
-            current_arg->type               = PROPERTY_STRING;
-            current_arg->value.string_value = strdup(current->valuestring);
-        } else if (cJSON_IsNumber(current)) {
-            current_arg->type             = PROPERTY_REAL;
-            current_arg->value.real_value = current->valuedouble;
-        } else if (cJSON_IsBool(current)) {
-            current_arg->type                = PROPERTY_BOOLEAN;
-            current_arg->value.boolean_value = cJSON_IsTrue(current);
-        } else {
-            // Unsupported type
-            return -4;
-        }
+static cJSON *resource_to_json(const mcp_resource_t *resource)
+{
+    cJSON *item = cJSON_CreateObject();
 
-        current = current->next;
+    cJSON_AddStringToObject(item, "uri", resource->uri);
+    cJSON_AddStringToObject(item, "name", resource->name);
+    if (resource->description) {
+        cJSON_AddStringToObject(item, "description", resource->description);
     }
-
-    *function_name = strdup(name->valuestring);
-    return 0;
+    if (resource->mime_type) {
+        cJSON_AddStringToObject(item, "mimeType", resource->mime_type);
+    }
+    if (resource->title) {
+        cJSON_AddStringToObject(item, "title", resource->title);
+    }
+    return item;
 }
 
-jsonrpc_t *jsonrpc_tool_call_response(const jsonrpc_id_t *id,
-                                      const char         *result)
+static char *print_and_delete(cJSON *array)
 {
-    jsonrpc_t *jsonrpc          = calloc(1, sizeof(jsonrpc_t));
-    jsonrpc->id                 = *id;
-    jsonrpc->result.result_type = JSONRPC_RESULT_RESULT;
-    jsonrpc->result.resp.obj    = cJSON_CreateObject();
-
-    cJSON *content = cJSON_CreateArray();
-    cJSON *item    = cJSON_CreateObject();
+    char *json = print_json(array);
+    cJSON_Delete(array);
+    return json;
+}
 
-    cJSON_AddStringToObject(item, "type", "text");
-    cJSON_AddStringToObject(item, "text", result);
+char *jsonrpc_tool_list_items(int n_tools, const mcp_tool_t *tools)
+{
+    cJSON *array = cJSON_CreateArray();
 
-    cJSON_AddItemToArray(content, item);
-    cJSON_AddItemToObject(jsonrpc->result.resp.obj, "content", content);
-    return jsonrpc;
+    for (int i = 0; i < n_tools; i++) {
+        add_element(array, tools[i].schema_json
+                               ? cJSON_CreateRaw(tools[i].schema_json)
+                               : tool_to_json(&tools[i]));
+    }
+    return print_and_delete(array);
 }
 
-jsonrpc_t *jsonrpc_resource_list_response(const jsonrpc_id_t *id,
-                                          int                 n_resources,
-                                          mcp_resource_t     *resources)
+char *jsonrpc_resource_list_items(int                   n_resources,
+                                  const mcp_resource_t *resources)
 {
-    jsonrpc_t *jsonrpc          = calloc(1, sizeof(jsonrpc_t));
-    jsonrpc->id                 = *id;
-    jsonrpc->result.result_type = JSONRPC_RESULT_RESULT;
-    jsonrpc->result.resp.obj    = cJSON_CreateObject();
-
-    cJSON *contents = cJSON_CreateArray();
+    cJSON *array = cJSON_CreateArray();
 
     for (int i = 0; i < n_resources; i++) {
-        cJSON *resource = cJSON_CreateObject();
-
-        cJSON_AddStringToObject(resource, "uri", resources[i].uri);
-        cJSON_AddStringToObject(resource, "name", resources[i].name);
-        if (resources[i].description) {
-            cJSON_AddStringToObject(resource, "description",
-                                    resources[i].description);
-        }
-        if (resources[i].mime_type) {
-            cJSON_AddStringToObject(resource, "mimeType",
-                                    resources[i].mime_type);
-        }
-        if (resources[i].title) {
-            cJSON_AddStringToObject(resource, "title", resources[i].title);
-        }
-
-        cJSON_AddItemToArray(contents, resource);
+        add_element(array, resource_to_json(&resources[i]));
     }
-
-    cJSON_AddItemToObject(jsonrpc->result.resp.obj, "contents", contents);
-    return jsonrpc;
+    return print_and_delete(array);
 }
 
-jsonrpc_t *jsonrpc_resource_read_text_response(const jsonrpc_id_t *id,
-                                               mcp_resource_t     *resource,
-                                               const char         *content)
+jsonrpc_t *jsonrpc_list_page_response(const jsonrpc_id_t *id, const char *key,
+                                      const char *items,
+                                      const char *next_cursor)
 {
-    jsonrpc_t *jsonrpc          = calloc(1, sizeof(jsonrpc_t));
+    jsonrpc_t *jsonrpc = jsonrpc_alloc();
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
     jsonrpc->id                 = *id;
     jsonrpc->result.result_type = JSONRPC_RESULT_RESULT;
     jsonrpc->result.resp.obj    = cJSON_CreateObject();
 
-    cJSON *contents = cJSON_CreateArray();
-
-    cJSON *resource_obj = cJSON_CreateObject();
-    cJSON_AddStringToObject(resource_obj, "uri", resource->uri);
-    cJSON_AddStringToObject(resource_obj, "name", resource->name);
-    if (resource->mime_type) {
-        cJSON_AddStringToObject(resource_obj, "mimeType", resource->mime_type);
+    // the page body is already serialized, embed it verbatim
+    add_item(jsonrpc->result.resp.obj, key, cJSON_CreateRaw(items));
+    if (next_cursor) {
+        cJSON_AddStringToObject(jsonrpc->result.resp.obj, "nextCursor",
+                                next_cursor);
     }
-    if (resource->title) {
-        cJSON_AddStringToObject(resource_obj, "title", resource->title);
-    }
-    cJSON_AddStringToObject(resource_obj, "text", content);
-
-    cJSON_AddItemToArray(contents, resource_obj);
-    cJSON_AddItemToObject(jsonrpc->result.resp.obj, "contents", contents);
-
     return jsonrpc;
 }
 
-int jsonrpc_resource_read_decode(const jsonrpc_t *jsonrpc, char **uri)
+int jsonrpc_list_decode(const jsonrpc_t *jsonrpc, char **cursor)
 {
-    if (jsonrpc == NULL || jsonrpc->params == NULL ||
-        cJSON_IsObject(jsonrpc->params) == false) {
+    *cursor = NULL;
+    if (jsonrpc == NULL || jsonrpc->params == NULL) {
+        return 0;
+    }
+    if (!cJSON_IsObject(jsonrpc->params)) {
         return -1;
     }
 
-    cJSON *uri_item = cJSON_GetObjectItem(jsonrpc->params, "uri");
-    if (uri_item == NULL || !cJSON_IsString(uri_item)) {
+    cJSON *item = cJSON_GetObjectItem(jsonrpc->params, "cursor");
+    if (item == NULL || cJSON_IsNull(item)) {
+        return 0;
+    }
+    if (!cJSON_IsString(item)) {
         return -2;
     }
+    *cursor = mem_strdup(item->valuestring);
+    return *cursor ? 0 : JSONRPC_EXHAUSTED;
+}
 
-    *uri = strdup(uri_item->valuestring);
-
-    return 0;
-}
\ No newline at end of file
+const char *jsonrpc_tool_call_name(const jsonrpc_t *jsonrpc)
+{
+    if (jsonrpc == NULL || !cJSON_IsObject(jsonrpc->params)) {
+        return NULL;
+    }
+    cJSON *name = cJSON_GetObjectItem(jsonrpc->params, "name");
+    return cJSON_IsString(name) ? name->valuestring : NULL;
+}
+
+/* The kwargs object of a tools/call, NULL when the call passes none. */
+static cJSON *tool_call_kwargs(const jsonrpc_t *jsonrpc)
+{
+    cJSON *json_args = cJSON_GetObjectItem(jsonrpc->params, "arguments");
+    if (json_args == NULL || cJSON_IsNull(json_args)) {
+        return NULL;
+    }
+    if (!cJSON_IsObject(json_args)) {
+        return json_args; // rejected by the callers
+    }
+    return cJSON_GetObjectItem(json_args, "kwargs");
+}
+
+int jsonrpc_tool_call_arguments(const jsonrpc_t *jsonrpc, char **arguments)
+{
+    if (jsonrpc == NULL || !cJSON_IsObject(jsonrpc->params)) {
+        return -1;
+    }
+
+    cJSON *json_kwargs = tool_call_kwargs(jsonrpc);
+    if (json_kwargs == NULL) {
+        *arguments = mem_strdup("{}");
+        return *arguments ? 0 : JSONRPC_EXHAUSTED;
+    }
+    if (!cJSON_IsObject(json_kwargs)) {
+        return -10;
+    }
+
+    *arguments = print_json(json_kwargs);
+    return *arguments ? 0 : JSONRPC_EXHAUSTED;
+}
+
+typedef struct {
+    cJSON *item;
+    int    index;
+} member_t;
+
+static int member_compare(const void *a, const void *b)
+{
+    const member_t *x = a;
+    const member_t *y = b;
+    int             c = strcmp(x->item->string, y->item->string);
+
+    // a repeated key keeps its place, the decoders take the last one
+    return c != 0 ? c : x->index - y->index;
+}
+
+/* Sorts the members of every object in the tree by key. */
+static int sort_members(cJSON *json)
+{
+    int n = cJSON_GetArraySize(json);
+
+    for (cJSON *item = json->child; item; item = item->next) {
+        if (sort_members(item) != 0) {
+            return -1;
+        }
+    }
+    if (!cJSON_IsObject(json) || n < 2) {
+        return 0;
+    }
+
+    member_t *members = mem_alloc((size_t) n * sizeof(member_t));
+    if (members == NULL) {
+        return -1;
+    }
+    int i = 0;
+    for (cJSON *item = json->child; item; item = item->next, i++) {
+        members[i] = (member_t) { .item = item, .index = i };
+    }
+    qsort(members, n, sizeof(member_t), member_compare);
+    for (i = 0; i < n; i++) {
+        members[i].item->prev = members[i > 0 ? i - 1 : n - 1].item;
+        members[i].item->next = i + 1 < n ? members[i + 1].item : NULL;
+    }
+    json->child = members[0].item;
+    mem_free(members);
+    return 0;
+}
+
+char *jsonrpc_tool_call_canonical_arguments(const jsonrpc_t *jsonrpc)
+{
+    cJSON *json_kwargs = jsonrpc && cJSON_IsObject(jsonrpc->params)
+                             ? tool_call_kwargs(jsonrpc)
+                             : NULL;
+
+    if (json_kwargs == NULL) {
+        return mem_strdup("{}");
+    }
+
+    cJSON *copy = cJSON_Duplicate(json_kwargs, true);
+    char  *text = NULL;
+    if (copy != NULL && sort_members(copy) == 0) {
+        text = print_json(copy);
+    }
+    cJSON_Delete(copy);
+    return text;
+}
+
+int jsonrpc_tool_call_argument_count(const jsonrpc_t *jsonrpc)
+{
+    if (jsonrpc == NULL || !cJSON_IsObject(jsonrpc->params)) {
+        return 0;
+    }
+    return cJSON_GetArraySize(tool_call_kwargs(jsonrpc));
+}
+
+static bool enum_allows(const property_t *schema, const char *value)
+{
+    if (schema->n_enum == 0) {
+        return true;
+    }
+    for (int i = 0; i < schema->n_enum; i++) {
+        if (strcmp(schema->enum_values[i], value) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool integer_value(const cJSON *json, long long *value)
+{
+    double real = json->valuedouble;
+
+    if (!cJSON_IsNumber(json) || real <= -9.2e18 || real >= 9.2e18 ||
+        (double) (long long) real != real) {
+        return false;
+    }
+    *value = (long long) real;
+    return true;
+}
+
+static int value_decode(const property_t *schema, const cJSON *json,
+                        property_t *arg);
+
+/* Strings of an array share one allocation with their pointers. */
+static int strings_decode(const property_t *items, const cJSON *json,
+                          property_array_t *array)
+{
+    size_t size = 0;
+
+    for (const cJSON *e = json->child; e; e = e->next) {
+        if (!cJSON_IsString(e) || !enum_allows(items, e->valuestring)) {
+            return -1;
+        }
+        size += strlen(e->valuestring) + 1;
+    }
+
+    char **strings = mem_alloc((size_t) array->count * sizeof(char *) + size);
+    char  *data    = (char *) (strings + array->count);
+    int    i       = 0;
+    if (strings == NULL) {
+        return JSONRPC_EXHAUSTED;
+    }
+    for (const cJSON *e = json->child; e; e = e->next) {
+        size_t len = strlen(e->valuestring) + 1;
+        memcpy(data, e->valuestring, len);
+        strings[i++] = data;
+        data += len;
+    }
+    array->strings = strings;
+    return 0;
+}
+
+static int array_decode(const property_t *items, const cJSON *json,
+                        property_array_t *array)
+{
+    const cJSON *e   = json->child;
+    int          i   = 0;
+    int          ret = 0;
+
+    array->item_type = items->type;
+    array->count     = cJSON_GetArraySize(json);
+    if (array->count == 0) {
+        return 0;
+    }
+
+    switch (items->type) {
+    case PROPERTY_STRING:
+        return strings_decode(items, json, array);
+    case PROPERTY_REAL:
+        array->reals = mem_alloc(array->count * sizeof(double));
+        if (array->reals == NULL) {
+            return JSONRPC_EXHAUSTED;
+        }
+        for (; e && cJSON_IsNumber(e); e = e->next) {
+            array->reals[i++] = e->valuedouble;
+        }
+        break;
+    case PROPERTY_INTEGER:
+        array->integers = mem_alloc(array->count * sizeof(long long));
+        if (array->integers == NULL) {
+            return JSONRPC_EXHAUSTED;
+        }
+        for (; e && integer_value(e, &array->integers[i]); e = e->next) {
+            i++;
+        }
+        break;
+    case PROPERTY_BOOLEAN:
+        array->booleans = mem_alloc(array->count * sizeof(bool));
+        if (array->booleans == NULL) {
+            return JSONRPC_EXHAUSTED;
+        }
+        for (; e && cJSON_IsBool(e); e = e->next) {
+            array->booleans[i++] = cJSON_IsTrue(e);
+        }
+        break;
+    default:
+        array->items = mem_calloc(array->count, sizeof(property_t));
+        if (array->items == NULL) {
+            return JSONRPC_EXHAUSTED;
+        }
+        for (; e && (ret = value_decode(items, e, &array->items[i])) == 0;
+             e = e->next) {
+            i++;
+        }
+        break;
+    }
+    if (ret != 0) {
+        return ret;
+    }
+    return e == NULL ? 0 : -1; // stopped early at a mismatching element
+}
+
+static int object_decode(int n, const property_t *schema, const cJSON *json,
+                         property_t **members)
+{
+    *members = n > 0 ? mem_calloc(n, sizeof(property_t)) : NULL;
+    if (n > 0 && *members == NULL) {
+        return JSONRPC_EXHAUSTED;
+    }
+
+    for (int i = 0; i < n; i++) {
+        property_t *arg = &(*members)[i];
+        cJSON      *item =
+            cJSON_GetObjectItemCaseSensitive(json, schema[i].name);
+
+        arg->name        = schema[i].name;
+        arg->description = schema[i].description;
+        arg->type        = schema[i].type;
+        if (item == NULL && schema[i].has_default) {
+            arg->value   = schema[i].value;
+            arg->present = true;
+            if (arg->type == PROPERTY_STRING &&
+                (arg->value.string_value =
+                     mem_strdup(arg->value.string_value)) == NULL) {
+                return JSONRPC_EXHAUSTED;
+            }
+        } else if (item == NULL && !schema[i].optional) {
+            return -1;
+        } else if (item) {
+            int ret = value_decode(&schema[i], item, arg);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+
+static int value_decode(const property_t *schema, const cJSON *json,
+                        property_t *arg)
+{
+    arg->name        = schema->name;
+    arg->description = schema->description;
+    arg->type        = schema->type;
+    arg->present     = true;
+
+    switch (schema->type) {
+    case PROPERTY_STRING:
+        if (!cJSON_IsString(json) || !enum_allows(schema, json->valuestring)) {
+            return -1;
+        }
+        arg->value.string_value = mem_strdup(json->valuestring);
+        return arg->value.string_value ? 0 : JSONRPC_EXHAUSTED;
+    case PROPERTY_REAL:
+        if (!cJSON_IsNumber(json)) {
+            return -1;
+        }
+        arg->value.real_value = json->valuedouble;
+        return 0;
+    case PROPERTY_INTEGER:
+        return integer_value(json, &arg->value.integer_value) ? 0 : -1;
+    case PROPERTY_BOOLEAN:
+        if (!cJSON_IsBool(json)) {
+            return -1;
+        }
+        arg->value.boolean_value = cJSON_IsTrue(json);
+        return 0;
+    case PROPERTY_ARRAY:
+        if (!cJSON_IsArray(json) || schema->items == NULL) {
+            return -1;
+        }
+        return array_decode(schema->items, json, &arg->value.array_value);
+    case PROPERTY_OBJECT:
+        if (!cJSON_IsObject(json)) {
+            return -1;
+        }
+        arg->value.object_value.count = schema->property_count;
+        return object_decode(schema->property_count, schema->properties, json,
+                             &arg->value.object_value.properties);
+    }
+    return -1;
+}
+
+int jsonrpc_tool_call_args(const jsonrpc_t *jsonrpc, const mcp_tool_t *tool,
+                           property_t **args)
+{
+    *args = NULL;
+    if (jsonrpc == NULL || !cJSON_IsObject(jsonrpc->params)) {
+        return -1;
+    }
+
+    cJSON *json_kwargs = tool_call_kwargs(jsonrpc);
+    if (json_kwargs != NULL && !cJSON_IsObject(json_kwargs)) {
+        return -10;
+    }
+
+    // a missing kwargs object only suits tools without required arguments
+    cJSON *empty = NULL;
+    if (json_kwargs == NULL) {
+        json_kwargs = empty = cJSON_CreateObject();
+        if (empty == NULL) {
+            return JSONRPC_EXHAUSTED;
+        }
+    }
+    int ret = object_decode(tool->property_count, tool->properties,
+                            json_kwargs, args);
+    cJSON_Delete(empty);
+    if (ret != 0) {
+        jsonrpc_tool_call_args_free(tool->property_count, *args);
+        *args = NULL;
+        return ret == JSONRPC_EXHAUSTED ? ret : -4;
+    }
+    return 0;
+}
+
+static void value_free(property_t *arg)
+{
+    if (arg->type == PROPERTY_STRING) {
+        mem_free(arg->value.string_value);
+    } else if (arg->type == PROPERTY_ARRAY) {
+        property_array_t *array = &arg->value.array_value;
+        if (array->item_type == PROPERTY_ARRAY ||
+            array->item_type == PROPERTY_OBJECT) {
+            jsonrpc_tool_call_args_free(array->count, array->items);
+        } else {
+            mem_free(array->reals); // any of the flat buffers
+        }
+    } else if (arg->type == PROPERTY_OBJECT) {
+        jsonrpc_tool_call_args_free(arg->value.object_value.count,
+                                    arg->value.object_value.properties);
+    }
+}
+
+void jsonrpc_tool_call_args_free(int n_args, property_t *args)
+{
+    if (args == NULL) {
+        return;
+    }
+    // names and descriptions belong to the tool's schema
+    for (int i = 0; i < n_args; i++) {
+        value_free(&args[i]);
+    }
+    mem_free(args);
+}
+
+/*
+ * The JSON string for s, escaped here rather than by cJSON's printer, which
+ * goes byte by byte through resource texts that may be megabytes long.
+ */
+static char *json_quote(const char *s)
+{
+    size_t len    = strlen(s);
+    size_t size   = mcp_json_escaped_size(s, len);
+    char  *quoted = mem_alloc(size + 3);
+
+    if (quoted == NULL) {
+        return NULL;
+    }
+    quoted[0] = '"';
+    mcp_json_escape(quoted + 1, s, len);
+    quoted[size + 1] = '"';
+    quoted[size + 2] = '\0';
+    return quoted;
+}
+
+jsonrpc_t *jsonrpc_resource_read_text_response(const jsonrpc_id_t *id,
+                                               mcp_resource_t     *resource,
+                                               const char         *content)
+{
+    jsonrpc_t *jsonrpc = jsonrpc_alloc();
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
+    jsonrpc->id                 = *id;
+    jsonrpc->result.result_type = JSONRPC_RESULT_RESULT;
+    jsonrpc->result.resp.obj    = cJSON_CreateObject();
+
+    cJSON *contents = cJSON_CreateArray();
+
+    cJSON *resource_obj = cJSON_CreateObject();
+    cJSON_AddStringToObject(resource_obj, "uri", resource->uri);
+    cJSON_AddStringToObject(resource_obj, "name", resource->name);
+    if (resource->mime_type) {
+        cJSON_AddStringToObject(resource_obj, "mimeType", resource->mime_type);
+    }
+    if (resource->title) {
+        cJSON_AddStringToObject(resource_obj, "title", resource->title);
+    }
+    if (content) {
+        char *text = json_quote(content);
+        if (text == NULL) {
+            cJSON_Delete(resource_obj);
+            cJSON_Delete(contents);
+            cJSON_Delete(jsonrpc->result.resp.obj);
+            mem_free(jsonrpc);
+            return NULL;
+        }
+        cJSON_AddRawToObject(resource_obj, "text", text);
+        mem_free(text);
+    }
+
+    add_element(contents, resource_obj);
+    add_item(jsonrpc->result.resp.obj, "contents", contents);
+
+    return jsonrpc;
+}
+
+int jsonrpc_resource_read_decode(const jsonrpc_t *jsonrpc, char **uri)
+{
+    if (jsonrpc == NULL || jsonrpc->params == NULL ||
+        cJSON_IsObject(jsonrpc->params) == false) {
+        return -1;
+    }
+
+    cJSON *uri_item = cJSON_GetObjectItem(jsonrpc->params, "uri");
+    if (uri_item == NULL || !cJSON_IsString(uri_item)) {
+        return -2;
+    }
+
+    *uri = mem_strdup(uri_item->valuestring);
+
+    return *uri ? 0 : JSONRPC_EXHAUSTED;
+}
+int jsonrpc_cancelled_decode(const jsonrpc_t *jsonrpc,
+                             jsonrpc_id_t   **request_id)
+{
+    if (jsonrpc == NULL || jsonrpc->params == NULL ||
+        cJSON_IsObject(jsonrpc->params) == false) {
+        return -1;
+    }
+
+    cJSON *id = cJSON_GetObjectItem(jsonrpc->params, "requestId");
+    if (!cJSON_IsNumber(id) && !cJSON_IsString(id)) {
+        return -2;
+    }
+    *request_id = mem_calloc(1, sizeof(jsonrpc_id_t));
+    if (*request_id == NULL) {
+        return JSONRPC_EXHAUSTED;
+    }
+    if (cJSON_IsNumber(id)) {
+        (*request_id)->id_type = JSONRPC_ID_INT;
+        (*request_id)->id.i    = (int64_t) id->valuedouble;
+    } else {
+        (*request_id)->id_type = JSONRPC_ID_STRING;
+        (*request_id)->id.s    = mem_strdup(id->valuestring);
+        if ((*request_id)->id.s == NULL) {
+            mem_free(*request_id);
+            *request_id = NULL;
+            return JSONRPC_EXHAUSTED;
+        }
+    }
+
+    return 0;
+}
+
+jsonrpc_t *jsonrpc_request(long long id, const char *method)
+{
+    jsonrpc_t *jsonrpc = jsonrpc_notification(method);
+
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
+    jsonrpc->id.id_type = JSONRPC_ID_INT;
+    jsonrpc->id.id.i    = id;
+    return jsonrpc;
+}
+
+jsonrpc_t *jsonrpc_init_request(long long id, const char *client_name)
+{
+    jsonrpc_t *jsonrpc = jsonrpc_request(id, "initialize");
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
+
+    cJSON *client_info = cJSON_CreateObject();
+
+    cJSON_AddStringToObject(client_info, "name", client_name);
+    cJSON_AddStringToObject(client_info, "version", "0.0.1");
+
+    jsonrpc->params = cJSON_CreateObject();
+    cJSON_AddStringToObject(jsonrpc->params, "protocolVersion", "2024-11-05");
+    add_item(jsonrpc->params, "capabilities", cJSON_CreateObject());
+    add_item(jsonrpc->params, "clientInfo", client_info);
+    return jsonrpc;
+}
+
+jsonrpc_t *jsonrpc_list_request(long long id, const char *method,
+                                const char *cursor)
+{
+    jsonrpc_t *jsonrpc = jsonrpc_request(id, method);
+
+    if (jsonrpc != NULL && cursor) {
+        jsonrpc->params = cJSON_CreateObject();
+        cJSON_AddStringToObject(jsonrpc->params, "cursor", cursor);
+    }
+    return jsonrpc;
+}
+
+jsonrpc_t *jsonrpc_tool_call_request(long long id, const char *name,
+                                     const char *arguments, int timeout_ms)
+{
+    jsonrpc_t *jsonrpc = jsonrpc_request(id, "tools/call");
+
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
+    jsonrpc->params = cJSON_CreateObject();
+    cJSON_AddStringToObject(jsonrpc->params, "name", name);
+    if (arguments) {
+        // already serialized by the caller, embed it verbatim
+        cJSON *json_args = cJSON_CreateObject();
+        add_item(json_args, "kwargs", cJSON_CreateRaw(arguments));
+        add_item(jsonrpc->params, "arguments", json_args);
+    }
+    if (timeout_ms > 0) {
+        cJSON *meta = cJSON_CreateObject();
+        cJSON_AddNumberToObject(meta, "timeout", timeout_ms);
+        add_item(jsonrpc->params, "_meta", meta);
+    }
+    return jsonrpc;
+}
+
+jsonrpc_t *jsonrpc_resource_read_request(long long id, const char *uri)
+{
+    jsonrpc_t *jsonrpc = jsonrpc_request(id, "resources/read");
+
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
+    jsonrpc->params = cJSON_CreateObject();
+    cJSON_AddStringToObject(jsonrpc->params, "uri", uri);
+    return jsonrpc;
+}
+
+jsonrpc_t *jsonrpc_cancelled_notification(long long request_id)
+{
+    jsonrpc_t *jsonrpc = jsonrpc_notification("notifications/cancelled");
+
+    if (jsonrpc == NULL) {
+        return NULL;
+    }
+    jsonrpc->params = cJSON_CreateObject();
+    cJSON_AddNumberToObject(jsonrpc->params, "requestId", request_id);
+    return jsonrpc;
+}
+
+/* Locates the value at the reader, which is left behind it. */
+static int value_span(mcp_json_reader_t *reader, const char **value,
+                      size_t *len)
+{
+    while (reader->pos < reader->end &&
+           (*reader->pos == ' ' || *reader->pos == '\t' ||
+            *reader->pos == '\n' || *reader->pos == '\r')) {
+        reader->pos++;
+    }
+    *value = reader->pos;
+    if (mcp_json_skip(reader) != 0) {
+        return -1;
+    }
+    *len = (size_t) (reader->pos - *value);
+    return 0;
+}
+
+static int error_scan(mcp_json_reader_t *reader, jsonrpc_response_t *response)
+{
+    const char *key;
+    size_t      key_len;
+    int         ret;
+
+    if (mcp_json_object_begin(reader) != 0) {
+        return -1;
+    }
+    while ((ret = mcp_json_object_next(reader, &key, &key_len)) == 1) {
+        long long code;
+        if (mcp_json_key_is(key, key_len, "code")) {
+            ret                  = mcp_json_read_integer(reader, &code);
+            response->error_code = (int) code;
+        } else if (mcp_json_key_is(key, key_len, "message") &&
+                   response->error_message == NULL) {
+            ret = mcp_json_read_string(reader, &response->error_message);
+        } else {
+            ret = mcp_json_skip(reader);
+        }
+        if (ret != 0) {
+            return -1;
+        }
+    }
+    return ret;
+}
+
+int jsonrpc_response_scan(const char *json, size_t len,
+                          jsonrpc_response_t *response)
+{
+    mcp_json_reader_t reader = { .pos = json, .end = json + len };
+    const char       *key;
+    size_t            key_len;
+    int               ret;
+
+    memset(response, 0, sizeof(jsonrpc_response_t));
+    response->id = -1;
+
+    // the payload is not terminated, a closing brace keeps numbers in bounds
+    while (len > 0 && (json[len - 1] == ' ' || json[len - 1] == '\n' ||
+                       json[len - 1] == '\r' || json[len - 1] == '\t')) {
+        len--;
+    }
+    if (len == 0 || json[len - 1] != '}' ||
+        mcp_json_object_begin(&reader) != 0) {
+        return -1;
+    }
+
+    while ((ret = mcp_json_object_next(&reader, &key, &key_len)) == 1) {
+        if (mcp_json_key_is(key, key_len, "id")) {
+            ret = mcp_json_read_integer(&reader, &response->id);
+            if (ret != 0) {
+                response->id = -1; // not one of ours
+                ret          = mcp_json_skip(&reader);
+            }
+        } else if (mcp_json_key_is(key, key_len, "method")) {
+            ret = value_span(&reader, &response->method,
+                             &response->method_len);
+            if (ret == 0 && response->method_len >= 2 &&
+                response->method[0] == '"') {
+                response->method++;
+                response->method_len -= 2;
+            }
+        } else if (mcp_json_key_is(key, key_len, "result") ||
+                   mcp_json_key_is(key, key_len, "params")) {
+            ret = value_span(&reader, &response->result,
+                             &response->result_len);
+        } else if (mcp_json_key_is(key, key_len, "error")) {
+            ret = error_scan(&reader, response);
+            if (response->error_code == 0) {
+                response->error_code = -32603; // an error without a code
+            }
+        } else {
+            ret = mcp_json_skip(&reader);
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+    if (ret != 0) {
+        jsonrpc_response_free(response);
+        return -1;
+    }
+    return 0;
+}
+
+jsonrpc_id_t *jsonrpc_id_scan(const char *json, size_t len)
+{
+    mcp_json_reader_t reader = { .pos = json, .end = json + len };
+    const char       *key;
+    size_t            key_len;
+
+    // as in jsonrpc_response_scan, the closing brace bounds the numbers
+    while (len > 0 && (json[len - 1] == ' ' || json[len - 1] == '\n' ||
+                       json[len - 1] == '\r' || json[len - 1] == '\t')) {
+        len--;
+    }
+    if (len == 0 || json[len - 1] != '}' ||
+        mcp_json_object_begin(&reader) != 0) {
+        return NULL;
+    }
+
+    while (mcp_json_object_next(&reader, &key, &key_len) == 1) {
+        if (!mcp_json_key_is(key, key_len, "id")) {
+            if (mcp_json_skip(&reader) != 0) {
+                return NULL;
+            }
+            continue;
+        }
+
+        const char *value;
+        size_t      value_len;
+        if (value_span(&reader, &value, &value_len) != 0) {
+            return NULL;
+        }
+
+        mcp_json_reader_t id_reader = { .pos = value, .end = reader.pos };
+        jsonrpc_id_t     *id        = mem_calloc(1, sizeof(jsonrpc_id_t));
+        long long         n;
+        if (id == NULL) {
+            return NULL;
+        }
+        id->id_type = JSONRPC_ID_NONE;
+        if (*value == '"') {
+            if (mcp_json_read_string(&id_reader, &id->id.s) == 0) {
+                id->id_type = JSONRPC_ID_STRING;
+            }
+        } else if (mcp_json_read_integer(&id_reader, &n) == 0) {
+            id->id_type = JSONRPC_ID_INT;
+            id->id.i    = n;
+        }
+        return id;
+    }
+    return NULL;
+}
+
+void jsonrpc_response_free(jsonrpc_response_t *response)
+{
+    mem_free(response->error_message);
+    response->error_message = NULL;
+}
+
+/* Appends the "name" member of the object at the reader to names. */
+static int name_decode(mcp_json_reader_t *reader, int *n_names, char ***names)
+{
+    const char *key;
+    size_t      key_len;
+    char       *name = NULL;
+    int         ret;
+
+    if (mcp_json_object_begin(reader) != 0) {
+        return -1;
+    }
+    while ((ret = mcp_json_object_next(reader, &key, &key_len)) == 1) {
+        if (mcp_json_key_is(key, key_len, "name") && name == NULL) {
+            ret = mcp_json_read_string(reader, &name);
+        } else {
+            ret = mcp_json_skip(reader);
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+    if (ret != 0 || name == NULL) {
+        mem_free(name);
+        return -1;
+    }
+    *names             = mem_realloc(*names, (*n_names + 1) * sizeof(char *));
+    (*names)[*n_names] = name;
+    (*n_names)++;
+    return 0;
+}
+
+/* Appends the names of the array of objects at the reader to names. */
+static int names_decode(mcp_json_reader_t *reader, int *n_names,
+                        char ***names)
+{
+    int ret;
+
+    if (mcp_json_array_begin(reader) != 0) {
+        return -1;
+    }
+    while ((ret = mcp_json_array_next(reader)) == 1) {
+        if (name_decode(reader, n_names, names) != 0) {
+            return -1;
+        }
+    }
+    return ret;
+}
+
+/* Enters the object at the reader and stops at the value of member name. */
+static int member_find(mcp_json_reader_t *reader, const char *name)
+{
+    const char *key;
+    size_t      key_len;
+    int         ret;
+
+    if (mcp_json_object_begin(reader) != 0) {
+        return -1;
+    }
+    while ((ret = mcp_json_object_next(reader, &key, &key_len)) == 1) {
+        if (mcp_json_key_is(key, key_len, name)) {
+            return 0;
+        }
+        if (mcp_json_skip(reader) != 0) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+int jsonrpc_server_online_decode(const char *json, size_t len,
+                                 char **description, int *n_roles,
+                                 char ***roles)
+{
+    jsonrpc_response_t notification;
+    const char        *key;
+    size_t             key_len;
+    int                ret;
+
+    *description = NULL;
+    *n_roles     = 0;
+    *roles       = NULL;
+    if (jsonrpc_response_scan(json, len, &notification) != 0) {
+        return -1;
+    }
+    jsonrpc_response_free(&notification);
+
+    mcp_json_reader_t reader = {
+        .pos = notification.result,
+        .end = notification.result + notification.result_len,
+    };
+    if (notification.result == NULL || mcp_json_object_begin(&reader) != 0) {
+        return -1;
+    }
+    while ((ret = mcp_json_object_next(&reader, &key, &key_len)) == 1) {
+        if (mcp_json_key_is(key, key_len, "description") &&
+            *description == NULL) {
+            ret = mcp_json_read_string(&reader, description);
+        } else if (mcp_json_key_is(key, key_len, "meta")) {
+            // meta.rbac.roles, the rest of meta is of no interest
+            mcp_json_reader_t meta = reader;
+            if (member_find(&meta, "rbac") == 0 &&
+                member_find(&meta, "roles") == 0) {
+                names_decode(&meta, n_roles, roles);
+            }
+            ret = mcp_json_skip(&reader);
+        } else {
+            ret = mcp_json_skip(&reader);
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+    return ret == 0 ? 0 : -1;
+}
+
+int jsonrpc_tool_names_decode(const char *json, size_t len, int *n_names,
+                              char ***names, char **next_cursor)
+{
+    mcp_json_reader_t reader = { .pos = json, .end = json + len };
+    const char       *key;
+    size_t            key_len;
+    int               ret;
+
+    *next_cursor = NULL;
+    if (mcp_json_object_begin(&reader) != 0) {
+        return -1;
+    }
+    while ((ret = mcp_json_object_next(&reader, &key, &key_len)) == 1) {
+        if (mcp_json_key_is(key, key_len, "tools")) {
+            ret = names_decode(&reader, n_names, names);
+        } else if (mcp_json_key_is(key, key_len, "nextCursor") &&
+                   *next_cursor == NULL) {
+            ret = mcp_json_read_string(&reader, next_cursor);
+        } else {
+            ret = mcp_json_skip(&reader);
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+    if (ret != 0) {
+        mem_free(*next_cursor);
+        *next_cursor = NULL;
+        return -1;
+    }
+    return 0;
+}
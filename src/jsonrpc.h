@@ -2,6 +2,8 @@
 #define MCP_JSONRPC_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "mcp.h"
 
@@ -9,8 +11,25 @@ typedef struct jsonrpc        jsonrpc_t;
 typedef struct jsonrpc_id     jsonrpc_id_t;
 typedef struct jsonrpc_result jsonrpc_result_t;
 
+/*
+ * Builders return NULL when the memory pools are exhausted, and encoding
+ * NULL, or a message missing a part the pools refused, returns NULL.
+ * Decoders return JSONRPC_EXHAUSTED then.
+ */
+#define JSONRPC_EXHAUSTED (-12)
+
 char      *jsonrpc_encode(jsonrpc_t *jsonrpc);
-jsonrpc_t *jsonrpc_decode(const char *json_str);
+jsonrpc_t *jsonrpc_decode(const char *json, size_t len);
+
+/*
+ * Counts what cJSON allocates from then on, process wide: the trees being
+ * built or held, not the text printed from them, which belongs to the
+ * caller. Call before any JSON is handled. jsonrpc_memory_allocated is a
+ * running total for the calling thread, to measure what one decode costs.
+ */
+void   jsonrpc_track_memory(void);
+void   jsonrpc_memory_usage(size_t *in_use, size_t *peak);
+size_t jsonrpc_memory_allocated(void);
 
 void jsonrpc_decode_free(jsonrpc_t *jsonrpc);
 
@@ -18,25 +37,116 @@ char               *jsonrpc_get_method(const jsonrpc_t *jsonrpc);
 const jsonrpc_id_t *jsonrpc_get_id(const jsonrpc_t *jsonrpc);
 bool                jsonrpc_id_exists(const jsonrpc_id_t *id);
 
-int jsonrpc_tool_call_decode(const jsonrpc_t *jsonrpc, char **function_name,
-                             int *n_args, property_t **args);
-int jsonrpc_resource_read_decode(const jsonrpc_t *jsonrpc, char **uri);
+bool          jsonrpc_id_equal(const jsonrpc_id_t *a, const jsonrpc_id_t *b);
+uint64_t      jsonrpc_id_hash(const jsonrpc_id_t *id);
+jsonrpc_id_t *jsonrpc_id_dup(const jsonrpc_id_t *id);
+void          jsonrpc_id_free(jsonrpc_id_t *id);
+/* Writes the id as JSON if it fits in size bytes, returns its length. */
+size_t jsonrpc_id_print(const jsonrpc_id_t *id, char *buf, size_t size);
+
+int jsonrpc_get_meta_int(const jsonrpc_t *jsonrpc, const char *key,
+                         long long *value);
+/* The request's _meta.progressToken as JSON text, NULL when it has none. */
+char *jsonrpc_progress_token(const jsonrpc_t *jsonrpc);
+
+int jsonrpc_list_decode(const jsonrpc_t *jsonrpc, char **cursor);
+const char *jsonrpc_tool_call_name(const jsonrpc_t *jsonrpc);
+int         jsonrpc_tool_call_arguments(const jsonrpc_t *jsonrpc,
+                                        char           **arguments);
+int         jsonrpc_tool_call_argument_count(const jsonrpc_t *jsonrpc);
+/*
+ * The arguments as compact JSON with the members of every object sorted by
+ * key, so arguments that only differ in how they were written print alike.
+ */
+char *jsonrpc_tool_call_canonical_arguments(const jsonrpc_t *jsonrpc);
+/*
+ * Decodes a call's arguments against the tool's schema into
+ * tool->property_count entries in schema order. Returns -4 when they do not
+ * match it.
+ */
+int  jsonrpc_tool_call_args(const jsonrpc_t *jsonrpc, const mcp_tool_t *tool,
+                            property_t **args);
+void jsonrpc_tool_call_args_free(int n_args, property_t *args);
+int  jsonrpc_resource_read_decode(const jsonrpc_t *jsonrpc, char **uri);
+int  jsonrpc_cancelled_decode(const jsonrpc_t *jsonrpc,
+                              jsonrpc_id_t   **request_id);
 
 jsonrpc_t *jsonrpc_server_online(const char *server_name,
                                  const char *description, int n_roles,
                                  mcp_mqtt_role_t *roles);
+jsonrpc_t *jsonrpc_notification(const char *method);
+/* token is JSON text, total <= 0 when unknown and message may be NULL. */
+jsonrpc_t *jsonrpc_progress_notification(const char *token, double progress,
+                                         double total, const char *message);
+jsonrpc_t *jsonrpc_partial_notification(const char *token, const char *text);
 jsonrpc_t *jsonrpc_error_response(const jsonrpc_id_t *id, int code,
                                   const char *message);
+jsonrpc_t *jsonrpc_retry_error_response(const jsonrpc_id_t *id, int code,
+                                        const char *message,
+                                        long long   retry_after_ms);
 jsonrpc_t *jsonrpc_init_response(const jsonrpc_id_t *id, bool tools,
                                  bool resources);
-jsonrpc_t *jsonrpc_tool_list_response(const jsonrpc_id_t *id, int n_tools,
-                                      mcp_tool_t *tools);
-jsonrpc_t *jsonrpc_tool_call_response(const jsonrpc_id_t *id,
-                                      const char         *result);
-
-jsonrpc_t *jsonrpc_resource_list_response(const jsonrpc_id_t *id,
-                                          int                 n_resources,
-                                          mcp_resource_t     *resources);
+
+/* Serialized JSON arrays of list entries, the bodies of list pages. */
+char      *jsonrpc_tool_list_items(int n_tools, const mcp_tool_t *tools);
+char      *jsonrpc_resource_list_items(int                   n_resources,
+                                       const mcp_resource_t *resources);
+jsonrpc_t *jsonrpc_list_page_response(const jsonrpc_id_t *id, const char *key,
+                                      const char *items,
+                                      const char *next_cursor);
+
+/*
+ * Requests of the client side, whose ids are always integers assigned by the
+ * caller. arguments is the JSON text of an object or NULL, it is passed as
+ * the kwargs of the call like the server expects.
+ */
+jsonrpc_t *jsonrpc_request(long long id, const char *method);
+jsonrpc_t *jsonrpc_init_request(long long id, const char *client_name);
+jsonrpc_t *jsonrpc_list_request(long long id, const char *method,
+                                const char *cursor);
+jsonrpc_t *jsonrpc_tool_call_request(long long id, const char *name,
+                                     const char *arguments, int timeout_ms);
+jsonrpc_t *jsonrpc_resource_read_request(long long id, const char *uri);
+jsonrpc_t *jsonrpc_cancelled_notification(long long request_id);
+
+/* Fields of a response or notification, located in place by a scan. */
+typedef struct {
+    long long   id; // -1 when there is no integer id
+    const char *method;
+    size_t      method_len;
+    const char *result; // or the params of a notification
+    size_t      result_len;
+    int         error_code; // 0 unless the response is an error
+    char       *error_message;
+} jsonrpc_response_t;
+
+/*
+ * Finds the id, method and result or error of the len bytes of json without
+ * building a tree; method and result point into json and are not terminated.
+ * Returns -1 when json is not a JSON object.
+ */
+int  jsonrpc_response_scan(const char *json, size_t len,
+                           jsonrpc_response_t *response);
+void jsonrpc_response_free(jsonrpc_response_t *response);
+/*
+ * The id of a request found by a scan, without parsing the rest of it: NULL
+ * when there is none, one that does not exist when it is not valid.
+ */
+jsonrpc_id_t *jsonrpc_id_scan(const char *json, size_t len);
+/*
+ * The description and role names a server announces in
+ * notifications/server/online.
+ */
+int jsonrpc_server_online_decode(const char *json, size_t len,
+                                 char **description, int *n_roles,
+                                 char ***roles);
+/*
+ * Appends the tool names of a tools/list result to names, which grows by
+ * realloc, and returns its nextCursor, NULL on the last page.
+ */
+int jsonrpc_tool_names_decode(const char *json, size_t len, int *n_names,
+                              char ***names, char **next_cursor);
+
 jsonrpc_t *jsonrpc_resource_read_text_response(const jsonrpc_id_t *id,
                                                mcp_resource_t     *resource,
                                                const char         *content);
@@ -0,0 +1,1060 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <MQTTAsync.h>
+
+#include "discovery.h"
+#include "jsonrpc.h"
+#include "mcp_client.h"
+#include "mcp_json.h"
+#include "mem.h"
+#include "pending.h"
+#include "reconnect.h"
+
+#define PRESENCE_PREFIX "$mcp-server/presence/"
+
+struct mcp_client_session {
+    mcp_client_t *client;
+    char         *server_id;
+    char         *server_name;
+    char         *topic;         // $mcp-rpc/{client}/{server id}/{name}
+    char         *control_topic; // where initialize goes
+
+    atomic_llong     next_id;
+    pending_table_t *pending;
+
+    // tools/list pages collected so far, handed to discovery at the end
+    bool   listing;
+    bool   relist; // the list changed while it was fetched
+    int    n_listed;
+    char **listed;
+
+    struct mcp_client_session *next;
+};
+
+struct mcp_client {
+    char *name;
+    char *broker_uri;
+    char *client_id;
+    char *user;
+    char *password;
+    char *cert;
+    char *presence_topic;
+
+    MQTTAsync                client;
+    MQTTAsync_connectOptions conn_opts;
+    MQTTAsync_willOptions    will_opts;
+    MQTTProperties           connect_props;
+
+    reconnect_t *reconnect;
+    int          reconnect_min_ms;
+    int          reconnect_max_ms;
+    int          call_timeout_ms;
+
+    mcp_client_presence_fn presence;
+    void                  *presence_ctx;
+    discovery_t           *discovery;
+
+    /*
+     * Guards the state below; responses are completed while holding it, so
+     * a session is never freed under the callback thread.
+     */
+    pthread_mutex_t       lock;
+    pthread_cond_t        cond; // connection and discovery changes
+    bool                  connected;
+    mcp_client_session_t *sessions;
+};
+
+struct mcp_future {
+    atomic_int      refs;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    bool            done;
+
+    mcp_client_response_t response;
+    char                 *result;
+    char                 *message;
+};
+
+static MQTTProperty component_property = {
+    .identifier  = MQTTPROPERTY_CODE_USER_PROPERTY,
+    .value.data  = { .len = 18, .data = "MCP-COMPONENT-TYPE" },
+    .value.value = { .len = 10, .data = "mcp-client" },
+};
+
+static char *format_topic(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    char *topic = mem_alloc(len + 1);
+    if (topic == NULL) {
+        return NULL;
+    }
+    va_start(args, fmt);
+    vsnprintf(topic, len + 1, fmt, args);
+    va_end(args);
+    return topic;
+}
+
+static void deadline_after(int timeout_ms, struct timespec *ts)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static void cond_init_monotonic(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void future_retain(mcp_future_t *future)
+{
+    atomic_fetch_add(&future->refs, 1);
+}
+
+static void future_release(mcp_future_t *future)
+{
+    if (atomic_fetch_sub(&future->refs, 1) != 1) {
+        return;
+    }
+    pthread_cond_destroy(&future->cond);
+    pthread_mutex_destroy(&future->lock);
+    mem_free(future->result);
+    mem_free(future->message);
+    mem_free(future);
+}
+
+mcp_future_t *mcp_future_create(void)
+{
+    mcp_future_t *future = mem_calloc(1, sizeof(mcp_future_t));
+    if (future == NULL) {
+        return NULL;
+    }
+
+    atomic_init(&future->refs, 1);
+    pthread_mutex_init(&future->lock, NULL);
+    cond_init_monotonic(&future->cond);
+    return future;
+}
+
+void mcp_future_callback(void *ctx, const mcp_client_response_t *response)
+{
+    mcp_future_t *future = (mcp_future_t *) ctx;
+
+    pthread_mutex_lock(&future->lock);
+    if (response->result) {
+        future->result = mem_alloc(response->result_len + 1);
+    }
+    if (response->message) {
+        future->message = mem_strdup(response->message);
+    }
+    future->response.error   = response->error;
+    future->response.message = future->message;
+    if (future->result) {
+        memcpy(future->result, response->result, response->result_len);
+        future->result[response->result_len] = '\0';
+        future->response.result     = future->result;
+        future->response.result_len = response->result_len;
+    } else if (response->result) {
+        // an internal error, the result could not be kept
+        future->response.error   = -32603;
+        future->response.message = "Out of memory";
+    }
+    future->done = true;
+    pthread_cond_broadcast(&future->cond);
+    pthread_mutex_unlock(&future->lock);
+
+    // taken when the request was issued
+    future_release(future);
+}
+
+int mcp_future_wait(mcp_future_t *future, int timeout_ms)
+{
+    struct timespec ts;
+    int             ret = 0;
+
+    if (timeout_ms >= 0) {
+        deadline_after(timeout_ms, &ts);
+    }
+    pthread_mutex_lock(&future->lock);
+    while (!future->done && ret == 0) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&future->cond, &future->lock);
+        } else {
+            ret = pthread_cond_timedwait(&future->cond, &future->lock, &ts);
+        }
+    }
+    bool done = future->done;
+    pthread_mutex_unlock(&future->lock);
+    return done ? 0 : -1;
+}
+
+const mcp_client_response_t *mcp_future_response(const mcp_future_t *future)
+{
+    return future->done ? &future->response : NULL;
+}
+
+void mcp_future_free(mcp_future_t *future)
+{
+    if (future) {
+        future_release(future);
+    }
+}
+
+static void pending_complete(pending_t *pending,
+                             const mcp_client_response_t *response)
+{
+    if (pending->callback) {
+        pending->callback(pending->ctx, response);
+    }
+    mem_free(pending);
+}
+
+/* Fails every request of the session that is still waiting. */
+static void session_fail(mcp_client_session_t *session, const char *message)
+{
+    mcp_client_response_t response = {
+        .error   = MCP_CLIENT_CLOSED,
+        .message = message,
+    };
+    pending_t *pending = pending_take_all(session->pending);
+
+    while (pending) {
+        pending_t *next = pending->next;
+        pending_complete(pending, &response);
+        pending = next;
+    }
+}
+
+static int session_publish(mcp_client_session_t *session, const char *topic,
+                           jsonrpc_t *jsonrpc, MQTTProperties *props)
+{
+    char *data = jsonrpc_encode(jsonrpc);
+    if (data == NULL) {
+        return -1;
+    }
+
+    MQTTAsync_message msg = MQTTAsync_message_initializer;
+    msg.payload           = (void *) data;
+    msg.payloadlen        = (int) strlen(data);
+    msg.qos               = 0;
+    msg.retained          = 0;
+    if (props) {
+        msg.properties = *props;
+    }
+
+    int ret = MQTTAsync_sendMessage(session->client->client, topic, &msg, NULL);
+    mem_free(data);
+    return ret == MQTTASYNC_SUCCESS ? 0 : -1;
+}
+
+/*
+ * Registers the request before publishing it, its response may arrive before
+ * MQTTAsync_sendMessage returns.
+ */
+static long long session_request(mcp_client_session_t *session, long long id,
+                                 jsonrpc_t *jsonrpc,
+                                 mcp_client_callback callback, void *ctx)
+{
+    pending_t *pending = mem_calloc(1, sizeof(pending_t));
+    if (pending == NULL) {
+        mem_free(jsonrpc_encode(jsonrpc)); // consumes the message
+        return -1;
+    }
+
+    pending->id       = id;
+    pending->callback = callback;
+    pending->ctx      = ctx;
+    if (callback == mcp_future_callback) {
+        future_retain((mcp_future_t *) ctx);
+    }
+    pending_insert(session->pending, pending);
+
+    if (session_publish(session, session->topic, jsonrpc, NULL) != 0) {
+        pending = pending_take(session->pending, id);
+        if (pending == NULL) {
+            return id; // failed as the connection dropped, already reported
+        }
+        if (callback == mcp_future_callback) {
+            future_release((mcp_future_t *) ctx);
+        }
+        mem_free(pending);
+        return -1;
+    }
+    return id;
+}
+
+static long long session_next_id(mcp_client_session_t *session)
+{
+    return atomic_fetch_add(&session->next_id, 1);
+}
+
+long long mcp_client_call_tool(mcp_client_session_t *session, const char *name,
+                               const char *arguments,
+                               mcp_client_callback callback, void *ctx)
+{
+    long long id = session_next_id(session);
+
+    return session_request(
+        session, id,
+        jsonrpc_tool_call_request(id, name, arguments,
+                                  session->client->call_timeout_ms),
+        callback, ctx);
+}
+
+long long mcp_client_read_resource(mcp_client_session_t *session,
+                                   const char *uri,
+                                   mcp_client_callback callback, void *ctx)
+{
+    long long id = session_next_id(session);
+
+    return session_request(session, id,
+                           jsonrpc_resource_read_request(id, uri), callback,
+                           ctx);
+}
+
+long long mcp_client_list_tools(mcp_client_session_t *session,
+                                const char *cursor,
+                                mcp_client_callback callback, void *ctx)
+{
+    long long id = session_next_id(session);
+
+    return session_request(session, id,
+                           jsonrpc_list_request(id, "tools/list", cursor),
+                           callback, ctx);
+}
+
+long long mcp_client_list_resources(mcp_client_session_t *session,
+                                    const char          *cursor,
+                                    mcp_client_callback  callback, void *ctx)
+{
+    long long id = session_next_id(session);
+
+    return session_request(session, id,
+                           jsonrpc_list_request(id, "resources/list", cursor),
+                           callback, ctx);
+}
+
+int mcp_client_cancel(mcp_client_session_t *session, long long id)
+{
+    pending_t *pending = pending_take(session->pending, id);
+    if (pending == NULL) {
+        return -1;
+    }
+
+    mcp_client_response_t response = {
+        .error   = -32800,
+        .message = "Request cancelled",
+    };
+    session_publish(session, session->topic,
+                    jsonrpc_cancelled_notification(id), NULL);
+    pending_complete(pending, &response);
+    return 0;
+}
+
+typedef struct {
+    mcp_client_t *client;
+    long long     id; // the initialize request waiting for the subscription
+    char          topic[];
+} subscribe_ctx_t;
+
+static mcp_client_session_t *find_session(mcp_client_t *client,
+                                          const char   *topic)
+{
+    mcp_client_session_t *session = client->sessions;
+
+    while (session && strcmp(session->topic, topic) != 0) {
+        session = session->next;
+    }
+    return session;
+}
+
+static void on_session_subscribe(void *ctx, MQTTAsync_successData5 *response)
+{
+    subscribe_ctx_t *sub    = (subscribe_ctx_t *) ctx;
+    mcp_client_t    *client = sub->client;
+    (void) response;
+
+    MQTTProperty client_id = {
+        .identifier  = MQTTPROPERTY_CODE_USER_PROPERTY,
+        .value.data  = { .len = 18, .data = "MCP-MQTT-CLIENT-ID" },
+        .value.value = { .len  = (int) strlen(client->client_id),
+                         .data = client->client_id },
+    };
+    MQTTProperties props = MQTTProperties_initializer;
+    MQTTProperties_add(&props, &client_id);
+    MQTTProperties_add(&props, &component_property);
+
+    pthread_mutex_lock(&client->lock);
+    mcp_client_session_t *session = find_session(client, sub->topic);
+    if (session &&
+        session_publish(session, session->control_topic,
+                        jsonrpc_init_request(sub->id, client->name),
+                        &props) != 0) {
+        mcp_client_response_t failure = {
+            .error   = MCP_CLIENT_CLOSED,
+            .message = "Failed to send initialize",
+        };
+        pending_t *pending = pending_take(session->pending, sub->id);
+        if (pending) {
+            pending_complete(pending, &failure);
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    MQTTProperties_free(&props);
+    mem_free(sub);
+}
+
+static void on_session_subscribe_failure(void                   *ctx,
+                                         MQTTAsync_failureData5 *response)
+{
+    subscribe_ctx_t *sub    = (subscribe_ctx_t *) ctx;
+    mcp_client_t    *client = sub->client;
+
+    printf("Failed to subscribe %s, rc %d\n", sub->topic, response->code);
+
+    pthread_mutex_lock(&client->lock);
+    mcp_client_session_t *session = find_session(client, sub->topic);
+    if (session) {
+        mcp_client_response_t failure = {
+            .error   = MCP_CLIENT_CLOSED,
+            .message = "Failed to subscribe",
+        };
+        pending_t *pending = pending_take(session->pending, sub->id);
+        if (pending) {
+            pending_complete(pending, &failure);
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+    mem_free(sub);
+}
+
+/*
+ * Subscribes the session topic and sends initialize once the broker
+ * confirmed it, so the server's answer cannot arrive before we listen. The
+ * response is followed by notifications/initialized.
+ */
+static int session_initialize(mcp_client_session_t *session,
+                              mcp_client_callback callback, void *ctx)
+{
+    mcp_client_t    *client  = session->client;
+    long long        id      = session_next_id(session);
+    size_t           len     = strlen(session->topic) + 1;
+    subscribe_ctx_t *sub     = mem_alloc(sizeof(subscribe_ctx_t) + len);
+    pending_t       *pending = mem_calloc(1, sizeof(pending_t));
+
+    if (sub == NULL || pending == NULL) {
+        mem_free(sub);
+        mem_free(pending);
+        return -1;
+    }
+    sub->client = client;
+    sub->id     = id;
+    memcpy(sub->topic, session->topic, len);
+
+    pending->id         = id;
+    pending->initialize = true;
+    pending->callback   = callback;
+    pending->ctx        = ctx;
+    if (callback == mcp_future_callback) {
+        future_retain((mcp_future_t *) ctx);
+    }
+    pending_insert(session->pending, pending);
+
+    MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
+    opts.subscribeOptions.noLocal  = 1; // we publish requests there as well
+    opts.onSuccess5                = on_session_subscribe;
+    opts.onFailure5                = on_session_subscribe_failure;
+    opts.context                   = sub;
+
+    if (MQTTAsync_subscribe(client->client, session->topic, 0, &opts) !=
+        MQTTASYNC_SUCCESS) {
+        mem_free(sub);
+        pending = pending_take(session->pending, id);
+        if (pending) {
+            if (callback == mcp_future_callback) {
+                future_release((mcp_future_t *) ctx);
+            }
+            mem_free(pending);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static void listed_free(mcp_client_session_t *session)
+{
+    for (int i = 0; i < session->n_listed; i++) {
+        mem_free(session->listed[i]);
+    }
+    mem_free(session->listed);
+    session->listed   = NULL;
+    session->n_listed = 0;
+}
+
+static void list_tools(mcp_client_session_t *session, const char *cursor);
+
+/* Collects a page of the session's tools, the last one updates discovery. */
+static void tools_listed(void *ctx, const mcp_client_response_t *response)
+{
+    mcp_client_session_t *session = (mcp_client_session_t *) ctx;
+    char                 *cursor  = NULL;
+
+    if (response->error != 0 ||
+        jsonrpc_tool_names_decode(response->result, response->result_len,
+                                  &session->n_listed, &session->listed,
+                                  &cursor) != 0) {
+        listed_free(session);
+        session->listing = false;
+        return;
+    }
+    if (cursor) {
+        list_tools(session, cursor);
+        mem_free(cursor);
+        return;
+    }
+
+    discovery_set_tools(session->client->discovery, session->server_id,
+                        session->server_name, session->n_listed,
+                        session->listed);
+    session->listed   = NULL;
+    session->n_listed = 0;
+    session->listing  = false;
+    if (session->relist) {
+        session->relist = false;
+        list_tools(session, NULL);
+    }
+}
+
+static void list_tools(mcp_client_session_t *session, const char *cursor)
+{
+    if (cursor == NULL && session->listing) {
+        session->relist = true; // start over once this listing is done
+        return;
+    }
+    if (cursor == NULL) {
+        listed_free(session);
+    }
+    session->listing = true;
+    if (mcp_client_list_tools(session, cursor, tools_listed, session) < 0) {
+        listed_free(session);
+        session->listing = false;
+    }
+}
+
+static void session_response(mcp_client_session_t *session,
+                             const MQTTAsync_message *message)
+{
+    jsonrpc_response_t scan;
+
+    if (jsonrpc_response_scan(message->payload, message->payloadlen,
+                              &scan) != 0) {
+        return;
+    }
+    if (scan.method) {
+        // notifications carry no id, none of them is waited for
+        static const char list_changed[] = "notifications/tools/list_changed";
+        if (scan.method_len == sizeof(list_changed) - 1 &&
+            memcmp(scan.method, list_changed, scan.method_len) == 0) {
+            list_tools(session, NULL);
+        }
+    } else if (scan.id >= 0) {
+        pending_t *pending = pending_take(session->pending, scan.id);
+        if (pending) {
+            mcp_client_response_t response = {
+                .error      = scan.error_code,
+                .message    = scan.error_message,
+                .result     = scan.error_code ? NULL : scan.result,
+                .result_len = scan.error_code ? 0 : scan.result_len,
+            };
+            bool initialized = pending->initialize && scan.error_code == 0;
+            if (initialized) {
+                session_publish(session, session->topic,
+                                jsonrpc_notification(
+                                    "notifications/initialized"),
+                                NULL);
+            }
+            pending_complete(pending, &response);
+            if (initialized) {
+                list_tools(session, NULL);
+            }
+        }
+    }
+    jsonrpc_response_free(&scan);
+}
+
+static void roles_free(int n_roles, char **roles)
+{
+    for (int i = 0; i < n_roles; i++) {
+        mem_free(roles[i]);
+    }
+    mem_free(roles);
+}
+
+static void server_presence(mcp_client_t *client, const char *topic,
+                            const MQTTAsync_message *message)
+{
+    const char *server_id   = topic + strlen(PRESENCE_PREFIX);
+    const char *server_name = strchr(server_id, '/');
+    if (server_name == NULL || server_name == server_id) {
+        return;
+    }
+
+    char  *id      = mem_strndup(server_id, server_name - server_id);
+    char  *name    = mem_strdup(server_name + 1);
+    char **roles   = NULL;
+    bool   online  = message->payloadlen > 0;
+    bool   changed = false;
+
+    if (id == NULL || name == NULL) {
+        mem_free(id);
+        mem_free(name);
+        return;
+    }
+
+    mcp_server_info_t info = { .server_id = id, .server_name = name };
+
+    if (online) {
+        jsonrpc_server_online_decode(message->payload, message->payloadlen,
+                                     (char **) &info.description,
+                                     &info.n_roles, &roles);
+        info.roles = (const char *const *) roles;
+        changed    = discovery_online(client->discovery, &info);
+    } else {
+        changed = discovery_offline(client->discovery, id, name);
+    }
+
+    pthread_mutex_lock(&client->lock);
+    for (mcp_client_session_t *session = client->sessions; session;
+         session = session->next) {
+        if (strcmp(session->server_id, id) != 0 ||
+            strcmp(session->server_name, name) != 0) {
+            continue;
+        }
+        if (!online) {
+            // its responses are not coming, fail what waits for them
+            session_fail(session, "Server went offline");
+        } else if (changed) {
+            // back after going away, it no longer knows our sessions
+            session_initialize(session, NULL, NULL);
+        }
+    }
+    pthread_cond_broadcast(&client->cond);
+    mcp_client_presence_fn presence     = client->presence;
+    void                  *presence_ctx = client->presence_ctx;
+    pthread_mutex_unlock(&client->lock);
+
+    if (presence) {
+        presence(presence_ctx, &info, online);
+    }
+    mem_free(id);
+    mem_free(name);
+    mem_free((char *) info.description);
+    roles_free(info.n_roles, roles);
+}
+
+static int msg_arrvd(void *ctx, char *topic, int topicLen,
+                     MQTTAsync_message *message)
+{
+    mcp_client_t *client = (mcp_client_t *) ctx;
+    (void) topicLen; // paho terminates topic names
+
+    if (!mcp_json_valid_utf8(message->payload, message->payloadlen)) {
+        printf("Dropping a message that is not UTF-8 on %s\n", topic);
+    } else if (strncmp(topic, PRESENCE_PREFIX, strlen(PRESENCE_PREFIX)) == 0) {
+        server_presence(client, topic, message);
+    } else if (strncmp(topic, "$mcp-rpc/", strlen("$mcp-rpc/")) == 0) {
+        pthread_mutex_lock(&client->lock);
+        mcp_client_session_t *session = find_session(client, topic);
+        if (session) {
+            session_response(session, message);
+        }
+        pthread_mutex_unlock(&client->lock);
+    }
+
+    MQTTAsync_freeMessage(&message);
+    MQTTAsync_free(topic);
+    return 1;
+}
+
+static void reconnect_broker(void *ctx)
+{
+    mcp_client_t *client = (mcp_client_t *) ctx;
+
+    int ret = MQTTAsync_connect(client->client, &client->conn_opts);
+    printf("Reconnecting to MQTT broker: %s, %d\n", client->broker_uri, ret);
+    if (ret != MQTTASYNC_SUCCESS) {
+        reconnect_schedule(client->reconnect);
+    }
+}
+
+static void conn_lost(void *ctx, char *cause)
+{
+    mcp_client_t *client = (mcp_client_t *) ctx;
+
+    printf("Connection lost: %s\n", cause ? cause : "unknown");
+
+    // responses sent while we are away are lost, fail what waits for them
+    pthread_mutex_lock(&client->lock);
+    client->connected = false;
+    for (mcp_client_session_t *session = client->sessions; session;
+         session = session->next) {
+        session_fail(session, "Connection lost");
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    reconnect_schedule(client->reconnect);
+}
+
+static void on_connect_failure(void *ctx, MQTTAsync_failureData5 *response)
+{
+    mcp_client_t *client = (mcp_client_t *) ctx;
+
+    printf("Connection failed, rc %d\n", response->code);
+    reconnect_schedule(client->reconnect);
+}
+
+/*
+ * Every connect starts clean: discovery is subscribed again and the open
+ * sessions initialize again, since our will told the servers we left.
+ */
+static void on_connect(void *ctx, MQTTAsync_successData5 *response)
+{
+    mcp_client_t *client = (mcp_client_t *) ctx;
+    (void) response;
+
+    reconnect_reset(client->reconnect);
+    printf("Connected to MQTT broker: %s\n", client->broker_uri);
+
+    MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
+    MQTTAsync_subscribe(client->client, PRESENCE_PREFIX "+/+", 0, &opts);
+
+    pthread_mutex_lock(&client->lock);
+    client->connected = true;
+    for (mcp_client_session_t *session = client->sessions; session;
+         session = session->next) {
+        session_initialize(session, NULL, NULL);
+    }
+    pthread_cond_broadcast(&client->cond);
+    pthread_mutex_unlock(&client->lock);
+}
+
+/* What mcp_client_init allocates before the MQTT client is created. */
+static void client_free(mcp_client_t *client)
+{
+    discovery_destroy(client->discovery);
+    mem_free(client->name);
+    mem_free(client->broker_uri);
+    mem_free(client->client_id);
+    mem_free(client->user);
+    mem_free(client->password);
+    mem_free(client->cert);
+    mem_free(client->presence_topic);
+    mem_free(client);
+}
+
+mcp_client_t *mcp_client_init(const char *name, const char *broker_uri,
+                              const char *client_id, const char *user,
+                              const char *password, const char *cert)
+{
+    MQTTAsync_connectOptions conn_opts = MQTTAsync_connectOptions_initializer5;
+    MQTTAsync_willOptions    will_opts = MQTTAsync_willOptions_initializer;
+    MQTTAsync_createOptions  create_opts = MQTTAsync_createOptions_initializer5;
+
+    if (!name || !broker_uri || !client_id) {
+        return NULL;
+    }
+#ifdef MCP_STATIC_MEMORY
+    jsonrpc_track_memory(); // cJSON allocates from the pools as well
+#endif
+
+    mcp_client_t *client = mem_calloc(1, sizeof(mcp_client_t));
+    if (client == NULL) {
+        return NULL;
+    }
+
+    client->name           = mem_strdup(name);
+    client->broker_uri     = mem_strdup(broker_uri);
+    client->client_id      = mem_strdup(client_id);
+    client->user           = user ? mem_strdup(user) : NULL;
+    client->password       = password ? mem_strdup(password) : NULL;
+    client->cert           = cert ? mem_strdup(cert) : NULL;
+    client->presence_topic =
+        format_topic("$mcp-client/presence/%s", client_id);
+    client->discovery = discovery_create();
+    if (!client->name || !client->broker_uri || !client->client_id ||
+        (user && !client->user) || (password && !client->password) ||
+        (cert && !client->cert) || !client->presence_topic ||
+        !client->discovery) {
+        client_free(client);
+        return NULL;
+    }
+
+    int ret = MQTTAsync_createWithOptions(
+        &client->client, client->broker_uri, client->client_id,
+        MQTTCLIENT_PERSISTENCE_NONE, NULL, &create_opts);
+    if (ret != MQTTASYNC_SUCCESS) {
+        printf("Failed to create MQTT client, return code %d\n", ret);
+        client_free(client);
+        return NULL;
+    }
+    MQTTAsync_setCallbacks(client->client, client, conn_lost, msg_arrvd, NULL);
+
+    will_opts.topicName = client->presence_topic;
+    will_opts.message   = "";
+    client->will_opts   = will_opts;
+
+    MQTTProperties connect_props = MQTTProperties_initializer;
+    MQTTProperties_add(&connect_props, &component_property);
+    client->connect_props = connect_props;
+
+    conn_opts.connectProperties = &client->connect_props;
+    conn_opts.will              = &client->will_opts;
+    conn_opts.username          = client->user;
+    conn_opts.password          = client->password;
+    conn_opts.onSuccess5        = on_connect;
+    conn_opts.onFailure5        = on_connect_failure;
+    conn_opts.context           = client;
+    client->conn_opts           = conn_opts;
+
+    client->reconnect_min_ms = 500;
+    client->reconnect_max_ms = 60000;
+    pthread_mutex_init(&client->lock, NULL);
+    cond_init_monotonic(&client->cond);
+
+    return client;
+}
+
+void mcp_client_close(mcp_client_t *client)
+{
+    if (client == NULL) {
+        return;
+    }
+
+    while (client->sessions) {
+        mcp_client_session_close(client->sessions);
+    }
+    reconnect_destroy(client->reconnect);
+    if (client->connected) {
+        // a clean disconnect does not publish the will
+        MQTTAsync_message msg = MQTTAsync_message_initializer;
+        MQTTAsync_sendMessage(client->client, client->presence_topic, &msg,
+                              NULL);
+
+        MQTTAsync_disconnectOptions opts =
+            MQTTAsync_disconnectOptions_initializer5;
+        MQTTAsync_disconnect(client->client, &opts);
+    }
+    MQTTAsync_destroy(&client->client);
+    MQTTProperties_free(&client->connect_props);
+
+    pthread_cond_destroy(&client->cond);
+    pthread_mutex_destroy(&client->lock);
+    client_free(client);
+}
+
+void mcp_client_on_presence(mcp_client_t *client, mcp_client_presence_fn fn,
+                            void *ctx)
+{
+    pthread_mutex_lock(&client->lock);
+    client->presence     = fn;
+    client->presence_ctx = ctx;
+    pthread_mutex_unlock(&client->lock);
+}
+
+int mcp_client_set_call_timeout(mcp_client_t *client, int timeout_ms)
+{
+    if (timeout_ms < 0) {
+        return -1;
+    }
+    client->call_timeout_ms = timeout_ms;
+    return 0;
+}
+
+int mcp_client_set_reconnect(mcp_client_t *client, int min_ms, int max_ms)
+{
+    if (client->reconnect != NULL || min_ms < 0 || max_ms < min_ms) {
+        return -1;
+    }
+    client->reconnect_min_ms = min_ms;
+    client->reconnect_max_ms = max_ms;
+    return 0;
+}
+
+int mcp_client_connect(mcp_client_t *client, int timeout_ms)
+{
+    if (client->reconnect == NULL) {
+        client->reconnect =
+            reconnect_create(client->reconnect_min_ms,
+                             client->reconnect_max_ms, reconnect_broker,
+                             client);
+    }
+
+    int ret = MQTTAsync_connect(client->client, &client->conn_opts);
+    printf("Connecting to MQTT broker: %s\n", client->broker_uri);
+    if (ret != MQTTASYNC_SUCCESS) {
+        return -1;
+    }
+
+    struct timespec ts;
+    int             wait = 0;
+
+    deadline_after(timeout_ms, &ts);
+    pthread_mutex_lock(&client->lock);
+    while (!client->connected && wait == 0) {
+        wait = pthread_cond_timedwait(&client->cond, &client->lock, &ts);
+    }
+    bool connected = client->connected;
+    pthread_mutex_unlock(&client->lock);
+    return connected ? 0 : -1;
+}
+
+int mcp_client_find_server(mcp_client_t *client, const char *server_name,
+                           char *server_id, size_t size)
+{
+    return discovery_find_server(client->discovery, server_name, NULL,
+                                 server_id, size);
+}
+
+int mcp_client_find_tool(mcp_client_t *client, const char *tool_name,
+                         char *server_id, size_t id_size, char *server_name,
+                         size_t name_size)
+{
+    return discovery_find_tool(client->discovery, tool_name, server_id,
+                               id_size, server_name, name_size);
+}
+
+/* Waits for a matching server to be discovered, copies its id. */
+static char *find_server(mcp_client_t *client, const char *server_id,
+                         const char *server_name, struct timespec *deadline)
+{
+    char found[256];
+    int  ret  = -1;
+    int  wait = 0;
+
+    pthread_mutex_lock(&client->lock);
+    while (ret != 0 && wait == 0) {
+        ret = discovery_find_server(client->discovery, server_name, server_id,
+                                    found, sizeof(found));
+        if (ret != 0) {
+            wait = pthread_cond_timedwait(&client->cond, &client->lock,
+                                          deadline);
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+    return ret == 0 ? mem_strdup(found) : NULL;
+}
+
+static void session_free(mcp_client_session_t *session)
+{
+    pending_table_destroy(session->pending);
+    listed_free(session);
+    mem_free(session->server_id);
+    mem_free(session->server_name);
+    mem_free(session->topic);
+    mem_free(session->control_topic);
+    mem_free(session);
+}
+
+mcp_client_session_t *mcp_client_open(mcp_client_t *client,
+                                      const char   *server_id,
+                                      const char *server_name, int timeout_ms)
+{
+    struct timespec deadline;
+
+    deadline_after(timeout_ms, &deadline);
+    char *id = find_server(client, server_id, server_name, &deadline);
+    if (id == NULL) {
+        return NULL;
+    }
+
+    mcp_client_session_t *session = mem_calloc(1, sizeof(mcp_client_session_t));
+    if (session == NULL) {
+        mem_free(id);
+        return NULL;
+    }
+
+    session->client        = client;
+    session->server_id     = id;
+    session->server_name   = mem_strdup(server_name);
+    session->topic         = format_topic("$mcp-rpc/%s/%s/%s",
+                                          client->client_id, id, server_name);
+    session->control_topic =
+        format_topic("$mcp-server/%s/%s", id, server_name);
+    session->pending       = pending_table_create();
+    atomic_init(&session->next_id, 1);
+
+    mcp_future_t *future = mcp_future_create();
+    if (!session->server_name || !session->topic || !session->control_topic ||
+        !session->pending || !future) {
+        session_free(session);
+        mcp_future_free(future);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&client->lock);
+    session->next    = client->sessions;
+    client->sessions = session;
+    int ret          = session_initialize(session, mcp_future_callback, future);
+    pthread_mutex_unlock(&client->lock);
+
+    // whatever is left of the timeout
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t remaining = (int64_t) (deadline.tv_sec - now.tv_sec) * 1000 +
+                        (deadline.tv_nsec - now.tv_nsec) / 1000000;
+
+    if (ret != 0 ||
+        mcp_future_wait(future, remaining > 0 ? (int) remaining : 0) != 0 ||
+        mcp_future_response(future)->error != 0) {
+        mcp_client_session_close(session);
+        session = NULL;
+    }
+    mcp_future_free(future);
+    return session;
+}
+
+void mcp_client_session_close(mcp_client_session_t *session)
+{
+    if (session == NULL) {
+        return;
+    }
+    mcp_client_t *client = session->client;
+
+    pthread_mutex_lock(&client->lock);
+    mcp_client_session_t **slot = &client->sessions;
+    while (*slot && *slot != session) {
+        slot = &(*slot)->next;
+    }
+    if (*slot) {
+        *slot = session->next;
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
+    MQTTAsync_unsubscribe(client->client, session->topic, &opts);
+
+    session_fail(session, "Session closed");
+    session_free(session);
+}
@@ -0,0 +1,786 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define JSON_KERNEL_X86
+#endif
+
+#include "mcp_json.h"
+#include "mem.h"
+
+static void skip_space(mcp_json_reader_t *reader)
+{
+    while (reader->pos < reader->end &&
+           (*reader->pos == ' ' || *reader->pos == '\t' ||
+            *reader->pos == '\n' || *reader->pos == '\r')) {
+        reader->pos++;
+    }
+}
+
+static bool consume(mcp_json_reader_t *reader, char c)
+{
+    skip_space(reader);
+    if (reader->pos < reader->end && *reader->pos == c) {
+        reader->pos++;
+        return true;
+    }
+    return false;
+}
+
+/* Finds the closing quote of the string starting at pos, which is past '"'. */
+static const char *string_end(const mcp_json_reader_t *reader,
+                              const char              *pos)
+{
+    while (pos < reader->end && *pos != '"') {
+        if (*pos == '\\') {
+            pos++;
+        }
+        pos++;
+    }
+    return pos < reader->end ? pos : NULL;
+}
+
+void mcp_json_reader_init(mcp_json_reader_t *reader, const char *json)
+{
+    reader->pos = json;
+    reader->end = json + strlen(json);
+}
+
+int mcp_json_object_begin(mcp_json_reader_t *reader)
+{
+    return consume(reader, '{') ? 0 : -1;
+}
+
+int mcp_json_object_next(mcp_json_reader_t *reader, const char **key,
+                         size_t *key_len)
+{
+    if (consume(reader, '}')) {
+        return 0;
+    }
+    consume(reader, ','); // absent before the first member
+    if (!consume(reader, '"')) {
+        return -1;
+    }
+
+    const char *end = string_end(reader, reader->pos);
+    if (end == NULL) {
+        return -1;
+    }
+    *key        = reader->pos;
+    *key_len    = (size_t) (end - reader->pos);
+    reader->pos = end + 1;
+    return consume(reader, ':') ? 1 : -1;
+}
+
+bool mcp_json_key_is(const char *key, size_t key_len, const char *name)
+{
+    return strlen(name) == key_len && memcmp(key, name, key_len) == 0;
+}
+
+static int hex4(const char *p, unsigned int *value)
+{
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        *value <<= 4;
+        if (c >= '0' && c <= '9') {
+            *value |= (unsigned int) (c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            *value |= (unsigned int) (c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            *value |= (unsigned int) (c - 'A' + 10);
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static char *put_utf8(char *out, unsigned int cp)
+{
+    if (cp < 0x80) {
+        *out++ = (char) cp;
+    } else if (cp < 0x800) {
+        *out++ = (char) (0xc0 | cp >> 6);
+        *out++ = (char) (0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        *out++ = (char) (0xe0 | cp >> 12);
+        *out++ = (char) (0x80 | (cp >> 6 & 0x3f));
+        *out++ = (char) (0x80 | (cp & 0x3f));
+    } else {
+        *out++ = (char) (0xf0 | cp >> 18);
+        *out++ = (char) (0x80 | (cp >> 12 & 0x3f));
+        *out++ = (char) (0x80 | (cp >> 6 & 0x3f));
+        *out++ = (char) (0x80 | (cp & 0x3f));
+    }
+    return out;
+}
+
+int mcp_json_read_string(mcp_json_reader_t *reader, char **value)
+{
+    if (!consume(reader, '"')) {
+        return -1;
+    }
+    const char *end = string_end(reader, reader->pos);
+    if (end == NULL) {
+        return -1;
+    }
+
+    // unescaping never makes the string longer
+    char *out = mem_alloc((size_t) (end - reader->pos) + 1);
+    char *o   = out;
+    if (out == NULL) {
+        return -1;
+    }
+    for (const char *p = reader->pos; p < end; p++) {
+        if (*p != '\\') {
+            *o++ = *p;
+            continue;
+        }
+        switch (*++p) {
+        case 'b':
+            *o++ = '\b';
+            break;
+        case 'f':
+            *o++ = '\f';
+            break;
+        case 'n':
+            *o++ = '\n';
+            break;
+        case 'r':
+            *o++ = '\r';
+            break;
+        case 't':
+            *o++ = '\t';
+            break;
+        case 'u': {
+            unsigned int cp, low;
+            if (end - p < 5 || hex4(p + 1, &cp) != 0) {
+                mem_free(out);
+                return -1;
+            }
+            p += 4;
+            if (cp >= 0xd800 && cp < 0xdc00 && end - p >= 7 && p[1] == '\\' &&
+                p[2] == 'u' && hex4(p + 3, &low) == 0 && low >= 0xdc00 &&
+                low < 0xe000) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                p += 6;
+            }
+            o = put_utf8(o, cp);
+            break;
+        }
+        default: // '"', '\\' and '/' stand for themselves
+            *o++ = *p;
+            break;
+        }
+    }
+    *o = '\0';
+
+    reader->pos = end + 1;
+    *value      = out;
+    return 0;
+}
+
+int mcp_json_read_real(mcp_json_reader_t *reader, double *value)
+{
+    skip_space(reader);
+
+    char *end;
+    errno  = 0;
+    *value = strtod(reader->pos, &end);
+    if (end == reader->pos || errno == ERANGE) {
+        return -1;
+    }
+    reader->pos = end;
+    return 0;
+}
+
+int mcp_json_read_integer(mcp_json_reader_t *reader, long long *value)
+{
+    skip_space(reader);
+
+    char *end;
+    errno  = 0;
+    *value = strtoll(reader->pos, &end, 10);
+    if (end == reader->pos || errno == ERANGE) {
+        return -1;
+    }
+    if (*end == '.' || *end == 'e' || *end == 'E') {
+        // 3.0 or 1e3 are integers too, as long as nothing is cut off
+        double real;
+        if (mcp_json_read_real(reader, &real) != 0 || real <= -9.2e18 ||
+            real >= 9.2e18 || (double) (long long) real != real) {
+            return -1;
+        }
+        *value = (long long) real;
+        return 0;
+    }
+    reader->pos = end;
+    return 0;
+}
+
+static bool consume_word(mcp_json_reader_t *reader, const char *word)
+{
+    size_t len = strlen(word);
+
+    skip_space(reader);
+    if ((size_t) (reader->end - reader->pos) >= len &&
+        memcmp(reader->pos, word, len) == 0) {
+        reader->pos += len;
+        return true;
+    }
+    return false;
+}
+
+int mcp_json_read_boolean(mcp_json_reader_t *reader, bool *value)
+{
+    if (consume_word(reader, "true")) {
+        *value = true;
+        return 0;
+    }
+    if (consume_word(reader, "false")) {
+        *value = false;
+        return 0;
+    }
+    return -1;
+}
+
+int mcp_json_skip(mcp_json_reader_t *reader)
+{
+    int depth = 0;
+
+    skip_space(reader);
+    do {
+        if (reader->pos >= reader->end) {
+            return -1;
+        }
+        char c = *reader->pos;
+        if (c == '"') {
+            const char *end = string_end(reader, reader->pos + 1);
+            if (end == NULL) {
+                return -1;
+            }
+            reader->pos = end + 1;
+        } else if (c == '{' || c == '[') {
+            depth++;
+            reader->pos++;
+        } else if (c == '}' || c == ']') {
+            if (--depth < 0) {
+                return -1;
+            }
+            reader->pos++;
+        } else if (depth > 0) {
+            reader->pos++; // separators and scalars inside a container
+        } else {
+            // a scalar on its own runs up to the next separator
+            while (reader->pos < reader->end && *reader->pos != ',' &&
+                   *reader->pos != '}' && *reader->pos != ']') {
+                reader->pos++;
+            }
+        }
+    } while (depth > 0);
+    return 0;
+}
+
+int mcp_json_array_begin(mcp_json_reader_t *reader)
+{
+    return consume(reader, '[') ? 0 : -1;
+}
+
+int mcp_json_array_next(mcp_json_reader_t *reader)
+{
+    if (consume(reader, ']')) {
+        return 0;
+    }
+    consume(reader, ','); // absent before the first element
+    skip_space(reader);
+    return reader->pos < reader->end ? 1 : -1;
+}
+
+typedef int (*read_fn)(mcp_json_reader_t *reader, void *value);
+
+static int read_real(mcp_json_reader_t *reader, void *value)
+{
+    return mcp_json_read_real(reader, value);
+}
+
+static int read_integer(mcp_json_reader_t *reader, void *value)
+{
+    return mcp_json_read_integer(reader, value);
+}
+
+static int read_boolean(mcp_json_reader_t *reader, void *value)
+{
+    return mcp_json_read_boolean(reader, value);
+}
+
+static int read_string(mcp_json_reader_t *reader, void *value)
+{
+    return mcp_json_read_string(reader, value);
+}
+
+static int read_array(mcp_json_reader_t *reader, size_t size, read_fn read,
+                      void **values, int *count)
+{
+    char *buf = NULL;
+    int   n   = 0;
+    int   cap = 0;
+    int   ret;
+
+    if (mcp_json_array_begin(reader) != 0) {
+        return -1;
+    }
+    while ((ret = mcp_json_array_next(reader)) == 1) {
+        if (n == cap) {
+            int   grown_cap = cap ? cap * 2 : 16;
+            char *grown     = mem_realloc(buf, (size_t) grown_cap * size);
+            if (grown == NULL) {
+                ret = -1;
+                break;
+            }
+            buf = grown;
+            cap = grown_cap;
+        }
+        if (read(reader, buf + (size_t) n * size) != 0) {
+            ret = -1;
+            break;
+        }
+        n++;
+    }
+    if (ret != 0) {
+        if (read == read_string) {
+            for (int i = 0; i < n; i++) {
+                mem_free(((char **) buf)[i]);
+            }
+        }
+        mem_free(buf);
+        return -1;
+    }
+
+    *values = buf;
+    *count  = n;
+    return 0;
+}
+
+int mcp_json_read_reals(mcp_json_reader_t *reader, double **values,
+                        int *count)
+{
+    return read_array(reader, sizeof(double), read_real, (void **) values,
+                      count);
+}
+
+int mcp_json_read_integers(mcp_json_reader_t *reader, long long **values,
+                           int *count)
+{
+    return read_array(reader, sizeof(long long), read_integer,
+                      (void **) values, count);
+}
+
+int mcp_json_read_booleans(mcp_json_reader_t *reader, bool **values,
+                           int *count)
+{
+    return read_array(reader, sizeof(bool), read_boolean, (void **) values,
+                      count);
+}
+
+int mcp_json_read_strings(mcp_json_reader_t *reader, char ***values,
+                          int *count)
+{
+    char **strings;
+    int    n;
+
+    if (read_array(reader, sizeof(char *), read_string, (void **) &strings,
+                   &n) != 0) {
+        return -1;
+    }
+
+    // repack into one block behind the pointers
+    size_t size = (size_t) n * sizeof(char *);
+    for (int i = 0; i < n; i++) {
+        size += strlen(strings[i]) + 1;
+    }
+    char **packed = n > 0 ? mem_alloc(size) : NULL;
+    char  *data   = packed ? (char *) (packed + n) : NULL;
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(strings[i]) + 1;
+        if (packed != NULL) {
+            memcpy(data, strings[i], len);
+            packed[i] = data;
+            data += len;
+        }
+        mem_free(strings[i]);
+    }
+    mem_free(strings);
+    if (n > 0 && packed == NULL) {
+        return -1;
+    }
+
+    *values = packed;
+    *count  = n;
+    return 0;
+}
+
+void mcp_json_free(void *p)
+{
+    mem_free(p);
+}
+
+int mcp_json_enum_index(const char *value, int n_values, const char **values)
+{
+    for (int i = 0; i < n_values; i++) {
+        if (strcmp(values[i], value) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Scanning kernels. Text is copied in runs up to the next byte that needs
+ * escaping, and validated 16 or 32 bytes at a time while it is ASCII; the
+ * widest kernel the CPU supports is picked on first use.
+ */
+typedef struct {
+    const char *name;
+    // index of the first byte that needs escaping, or len
+    size_t (*plain)(const char *s, size_t len);
+    // index of the first byte that is not ASCII, or len
+    size_t (*ascii)(const char *s, size_t len);
+} json_kernel_t;
+
+static bool needs_escape(unsigned char c)
+{
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+static size_t plain_scalar(const char *s, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len && !needs_escape((unsigned char) s[i])) {
+        i++;
+    }
+    return i;
+}
+
+static size_t ascii_scalar(const char *s, size_t len)
+{
+    size_t i = 0;
+
+    // eight bytes at a time, none of them with the high bit set
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, s + i, 8);
+        if (word & 0x8080808080808080ULL) {
+            break;
+        }
+    }
+    while (i < len && (unsigned char) s[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+#ifdef JSON_KERNEL_X86
+__attribute__((target("sse4.2"))) static size_t plain_sse42(const char *s,
+                                                           size_t      len)
+{
+    // byte ranges that need escaping: controls, '"' and '\\'
+    const __m128i ranges =
+        _mm_setr_epi8(0x00, 0x1f, '"', '"', '\\', '\\', 0, 0, 0, 0, 0, 0, 0, 0,
+                      0, 0);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (s + i));
+        int     index = _mm_cmpestri(ranges, 6, chunk, 16,
+                                     _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                                         _SIDD_LEAST_SIGNIFICANT);
+        if (index < 16) {
+            return i + (size_t) index;
+        }
+    }
+    return i + plain_scalar(s + i, len - i);
+}
+
+__attribute__((target("sse4.2"))) static size_t ascii_sse42(const char *s,
+                                                           size_t      len)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (s + i));
+        int     mask  = _mm_movemask_epi8(chunk);
+        if (mask != 0) {
+            return i + (size_t) __builtin_ctz((unsigned int) mask);
+        }
+    }
+    return i + ascii_scalar(s + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t plain_avx2(const char *s,
+                                                        size_t      len)
+{
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    const __m256i quote   = _mm256_set1_epi8('"');
+    const __m256i slash   = _mm256_set1_epi8('\\');
+    size_t        i       = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *) (s + i));
+        // c <= 0x1f unsigned, when the minimum of both is c itself
+        __m256i hit = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control),
+                                        chunk);
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(chunk, quote));
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(chunk, slash));
+
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(hit);
+        if (mask != 0) {
+            return i + (size_t) __builtin_ctz(mask);
+        }
+    }
+    return i + plain_sse42(s + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t ascii_avx2(const char *s,
+                                                        size_t      len)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i      chunk = _mm256_loadu_si256((const __m256i *) (s + i));
+        unsigned int mask  = (unsigned int) _mm256_movemask_epi8(chunk);
+        if (mask != 0) {
+            return i + (size_t) __builtin_ctz(mask);
+        }
+    }
+    return i + ascii_sse42(s + i, len - i);
+}
+#endif
+
+static const json_kernel_t kernels[] = {
+#ifdef JSON_KERNEL_X86
+    { "avx2", plain_avx2, ascii_avx2 },
+    { "sse4.2", plain_sse42, ascii_sse42 },
+#endif
+    { "scalar", plain_scalar, ascii_scalar },
+};
+
+#define N_KERNELS (int) (sizeof(kernels) / sizeof(kernels[0]))
+
+static _Atomic(const json_kernel_t *) kernel;
+
+static bool kernel_supported(const json_kernel_t *k)
+{
+#ifdef JSON_KERNEL_X86
+    __builtin_cpu_init();
+    if (k->plain == plain_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (k->plain == plain_sse42) {
+        return __builtin_cpu_supports("sse4.2");
+    }
+#endif
+    (void) k;
+    return true;
+}
+
+static const json_kernel_t *current_kernel(void)
+{
+    const json_kernel_t *k = atomic_load_explicit(&kernel,
+                                                  memory_order_relaxed);
+
+    if (k == NULL) {
+        // racing threads all settle on the same one
+        k = &kernels[N_KERNELS - 1];
+        for (int i = 0; i < N_KERNELS; i++) {
+            if (kernel_supported(&kernels[i])) {
+                k = &kernels[i];
+                break;
+            }
+        }
+        atomic_store_explicit(&kernel, k, memory_order_relaxed);
+    }
+    return k;
+}
+
+const char *mcp_json_kernel(void)
+{
+    return current_kernel()->name;
+}
+
+int mcp_json_set_kernel(const char *name)
+{
+    for (int i = 0; i < N_KERNELS; i++) {
+        if (strcmp(kernels[i].name, name) == 0) {
+            if (!kernel_supported(&kernels[i])) {
+                return -1;
+            }
+            atomic_store_explicit(&kernel, &kernels[i], memory_order_relaxed);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static size_t escape_size(unsigned char c)
+{
+    if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' ||
+        c == '\r' || c == '\t') {
+        return 2;
+    }
+    return c < 0x20 ? 6 : 1;
+}
+
+size_t mcp_json_escaped_size(const char *s, size_t len)
+{
+    const json_kernel_t *k    = current_kernel();
+    size_t               size = len;
+
+    for (size_t i = k->plain(s, len); i < len;
+         i += 1 + k->plain(s + i + 1, len - i - 1)) {
+        size += escape_size((unsigned char) s[i]) - 1;
+    }
+    return size;
+}
+
+size_t mcp_json_escape(char *out, const char *s, size_t len)
+{
+    static const char    hex[] = "0123456789abcdef";
+    const json_kernel_t *k     = current_kernel();
+    char                *o     = out;
+    size_t               i     = 0;
+
+    while (i < len) {
+        size_t run = k->plain(s + i, len - i);
+        memcpy(o, s + i, run);
+        o += run;
+        i += run;
+        if (i == len) {
+            break;
+        }
+
+        unsigned char c = (unsigned char) s[i++];
+        switch (c) {
+        case '"':
+        case '\\':
+            *o++ = '\\';
+            *o++ = (char) c;
+            break;
+        case '\b':
+            *o++ = '\\';
+            *o++ = 'b';
+            break;
+        case '\f':
+            *o++ = '\\';
+            *o++ = 'f';
+            break;
+        case '\n':
+            *o++ = '\\';
+            *o++ = 'n';
+            break;
+        case '\r':
+            *o++ = '\\';
+            *o++ = 'r';
+            break;
+        case '\t':
+            *o++ = '\\';
+            *o++ = 't';
+            break;
+        default:
+            memcpy(o, "\\u00", 4);
+            o[4] = hex[c >> 4];
+            o[5] = hex[c & 0xf];
+            o += 6;
+            break;
+        }
+    }
+    return (size_t) (o - out);
+}
+
+/* Length of the well-formed sequence at s (RFC 3629), or 0. */
+static size_t utf8_sequence(const unsigned char *s, size_t len)
+{
+    unsigned char lead = s[0];
+    size_t        n;
+    unsigned char min = 0x80, max = 0xbf; // bounds of the second byte
+
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        n = 2;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+        n = 3;
+        if (lead == 0xe0) {
+            min = 0xa0; // overlong
+        } else if (lead == 0xed) {
+            max = 0x9f; // surrogates
+        }
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+        n = 4;
+        if (lead == 0xf0) {
+            min = 0x90; // overlong
+        } else if (lead == 0xf4) {
+            max = 0x8f; // above U+10FFFF
+        }
+    } else {
+        return 0;
+    }
+
+    if (len < n || s[1] < min || s[1] > max) {
+        return 0;
+    }
+    for (size_t i = 2; i < n; i++) {
+        if ((s[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+    }
+    return n;
+}
+
+bool mcp_json_valid_utf8(const char *s, size_t len)
+{
+    const json_kernel_t *k = current_kernel();
+    size_t               i = 0;
+
+    while (i < len) {
+        i += k->ascii(s + i, len - i);
+        if (i == len) {
+            break;
+        }
+        size_t n = utf8_sequence((const unsigned char *) s + i, len - i);
+        if (n == 0) {
+            return false;
+        }
+        i += n;
+    }
+    return true;
+}
+
+bool mcp_json_depth_within(const char *s, size_t len, int max_depth)
+{
+    int  depth     = 0;
+    bool in_string = false;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        if (in_string) {
+            if (c == '\\') {
+                i++;
+            } else if (c == '"') {
+                in_string = false;
+            }
+        } else if (c == '"') {
+            in_string = true;
+        } else if (c == '{' || c == '[') {
+            if (++depth > max_depth) {
+                return false;
+            }
+        } else if (c == '}' || c == ']') {
+            depth--;
+        }
+    }
+    return true;
+}
@@ -1,15 +1,54 @@
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <MQTTAsync.h>
 
+#include "call.h"
+#include "capture.h"
+#include "catalog.h"
+#include "inbox.h"
 #include "jsonrpc.h"
+#include "mcp_json.h"
 #include "mcp_server.h"
-
+#include "mem.h"
+#include "memo.h"
+#include "response_cache.h"
+#include "rbac.h"
+#include "reconnect.h"
+#include "replay.h"
+#include "result.h"
+#include "session.h"
+#include "spool.h"
+#include "trace.h"
+
+#ifdef MCP_STATIC_MEMORY
+// answered requests kept against duplicates, sized to the pools
+#define CACHE_CAPACITY (4 * MCP_STATIC_CALLS)
+#else
+#define CACHE_CAPACITY 1024
+#endif
+
+/*
+ * One MQTT connection of the server with the sessions of the clients hashed
+ * to it. Each has its own callback thread, so the decoding, dispatch and
+ * encoding of session traffic spread over as many cores as there are shards.
+ */
 typedef struct {
-    char *client_id;
-} connect_mcp_client;
+    mcp_server_t            *server;
+    int                      index;
+    MQTTAsync                client;
+    MQTTAsync_connectOptions conn_opts;
+    reconnect_t             *reconnect;
+    session_table_t         *sessions;
+    response_cache_t        *responses;
+    atomic_bool              connected;
+} shard_t;
 
 struct mcp_server {
     char *name;
@@ -21,23 +60,56 @@ struct mcp_server {
     char *password;
     char *cert;
 
-    int         n_tools;
-    mcp_tool_t *tools;
-
-    int               n_resources;
-    mcp_resource_t   *resources;
+    catalog_t        *catalog;
     mcp_resource_read read_callback;
 
-    MQTTAsync                client;
-    MQTTAsync_connectOptions conn_opts;
+    call_pool_t *calls;
+    int          n_workers;
+    int          call_timeout_ms;
+    int          progress_interval_ms;
+
+    int               response_capacity;
+    int               response_ttl_ms;
+    memo_cache_t     *memo;
+    trace_t          *trace;
+    spool_t          *spool;
+    int               spool_ttl_s;
+    capture_t        *capture;
+    replay_t         *replay;
+
+    // event loop mode, see mcp_server_start
+    inbox_t    *inbox;
+    int64_t     next_deadline_ms;
+    int64_t     next_reconnect_ms;
+    atomic_bool stopping;
+    bool        stopped;
+
+    shard_t                 *shards;
+    int                      n_shards;
+    MQTTAsync_connectOptions conn_opts; // of every shard, but for context
     MQTTAsync_willOptions    will_opts;
+    MQTTProperties           connect_props;
+
+    int reconnect_min_ms;
+    int reconnect_max_ms;
+    int session_expiry_s;
 
     char *control_topic;
     char *presence_topic;
     char *capability_topic;
 
-    int                 n_clients;
-    connect_mcp_client *clients;
+    rbac_t *rbac;
+
+    rate_limit_t global_limit;
+    double       session_rate;
+    int          session_burst;
+
+    // memory budget, see mcp_server_set_limits
+    mcp_limits_t  limits;
+    atomic_size_t in_flight;
+    atomic_size_t in_flight_peak;
+    atomic_llong  rejected;
+    atomic_int    n_sessions;
 };
 
 MQTTProperty property = {
@@ -46,35 +118,358 @@ MQTTProperty property = {
     .value.value = { .len = 10, .data = "mcp-server" },
 };
 
-MQTTProperties props = MQTTProperties_initializer;
-
 int msg_arrvd(void *ctx, char *topic, int topicLen, MQTTAsync_message *message);
 
+static void reconnect_broker(void *ctx)
+{
+    shard_t *shard = (shard_t *) ctx;
+
+    if (atomic_load(&shard->server->stopping)) {
+        return;
+    }
+    int ret = MQTTAsync_connect(shard->client, &shard->conn_opts);
+    printf("Reconnecting shard %d to MQTT broker: %s, %d\n", shard->index,
+           shard->server->broker_uri, ret);
+    if (ret != MQTTASYNC_SUCCESS) {
+        reconnect_schedule(shard->reconnect);
+    }
+}
+
+/*
+ * In event loop mode the paho callbacks only hand what they saw over to
+ * mcp_server_process, returns false when the server is not in that mode.
+ * An event the memory pools cannot take is dropped.
+ */
+static bool post_event(shard_t *shard, inbox_kind_e kind, int code,
+                       char *topic, int topic_len, MQTTAsync_message *message)
+{
+    inbox_t *inbox = shard->server->inbox;
+    if (inbox == NULL) {
+        return false;
+    }
+
+    inbox_event_t *event = mem_calloc(1, sizeof(inbox_event_t));
+    if (event == NULL) {
+        // dropped as if the broker had never delivered it
+        printf("Dropped an event of shard %d, memory pools exhausted\n",
+               shard->index);
+        if (message) {
+            MQTTAsync_freeMessage(&message);
+        }
+        if (topic) {
+            MQTTAsync_free(topic);
+        }
+        return true;
+    }
+    event->kind          = kind;
+    event->ctx           = shard;
+    event->code          = code;
+    event->topic         = topic;
+    event->topic_len     = topic_len;
+    event->message       = message;
+    inbox_post(inbox, event);
+    return true;
+}
+
+static void shard_lost(shard_t *shard)
+{
+    atomic_store(&shard->connected, false);
+    if (!atomic_load(&shard->server->stopping)) {
+        reconnect_schedule(shard->reconnect);
+    }
+}
+
 void conn_lost(void *ctx, char *cause)
 {
-    mcp_server_t *server = (mcp_server_t *) ctx;
-    int           rc;
+    shard_t *shard = (shard_t *) ctx;
 
-    MQTTAsync_connect(server->client, &server->conn_opts);
+    printf("Connection of shard %d lost: %s\n", shard->index,
+           cause ? cause : "unknown");
+    if (!post_event(shard, INBOX_CONNECTION_LOST, 0, NULL, 0, NULL)) {
+        shard_lost(shard);
+    }
 }
 
 void onConnectFailure(void *ctx, MQTTAsync_failureData5 *response)
 {
-    (void) ctx;
-    printf("Connection failed, rc %d\n", response->code);
+    shard_t *shard = (shard_t *) ctx;
+
+    printf("Connection of shard %d failed, rc %d\n", shard->index,
+           response->code);
+    if (!post_event(shard, INBOX_CONNECT_FAILED, response->code, NULL, 0,
+                    NULL)) {
+        shard_lost(shard);
+    }
 }
 
-void onConnect(void *ctx, MQTTAsync_successData5 *response)
+/* Returns the length of the whole topic, size or more when truncated. */
+static int session_topic(mcp_server_t *server, const char *client_id,
+                         char *topic, size_t size)
 {
-    (void) response;
-    mcp_server_t *server = (mcp_server_t *) ctx;
+    return snprintf(topic, size, "$mcp-rpc/%s/%s/%s", client_id,
+                    server->client_id, server->name);
+}
 
-    int ret =
-        MQTTAsync_subscribe(server->client, server->control_topic, 0, NULL);
-    printf("Connected to MQTT broker: %s, %d\n", server->broker_uri, ret);
+/* Extracts the client id following prefix, up to the next '/' or the end. */
+static bool topic_client_id(const char *topic, const char *prefix,
+                            const char **client_id, size_t *len)
+{
+    size_t prefix_len = strlen(prefix);
+    if (strncmp(topic, prefix, prefix_len) != 0) {
+        return false;
+    }
+
+    const char *end = strchr(topic + prefix_len, '/');
+    *client_id      = topic + prefix_len;
+    *len            = end ? (size_t) (end - *client_id) : strlen(*client_id);
+    return *len > 0;
+}
+
+/*
+ * The hash has to be stable for the life of the process: a shard that lost
+ * its connection resumes its broker session, and with it the subscriptions,
+ * of the same clients. A restarted process starts clean sessions instead.
+ */
+static shard_t *client_shard(mcp_server_t *server, const char *client_id,
+                             size_t len)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char) client_id[i]) * 16777619u;
+    }
+    return &server->shards[hash % (uint32_t) server->n_shards];
+}
+
+/* The shard of the client a session or client presence topic is about. */
+static shard_t *topic_shard(mcp_server_t *server, const char *topic)
+{
+    const char *client_id;
+    size_t      len;
+
+    if (server->n_shards > 1 &&
+        (topic_client_id(topic, "$mcp-rpc/", &client_id, &len) ||
+         topic_client_id(topic, "$mcp-client/presence/", &client_id, &len))) {
+        return client_shard(server, client_id, len);
+    }
+    return &server->shards[0];
+}
+
+static response_cache_t *topic_responses(mcp_server_t *server,
+                                         const char   *topic)
+{
+    return topic_shard(server, topic)->responses;
+}
+
+typedef struct {
+    shard_t *shard;
+    int      count;
+    char   **topics; // NULL when there was no memory to collect them
+} resubscribe_ctx_t;
+
+/* Subscribes a topic on its own, for those that could not be collected. */
+static void subscribe_topic(shard_t *shard, const char *topic, bool no_local)
+{
+    MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
+    opts.subscribeOptions.noLocal  = no_local;
+    MQTTAsync_subscribe(shard->client, topic, 0, &opts);
+}
+
+static void collect_topic(resubscribe_ctx_t *resub, const char *topic,
+                          bool no_local)
+{
+    char *copy = resub->topics ? mem_strdup(topic) : NULL;
+    if (copy == NULL) {
+        subscribe_topic(resub->shard, topic, no_local);
+        return;
+    }
+    resub->topics[resub->count++] = copy;
+}
+
+static void collect_session_topic(session_t *session, void *ctx)
+{
+    resubscribe_ctx_t *resub = (resubscribe_ctx_t *) ctx;
+    char               topic[256];
+
+    session_topic(resub->shard->server, session->client_id, topic,
+                  sizeof(topic));
+    collect_topic(resub, topic, true);
+}
+
+/*
+ * The broker dropped our session (first connect, or it expired while we were
+ * away), so subscribe the control topic, client presence and every known
+ * session topic again in a single SUBSCRIBE instead of waiting for each
+ * client to re-initialize. Client presence tells us when to drop a session.
+ * Only the first shard takes initialize requests and client presence. Short
+ * of memory for the SUBSCRIBE, topics are subscribed one at a time.
+ */
+static void resubscribe(shard_t *shard)
+{
+    mcp_server_t     *server = shard->server;
+    resubscribe_ctx_t resub  = { .shard = shard };
+
+    session_table_read_lock(shard->sessions);
+    resub.topics =
+        mem_calloc(session_count(shard->sessions) + 2, sizeof(char *));
+    if (shard->index == 0) {
+        collect_topic(&resub, server->control_topic, false);
+        collect_topic(&resub, "$mcp-client/presence/+", false);
+    }
+    int n_fixed = resub.count;
+    session_foreach(shard->sessions, collect_session_topic, &resub);
+    session_table_unlock(shard->sessions);
+    if (resub.count == 0) {
+        mem_free(resub.topics);
+        return;
+    }
+
+    int                   *qos     = mem_calloc(resub.count, sizeof(int));
+    MQTTSubscribe_options *options =
+        mem_calloc(resub.count, sizeof(MQTTSubscribe_options));
+    if (qos == NULL || options == NULL) {
+        for (int i = 0; i < resub.count; i++) {
+            subscribe_topic(shard, resub.topics[i], i >= n_fixed);
+        }
+    } else {
+        for (int i = 0; i < resub.count; i++) {
+            MQTTSubscribe_options initializer =
+                MQTTSubscribe_options_initializer;
+            options[i]         = initializer;
+            options[i].noLocal = i >= n_fixed; // session topics
+        }
+
+        MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
+        opts.subscribeOptionsCount     = resub.count;
+        opts.subscribeOptionsList      = options;
+
+        int ret = MQTTAsync_subscribeMany(shard->client, resub.count,
+                                          resub.topics, qos, &opts);
+        printf("Subscribed %d topics on shard %d, %d\n", resub.count,
+               shard->index, ret);
+    }
+
+    for (int i = 0; i < resub.count; i++) {
+        mem_free(resub.topics[i]);
+    }
+    mem_free(resub.topics);
+    mem_free(options);
+    mem_free(qos);
+}
+
+/* Hands a message to the MQTT client, expiry_s of 0 never expires. */
+static int publish(mcp_server_t *server, const char *topic,
+                   const char *payload, size_t len, int expiry_s,
+                   const char *traceparent)
+{
+    MQTTAsync_message msg = MQTTAsync_message_initializer;
+    msg.payload           = (void *) payload;
+    msg.payloadlen        = (int) len;
+    msg.qos               = 0;
+    msg.retained          = 0;
+
+    if (expiry_s > 0) {
+        MQTTProperty expiry = {
+            .identifier     = MQTTPROPERTY_CODE_MESSAGE_EXPIRY_INTERVAL,
+            .value.integer4 = (unsigned int) expiry_s,
+        };
+        MQTTProperties_add(&msg.properties, &expiry);
+    }
+    if (traceparent) {
+        MQTTProperty property = {
+            .identifier  = MQTTPROPERTY_CODE_USER_PROPERTY,
+            .value.data  = { .len = 11, .data = "traceparent" },
+            .value.value = { .len  = TRACEPARENT_LEN,
+                             .data = (char *) traceparent },
+        };
+        MQTTProperties_add(&msg.properties, &property);
+    }
+    capture_message(server->capture, CAPTURE_OUT, topic, payload, len,
+                    &msg.properties);
+
+    int ret = MQTTASYNC_SUCCESS;
+    if (server->replay) {
+        replay_published(server->replay, topic, payload);
+    } else {
+        ret = MQTTAsync_sendMessage(topic_shard(server, topic)->client, topic,
+                                    &msg, NULL);
+    }
+    MQTTProperties_free(&msg.properties);
+    return ret;
+}
+
+static int publish_spooled(void *ctx, const char *topic, const char *payload,
+                           size_t len, int expiry_s)
+{
+    return publish((mcp_server_t *) ctx, topic, payload, len, expiry_s, NULL);
+}
+
+/*
+ * Publishes now when connected, else keeps the message in the spool (when
+ * there is one) for the next connection; while older messages wait there,
+ * newer ones queue up behind them so clients see them in order.
+ */
+static void send_message(mcp_server_t *server, const char *topic,
+                         const char *payload, const char *traceparent)
+{
+    if (payload == NULL) {
+        printf("Failed to encode a message to %s\n", topic);
+        return;
+    }
+
+    size_t   len   = strlen(payload);
+    shard_t *shard = topic_shard(server, topic);
+
+    if (server->spool == NULL || server->replay) {
+        publish(server, topic, payload, len, 0, traceparent);
+        return;
+    }
+    if (atomic_load(&shard->connected) && spool_empty(server->spool) &&
+        publish(server, topic, payload, len, 0, traceparent) ==
+            MQTTASYNC_SUCCESS) {
+        return;
+    }
+
+    int64_t expires_ms = 0;
+    if (server->spool_ttl_s > 0) {
+        expires_ms = spool_now_ms() + (int64_t) server->spool_ttl_s * 1000;
+    }
+    if (spool_append(server->spool, topic, payload, len, expires_ms) != 0) {
+        printf("Dropping a message too big for the spool: %s\n", topic);
+    }
+    // the connection may have come back while we appended
+    if (atomic_load(&shard->connected)) {
+        spool_drain(server->spool, publish_spooled, server);
+    }
+}
+
+/* Responses to traced requests carry the traceparent of the server span. */
+static void send_response(mcp_server_t *server, const char *topic,
+                          const char *response, trace_request_t *trace)
+{
+    int64_t start_ns = trace_clock(trace);
+    char    traceparent[TRACEPARENT_LEN + 1];
+
+    if (trace) {
+        trace_traceparent(trace, traceparent);
+    }
+    send_message(server, topic, response, trace ? traceparent : NULL);
+    if (response) {
+        printf("Sending response to topic: %s\n %s\n", topic, response);
+    }
+    trace_span(trace, "publish", start_ns, trace_clock(trace));
+}
 
-    char *data = jsonrpc_encode(
-        jsonrpc_server_online(server->name, server->description, 0, NULL));
+static void publish_online(mcp_server_t *server, MQTTAsync client)
+{
+    rbac_t *rbac = server->rbac;
+    char   *data = jsonrpc_encode(jsonrpc_server_online(
+        server->name, server->description, rbac ? rbac->n_roles : 0,
+        rbac ? rbac->roles : NULL));
+    if (data == NULL) {
+        printf("Failed to encode the online presence\n");
+        return;
+    }
 
     MQTTAsync_message online_msg = MQTTAsync_message_initializer;
     online_msg.payload           = (void *) data;
@@ -82,9 +477,84 @@ void onConnect(void *ctx, MQTTAsync_successData5 *response)
     online_msg.qos               = 0;
     online_msg.retained          = 1;
 
-    MQTTAsync_sendMessage(server->client, server->presence_topic, &online_msg,
-                          NULL);
-    free(data);
+    MQTTAsync_sendMessage(client, server->presence_topic, &online_msg, NULL);
+    mem_free(data);
+}
+
+static void shard_connected(shard_t *shard, bool session_present)
+{
+    mcp_server_t *server = shard->server;
+
+    reconnect_reset(shard->reconnect);
+    printf("Connected shard %d to MQTT broker: %s, session present %d\n",
+           shard->index, server->broker_uri, session_present);
+    if (!session_present) {
+        resubscribe(shard);
+    }
+    // later connects of this process resume the session the broker kept for
+    // us; the first one starts clean, the session table died with the last
+    shard->conn_opts.cleanstart = 0;
+
+    if (shard->index == 0) {
+        publish_online(server, shard->client);
+    }
+
+    // what was produced while we were away, or before a restart
+    atomic_store(&shard->connected, true);
+    if (server->spool) {
+        int sent = spool_drain(server->spool, publish_spooled, server);
+        printf("Replayed %d spooled messages\n", sent);
+    }
+}
+
+void onConnect(void *ctx, MQTTAsync_successData5 *response)
+{
+    shard_t *shard           = (shard_t *) ctx;
+    int      session_present = response->alt.connect.sessionPresent;
+
+    if (!post_event(shard, INBOX_CONNECTED, session_present, NULL, 0, NULL)) {
+        shard_connected(shard, session_present);
+    }
+}
+
+/* The first shard connects with the client id, the others add a suffix. */
+static int shard_init(mcp_server_t *server, shard_t *shard, int index)
+{
+    MQTTAsync_createOptions create_opts = MQTTAsync_createOptions_initializer5;
+    char                    mqtt_id[256];
+
+    if (index == 0) {
+        snprintf(mqtt_id, sizeof(mqtt_id), "%s", server->client_id);
+    } else {
+        snprintf(mqtt_id, sizeof(mqtt_id), "%s-%d", server->client_id, index);
+    }
+
+    int ret = MQTTAsync_createWithOptions(&shard->client, server->broker_uri,
+                                          mqtt_id, MQTTCLIENT_PERSISTENCE_NONE,
+                                          NULL, &create_opts);
+    if (ret != MQTTASYNC_SUCCESS) {
+        printf("Failed to create MQTT client, return code %d\n", ret);
+        return -1;
+    }
+    MQTTAsync_setCallbacks(shard->client, shard, conn_lost, msg_arrvd, NULL);
+
+    shard->server            = server;
+    shard->index             = index;
+    shard->conn_opts         = server->conn_opts;
+    shard->conn_opts.context = shard;
+    if (index > 0) {
+        shard->conn_opts.will = NULL; // the first shard speaks for the server
+    }
+    shard->sessions  = session_table_create();
+    shard->responses = response_cache_create(server->response_capacity,
+                                             server->response_ttl_ms);
+    return 0;
+}
+
+static void shard_destroy(shard_t *shard)
+{
+    response_cache_destroy(shard->responses);
+    session_table_destroy(shard->sessions);
 }
 
 mcp_server_t *mcp_server_init(const char *name, const char *description,
@@ -94,17 +564,14 @@ mcp_server_t *mcp_server_init(const char *name, const char *description,
 {
     MQTTAsync_connectOptions conn_opts = MQTTAsync_connectOptions_initializer5;
     MQTTAsync_willOptions    will_opts = MQTTAsync_willOptions_initializer;
-    MQTTAsync_createOptions  create_opts = MQTTAsync_createOptions_initializer5;
-
-    MQTTProperties_add(&props, &property);
 
     if (!name || !broker_uri || !client_id) {
         return NULL;
     }
 
-    char *server_control_topic    = calloc(1, 128);
-    char *server_presence_topic   = calloc(1, 128);
-    char *server_capability_topic = calloc(1, 128);
+    char *server_control_topic    = mem_calloc(1, 128);
+    char *server_presence_topic   = mem_calloc(1, 128);
+    char *server_capability_topic = mem_calloc(1, 128);
 
     snprintf(server_control_topic, 128, "$mcp-server/%s/%s", client_id, name);
     snprintf(server_presence_topic, 128, "$mcp-server/presence/%s/%s",
@@ -112,50 +579,44 @@ mcp_server_t *mcp_server_init(const char *name, const char *description,
     snprintf(server_capability_topic, 128, "$mcp-server/capability/%s/%s",
              client_id, name);
 
-    mcp_server_t *server = calloc(1, sizeof(mcp_server_t));
+    mcp_server_t *server = mem_calloc(1, sizeof(mcp_server_t));
 
-    server->name = strdup(name);
+    server->name = mem_strdup(name);
     if (description) {
-        server->description = strdup(description);
+        server->description = mem_strdup(description);
     } else {
         server->description = NULL;
     }
-    server->broker_uri = strdup(broker_uri);
-    server->client_id  = strdup(client_id);
+    server->broker_uri = mem_strdup(broker_uri);
+    server->client_id  = mem_strdup(client_id);
     if (user) {
-        server->user = strdup(user);
+        server->user = mem_strdup(user);
     } else {
         server->user = NULL;
     }
     if (password) {
-        server->password = strdup(password);
+        server->password = mem_strdup(password);
     } else {
         server->password = NULL;
     }
     if (cert) {
-        server->cert = strdup(cert);
+        server->cert = mem_strdup(cert);
     } else {
         server->cert = NULL;
     }
 
-    int ret = MQTTAsync_createWithOptions(
-        &server->client, server->broker_uri, server->client_id,
-        MQTTCLIENT_PERSISTENCE_NONE, NULL, &create_opts);
-    if (ret != MQTTASYNC_SUCCESS) {
-        printf("Failed to create MQTT client, return code %d\n", ret);
-        return NULL;
-    }
-    MQTTAsync_setCallbacks(server->client, server, conn_lost, msg_arrvd, NULL);
-
     will_opts.topicName = server_presence_topic;
     will_opts.message   = "";
     server->will_opts   = will_opts;
 
-    conn_opts.connectProperties = &props;
+    MQTTProperties connect_props = MQTTProperties_initializer;
+    MQTTProperties_add(&connect_props, &property);
+    server->connect_props = connect_props;
+
+    conn_opts.connectProperties = &server->connect_props;
     conn_opts.will              = &server->will_opts;
     conn_opts.onSuccess5        = onConnect;
     conn_opts.onFailure5        = onConnectFailure;
-    conn_opts.context           = server;
 
     server->conn_opts = conn_opts;
 
@@ -163,398 +624,1477 @@ mcp_server_t *mcp_server_init(const char *name, const char *description,
     server->presence_topic   = server_presence_topic;
     server->capability_topic = server_capability_topic;
 
+    server->catalog   = catalog_create();
+    catalog_set_page_size(server->catalog, 100);
+    server->n_workers            = 4;
+    server->progress_interval_ms = 100;
+    server->reconnect_min_ms     = 500;
+    server->reconnect_max_ms     = 60000;
+    server->session_expiry_s     = 300;
+    server->response_capacity    = CACHE_CAPACITY;
+    server->response_ttl_ms      = 30000;
+    server->memo                 = memo_cache_create(CACHE_CAPACITY);
+    rate_limit_init(&server->global_limit, 0, 0);
+#ifdef MCP_STATIC_MEMORY
+    server->limits = (mcp_limits_t) {
+        .max_payload   = MCP_STATIC_MAX_BLOCK,
+        .max_arguments = MCP_STATIC_ARGS,
+        .max_sessions  = MCP_STATIC_SESSIONS,
+        .max_calls     = MCP_STATIC_CALLS,
+    };
+    jsonrpc_track_memory();
+#endif
+
+    server->shards   = mem_calloc(1, sizeof(shard_t));
+    server->n_shards = 1;
+    if (shard_init(server, &server->shards[0], 0) != 0) {
+        return NULL;
+    }
+
     return server;
 }
 
 void mcp_server_close(mcp_server_t *server)
 {
     if (server) {
-        free(server->name);
-        free(server->broker_uri);
-        free(server->client_id);
+        mem_free(server->name);
+        mem_free(server->broker_uri);
+        mem_free(server->client_id);
 
-        free(server->control_topic);
-        free(server->presence_topic);
-        free(server->capability_topic);
+        mem_free(server->control_topic);
+        mem_free(server->presence_topic);
+        mem_free(server->capability_topic);
 
         if (server->description) {
-            free(server->description);
+            mem_free(server->description);
         }
         if (server->user) {
-            free(server->user);
+            mem_free(server->user);
         }
         if (server->password) {
-            free(server->password);
+            mem_free(server->password);
         }
         if (server->cert) {
-            free(server->cert);
+            mem_free(server->cert);
         }
-        for (int i = 0; i < server->n_tools; i++) {
-            free(server->tools[i].name);
-            if (server->tools[i].description) {
-                free(server->tools[i].description);
-            }
-            for (int j = 0; j < server->tools[i].property_count; j++) {
-                free(server->tools[i].properties[j].name);
-                if (server->tools[i].properties[j].description) {
-                    free(server->tools[i].properties[j].description);
-                }
-            }
-            free(server->tools[i].properties);
+        for (int i = 0; i < server->n_shards; i++) {
+            reconnect_destroy(server->shards[i].reconnect);
         }
-        free(server->tools);
-
-        for (int i = 0; i < server->n_resources; i++) {
-            free(server->resources[i].uri);
-            free(server->resources[i].name);
-            if (server->resources[i].description) {
-                free(server->resources[i].description);
-            }
-            if (server->resources[i].mime_type) {
-                free(server->resources[i].mime_type);
-            }
-            if (server->resources[i].title) {
-                free(server->resources[i].title);
-            }
+        call_pool_destroy(server->calls);
+        trace_destroy(server->trace); // after the workers recording spans
+        spool_close(server->spool);
+        inbox_destroy(server->inbox);
+        capture_close(server->capture);
+        replay_destroy(server->replay);
+        MQTTProperties_free(&server->connect_props);
+        for (int i = 0; i < server->n_shards; i++) {
+            shard_destroy(&server->shards[i]);
         }
-        free(server->resources);
+        mem_free(server->shards);
+        memo_cache_destroy(server->memo);
+        catalog_destroy(server->catalog);
+        rbac_release(server->rbac);
+        mem_free(server);
+    }
+}
 
-        if (server->n_clients > 0) {
-            for (int i = 0; i < server->n_clients; i++) {
-                free(server->clients[i].client_id);
-            }
-            free(server->clients);
-        }
-        free(server);
+typedef struct {
+    mcp_server_t *server;
+    const char   *data;
+} notify_ctx_t;
+
+static void notify_session(session_t *session, void *ctx)
+{
+    notify_ctx_t *notify = (notify_ctx_t *) ctx;
+    char          topic[256];
+
+    if (!session->initialized) {
+        return;
+    }
+    session_topic(notify->server, session->client_id, topic, sizeof(topic));
+    send_message(notify->server, topic, notify->data, NULL);
+}
+
+static void notify_sessions(mcp_server_t *server, const char *method)
+{
+    char        *data   = jsonrpc_encode(jsonrpc_notification(method));
+    notify_ctx_t notify = { .server = server, .data = data };
+
+    if (data == NULL) {
+        printf("Failed to encode %s\n", method);
+        return;
     }
+    for (int i = 0; i < server->n_shards; i++) {
+        session_table_t *sessions = server->shards[i].sessions;
+        session_table_read_lock(sessions);
+        session_foreach(sessions, notify_session, &notify);
+        session_table_unlock(sessions);
+    }
+
+    mem_free(data);
+}
+
+/* Remembered results may come from tools that were replaced. */
+static void tools_changed(mcp_server_t *server)
+{
+    memo_cache_clear(server->memo);
+    notify_sessions(server, "notifications/tools/list_changed");
 }
 
 int mcp_server_register_tool(mcp_server_t *server, int n_tools,
                              mcp_tool_t *tools)
 {
-    server->n_tools = n_tools;
-    server->tools   = calloc(n_tools, sizeof(mcp_tool_t));
+    int ret = catalog_set_tools(server->catalog, n_tools, tools);
+    if (ret == 0) {
+        tools_changed(server);
+    }
+    return ret;
+}
 
-    for (int i = 0; i < n_tools; i++) {
-        server->tools[i].name = strdup(tools[i].name);
-        server->tools[i].description =
-            tools[i].description ? strdup(tools[i].description) : NULL;
-        server->tools[i].property_count = tools[i].property_count;
-        server->tools[i].properties =
-            calloc(tools[i].property_count, sizeof(property_t));
-        for (int j = 0; j < tools[i].property_count; j++) {
-            server->tools[i].properties[j] = tools[i].properties[j];
-        }
-        server->tools[i].call = tools[i].call;
+int mcp_server_register_static_tools(mcp_server_t *server, int n_tools,
+                                    const mcp_tool_t *tools)
+{
+    int ret = catalog_set_static_tools(server->catalog, n_tools, tools);
+    if (ret == 0) {
+        tools_changed(server);
     }
+    return ret;
+}
 
-    return 0;
+int mcp_server_add_tool(mcp_server_t *server, const mcp_tool_t *tool)
+{
+    int ret = catalog_add_tool(server->catalog, tool);
+    if (ret == 0) {
+        tools_changed(server);
+    }
+    return ret;
+}
+
+int mcp_server_remove_tool(mcp_server_t *server, const char *name)
+{
+    int ret = catalog_remove_tool(server->catalog, name);
+    if (ret == 0) {
+        tools_changed(server);
+    }
+    return ret;
 }
 
 int mcp_server_register_resources(mcp_server_t *server, int n_resources,
                                   mcp_resource_t   *resources,
                                   mcp_resource_read read_callback)
 {
-    server->n_resources = n_resources;
-    server->resources   = calloc(n_resources, sizeof(mcp_resource_t));
-
-    for (int i = 0; i < n_resources; i++) {
-        server->resources[i].uri  = strdup(resources[i].uri);
-        server->resources[i].name = strdup(resources[i].name);
-        server->resources[i].description =
-            resources[i].description ? strdup(resources[i].description) : NULL;
-        server->resources[i].mime_type =
-            resources[i].mime_type ? strdup(resources[i].mime_type) : NULL;
-        server->resources[i].title =
-            resources[i].title ? strdup(resources[i].title) : NULL;
+    int ret = catalog_set_resources(server->catalog, n_resources, resources);
+    if (ret == 0) {
+        server->read_callback = read_callback;
+        notify_sessions(server, "notifications/resources/list_changed");
     }
+    return ret;
+}
 
-    server->read_callback = read_callback;
-    return 0;
+int mcp_server_register_static_resources(mcp_server_t *server,
+                                        int n_resources,
+                                        const mcp_resource_t *resources,
+                                        mcp_resource_read     read_callback)
+{
+    int ret =
+        catalog_set_static_resources(server->catalog, n_resources, resources);
+    if (ret == 0) {
+        server->read_callback = read_callback;
+        notify_sessions(server, "notifications/resources/list_changed");
+    }
+    return ret;
 }
 
-static char *get_user_property(const MQTTProperties *props, const char *key)
+static char *get_user_property(const MQTTProperties *props, const char *key,
+                               char *value, size_t size)
 {
-    static char value[256] = { 0 };
+    size_t key_len = strlen(key);
+
     for (int i = 0; i < props->count; i++) {
-        if (props->array[i].identifier == MQTTPROPERTY_CODE_USER_PROPERTY) {
-            if (strcmp(props->array[i].value.data.data, key) == 0) {
-                strncpy(value, props->array[i].value.value.data,
-                        props->array[i].value.value.len);
-                return value;
+        const MQTTProperty *prop = &props->array[i];
+        if (prop->identifier == MQTTPROPERTY_CODE_USER_PROPERTY &&
+            (size_t) prop->value.data.len == key_len &&
+            memcmp(prop->value.data.data, key, key_len) == 0) {
+            if ((size_t) prop->value.value.len >= size) {
+                return NULL;
             }
+            memcpy(value, prop->value.value.data, prop->value.value.len);
+            value[prop->value.value.len] = '\0';
+            return value;
         }
     }
     return NULL;
 }
 
-static bool insert_client(mcp_server_t *server, const char *client_id)
+/*
+ * Returns 1 for a new session, 0 for a known one, -1 when full and -2 when
+ * the memory pools cannot take it.
+ */
+static int insert_client(mcp_server_t *server, const char *client_id,
+                         int role)
 {
-    for (int i = 0; i < server->n_clients; i++) {
-        if (strcmp(server->clients[i].client_id, client_id) == 0) {
-            // client already exists
-            return false;
+    size_t           len      = strlen(client_id);
+    session_table_t *sessions = client_shard(server, client_id, len)->sessions;
+    int              max      = server->limits.max_sessions;
+    bool             created;
+
+    session_table_lock(sessions);
+    if (max > 0 && !session_find(sessions, client_id, len) &&
+        atomic_fetch_add(&server->n_sessions, 1) >= max) {
+        atomic_fetch_sub(&server->n_sessions, 1);
+        session_table_unlock(sessions);
+        return -1;
+    }
+    session_t *session = session_insert(sessions, client_id, &created);
+    if (session == NULL) {
+        if (max > 0) {
+            atomic_fetch_sub(&server->n_sessions, 1);
         }
+        session_table_unlock(sessions);
+        return -2;
     }
-
-    if (server->n_clients == 0) {
-        server->clients = calloc(1, sizeof(connect_mcp_client));
-    } else {
-        server->clients =
-            realloc(server->clients,
-                    (server->n_clients + 1) * sizeof(connect_mcp_client));
+    if (created) {
+        rate_limit_init(&session->limit, server->session_rate,
+                        server->session_burst);
     }
-    server->clients[server->n_clients].client_id = strdup(client_id);
-    server->n_clients++;
-    return true;
+    session->role = role;
+    session_table_unlock(sessions);
+    return created ? 1 : 0;
 }
 
-static bool remove_client(mcp_server_t *server, const char *topic_client_id)
+/* The role insert_client stored at initialize, -1 for unknown sessions. */
+static int session_role(mcp_server_t *server, const char *topic)
 {
-    for (int i = 0; i < server->n_clients; i++) {
-        char *find = strstr(topic_client_id, server->clients[i].client_id);
-        if (find != NULL &&
-            strlen(find) == strlen(server->clients[i].client_id)) {
-            free(server->clients[i].client_id);
-            for (int j = i; j < server->n_clients - 1; j++) {
-                server->clients[j] = server->clients[j + 1];
-            }
-            server->n_clients--;
-            if (server->n_clients == 0) {
-                free(server->clients);
-                server->clients = NULL;
-            } else {
-                server->clients =
-                    realloc(server->clients,
-                            server->n_clients * sizeof(connect_mcp_client));
-            }
-            return true;
+    const char *client_id;
+    size_t      len;
+    int         role = -1;
+
+    if (topic_client_id(topic, "$mcp-rpc/", &client_id, &len)) {
+        session_table_t *sessions =
+            client_shard(server, client_id, len)->sessions;
+        session_table_read_lock(sessions);
+        session_t *session = session_find(sessions, client_id, len);
+        if (session) {
+            role = session->role;
         }
+        session_table_unlock(sessions);
     }
-    return false;
+    return role;
 }
 
-static bool is_client_init(mcp_server_t *server, const char *topic_client)
+static bool remove_client(mcp_server_t *server, const char *topic)
 {
-    for (int i = 0; i < server->n_clients; i++) {
-        char *find = strstr(topic_client, server->clients[i].client_id);
-        if (find != NULL &&
-            strlen(find) == strlen(server->clients[i].client_id)) {
-            return true; // client is initialized
-        }
+    const char *client_id;
+    size_t      len;
+    bool        removed = false;
+
+    if (topic_client_id(topic, "$mcp-client/presence/", &client_id, &len)) {
+        session_table_t *sessions =
+            client_shard(server, client_id, len)->sessions;
+        session_table_lock(sessions);
+        removed = session_remove(sessions, client_id, len);
+        session_table_unlock(sessions);
     }
-    return false;
+    if (removed && server->limits.max_sessions > 0) {
+        atomic_fetch_sub(&server->n_sessions, 1);
+    }
+    return removed;
 }
 
-static mcp_resource_t *get_resource_by_uri(mcp_server_t *server,
-                                           const char   *uri)
+static void mark_client_initialized(mcp_server_t *server, const char *topic)
 {
-    for (int i = 0; i < server->n_resources; i++) {
-        if (strcmp(server->resources[i].uri, uri) == 0) {
-            return &server->resources[i];
+    const char *client_id;
+    size_t      len;
+
+    if (topic_client_id(topic, "$mcp-rpc/", &client_id, &len)) {
+        session_table_t *sessions =
+            client_shard(server, client_id, len)->sessions;
+        session_table_lock(sessions);
+        session_t *session = session_find(sessions, client_id, len);
+        if (session) {
+            session->initialized = true;
         }
+        session_table_unlock(sessions);
     }
-    return NULL;
 }
 
-static bool mcp_server_tool_check(mcp_server_t *server, const char *tool_name,
-                                  int n_args, property_t *args,
-                                  mcp_tool_t **tool)
+/*
+ * Admits a tools/call against the global, tool and session buckets, taking
+ * back the tokens already spent when a later bucket rejects it. Returns 0 or
+ * the time in milliseconds after which a retry would be admitted.
+ */
+static int64_t rate_limit_check(mcp_server_t *server, const char *topic,
+                                catalog_tool_state_t *tool_state)
 {
-    if (server == NULL || tool_name == NULL || args == NULL || n_args <= 0) {
-        return false; // Invalid parameters
+    int64_t     now  = rate_limit_now_us();
+    int64_t     wait = rate_limit_acquire(&server->global_limit, now);
+    const char *client_id;
+    size_t      len;
+
+    if (wait == 0 && tool_state) {
+        wait = rate_limit_acquire(&tool_state->limit, now);
+        if (wait != 0) {
+            rate_limit_refund(&server->global_limit);
+        }
     }
-
-    for (int i = 0; i < server->n_tools; i++) {
-        if (strcmp(server->tools[i].name, tool_name) == 0) {
-            if (server->tools[i].property_count != n_args) {
-                return false;
-            }
-            for (int j = 0; j < n_args; j++) {
-                if (strcmp(server->tools[i].properties[j].name, args[j].name) !=
-                    0) {
-                    return false; // Argument name mismatch
-                } else {
-                    if (server->tools[i].properties[j].type ==
-                        PROPERTY_INTEGER) {
-                        args[j].type = PROPERTY_INTEGER;
-                        args[j].value.integer_value =
-                            (long long) args[j].value.real_value;
-                    }
-                }
+    if (wait == 0 && server->session_rate > 0 &&
+        topic_client_id(topic, "$mcp-rpc/", &client_id, &len)) {
+        session_table_t *sessions =
+            client_shard(server, client_id, len)->sessions;
+        session_table_read_lock(sessions);
+        session_t *session = session_find(sessions, client_id, len);
+        if (session) {
+            wait = rate_limit_acquire(&session->limit, now);
+        }
+        session_table_unlock(sessions);
+        if (wait != 0) {
+            rate_limit_refund(&server->global_limit);
+            if (tool_state) {
+                rate_limit_refund(&tool_state->limit);
             }
-            *tool = &server->tools[i];
-            return true;
         }
     }
-    return false;
+
+    return wait > 0 ? (wait + 999) / 1000 : 0;
 }
 
-int msg_arrvd(void *ctx, char *topic, int topicLen, MQTTAsync_message *message)
+static char *list_response(catalog_snapshot_t *catalog, catalog_list_e list,
+                           int role, const char *key, const jsonrpc_id_t *id,
+                           const char *cursor)
 {
-    mcp_server_t *server = (mcp_server_t *) ctx;
-    printf("Message arrived on topic: %s %d, %d\n", topic, topicLen,
-           message->payloadlen);
+    catalog_page_t page;
+    int            ret = catalog_list_page(catalog, list, role, cursor, &page);
 
-    jsonrpc_t *jsonrpc = jsonrpc_decode(message->payload);
-    if (jsonrpc == NULL) {
-        MQTTAsync_freeMessage(&message);
-        MQTTAsync_free(topic);
-        return 1;
+    if (ret == -2) {
+        return jsonrpc_encode(
+            jsonrpc_error_response(id, -32006, "Memory pools exhausted"));
     }
-
-    char               *method = jsonrpc_get_method(jsonrpc);
-    const jsonrpc_id_t *id     = jsonrpc_get_id(jsonrpc);
-    if (method == NULL) {
-        jsonrpc_decode_free(jsonrpc);
-        MQTTAsync_freeMessage(&message);
-        MQTTAsync_free(topic);
-        return 1;
+    if (ret != 0) {
+        return jsonrpc_encode(
+            jsonrpc_error_response(id, -32602, "Invalid cursor"));
     }
 
-    printf("Method: %s\n", method);
-    if (strncmp(topic, server->control_topic, strlen(server->control_topic)) ==
-        0) {
-        if (strcmp(method, "initialize") != 0) {
-            jsonrpc_decode_free(jsonrpc);
-            MQTTAsync_freeMessage(&message);
-            MQTTAsync_free(topic);
-            return 1;
-        }
+    char *response = jsonrpc_encode(
+        jsonrpc_list_page_response(id, key, page.items, page.next_cursor));
+    catalog_page_free(&page);
+    return response;
+}
 
-        if (!jsonrpc_id_exists(id)) {
-            jsonrpc_decode_free(jsonrpc);
-            MQTTAsync_freeMessage(&message);
-            MQTTAsync_free(topic);
-            return 1;
-        }
+static char *read_response(mcp_server_t *server, catalog_snapshot_t *catalog,
+                           int role, const jsonrpc_id_t *id, const char *uri)
+{
+    mcp_resource_t *resource = catalog_find_resource(catalog, uri);
 
-        char *client_id =
-            get_user_property(&message->properties, "MCP-MQTT-CLIENT-ID");
-        if (client_id == NULL) {
-            jsonrpc_decode_free(jsonrpc);
-            MQTTAsync_freeMessage(&message);
-            MQTTAsync_free(topic);
-            return 1;
-        }
+    if (resource == NULL) {
+        return NULL;
+    }
+    if (!catalog_resource_allowed(catalog, role, resource)) {
+        return jsonrpc_encode(jsonrpc_error_response(id, -32003, "Forbidden"));
+    }
 
-        char *sub_topic = calloc(1, 128);
-        snprintf(sub_topic, 128, "$mcp-rpc/%s/%s/%s", client_id,
-                 server->client_id, server->name);
-        if (insert_client(server, client_id)) {
-            MQTTAsync_responseOptions opts =
-                MQTTAsync_responseOptions_initializer;
-            opts.subscribeOptions.noLocal = 1;
-            MQTTAsync_subscribe(server->client, sub_topic, 0, &opts);
-        }
+    const char *content = server->read_callback(uri);
+    return jsonrpc_encode(
+        jsonrpc_resource_read_text_response(id, resource, content));
+}
 
-        char *response = jsonrpc_encode(jsonrpc_init_response(
-            id, server->n_tools > 0, server->n_resources > 0));
+static void execute_query(mcp_server_t *server, mcp_call_t *call)
+{
+    int64_t start_ns = trace_clock(call->trace);
+    char   *response = NULL;
+
+    switch (call->query) {
+    case CALL_QUERY_LIST_TOOLS:
+        response = list_response(call->catalog, CATALOG_TOOLS, call->role,
+                                 "tools", call->id, call->query_arg);
+        break;
+    case CALL_QUERY_LIST_RESOURCES:
+        response = list_response(call->catalog, CATALOG_RESOURCES, call->role,
+                                 "resources", call->id, call->query_arg);
+        break;
+    case CALL_QUERY_READ_RESOURCE:
+        response = read_response(server, call->catalog, call->role, call->id,
+                                 call->query_arg);
+        break;
+    default:
+        break;
+    }
+    trace_span(call->trace,
+               call->query == CALL_QUERY_READ_RESOURCE ? "read" : "list",
+               start_ns, trace_clock(call->trace));
 
-        MQTTAsync_message msg = MQTTAsync_message_initializer;
-        msg.payload           = (void *) response;
-        msg.payloadlen        = (int) strlen(response);
-        msg.qos               = 0;
-        msg.retained          = 0;
+    if (call_finish(call) && response) {
+        send_response(server, call->topic, response, call->trace);
+    }
+    mem_free(response);
+}
+
+static void execute_call(void *ctx, mcp_call_t *call)
+{
+    mcp_server_t     *server   = (mcp_server_t *) ctx;
+    const mcp_tool_t *tool     = call->tool;
+    mcp_result_t      result;
+    int               ret;
+    int64_t           start_ns = trace_clock(call->trace);
+
+    trace_span(call->trace, "queue", call->queued_ns, start_ns);
+    if (call->query != CALL_QUERY_NONE) {
+        execute_query(server, call);
+        trace_end(call->trace, trace_clock(call->trace));
+        call->trace = NULL;
+        return;
+    }
+
+    result_init(&result, call->id);
+    if (tool->call_json) {
+        ret = tool->call_json(call->arguments, &result);
+    } else if (tool->invoke) {
+        ret = tool->invoke(call->n_args, call->args, &result);
+    } else {
+        const char *text = tool->call(call->n_args, call->args);
+        ret              = text ? mcp_result_text(&result, text) : -1;
+    }
+    int64_t encode_ns = trace_clock(call->trace);
+    trace_span(call->trace, "tool", start_ns, encode_ns);
+    if (!call_finish(call)) {
+        // already answered as cancelled or timed out
+        printf("Dropping late result of tool %s\n", tool->name);
+        result_release(&result);
+        return;
+    }
+
+    call_flush(call);
+
+    char       *error    = NULL;
+    const char *response = NULL;
+    if (ret == MCP_RESULT_INVALID_PARAMS) {
+        response = error = jsonrpc_encode(
+            jsonrpc_error_response(call->id, -32602, "Invalid params"));
+    } else {
+        if (ret < 0 && result.n_items == 0) {
+            mcp_result_text(&result, "Tool execution failed");
+        }
+        if (ret < 0) {
+            mcp_result_error(&result);
+        }
+        response = result_finish(&result);
+    }
+    trace_span(call->trace, "encode", encode_ns, trace_clock(call->trace));
+    send_response(server, call->topic, response, call->trace);
+    if (result.overflowed) {
+        // a retry may well fit once memory is freed
+        response_cache_abandon(topic_responses(server, call->topic),
+                               call->topic, call->id);
+    } else {
+        response_cache_complete(topic_responses(server, call->topic),
+                                call->topic, call->id, response);
+    }
+    if (call->memo.data && ret == 0 && !result.is_error &&
+        !result.overflowed) {
+        memo_cache_store(server->memo, &call->memo, call->id, response,
+                         tool->memo_ttl_ms);
+    }
+    trace_end(call->trace, trace_clock(call->trace));
+    call->trace = NULL;
+    mem_free(error);
+    result_release(&result);
+}
+
+static void notify_call(void *ctx, const mcp_call_t *call,
+                        const char *notification)
+{
+    send_response((mcp_server_t *) ctx, call->topic, notification, NULL);
+}
+
+static void abort_call(void *ctx, mcp_call_t *call, call_abort_reason_e reason)
+{
+    mcp_server_t *server = (mcp_server_t *) ctx;
+    char         *response;
+
+    if (reason == CALL_CANCELLED) {
+        response = jsonrpc_encode(
+            jsonrpc_error_response(call->id, -32800, "Request cancelled"));
+    } else {
+        response = jsonrpc_encode(
+            jsonrpc_error_response(call->id, -32001, "Request timed out"));
+    }
+    send_response(server, call->topic, response, NULL);
+    response_cache_complete(topic_responses(server, call->topic), call->topic,
+                            call->id, response);
+    mem_free(response);
+}
+
+static int64_t call_deadline(mcp_server_t *server, const mcp_tool_t *tool,
+                             const jsonrpc_t         *jsonrpc,
+                             const MQTTAsync_message *message)
+{
+    int64_t   timeout = tool->timeout_ms > 0 ? tool->timeout_ms
+                                             : server->call_timeout_ms;
+    long long requested;
+
+    if (jsonrpc_get_meta_int(jsonrpc, "timeout", &requested) == 0 &&
+        requested > 0 && (timeout == 0 || requested < timeout)) {
+        timeout = requested;
+    }
+
+    MQTTProperties *props = (MQTTProperties *) &message->properties;
+    if (MQTTProperties_hasProperty(props,
+                                   MQTTPROPERTY_CODE_MESSAGE_EXPIRY_INTERVAL)) {
+        int64_t expiry = (int64_t) MQTTProperties_getNumericValue(
+                             props, MQTTPROPERTY_CODE_MESSAGE_EXPIRY_INTERVAL) *
+                         1000;
+        if (expiry > 0 && (timeout == 0 || expiry < timeout)) {
+            timeout = expiry;
+        }
+    }
+
+    return timeout > 0 ? call_now_ms() + timeout : 0;
+}
 
-        MQTTAsync_sendMessage(server->client, sub_topic, &msg, NULL);
-        free(response);
-        free(sub_topic);
+/* Answers a request the memory pools have no room left for. */
+static char *exhausted_response(mcp_server_t *server, const jsonrpc_id_t *id)
+{
+    atomic_fetch_add(&server->rejected, 1);
+    return jsonrpc_encode(
+        jsonrpc_error_response(id, -32006, "Memory pools exhausted"));
+}
+
+/*
+ * Looks up the result of a pure tool, leaving the key in memo for the call
+ * to store its result under on a miss.
+ */
+static char *memo_lookup(mcp_server_t *server, const mcp_tool_t *tool,
+                         const jsonrpc_t *jsonrpc, int n_args,
+                         const property_t *args, memo_key_t *memo)
+{
+    if (!tool->pure || server->memo == NULL) {
+        return NULL;
+    }
+
+    char *arguments = NULL;
+    if (tool->call_json) {
+        arguments = jsonrpc_tool_call_canonical_arguments(jsonrpc);
+        if (arguments == NULL) {
+            return NULL;
+        }
+    }
+    memo_key_build(memo, tool, n_args, args, arguments);
+    mem_free(arguments);
+    return memo_cache_lookup(server->memo, memo, jsonrpc_get_id(jsonrpc));
+}
+
+/* Returns an immediate response, or NULL once the call has been queued. */
+static char *tool_call(mcp_server_t *server, catalog_snapshot_t *catalog,
+                       int role, const char *topic, const jsonrpc_t *jsonrpc,
+                       const MQTTAsync_message *message,
+                       trace_request_t **trace, size_t *charge)
+{
+    response_cache_t   *responses = topic_responses(server, topic);
+    const jsonrpc_id_t *id        = jsonrpc_get_id(jsonrpc);
+    const char         *name      = jsonrpc_tool_call_name(jsonrpc);
+    char               *response  = NULL;
+    char               *arguments = NULL;
+    int                 n_args    = 0;
+    mcp_tool_t         *tool      = NULL;
+    property_t         *args      = NULL;
+    mcp_call_t         *call      = NULL;
+    int                 ret       = 0;
+    memo_key_t          memo      = { 0 };
+
+    if (name == NULL) {
+        response = jsonrpc_encode(
+            jsonrpc_error_response(id, -32600, "Invalid params"));
+        response_cache_complete(responses, topic, id, response);
+        return response;
+    }
+    trace_set_name(*trace, "tools/call", name);
+
+    tool = catalog_find_tool(catalog, name);
+    if (server->limits.max_arguments > 0 &&
+        jsonrpc_tool_call_argument_count(jsonrpc) >
+            server->limits.max_arguments) {
+        atomic_fetch_add(&server->rejected, 1);
+        response = jsonrpc_encode(
+            jsonrpc_error_response(id, -32602, "Too many arguments"));
+        response_cache_complete(responses, topic, id, response);
+        return response;
+    }
+    if (tool && tool->call_json) {
+        // generated binders decode the arguments JSON themselves
+        ret = jsonrpc_tool_call_arguments(jsonrpc, &arguments);
+    } else if (tool) {
+        ret    = jsonrpc_tool_call_args(jsonrpc, tool, &args);
+        n_args = tool->property_count;
+    }
+
+    int64_t retry_after = 0;
+    if (tool == NULL) {
+        response = jsonrpc_encode(
+            jsonrpc_error_response(id, -32601, "Method not found"));
+        response_cache_complete(responses, topic, id, response);
+    } else if (!catalog_tool_allowed(catalog, role, tool)) {
+        response =
+            jsonrpc_encode(jsonrpc_error_response(id, -32003, "Forbidden"));
+        response_cache_complete(responses, topic, id, response);
+    } else if (ret == JSONRPC_EXHAUSTED) {
+        // not cached either, the pools may have room again on a retry
+        response_cache_abandon(responses, topic, id);
+        response = exhausted_response(server, id);
+    } else if (ret != 0) {
+        response = jsonrpc_encode(
+            jsonrpc_error_response(id, -32602, "Invalid params"));
+        response_cache_complete(responses, topic, id, response);
+    } else if ((retry_after = rate_limit_check(
+                    server, topic, catalog_tool_state(catalog, tool))) > 0) {
+        // not cached, a retry after the hint has to run the tool
+        response_cache_abandon(responses, topic, id);
+        response = jsonrpc_encode(jsonrpc_retry_error_response(
+            id, -32005, "Rate limit exceeded", retry_after));
+    } else if ((response = memo_lookup(server, tool, jsonrpc, n_args, args,
+                                       &memo)) != NULL) {
+        // answered these arguments before, nothing to run or encode
+        response_cache_complete(responses, topic, id, response);
+    } else if ((call = call_create(topic, id, catalog_retain(catalog), tool,
+                                   n_args, args, arguments,
+                                   call_deadline(server, tool, jsonrpc,
+                                                 message))) == NULL) {
+        catalog_release(catalog);
+        response_cache_abandon(responses, topic, id);
+        response = exhausted_response(server, id);
+    } else {
+        call->progress_token       = jsonrpc_progress_token(jsonrpc);
+        call->progress_interval_ms = server->progress_interval_ms;
+        call->memo                 = memo;
+        call->trace                = *trace;
+        call->queued_ns            = trace_clock(*trace);
+        call->budget               = &server->in_flight;
+        call->charge               = *charge;
+        memo                       = (memo_key_t) { 0 };
+        args                       = NULL;
+        arguments                  = NULL;
+        *trace                     = NULL;
+        *charge                    = 0;
+        int submitted              = call_pool_submit(server->calls, call);
+        if (submitted != 0) {
+            response_cache_abandon(responses, topic, id);
+            call_free(call);
+        }
+        if (submitted == -1) {
+            // stopped meanwhile, answers the duplicates attached as well
+            response = jsonrpc_encode(jsonrpc_error_response(
+                id, -32000, "Server is shutting down"));
+        } else if (submitted == -2) {
+            atomic_fetch_add(&server->rejected, 1);
+            response = jsonrpc_encode(jsonrpc_error_response(
+                id, -32006, "Too many requests in flight"));
+        } else if (submitted == -3) {
+            response = exhausted_response(server, id);
+        }
+    }
+
+    jsonrpc_tool_call_args_free(n_args, args);
+    mem_free(arguments);
+    memo_key_free(&memo);
+    return response;
+}
+
+/*
+ * Lists and reads are answered by the workers as well, so a burst of them
+ * (or a slow read callback) does not hold up the MQTT thread. Only decoding
+ * happens here; returns an immediate response, or NULL once queued.
+ */
+static char *query_submit(mcp_server_t *server, catalog_snapshot_t *catalog,
+                          int role, const char *topic,
+                          const jsonrpc_t *jsonrpc, call_query_e query,
+                          trace_request_t **trace, size_t *charge)
+{
+    const jsonrpc_id_t *id  = jsonrpc_get_id(jsonrpc);
+    char               *arg = NULL;
+    int                 ret;
+
+    if (query == CALL_QUERY_READ_RESOURCE) {
+        ret = jsonrpc_resource_read_decode(jsonrpc, &arg);
+    } else {
+        ret = jsonrpc_list_decode(jsonrpc, &arg);
+    }
+    if (ret == JSONRPC_EXHAUSTED) {
+        mem_free(arg);
+        return exhausted_response(server, id);
+    }
+    if (ret != 0) {
+        mem_free(arg);
+        if (query == CALL_QUERY_READ_RESOURCE) {
+            return NULL;
+        }
+        return jsonrpc_encode(
+            jsonrpc_error_response(id, -32602, "Invalid cursor"));
+    }
+
+    mcp_call_t *call =
+        call_create_query(topic, id, catalog_retain(catalog), role, query, arg);
+    if (call == NULL) {
+        catalog_release(catalog);
+        mem_free(arg);
+        return exhausted_response(server, id);
+    }
+    call->trace     = *trace;
+    call->queued_ns = trace_clock(*trace);
+    call->budget    = &server->in_flight;
+    call->charge    = *charge;
+    *trace          = NULL;
+    *charge         = 0;
+    ret             = call_pool_submit(server->calls, call);
+    if (ret != 0) {
+        call_free(call);
+    }
+    if (ret == -2) {
+        atomic_fetch_add(&server->rejected, 1);
+        return jsonrpc_encode(jsonrpc_error_response(
+            id, -32006, "Too many requests in flight"));
+    }
+    if (ret == -3) {
+        return exhausted_response(server, id);
+    }
+    return NULL;
+}
+
+/*
+ * Handles a request on a session topic, returns the response or NULL. Calls
+ * queued for a worker take the trace of the request along, and its charge
+ * against the memory budget.
+ */
+static char *rpc_dispatch(mcp_server_t *server, catalog_snapshot_t *catalog,
+                          const char *topic, const jsonrpc_t *jsonrpc,
+                          const MQTTAsync_message *message,
+                          trace_request_t **trace, size_t *charge)
+{
+    const char         *method   = jsonrpc_get_method(jsonrpc);
+    const jsonrpc_id_t *id       = jsonrpc_get_id(jsonrpc);
+    char               *response = NULL;
+    int                 role     = -1;
+
+    trace_set_name(*trace, method, NULL);
+    if (atomic_load(&server->stopping)) {
+        return jsonrpc_id_exists(id)
+                   ? jsonrpc_encode(jsonrpc_error_response(
+                         id, -32000, "Server is shutting down"))
+                   : NULL;
+    }
+    if (catalog->rbac) {
+        int64_t start_ns    = trace_clock(*trace);
+        int     rbac_method = rbac_method_index(method);
+        bool    allowed     = true;
+
+        // only the methods RBAC covers need the session's role
+        if (rbac_method >= 0) {
+            role    = session_role(server, topic);
+            allowed = role >= 0 &&
+                      rbac_method_allowed(catalog->rbac, role, rbac_method);
+        }
+        trace_span(*trace, "auth", start_ns, trace_clock(*trace));
+        if (!allowed) {
+            return jsonrpc_encode(
+                jsonrpc_error_response(id, -32003, "Forbidden"));
+        }
+    }
+
+    if (strcmp(method, "tools/list") == 0) {
+        response = query_submit(server, catalog, role, topic, jsonrpc,
+                                CALL_QUERY_LIST_TOOLS, trace, charge);
+    }
+    if (strcmp(method, "tools/call") == 0) {
+        char *cached = NULL;
+        switch (response_cache_begin(topic_responses(server, topic), topic, id,
+                                     &cached)) {
+        case RESPONSE_CACHE_HIT:
+            // retry of an answered call, replay without executing
+            response = cached != NULL ? cached : exhausted_response(server, id);
+            break;
+        case RESPONSE_CACHE_IN_FLIGHT:
+            // attached to the original, whose answer has the same id
+            break;
+        case RESPONSE_CACHE_MISS:
+            response = tool_call(server, catalog, role, topic, jsonrpc,
+                                 message, trace, charge);
+            break;
+        }
+    }
+    if (strcmp(method, "resources/list") == 0) {
+        response = query_submit(server, catalog, role, topic, jsonrpc,
+                                CALL_QUERY_LIST_RESOURCES, trace, charge);
+    }
+    if (strcmp(method, "resources/read") == 0) {
+        response = query_submit(server, catalog, role, topic, jsonrpc,
+                                CALL_QUERY_READ_RESOURCE, trace, charge);
+    }
+
+    return response;
+}
+
+static void route_message(mcp_server_t *server, const char *topic,
+                          int topicLen, const MQTTAsync_message *message,
+                          const jsonrpc_t *jsonrpc, int64_t arrived_ns,
+                          int64_t decoded_ns, size_t *charge)
+{
+    char               *method = jsonrpc_get_method(jsonrpc);
+    const jsonrpc_id_t *id     = jsonrpc_get_id(jsonrpc);
+    if (method == NULL) {
+        return;
+    }
+
+    printf("Method: %s\n", method);
+    if (strncmp(topic, server->control_topic, strlen(server->control_topic)) ==
+        0) {
+        // no new sessions once stopping, the client finds another server
+        if (strcmp(method, "initialize") != 0 ||
+            atomic_load(&server->stopping)) {
+            return;
+        }
+
+        if (!jsonrpc_id_exists(id)) {
+            return;
+        }
+
+        char  client_id_buf[256];
+        char *client_id =
+            get_user_property(&message->properties, "MCP-MQTT-CLIENT-ID",
+                              client_id_buf, sizeof(client_id_buf));
+        if (client_id == NULL) {
+            return;
+        }
+
+        char sub_topic[256];
+        int  len = session_topic(server, client_id, sub_topic,
+                                 sizeof(sub_topic));
+        if (len >= (int) sizeof(sub_topic)) {
+            // sessions keep their topic in 256 bytes, answered where the
+            // client listens all the same
+            char *full = mem_alloc(len + 1);
+            char *response = jsonrpc_encode(
+                jsonrpc_error_response(id, -32600, "Client id too long"));
+            if (full != NULL) {
+                session_topic(server, client_id, full, len + 1);
+                send_message(server, full, response, NULL);
+            }
+            mem_free(full);
+            mem_free(response);
+            return;
+        }
+
+        int  role = -1;
+        int  inserted;
+        char role_buf[128];
+        if (server->rbac) {
+            char *role_name =
+                get_user_property(&message->properties, "MCP-RBAC-ROLE",
+                                  role_buf, sizeof(role_buf));
+            role = role_name ? rbac_role_index(server->rbac, role_name) : -1;
+        }
+
+        char *response;
+        if (server->rbac && role < 0) {
+            response = jsonrpc_encode(
+                jsonrpc_error_response(id, -32003, "Unknown role"));
+        } else if ((inserted = insert_client(server, client_id, role)) < 0) {
+            const char *error = inserted == -1 ? "Too many sessions"
+                                               : "Memory pools exhausted";
+            atomic_fetch_add(&server->rejected, 1);
+            response =
+                jsonrpc_encode(jsonrpc_error_response(id, -32006, error));
+        } else {
+            if (inserted > 0) {
+                MQTTAsync_responseOptions opts =
+                    MQTTAsync_responseOptions_initializer;
+                opts.subscribeOptions.noLocal = 1;
+                // on the connection the session is served on
+                shard_t *shard =
+                    client_shard(server, client_id, strlen(client_id));
+                MQTTAsync_subscribe(shard->client, sub_topic, 0, &opts);
+            }
+
+            catalog_snapshot_t *catalog = catalog_acquire(server->catalog);
+            response = jsonrpc_encode(jsonrpc_init_response(
+                id, catalog->n_tools > 0, catalog->n_resources > 0));
+            catalog_release(catalog);
+        }
+
+        send_message(server, sub_topic, response, NULL);
+        mem_free(response);
     }
 
     if (strncmp(topic, "$mcp-client/presence/",
                 strlen("$mcp-client/presence/")) == 0) {
         if (message->payloadlen == 0) {
-            char *client_topic = calloc(1, topicLen + 1);
-            strncpy(client_topic, topic, topicLen);
-            remove_client(server, client_topic);
-            free(client_topic);
+            char *client_topic = mem_strndup(topic, topicLen);
+            if (client_topic != NULL) {
+                remove_client(server, client_topic);
+            }
+            mem_free(client_topic);
         }
     }
 
     if (strncmp(topic, "$mcp-rpc/", strlen("$mcp-rpc/")) == 0) {
         if (strcmp(method, "notifications/initialized") == 0) {
-            // client initialized
+            mark_client_initialized(server, topic);
         }
-        char *response = NULL;
-        if (strcmp(method, "tools/list") == 0) {
-            response = jsonrpc_encode(
-                jsonrpc_tool_list_response(id, server->n_tools, server->tools));
-        }
-        if (strcmp(method, "tools/call") == 0) {
-            char       *f_name = NULL;
-            int         n_args = 0;
-            mcp_tool_t *tool   = NULL;
-            property_t *args   = NULL;
-
-            int ret =
-                jsonrpc_tool_call_decode(jsonrpc, &f_name, &n_args, &args);
-            if (ret != 0) {
-                response = jsonrpc_encode(
-                    jsonrpc_error_response(id, -32600, "Invalid params"));
-            } else {
-                if (mcp_server_tool_check(server, f_name, n_args, args,
-                                          &tool)) {
-                    const char *result = tool->call(n_args, args);
-                    response =
-                        jsonrpc_encode(jsonrpc_tool_call_response(id, result));
-                } else {
-                    response = jsonrpc_encode(
-                        jsonrpc_error_response(id, -32601, "Method not found"));
-                }
-
-                for (int i = 0; i < server->n_tools; i++) {
-                    if (args[i].type == PROPERTY_STRING) {
-                        free(args[i].value.string_value);
-                    }
-                }
-                free(args);
+        if (strcmp(method, "notifications/cancelled") == 0) {
+            jsonrpc_id_t *request_id = NULL;
+            if (jsonrpc_cancelled_decode(jsonrpc, &request_id) == 0) {
+                call_pool_cancel(server->calls, topic, request_id);
+                jsonrpc_id_free(request_id);
             }
         }
-        if (strcmp(method, "resources/list") == 0) {
-            response = jsonrpc_encode(jsonrpc_resource_list_response(
-                id, server->n_resources, server->resources));
+        trace_request_t *trace = NULL;
+        if (server->trace && jsonrpc_id_exists(id)) {
+            char traceparent[128];
+            trace = trace_begin(server->trace,
+                                get_user_property(&message->properties,
+                                                  "traceparent", traceparent,
+                                                  sizeof(traceparent)),
+                                arrived_ns);
+            trace_span(trace, "decode", arrived_ns, decoded_ns);
         }
-        if (strcmp(method, "resources/read") == 0) {
-            char *uri = NULL;
-            int   ret = jsonrpc_resource_read_decode(jsonrpc, &uri);
 
-            if (ret == 0) {
-                mcp_resource_t *resource = get_resource_by_uri(server, uri);
-                if (resource) {
-                    const char *content = server->read_callback(uri);
-                    response =
-                        jsonrpc_encode(jsonrpc_resource_read_text_response(
-                            id, resource, content));
-                }
+        catalog_snapshot_t *catalog = catalog_acquire(server->catalog);
+        char *response = rpc_dispatch(server, catalog, topic, jsonrpc,
+                                      message, &trace, charge);
+        catalog_release(catalog);
 
-                free(uri);
-            }
+        if (response) {
+            send_response(server, topic, response, trace);
+            mem_free(response);
         }
+        trace_end(trace, trace_clock(trace)); // unless a worker took it
+    }
+}
 
-        if (response) {
-            MQTTAsync_message msg = MQTTAsync_message_initializer;
-            msg.payload           = (void *) response;
-            msg.payloadlen        = (int) strlen(response);
-            msg.qos               = 0;
-            msg.retained          = 0;
-            int rr = MQTTAsync_sendMessage(server->client, topic, &msg, NULL);
-            printf("Sending response to topic: %d %s\n %s\n", rr, topic,
-                   response);
-            free(response);
+static void budget_peak(mcp_server_t *server, size_t in_flight)
+{
+    size_t peak = atomic_load(&server->in_flight_peak);
+
+    while (in_flight > peak && !atomic_compare_exchange_weak(
+                                   &server->in_flight_peak, &peak, in_flight)) {
+    }
+}
+
+/* Takes n bytes of the memory budget, false when they do not fit. */
+static bool budget_reserve(mcp_server_t *server, size_t n)
+{
+    size_t in_flight = atomic_fetch_add(&server->in_flight, n) + n;
+
+    if (server->limits.max_in_flight > 0 &&
+        in_flight > server->limits.max_in_flight) {
+        atomic_fetch_sub(&server->in_flight, n);
+        return false;
+    }
+    budget_peak(server, in_flight);
+    return true;
+}
+
+/*
+ * Checks a message against the limits before anything is parsed, reserving
+ * its payload in the memory budget. A request turned away is answered with
+ * its id, found by a scan, when it has one.
+ */
+static bool admit_message(mcp_server_t *server, const char *topic,
+                          const MQTTAsync_message *message)
+{
+    const mcp_limits_t *limits = &server->limits;
+    size_t              len    = (size_t) message->payloadlen;
+    const char         *error  = NULL;
+    int                 code   = -32600;
+
+    if (limits->max_payload > 0 && len > limits->max_payload) {
+        error = "Request too large";
+    } else if (limits->max_depth > 0 &&
+               !mcp_json_depth_within(message->payload, len,
+                                      limits->max_depth)) {
+        error = "Request nested too deeply";
+    } else if (!mem_headroom()) {
+        code  = -32006;
+        error = "Memory pools exhausted";
+    } else if (!budget_reserve(server, len)) {
+        code  = -32006;
+        error = "Memory budget exceeded";
+    }
+    if (error == NULL) {
+        return true;
+    }
+
+    atomic_fetch_add(&server->rejected, 1);
+    printf("Rejected %zu bytes on %s: %s\n", len, topic, error);
+    if (strncmp(topic, "$mcp-rpc/", strlen("$mcp-rpc/")) == 0) {
+        jsonrpc_id_t *id = jsonrpc_id_scan(message->payload, len);
+        if (jsonrpc_id_exists(id)) {
+            char *response =
+                jsonrpc_encode(jsonrpc_error_response(id, code, error));
+            send_response(server, topic, response, NULL);
+            mem_free(response);
         }
+        jsonrpc_id_free(id);
+    }
+    return false;
+}
+
+/*
+ * A request is charged its payload and the tree decoded from it until it is
+ * answered, by the call that takes the charge over once queued.
+ */
+static void handle_message(void *ctx, char *topic, int topicLen,
+                           MQTTAsync_message *message)
+{
+    mcp_server_t *server     = (mcp_server_t *) ctx;
+    int64_t       arrived_ns = server->trace ? trace_now_ns() : 0;
+    size_t        charge     = (size_t) message->payloadlen;
+    printf("Message arrived on topic: %s %d, %d\n", topic, topicLen,
+           message->payloadlen);
+
+    if (!admit_message(server, topic, message)) {
+        return;
+    }
+
+    // JSON text is UTF-8 (RFC 8259), anything else is not worth parsing
+    size_t     allocated = jsonrpc_memory_allocated();
+    jsonrpc_t *jsonrpc =
+        mcp_json_valid_utf8(message->payload, message->payloadlen)
+            ? jsonrpc_decode(message->payload, message->payloadlen)
+            : NULL;
+    int64_t decoded_ns = server->trace ? trace_now_ns() : 0;
+    if (jsonrpc != NULL) {
+        size_t tree = jsonrpc_memory_allocated() - allocated;
+        // parsed already, counted even past the budget
+        budget_peak(server, atomic_fetch_add(&server->in_flight, tree) + tree);
+        charge += tree;
+        route_message(server, topic, topicLen, message, jsonrpc, arrived_ns,
+                      decoded_ns, &charge);
+        jsonrpc_decode_free(jsonrpc);
     }
+    atomic_fetch_sub(&server->in_flight, charge);
+}
+
+int msg_arrvd(void *ctx, char *topic, int topicLen, MQTTAsync_message *message)
+{
+    mcp_server_t *server = ((shard_t *) ctx)->server;
 
-    jsonrpc_decode_free(jsonrpc);
+    capture_message(server->capture, CAPTURE_IN, topic, message->payload,
+                    message->payloadlen, &message->properties);
+    if (post_event((shard_t *) ctx, INBOX_MESSAGE, 0, topic, topicLen,
+                   message)) {
+        return 1; // freed once handled
+    }
+    handle_message(server, topic, topicLen, message);
     MQTTAsync_freeMessage(&message);
     MQTTAsync_free(topic);
-
     return 1;
 }
 
-int mcp_server_run(mcp_server_t *server)
+int mcp_server_set_workers(mcp_server_t *server, int n_workers)
+{
+    if (server->calls != NULL || n_workers <= 0) {
+        return -1; // the pool is created by mcp_server_run
+    }
+    server->n_workers = n_workers;
+    return 0;
+}
+
+int mcp_server_set_progress_interval(mcp_server_t *server, int interval_ms)
+{
+    if (interval_ms < 0) {
+        return -1;
+    }
+    server->progress_interval_ms = interval_ms;
+    return 0;
+}
+
+int mcp_server_set_call_timeout(mcp_server_t *server, int timeout_ms)
+{
+    if (timeout_ms < 0) {
+        return -1;
+    }
+    server->call_timeout_ms = timeout_ms;
+    return 0;
+}
+
+int mcp_server_set_response_cache(mcp_server_t *server, int capacity,
+                                  int ttl_ms)
+{
+    if (server->calls != NULL || capacity < 0 || ttl_ms < 0) {
+        return -1; // cannot be swapped while requests are served
+    }
+    server->response_capacity = capacity;
+    server->response_ttl_ms   = ttl_ms;
+    for (int i = 0; i < server->n_shards; i++) {
+        shard_t *shard = &server->shards[i];
+        response_cache_destroy(shard->responses);
+        shard->responses = response_cache_create(capacity, ttl_ms);
+    }
+    return 0;
+}
+
+int mcp_server_set_memo_cache(mcp_server_t *server, int capacity)
+{
+    if (server->calls != NULL || capacity < 0) {
+        return -1; // cannot be swapped while requests are served
+    }
+    memo_cache_destroy(server->memo);
+    server->memo = memo_cache_create(capacity);
+    return 0;
+}
+
+void mcp_server_memo_stats(mcp_server_t *server, long long *hits,
+                           long long *misses)
+{
+    memo_cache_stats(server->memo, hits, misses);
+}
+
+int mcp_server_set_spool(mcp_server_t *server, const char *path, size_t size,
+                         int ttl_s)
+{
+    if (server->calls != NULL || ttl_s < 0) {
+        return -1; // messages are spooled without locking once running
+    }
+    spool_close(server->spool);
+    server->spool       = path ? spool_open(path, size) : NULL;
+    server->spool_ttl_s = ttl_s;
+    return path && server->spool == NULL ? -1 : 0;
+}
+
+int mcp_server_set_tracing(mcp_server_t *server, double sample_ratio,
+                           mcp_span_export_fn export, void *ctx)
+{
+    if (server->calls != NULL || sample_ratio < 0 || sample_ratio > 1) {
+        return -1; // spans are recorded without locking once running
+    }
+    trace_destroy(server->trace);
+    server->trace = export ? trace_create(sample_ratio, export, ctx) : NULL;
+    return export && server->trace == NULL ? -1 : 0;
+}
+
+int mcp_server_set_page_size(mcp_server_t *server, int page_size)
+{
+    return catalog_set_page_size(server->catalog, page_size);
+}
+
+int mcp_server_set_rate_limit(mcp_server_t *server,
+                              mcp_rate_limit_scope_e scope, double rate,
+                              int burst)
+{
+    if (server->calls != NULL || rate < 0) {
+        return -1; // buckets are read without locking once running
+    }
+    switch (scope) {
+    case MCP_RATE_LIMIT_GLOBAL:
+        rate_limit_init(&server->global_limit, rate, burst);
+        return 0;
+    case MCP_RATE_LIMIT_SESSION:
+        server->session_rate  = rate;
+        server->session_burst = burst;
+        return 0;
+    }
+    return -1;
+}
+
+int mcp_server_register_roles(mcp_server_t *server, int n_roles,
+                              mcp_mqtt_role_t *roles)
+{
+    if (server->calls != NULL) {
+        return -1; // sessions hold role indices once running
+    }
+
+    rbac_t *rbac = rbac_create(n_roles, roles);
+    if (rbac == NULL || catalog_set_rbac(server->catalog, rbac) != 0) {
+        rbac_release(rbac);
+        return -1;
+    }
+    rbac_release(server->rbac);
+    server->rbac = rbac;
+    return 0;
+}
+
+int mcp_server_set_reconnect(mcp_server_t *server, int min_ms, int max_ms)
+{
+    if (server->calls != NULL || min_ms < 0 || max_ms < min_ms) {
+        return -1;
+    }
+    server->reconnect_min_ms = min_ms;
+    server->reconnect_max_ms = max_ms;
+    return 0;
+}
+
+int mcp_server_set_session_expiry(mcp_server_t *server, int expiry_s)
 {
-    int ret = MQTTAsync_connect(server->client, &server->conn_opts);
-    printf("Connecting to MQTT broker: %s\n", server->broker_uri);
+    if (server->calls != NULL || expiry_s < 0) {
+        return -1;
+    }
+    server->session_expiry_s = expiry_s;
+    return 0;
+}
+
+#ifdef MCP_STATIC_MEMORY
+/* Static builds keep every limit within what the pools were sized for. */
+static int limit_clamp(int value, int cap)
+{
+    return value == 0 || value > cap ? cap : value;
+}
+#endif
+
+int mcp_server_set_limits(mcp_server_t *server, const mcp_limits_t *limits)
+{
+    if (server->calls != NULL || limits->max_depth < 0 ||
+        limits->max_arguments < 0 || limits->max_sessions < 0 ||
+        limits->max_calls < 0) {
+        return -1;
+    }
+    server->limits = *limits;
+#ifdef MCP_STATIC_MEMORY
+    mcp_limits_t *clamped = &server->limits;
+    if (clamped->max_payload == 0 ||
+        clamped->max_payload > MCP_STATIC_MAX_BLOCK) {
+        clamped->max_payload = MCP_STATIC_MAX_BLOCK;
+    }
+    clamped->max_arguments = limit_clamp(clamped->max_arguments,
+                                         MCP_STATIC_ARGS);
+    clamped->max_sessions  = limit_clamp(clamped->max_sessions,
+                                         MCP_STATIC_SESSIONS);
+    clamped->max_calls     = limit_clamp(clamped->max_calls, MCP_STATIC_CALLS);
+#endif
+    jsonrpc_track_memory();
+    return 0;
+}
+
+void mcp_server_memory_stats(mcp_server_t *server, mcp_memory_stats_t *stats)
+{
+    stats->in_flight      = atomic_load(&server->in_flight);
+    stats->in_flight_peak = atomic_load(&server->in_flight_peak);
+    stats->rejected       = atomic_load(&server->rejected);
+    jsonrpc_memory_usage(&stats->json_in_use, &stats->json_peak);
+    mem_stats(&stats->pool_used, &stats->pool_size, &stats->pool_exhausted);
+}
+
+int mcp_server_set_shards(mcp_server_t *server, int n_shards)
+{
+    if (server->calls != NULL || n_shards <= 0) {
+        return -1; // connections are only opened by mcp_server_run
+    }
+
+    shard_t *shards = mem_calloc(n_shards, sizeof(shard_t));
+    for (int i = 0; i < n_shards; i++) {
+        if (shard_init(server, &shards[i], i) != 0) {
+            while (i-- > 0) {
+                MQTTAsync_destroy(&shards[i].client);
+                shard_destroy(&shards[i]);
+            }
+            mem_free(shards);
+            return -1;
+        }
+    }
+    // nothing is connected or subscribed yet, sessions start with the run
+    for (int i = 0; i < server->n_shards; i++) {
+        MQTTAsync_destroy(&server->shards[i].client);
+        shard_destroy(&server->shards[i]);
+    }
+    mem_free(server->shards);
+    server->shards   = shards;
+    server->n_shards = n_shards;
+    return 0;
+}
+
+int mcp_server_set_capture(mcp_server_t *server, const char *path)
+{
+    if (server->calls != NULL) {
+        return -1; // messages are captured without locking once running
+    }
+    capture_close(server->capture);
+    server->capture = path ? capture_open(path) : NULL;
+    return path && server->capture == NULL ? -1 : 0;
+}
+
+int mcp_server_replay(mcp_server_t *server, const char *path, double speed,
+                      mcp_replay_stats_t *stats)
+{
+    if (server->calls != NULL || speed < 0) {
+        return -1; // replays stand in for mcp_server_run
+    }
+    server->calls  = call_pool_create(server->n_workers, execute_call,
+                                      abort_call, notify_call, server);
+    call_pool_set_capacity(server->calls, server->limits.max_calls);
+    server->replay = replay_create();
+    return replay_run(server->replay, path, speed, handle_message, server,
+                      stats);
+}
+
+static void server_prepare(mcp_server_t *server, int n_workers, bool polled)
+{
+    server->calls = call_pool_create(n_workers, execute_call, abort_call,
+                                     notify_call, server);
+    call_pool_set_capacity(server->calls, server->limits.max_calls);
+    for (int i = 0; i < server->n_shards; i++) {
+        shard_t *shard = &server->shards[i];
+        if (polled) {
+            shard->reconnect = reconnect_create_polled(
+                server->reconnect_min_ms, server->reconnect_max_ms,
+                reconnect_broker, shard);
+        } else {
+            shard->reconnect =
+                reconnect_create(server->reconnect_min_ms,
+                                 server->reconnect_max_ms, reconnect_broker,
+                                 shard);
+        }
+    }
+
+    MQTTProperty expiry = {
+        .identifier     = MQTTPROPERTY_CODE_SESSION_EXPIRY_INTERVAL,
+        .value.integer4 = (unsigned int) server->session_expiry_s,
+    };
+    MQTTProperties_add(&server->connect_props, &expiry);
+}
+
+static int server_connect(mcp_server_t *server)
+{
+    int ret = MQTTASYNC_SUCCESS;
+    for (int i = 0; i < server->n_shards; i++) {
+        shard_t *shard = &server->shards[i];
+        int      err   = MQTTAsync_connect(shard->client, &shard->conn_opts);
+        if (err != MQTTASYNC_SUCCESS) {
+            ret = err;
+        }
+    }
+    printf("Connecting to MQTT broker: %s, %d shards\n", server->broker_uri,
+           server->n_shards);
     return ret;
-}
\ No newline at end of file
+}
+
+int mcp_server_run(mcp_server_t *server)
+{
+    if (server->calls == NULL) {
+        server_prepare(server, server->n_workers, false);
+    }
+    return server_connect(server);
+}
+
+int mcp_server_start(mcp_server_t *server)
+{
+    if (server->calls != NULL) {
+        return -1;
+    }
+    server->inbox = inbox_create();
+    if (server->inbox == NULL) {
+        return -1;
+    }
+    server_prepare(server, 0, true); // tools run in mcp_server_process
+    if (server_connect(server) != MQTTASYNC_SUCCESS) {
+        return -1;
+    }
+    return inbox_fd(server->inbox);
+}
+
+static int64_t earliest(int64_t a, int64_t b)
+{
+    return a == 0 || (b != 0 && b < a) ? b : a;
+}
+
+int mcp_server_timeout(mcp_server_t *server)
+{
+    int64_t due = earliest(server->next_deadline_ms, server->next_reconnect_ms);
+    if (server->inbox == NULL || due == 0) {
+        return -1;
+    }
+    int64_t left = due - call_now_ms();
+    return left > 0 ? (int) (left < INT_MAX ? left : INT_MAX) : 0;
+}
+
+int mcp_server_process(mcp_server_t *server, int timeout_ms)
+{
+    if (server->inbox == NULL || server->stopped) {
+        return -1;
+    }
+
+    int wait = mcp_server_timeout(server);
+    if (wait < 0 || (timeout_ms >= 0 && timeout_ms < wait)) {
+        wait = timeout_ms;
+    }
+    if (wait != 0 && inbox_empty(server->inbox)) {
+        struct pollfd pfd = { .fd = inbox_fd(server->inbox), .events = POLLIN };
+        poll(&pfd, 1, wait);
+    }
+
+    int            n_done = 0;
+    inbox_event_t *event  = inbox_take(server->inbox);
+    while (event) {
+        inbox_event_t *next  = event->next;
+        shard_t       *shard = (shard_t *) event->ctx;
+        switch (event->kind) {
+        case INBOX_MESSAGE:
+            handle_message(server, event->topic, event->topic_len,
+                           event->message);
+            break;
+        case INBOX_CONNECTED:
+            shard_connected(shard, event->code != 0);
+            break;
+        case INBOX_CONNECTION_LOST:
+        case INBOX_CONNECT_FAILED:
+            shard_lost(shard);
+            break;
+        }
+        inbox_event_free(event);
+        event = next;
+        n_done++;
+    }
+
+    // the requests just handled queued their calls, run them right away
+    n_done += call_pool_run(server->calls, &server->next_deadline_ms);
+
+    server->next_reconnect_ms = 0;
+    for (int i = 0; i < server->n_shards; i++) {
+        server->next_reconnect_ms =
+            earliest(server->next_reconnect_ms,
+                     reconnect_poll(server->shards[i].reconnect));
+    }
+    return n_done;
+}
+
+int mcp_server_stop(mcp_server_t *server, int timeout_ms)
+{
+    if (server->calls == NULL || server->stopped || timeout_ms < 0) {
+        return -1;
+    }
+    if (server->inbox) {
+        mcp_server_process(server, 0); // arrived before the stop
+    }
+    atomic_store(&server->stopping, true);
+
+    // requests still arriving are turned away, the accepted ones finish
+    int64_t deadline_ms = call_now_ms() + timeout_ms;
+    while (call_pool_pending(server->calls) > 0 &&
+           call_now_ms() < deadline_ms) {
+        if (server->inbox) {
+            mcp_server_process(server, 10);
+        } else {
+            usleep(10000);
+        }
+    }
+    if (server->inbox) {
+        mcp_server_process(server, 0); // turn away what is still waiting
+    }
+    int n_left = call_pool_pending(server->calls);
+    if (n_left > 0) {
+        printf("Stopping with %d calls unanswered\n", n_left);
+    }
+
+    // clears the retained online presence, as the will would
+    MQTTAsync_message offline = MQTTAsync_message_initializer;
+    offline.payload           = "";
+    offline.payloadlen        = 0;
+    offline.retained          = 1;
+    MQTTAsync_sendMessage(server->shards[0].client, server->presence_topic,
+                          &offline, NULL);
+
+    MQTTAsync_disconnectOptions opts =
+        MQTTAsync_disconnectOptions_initializer5;
+    opts.timeout = 1000; // for the last responses to get out
+    for (int i = 0; i < server->n_shards; i++) {
+        atomic_store(&server->shards[i].connected, false);
+        MQTTAsync_disconnect(server->shards[i].client, &opts);
+    }
+    server->stopped = true;
+    return n_left == 0 ? 0 : -1;
+}
@@ -0,0 +1,258 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mem.h"
+
+#ifdef MCP_STATIC_MEMORY
+
+#define MEM_MIN_SHIFT 5 // 32 byte blocks, room for the free list link
+#define MEM_MAX_POOLS 24
+
+/*
+ * Blocks each class needs with every session connected and every call in
+ * flight. A call holds small blocks (32 to 128 bytes) for its decoded tree
+ * and arguments, medium ones (256 to 1024) for itself, its topic and cached
+ * answer, and a large one (2048 up to half the largest) for each buffer it
+ * grows through. The largest blocks take payloads and encodings, one per
+ * call and two for the MQTT thread. The startup terms cover the catalog,
+ * caches and shards.
+ */
+#define MEM_SMALL_BLOCKS                                                       \
+    (64 + 4 * MCP_STATIC_SESSIONS + 4 * MCP_STATIC_CALLS * MCP_STATIC_ARGS)
+#define MEM_MEDIUM_BLOCKS (16 + 2 * MCP_STATIC_SESSIONS + 4 * MCP_STATIC_CALLS)
+#define MEM_LARGE_BLOCKS  MCP_STATIC_CALLS
+#define MEM_MAX_BLOCKS    (2 + MCP_STATIC_CALLS)
+#define MEM_NEEDED                                                             \
+    ((size_t) MEM_SMALL_BLOCKS * (32 + 64 + 128) +                             \
+     (size_t) MEM_MEDIUM_BLOCKS * (256 + 512 + 1024) +                         \
+     (size_t) MEM_LARGE_BLOCKS * (MCP_STATIC_MAX_BLOCK - 2048) +               \
+     (size_t) MEM_MAX_BLOCKS * MCP_STATIC_MAX_BLOCK)
+
+_Static_assert(MCP_STATIC_MAX_BLOCK >= 2048 &&
+                   (MCP_STATIC_MAX_BLOCK & (MCP_STATIC_MAX_BLOCK - 1)) == 0,
+               "MCP_STATIC_MAX_BLOCK must be a power of two of 2048 or more");
+_Static_assert(MEM_NEEDED <= MCP_STATIC_ARENA,
+               "MCP_STATIC_ARENA cannot hold the blocks MCP_STATIC_SESSIONS, "
+               "MCP_STATIC_CALLS and MCP_STATIC_ARGS need");
+
+/*
+ * Blocks of one size. Those never handed out yet are taken in address
+ * order from fresh, freed ones are kept on a list linked through their
+ * first bytes.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    unsigned char  *base;
+    size_t          block_size;
+    size_t          n_blocks;
+    size_t          fresh;
+    size_t          used;
+    void           *free_list;
+    bool            warned;
+} mem_pool_t;
+
+static _Alignas(16) unsigned char arena[MCP_STATIC_ARENA];
+static mem_pool_t     pools[MEM_MAX_POOLS];
+static int            n_pools;
+static size_t         arena_used; // bytes the pools were carved from
+static atomic_llong   exhausted;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static size_t class_blocks(size_t block_size)
+{
+    if (block_size <= 128) {
+        return MEM_SMALL_BLOCKS;
+    }
+    if (block_size <= 1024) {
+        return MEM_MEDIUM_BLOCKS;
+    }
+    return block_size < MCP_STATIC_MAX_BLOCK ? MEM_LARGE_BLOCKS
+                                             : MEM_MAX_BLOCKS;
+}
+
+/*
+ * Each pool gets the blocks its class needs, then an equal share of what
+ * the arena has left over.
+ */
+static void mem_init(void)
+{
+    while (n_pools < MEM_MAX_POOLS &&
+           ((size_t) 1 << (MEM_MIN_SHIFT + n_pools)) <= MCP_STATIC_MAX_BLOCK) {
+        n_pools++;
+    }
+
+    size_t spare = (MCP_STATIC_ARENA - MEM_NEEDED) / n_pools;
+    for (int i = 0; i < n_pools; i++) {
+        mem_pool_t *pool = &pools[i];
+        pthread_mutex_init(&pool->lock, NULL);
+        pool->base       = arena + arena_used;
+        pool->block_size = (size_t) 1 << (MEM_MIN_SHIFT + i);
+        pool->n_blocks =
+            class_blocks(pool->block_size) + spare / pool->block_size;
+        arena_used += pool->n_blocks * pool->block_size;
+    }
+}
+
+/* The pool a block of the arena belongs to, NULL for the C heap. */
+static mem_pool_t *block_pool(const void *p)
+{
+    const unsigned char *c = p;
+
+    if (c < arena || c >= arena + arena_used) {
+        return NULL;
+    }
+    // laid out by size, the next pool starts where this one ends
+    int i = n_pools - 1;
+    while (c < pools[i].base) {
+        i--;
+    }
+    return &pools[i];
+}
+
+static void *pool_take(mem_pool_t *pool)
+{
+    void *p = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_list != NULL) {
+        p               = pool->free_list;
+        pool->free_list = *(void **) p;
+    } else if (pool->fresh < pool->n_blocks) {
+        p = pool->base + pool->fresh++ * pool->block_size;
+    }
+    if (p != NULL) {
+        pool->used++;
+    } else if (!pool->warned) {
+        pool->warned = true;
+        printf("Pool of %zu byte blocks exhausted\n", pool->block_size);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return p;
+}
+
+void *mem_alloc(size_t size)
+{
+    int i = 0;
+
+    pthread_once(&once, mem_init);
+    while (i < n_pools && pools[i].block_size < size) {
+        i++;
+    }
+    for (; i < n_pools; i++) {
+        void *p = pool_take(&pools[i]);
+        if (p != NULL) {
+            return p;
+        }
+    }
+    atomic_fetch_add(&exhausted, 1);
+    return NULL;
+}
+
+void *mem_calloc(size_t n, size_t size)
+{
+    if (size != 0 && n > SIZE_MAX / size) {
+        return NULL;
+    }
+
+    void *p = mem_alloc(n * size);
+    if (p != NULL) {
+        memset(p, 0, n * size);
+    }
+    return p;
+}
+
+void mem_free(void *p)
+{
+    mem_pool_t *pool = block_pool(p);
+
+    if (pool == NULL) {
+        free(p); // NULL or from the C heap
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    *(void **) p    = pool->free_list;
+    pool->free_list = p;
+    pool->used--;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+size_t mem_size(const void *p)
+{
+    mem_pool_t *pool = block_pool(p);
+
+    return pool ? pool->block_size : malloc_usable_size((void *) p);
+}
+
+void *mem_realloc(void *p, size_t size)
+{
+    if (p == NULL) {
+        return mem_alloc(size);
+    }
+    if (block_pool(p) == NULL) {
+        return realloc(p, size);
+    }
+
+    size_t old_size = mem_size(p);
+    if (size <= old_size && size > old_size / 2) {
+        return p; // the smaller pool would not save anything
+    }
+    void *q = mem_alloc(size);
+    if (q != NULL) {
+        memcpy(q, p, size < old_size ? size : old_size);
+        mem_free(p);
+    }
+    return q;
+}
+
+char *mem_strndup(const char *s, size_t n)
+{
+    size_t len  = strnlen(s, n);
+    char  *copy = mem_alloc(len + 1);
+
+    if (copy != NULL) {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+char *mem_strdup(const char *s)
+{
+    return mem_strndup(s, SIZE_MAX);
+}
+
+bool mem_headroom(void)
+{
+    pthread_once(&once, mem_init);
+    for (int i = 0; i < n_pools; i++) {
+        mem_pool_t *pool    = &pools[i];
+        size_t      reserve = (pool->n_blocks + 7) / 8;
+
+        pthread_mutex_lock(&pool->lock);
+        bool low = pool->n_blocks - pool->used < reserve;
+        pthread_mutex_unlock(&pool->lock);
+        if (low) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void mem_stats(size_t *used, size_t *capacity, long long *n_exhausted)
+{
+    pthread_once(&once, mem_init);
+    *used     = 0;
+    *capacity = 0;
+    for (int i = 0; i < n_pools; i++) {
+        mem_pool_t *pool = &pools[i];
+        pthread_mutex_lock(&pool->lock);
+        *used += pool->used * pool->block_size;
+        *capacity += pool->n_blocks * pool->block_size;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    *n_exhausted = atomic_load(&exhausted);
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef MCP_MEM_H
+#define MCP_MEM_H
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Allocation of everything the library owns. A normal build uses the C
+ * heap. Built with MCP_STATIC_MEMORY, blocks come from fixed pools in a
+ * static arena instead, one pool per power of two from 32 bytes up to
+ * MCP_STATIC_MAX_BLOCK: nothing fragments and every allocation takes
+ * constant time. Each pool holds the blocks its size class needs at the
+ * session, call and argument limits below plus an equal share of the rest
+ * of MCP_STATIC_ARENA; the build fails when the arena is too small for
+ * them. A pool that ran out lends from the larger ones, NULL comes back
+ * once all of them are exhausted. mem_free also takes blocks of the C heap.
+ */
+#ifdef MCP_STATIC_MEMORY
+
+#ifndef MCP_STATIC_ARENA
+#define MCP_STATIC_ARENA (640 * 1024)
+#endif
+#ifndef MCP_STATIC_MAX_BLOCK
+#define MCP_STATIC_MAX_BLOCK (16 * 1024) // largest message, power of two
+#endif
+#ifndef MCP_STATIC_SESSIONS
+#define MCP_STATIC_SESSIONS 16
+#endif
+#ifndef MCP_STATIC_CALLS
+#define MCP_STATIC_CALLS 8 // requests queued or running
+#endif
+#ifndef MCP_STATIC_ARGS
+#define MCP_STATIC_ARGS 16 // arguments of one tools/call
+#endif
+
+void  *mem_alloc(size_t size);
+void  *mem_calloc(size_t n, size_t size);
+void  *mem_realloc(void *p, size_t size);
+char  *mem_strdup(const char *s);
+char  *mem_strndup(const char *s, size_t n);
+void   mem_free(void *p);
+size_t mem_size(const void *p); // usable bytes of a block
+/* Whether every pool still has its reserve of free blocks. */
+bool mem_headroom(void);
+void mem_stats(size_t *used, size_t *capacity, long long *exhausted);
+
+#else
+
+static inline void *mem_alloc(size_t size)
+{
+    return malloc(size);
+}
+
+static inline void *mem_calloc(size_t n, size_t size)
+{
+    return calloc(n, size);
+}
+
+static inline void *mem_realloc(void *p, size_t size)
+{
+    return realloc(p, size);
+}
+
+static inline char *mem_strdup(const char *s)
+{
+    return strdup(s);
+}
+
+static inline char *mem_strndup(const char *s, size_t n)
+{
+    return strndup(s, n);
+}
+
+static inline void mem_free(void *p)
+{
+    free(p);
+}
+
+static inline size_t mem_size(const void *p)
+{
+    return malloc_usable_size((void *) p);
+}
+
+static inline bool mem_headroom(void)
+{
+    return true;
+}
+
+static inline void mem_stats(size_t *used, size_t *capacity,
+                             long long *exhausted)
+{
+    *used      = 0;
+    *capacity  = 0;
+    *exhausted = 0;
+}
+
+#endif
+
+#endif
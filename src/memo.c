@@ -0,0 +1,407 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "call.h"
+#include "mem.h"
+#include "memo.h"
+
+#define MEMO_STRIPES 16
+
+#define RESPONSE_PREFIX "{\"jsonrpc\":\"2.0\",\"id\":"
+
+typedef struct memo_entry {
+    uint64_t hash;
+    size_t   key_len;
+    char    *key;
+
+    char   *result; // the response after its id: ,"result":{...}}
+    size_t  result_len;
+    int64_t expires_ms; // 0 never
+
+    struct memo_entry *chain_next;
+    struct memo_entry *older;
+    struct memo_entry *newer;
+} memo_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+
+    int            n_buckets;
+    memo_entry_t **buckets;
+
+    int           count;
+    memo_entry_t *oldest;
+    memo_entry_t *newest;
+} memo_stripe_t;
+
+struct memo_cache {
+    int           capacity; // per stripe
+    atomic_ullong generation;
+    atomic_llong  hits;
+    atomic_llong  misses;
+    memo_stripe_t stripes[MEMO_STRIPES];
+};
+
+typedef struct {
+    char  *data;
+    size_t len;
+    size_t cap;
+    bool   failed; // the pools could not take the whole key
+} key_buf_t;
+
+static void key_append(key_buf_t *buf, const void *data, size_t len)
+{
+    if (buf->failed) {
+        return;
+    }
+    if (buf->len + len > buf->cap) {
+        size_t cap   = (buf->len + len) * 2;
+        char  *grown = mem_realloc(buf->data, cap);
+        if (grown == NULL) {
+            buf->failed = true;
+            return;
+        }
+        buf->data = grown;
+        buf->cap  = cap;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void key_string(key_buf_t *buf, const char *s)
+{
+    size_t len = strlen(s);
+
+    // length first, so no string can run into the next value
+    key_append(buf, &len, sizeof(len));
+    key_append(buf, s, len);
+}
+
+static void key_properties(key_buf_t *buf, int n, const property_t *props);
+
+static void key_array(key_buf_t *buf, const property_array_t *array)
+{
+    key_append(buf, &array->item_type, sizeof(array->item_type));
+    key_append(buf, &array->count, sizeof(array->count));
+    if (array->count == 0) {
+        return;
+    }
+
+    switch (array->item_type) {
+    case PROPERTY_STRING:
+        for (int i = 0; i < array->count; i++) {
+            key_string(buf, array->strings[i]);
+        }
+        break;
+    case PROPERTY_REAL:
+        key_append(buf, array->reals, array->count * sizeof(double));
+        break;
+    case PROPERTY_INTEGER:
+        key_append(buf, array->integers, array->count * sizeof(long long));
+        break;
+    case PROPERTY_BOOLEAN:
+        key_append(buf, array->booleans, array->count * sizeof(bool));
+        break;
+    default:
+        key_properties(buf, array->count, array->items);
+        break;
+    }
+}
+
+static void key_properties(key_buf_t *buf, int n, const property_t *props)
+{
+    for (int i = 0; i < n; i++) {
+        const property_t *p = &props[i];
+
+        key_append(buf, &p->type, sizeof(p->type));
+        key_append(buf, &p->present, sizeof(p->present));
+        if (!p->present) {
+            continue;
+        }
+        switch (p->type) {
+        case PROPERTY_STRING:
+            key_string(buf, p->value.string_value);
+            break;
+        case PROPERTY_REAL:
+            key_append(buf, &p->value.real_value, sizeof(double));
+            break;
+        case PROPERTY_INTEGER:
+            key_append(buf, &p->value.integer_value, sizeof(long long));
+            break;
+        case PROPERTY_BOOLEAN:
+            key_append(buf, &p->value.boolean_value, sizeof(bool));
+            break;
+        case PROPERTY_ARRAY:
+            key_array(buf, &p->value.array_value);
+            break;
+        case PROPERTY_OBJECT:
+            key_append(buf, &p->value.object_value.count, sizeof(int));
+            key_properties(buf, p->value.object_value.count,
+                           p->value.object_value.properties);
+            break;
+        }
+    }
+}
+
+void memo_key_build(memo_key_t *key, const mcp_tool_t *tool, int n_args,
+                    const property_t *args, const char *arguments)
+{
+    key_buf_t buf = { 0 };
+
+    key_string(&buf, tool->name);
+    if (arguments) {
+        key_string(&buf, arguments);
+    } else {
+        key_properties(&buf, n_args, args);
+    }
+    if (buf.failed) {
+        // no key, the call runs without looking up or storing its result
+        mem_free(buf.data);
+        buf.data = NULL;
+        buf.len  = 0;
+    }
+
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    for (size_t i = 0; i < buf.len; i++) {
+        hash = (hash ^ (unsigned char) buf.data[i]) * 1099511628211ULL;
+    }
+
+    key->hash       = hash;
+    key->generation = 0;
+    key->len        = buf.len;
+    key->data       = buf.data;
+}
+
+void memo_key_free(memo_key_t *key)
+{
+    mem_free(key->data);
+    key->data = NULL;
+    key->len  = 0;
+}
+
+static memo_stripe_t *entry_stripe(memo_cache_t *cache, uint64_t hash)
+{
+    // high bits pick the stripe, low bits the bucket within it
+    return &cache->stripes[(hash >> 32) % MEMO_STRIPES];
+}
+
+static memo_entry_t **entry_slot(memo_stripe_t *stripe, const memo_key_t *key)
+{
+    memo_entry_t **slot =
+        &stripe->buckets[key->hash & (stripe->n_buckets - 1)];
+
+    while (*slot) {
+        if ((*slot)->hash == key->hash && (*slot)->key_len == key->len &&
+            memcmp((*slot)->key, key->data, key->len) == 0) {
+            break;
+        }
+        slot = &(*slot)->chain_next;
+    }
+    return slot;
+}
+
+static void lru_unlink(memo_stripe_t *stripe, memo_entry_t *entry)
+{
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        stripe->oldest = entry->newer;
+    }
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        stripe->newest = entry->older;
+    }
+}
+
+static void lru_push(memo_stripe_t *stripe, memo_entry_t *entry)
+{
+    entry->newer = NULL;
+    entry->older = stripe->newest;
+    if (stripe->newest) {
+        stripe->newest->newer = entry;
+    } else {
+        stripe->oldest = entry;
+    }
+    stripe->newest = entry;
+}
+
+static void entry_remove(memo_stripe_t *stripe, memo_entry_t **slot)
+{
+    memo_entry_t *entry = *slot;
+
+    *slot = entry->chain_next;
+    lru_unlink(stripe, entry);
+    stripe->count--;
+
+    mem_free(entry->key);
+    mem_free(entry->result);
+    mem_free(entry);
+}
+
+static void entry_evict(memo_stripe_t *stripe, memo_entry_t *entry)
+{
+    memo_key_t key = {
+        .hash = entry->hash,
+        .len  = entry->key_len,
+        .data = entry->key,
+    };
+    entry_remove(stripe, entry_slot(stripe, &key));
+}
+
+memo_cache_t *memo_cache_create(int capacity)
+{
+    if (capacity <= 0) {
+        return NULL;
+    }
+
+    memo_cache_t *cache = mem_calloc(1, sizeof(memo_cache_t));
+
+    cache->capacity = (capacity + MEMO_STRIPES - 1) / MEMO_STRIPES;
+    atomic_init(&cache->generation, 1);
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+
+    int n_buckets = 1;
+    while (n_buckets < cache->capacity) {
+        n_buckets <<= 1;
+    }
+    for (int i = 0; i < MEMO_STRIPES; i++) {
+        pthread_mutex_init(&cache->stripes[i].lock, NULL);
+        cache->stripes[i].n_buckets = n_buckets;
+        cache->stripes[i].buckets   =
+            mem_calloc(n_buckets, sizeof(memo_entry_t *));
+    }
+
+    return cache;
+}
+
+void memo_cache_destroy(memo_cache_t *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+    memo_cache_clear(cache);
+    for (int i = 0; i < MEMO_STRIPES; i++) {
+        mem_free(cache->stripes[i].buckets);
+        pthread_mutex_destroy(&cache->stripes[i].lock);
+    }
+    mem_free(cache);
+}
+
+char *memo_cache_lookup(memo_cache_t *cache, memo_key_t *key,
+                        const jsonrpc_id_t *id)
+{
+    memo_stripe_t *stripe   = entry_stripe(cache, key->hash);
+    char          *response = NULL;
+
+    if (key->data == NULL) {
+        atomic_fetch_add(&cache->misses, 1);
+        return NULL;
+    }
+    pthread_mutex_lock(&stripe->lock);
+    key->generation      = atomic_load(&cache->generation);
+    memo_entry_t **slot  = entry_slot(stripe, key);
+    memo_entry_t  *entry = *slot;
+    if (entry && entry->expires_ms != 0 && entry->expires_ms <= call_now_ms()) {
+        entry_remove(stripe, slot);
+        entry = NULL;
+    }
+    if (entry) {
+        size_t prefix_len = strlen(RESPONSE_PREFIX);
+        size_t id_len     = jsonrpc_id_print(id, NULL, 0);
+
+        // a hit the pools cannot copy out runs the tool again
+        response = mem_alloc(prefix_len + id_len + entry->result_len + 1);
+        if (response) {
+            memcpy(response, RESPONSE_PREFIX, prefix_len);
+            jsonrpc_id_print(id, response + prefix_len, id_len);
+            memcpy(response + prefix_len + id_len, entry->result,
+                   entry->result_len + 1);
+
+            lru_unlink(stripe, entry);
+            lru_push(stripe, entry);
+        }
+    }
+    pthread_mutex_unlock(&stripe->lock);
+
+    atomic_fetch_add(response ? &cache->hits : &cache->misses, 1);
+    return response;
+}
+
+void memo_cache_store(memo_cache_t *cache, const memo_key_t *key,
+                      const jsonrpc_id_t *id, const char *response,
+                      int ttl_ms)
+{
+    size_t prefix_len = strlen(RESPONSE_PREFIX) + jsonrpc_id_print(id, NULL, 0);
+    if (strncmp(response, RESPONSE_PREFIX, strlen(RESPONSE_PREFIX)) != 0 ||
+        strlen(response) < prefix_len) {
+        return;
+    }
+
+    memo_stripe_t *stripe = entry_stripe(cache, key->hash);
+
+    pthread_mutex_lock(&stripe->lock);
+    memo_entry_t **slot = entry_slot(stripe, key);
+    if (key->data == NULL ||
+        key->generation != atomic_load(&cache->generation) || *slot) {
+        // cleared since the lookup, or stored by another call meanwhile
+        pthread_mutex_unlock(&stripe->lock);
+        return;
+    }
+    if (stripe->count >= cache->capacity) {
+        entry_evict(stripe, stripe->oldest);
+        slot = entry_slot(stripe, key);
+    }
+
+    memo_entry_t *entry  = mem_calloc(1, sizeof(memo_entry_t));
+    char         *copy   = mem_alloc(key->len);
+    char         *result = mem_strdup(response + prefix_len);
+    if (entry == NULL || copy == NULL || result == NULL) {
+        // not kept, the pools need the room more than the cache does
+        pthread_mutex_unlock(&stripe->lock);
+        mem_free(entry);
+        mem_free(copy);
+        mem_free(result);
+        return;
+    }
+    memcpy(copy, key->data, key->len);
+    entry->hash       = key->hash;
+    entry->key_len    = key->len;
+    entry->key        = copy;
+    entry->result     = result;
+    entry->result_len = strlen(result);
+    entry->expires_ms = ttl_ms > 0 ? call_now_ms() + ttl_ms : 0;
+
+    *slot = entry;
+    lru_push(stripe, entry);
+    stripe->count++;
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+void memo_cache_clear(memo_cache_t *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    // stores of results computed before this point are turned away
+    atomic_fetch_add(&cache->generation, 1);
+    for (int i = 0; i < MEMO_STRIPES; i++) {
+        memo_stripe_t *stripe = &cache->stripes[i];
+        pthread_mutex_lock(&stripe->lock);
+        while (stripe->oldest) {
+            entry_evict(stripe, stripe->oldest);
+        }
+        pthread_mutex_unlock(&stripe->lock);
+    }
+}
+
+void memo_cache_stats(memo_cache_t *cache, long long *hits,
+                      long long *misses)
+{
+    *hits   = cache ? atomic_load(&cache->hits) : 0;
+    *misses = cache ? atomic_load(&cache->misses) : 0;
+}
@@ -0,0 +1,53 @@
+#ifndef MCP_MEMO_H
+#define MCP_MEMO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jsonrpc.h"
+#include "mcp.h"
+
+/*
+ * A call of a pure tool in canonical form: the tool name and the decoded
+ * arguments in schema order, tagged with their types, so calls that only
+ * differ in how their JSON was written get the same key.
+ */
+typedef struct {
+    uint64_t hash;
+    uint64_t generation; // of the cache when the key was looked up
+    size_t   len;
+    char    *data;
+} memo_key_t;
+
+typedef struct memo_cache memo_cache_t;
+
+memo_cache_t *memo_cache_create(int capacity);
+void          memo_cache_destroy(memo_cache_t *cache);
+
+/*
+ * Tools that decode their arguments JSON themselves are keyed by its
+ * canonical text, see jsonrpc_tool_call_canonical_arguments.
+ */
+void memo_key_build(memo_key_t *key, const mcp_tool_t *tool, int n_args,
+                    const property_t *args, const char *arguments);
+void memo_key_free(memo_key_t *key);
+
+/*
+ * Returns the response for id spliced from the stored result, or NULL on a
+ * miss. Either way the key remembers the cache generation for the store.
+ */
+char *memo_cache_lookup(memo_cache_t *cache, memo_key_t *key,
+                        const jsonrpc_id_t *id);
+/*
+ * Keeps the result of response for ttl_ms (0 until it is evicted), unless
+ * the cache was cleared since the key was looked up.
+ */
+void memo_cache_store(memo_cache_t *cache, const memo_key_t *key,
+                      const jsonrpc_id_t *id, const char *response,
+                      int ttl_ms);
+/* Forgets every result, the tools they came from may have changed. */
+void memo_cache_clear(memo_cache_t *cache);
+void memo_cache_stats(memo_cache_t *cache, long long *hits,
+                      long long *misses);
+
+#endif
@@ -0,0 +1,131 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "mem.h"
+#include "pending.h"
+
+struct pending_table {
+    pthread_mutex_t lock;
+
+    int         n_buckets;
+    int         n_pending;
+    pending_t **buckets;
+};
+
+static pending_t **pending_slot(pending_table_t *table, long long id)
+{
+    pending_t **slot =
+        &table->buckets[(unsigned long long) id & (table->n_buckets - 1)];
+
+    while (*slot && (*slot)->id != id) {
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+static void pending_table_grow(pending_table_t *table)
+{
+    int         n_buckets = table->n_buckets * 2;
+    pending_t **buckets   = mem_calloc(n_buckets, sizeof(pending_t *));
+
+    if (buckets == NULL) {
+        return; // longer chains, but every request is still found
+    }
+    for (int i = 0; i < table->n_buckets; i++) {
+        pending_t *pending = table->buckets[i];
+        while (pending) {
+            pending_t  *next = pending->next;
+            pending_t **slot =
+                &buckets[(unsigned long long) pending->id & (n_buckets - 1)];
+            pending->next = *slot;
+            *slot         = pending;
+            pending       = next;
+        }
+    }
+    mem_free(table->buckets);
+    table->buckets   = buckets;
+    table->n_buckets = n_buckets;
+}
+
+pending_table_t *pending_table_create(void)
+{
+    pending_table_t *table = mem_calloc(1, sizeof(pending_table_t));
+    if (table == NULL) {
+        return NULL;
+    }
+
+    table->n_buckets = 64;
+    table->buckets   = mem_calloc(table->n_buckets, sizeof(pending_t *));
+    if (table->buckets == NULL) {
+        mem_free(table);
+        return NULL;
+    }
+    pthread_mutex_init(&table->lock, NULL);
+    return table;
+}
+
+void pending_table_destroy(pending_table_t *table)
+{
+    if (table == NULL) {
+        return;
+    }
+    for (int i = 0; i < table->n_buckets; i++) {
+        pending_t *pending = table->buckets[i];
+        while (pending) {
+            pending_t *next = pending->next;
+            mem_free(pending);
+            pending = next;
+        }
+    }
+    mem_free(table->buckets);
+    pthread_mutex_destroy(&table->lock);
+    mem_free(table);
+}
+
+void pending_insert(pending_table_t *table, pending_t *pending)
+{
+    pthread_mutex_lock(&table->lock);
+    if (table->n_pending >= table->n_buckets) {
+        pending_table_grow(table);
+    }
+    pending_t **slot =
+        &table->buckets[(unsigned long long) pending->id &
+                        (table->n_buckets - 1)];
+    pending->next = *slot;
+    *slot         = pending;
+    table->n_pending++;
+    pthread_mutex_unlock(&table->lock);
+}
+
+pending_t *pending_take(pending_table_t *table, long long id)
+{
+    pthread_mutex_lock(&table->lock);
+    pending_t **slot    = pending_slot(table, id);
+    pending_t  *pending = *slot;
+    if (pending) {
+        *slot = pending->next;
+        table->n_pending--;
+    }
+    pthread_mutex_unlock(&table->lock);
+    return pending;
+}
+
+pending_t *pending_take_all(pending_table_t *table)
+{
+    pending_t *list = NULL;
+
+    pthread_mutex_lock(&table->lock);
+    for (int i = 0; i < table->n_buckets; i++) {
+        pending_t *pending = table->buckets[i];
+        while (pending) {
+            pending_t *next = pending->next;
+            pending->next   = list;
+            list            = pending;
+            pending         = next;
+        }
+        table->buckets[i] = NULL;
+    }
+    table->n_pending = 0;
+    pthread_mutex_unlock(&table->lock);
+    return list;
+}
@@ -0,0 +1,33 @@
+#ifndef MCP_PENDING_H
+#define MCP_PENDING_H
+
+#include <stdbool.h>
+
+#include "mcp_client.h"
+
+/* A request of a client session waiting for its response. */
+typedef struct pending {
+    long long           id;
+    bool                initialize; // answered by notifications/initialized
+    mcp_client_callback callback;
+    void               *ctx;
+
+    struct pending *next;
+} pending_t;
+
+/*
+ * Requests by id, shared between the threads that issue them and the MQTT
+ * callback thread that completes them; every function takes the table lock.
+ * Ids are handed out in sequence, so they spread evenly over the buckets.
+ */
+typedef struct pending_table pending_table_t;
+
+pending_table_t *pending_table_create(void);
+void             pending_table_destroy(pending_table_t *table);
+
+void       pending_insert(pending_table_t *table, pending_t *pending);
+pending_t *pending_take(pending_table_t *table, long long id);
+/* Empties the table, returns its requests as a list linked by next. */
+pending_t *pending_take_all(pending_table_t *table);
+
+#endif
@@ -0,0 +1,76 @@
+#include <time.h>
+
+#include "rate_limit.h"
+
+int64_t rate_limit_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void rate_limit_params(double rate, int burst, int64_t *interval_us,
+                              int64_t *tolerance_us)
+{
+    if (rate <= 0) {
+        *interval_us  = 0;
+        *tolerance_us = 0;
+        return;
+    }
+    if (burst < 1) {
+        burst = 1;
+    }
+    *interval_us = (int64_t) (1000000.0 / rate);
+    if (*interval_us < 1) {
+        *interval_us = 1;
+    }
+    *tolerance_us = *interval_us * (burst - 1);
+}
+
+void rate_limit_init(rate_limit_t *limit, double rate, int burst)
+{
+    rate_limit_params(rate, burst, &limit->interval_us, &limit->tolerance_us);
+    atomic_init(&limit->tat_us, 0);
+}
+
+bool rate_limit_enabled(const rate_limit_t *limit)
+{
+    return limit->interval_us > 0;
+}
+
+bool rate_limit_same(const rate_limit_t *limit, double rate, int burst)
+{
+    int64_t interval_us, tolerance_us;
+
+    rate_limit_params(rate, burst, &interval_us, &tolerance_us);
+    return limit->interval_us == interval_us &&
+           limit->tolerance_us == tolerance_us;
+}
+
+int64_t rate_limit_acquire(rate_limit_t *limit, int64_t now_us)
+{
+    if (limit->interval_us == 0) {
+        return 0;
+    }
+
+    int64_t tat = atomic_load_explicit(&limit->tat_us, memory_order_relaxed);
+    for (;;) {
+        int64_t start = tat > now_us ? tat : now_us;
+        if (start - limit->tolerance_us > now_us) {
+            return start - limit->tolerance_us - now_us;
+        }
+        if (atomic_compare_exchange_weak_explicit(
+                &limit->tat_us, &tat, start + limit->interval_us,
+                memory_order_relaxed, memory_order_relaxed)) {
+            return 0;
+        }
+    }
+}
+
+void rate_limit_refund(rate_limit_t *limit)
+{
+    if (limit->interval_us != 0) {
+        atomic_fetch_sub_explicit(&limit->tat_us, limit->interval_us,
+                                  memory_order_relaxed);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef MCP_RATE_LIMIT_H
+#define MCP_RATE_LIMIT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Token bucket implemented as a generic cell rate algorithm: the whole bucket
+ * state is the theoretical arrival time of the next request, so a request is
+ * admitted or rejected with a single compare-and-swap and no lock.
+ */
+typedef struct {
+    _Atomic int64_t tat_us;
+    int64_t         interval_us;  // time to earn one token, 0 = unlimited
+    int64_t         tolerance_us; // burst allowance beyond a single token
+} rate_limit_t;
+
+int64_t rate_limit_now_us(void);
+
+void rate_limit_init(rate_limit_t *limit, double rate, int burst);
+bool rate_limit_enabled(const rate_limit_t *limit);
+bool rate_limit_same(const rate_limit_t *limit, double rate, int burst);
+
+/* Returns 0 when admitted, otherwise the microseconds until a retry fits. */
+int64_t rate_limit_acquire(rate_limit_t *limit, int64_t now_us);
+void    rate_limit_refund(rate_limit_t *limit);
+
+#endif
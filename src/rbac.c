@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+#include "rbac.h"
+
+static const char *rbac_methods[RBAC_METHOD_COUNT] = {
+    [RBAC_METHOD_TOOLS_LIST]     = "tools/list",
+    [RBAC_METHOD_TOOLS_CALL]     = "tools/call",
+    [RBAC_METHOD_RESOURCES_LIST] = "resources/list",
+    [RBAC_METHOD_RESOURCES_READ] = "resources/read",
+};
+
+/* '*' matches any run of characters, '?' exactly one. */
+static bool glob_match(const char *pattern, const char *s)
+{
+    const char *star = NULL;
+    const char *mark = NULL;
+
+    while (*s) {
+        if (*pattern == '*') {
+            star = pattern++;
+            mark = s;
+        } else if (*pattern == '?' || *pattern == *s) {
+            pattern++;
+            s++;
+        } else if (star) {
+            pattern = star + 1;
+            s       = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+static bool glob_match_any(int n_patterns, char **patterns, const char *s)
+{
+    for (int i = 0; i < n_patterns; i++) {
+        if (glob_match(patterns[i], s)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void free_strings(int n, char **strings)
+{
+    for (int i = 0; i < n; i++) {
+        mem_free(strings[i]);
+    }
+    mem_free(strings);
+}
+
+/* Returns -1 when a copy failed, leaving none of them behind. */
+static int copy_strings(int n, char **strings, int *n_copy, char ***copy)
+{
+    *n_copy = 0;
+    *copy   = NULL;
+    if (n <= 0) {
+        return 0;
+    }
+
+    char **dst = mem_calloc(n, sizeof(char *));
+    if (dst == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        dst[i] = mem_strdup(strings[i]);
+        if (dst[i] == NULL) {
+            free_strings(i, dst);
+            return -1;
+        }
+    }
+    *n_copy = n;
+    *copy   = dst;
+    return 0;
+}
+
+rbac_t *rbac_create(int n_roles, const mcp_mqtt_role_t *roles)
+{
+    if (n_roles <= 0 || roles == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < n_roles; i++) {
+        if (roles[i].name == NULL) {
+            return NULL;
+        }
+    }
+
+    rbac_t *rbac = mem_calloc(1, sizeof(rbac_t));
+    if (rbac == NULL) {
+        return NULL;
+    }
+
+    atomic_init(&rbac->refs, 1);
+    rbac->roles   = mem_calloc(n_roles, sizeof(mcp_mqtt_role_t));
+    rbac->methods = mem_calloc(n_roles, sizeof(uint32_t));
+    if (rbac->roles == NULL || rbac->methods == NULL) {
+        rbac_release(rbac);
+        return NULL;
+    }
+    rbac->n_roles = n_roles;
+
+    // roles not copied yet are all NULL, released as they are
+    for (int i = 0; i < n_roles; i++) {
+        mcp_mqtt_role_t *role = &rbac->roles[i];
+
+        role->name = mem_strdup(roles[i].name);
+        role->description =
+            roles[i].description ? mem_strdup(roles[i].description) : NULL;
+        if (role->name == NULL ||
+            (roles[i].description && role->description == NULL) ||
+            copy_strings(roles[i].n_allowed_methods, roles[i].allowed_methods,
+                         &role->n_allowed_methods,
+                         &role->allowed_methods) != 0 ||
+            copy_strings(roles[i].n_allowed_tools, roles[i].allowed_tools,
+                         &role->n_allowed_tools, &role->allowed_tools) != 0 ||
+            copy_strings(roles[i].n_allowed_resources,
+                         roles[i].allowed_resources,
+                         &role->n_allowed_resources,
+                         &role->allowed_resources) != 0) {
+            rbac_release(rbac);
+            return NULL;
+        }
+
+        for (int m = 0; m < RBAC_METHOD_COUNT; m++) {
+            if (glob_match_any(role->n_allowed_methods, role->allowed_methods,
+                               rbac_methods[m])) {
+                rbac->methods[i] |= 1u << m;
+            }
+        }
+    }
+
+    return rbac;
+}
+
+rbac_t *rbac_retain(rbac_t *rbac)
+{
+    if (rbac) {
+        atomic_fetch_add(&rbac->refs, 1);
+    }
+    return rbac;
+}
+
+void rbac_release(rbac_t *rbac)
+{
+    if (rbac == NULL || atomic_fetch_sub(&rbac->refs, 1) != 1) {
+        return;
+    }
+
+    for (int i = 0; i < rbac->n_roles; i++) {
+        mcp_mqtt_role_t *role = &rbac->roles[i];
+        mem_free(role->name);
+        mem_free(role->description);
+        free_strings(role->n_allowed_methods, role->allowed_methods);
+        free_strings(role->n_allowed_tools, role->allowed_tools);
+        free_strings(role->n_allowed_resources, role->allowed_resources);
+    }
+    mem_free(rbac->roles);
+    mem_free(rbac->methods);
+    mem_free(rbac);
+}
+
+int rbac_role_index(const rbac_t *rbac, const char *name)
+{
+    for (int i = 0; i < rbac->n_roles; i++) {
+        if (strcmp(rbac->roles[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int rbac_method_index(const char *method)
+{
+    for (int m = 0; m < RBAC_METHOD_COUNT; m++) {
+        if (strcmp(rbac_methods[m], method) == 0) {
+            return m;
+        }
+    }
+    return -1;
+}
+
+uint64_t *rbac_compile_tools(const rbac_t *rbac, int n_tools,
+                             const mcp_tool_t *tools)
+{
+    int       words = rbac_words(n_tools);
+    uint64_t *bits =
+        mem_calloc((size_t) rbac->n_roles * words + 1, sizeof(uint64_t));
+
+    if (bits == NULL) {
+        return NULL;
+    }
+    for (int r = 0; r < rbac->n_roles; r++) {
+        const mcp_mqtt_role_t *role = &rbac->roles[r];
+        for (int i = 0; i < n_tools; i++) {
+            if (glob_match_any(role->n_allowed_tools, role->allowed_tools,
+                               tools[i].name)) {
+                bits[r * words + i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    }
+    return bits;
+}
+
+uint64_t *rbac_compile_resources(const rbac_t *rbac, int n_resources,
+                                 const mcp_resource_t *resources)
+{
+    int       words = rbac_words(n_resources);
+    uint64_t *bits =
+        mem_calloc((size_t) rbac->n_roles * words + 1, sizeof(uint64_t));
+
+    if (bits == NULL) {
+        return NULL;
+    }
+    for (int r = 0; r < rbac->n_roles; r++) {
+        const mcp_mqtt_role_t *role = &rbac->roles[r];
+        for (int i = 0; i < n_resources; i++) {
+            if (glob_match_any(role->n_allowed_resources,
+                               role->allowed_resources, resources[i].uri)) {
+                bits[r * words + i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    }
+    return bits;
+}
@@ -0,0 +1,63 @@
+#ifndef MCP_RBAC_H
+#define MCP_RBAC_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mcp.h"
+
+typedef enum {
+    RBAC_METHOD_TOOLS_LIST = 0,
+    RBAC_METHOD_TOOLS_CALL,
+    RBAC_METHOD_RESOURCES_LIST,
+    RBAC_METHOD_RESOURCES_READ,
+    RBAC_METHOD_COUNT,
+} rbac_method_e;
+
+/*
+ * Registered roles with their allowed methods compiled into one bitset per
+ * role. Tool and resource patterns are compiled against a concrete catalog
+ * with rbac_compile_tools() and rbac_compile_resources(), one bit per role and
+ * catalog index, so authorizing a request never matches strings.
+ */
+typedef struct rbac {
+    atomic_int refs;
+
+    int              n_roles;
+    mcp_mqtt_role_t *roles;
+    uint32_t        *methods;
+} rbac_t;
+
+/* NULL for no roles, a role without a name or when out of memory. */
+rbac_t *rbac_create(int n_roles, const mcp_mqtt_role_t *roles);
+rbac_t *rbac_retain(rbac_t *rbac);
+void    rbac_release(rbac_t *rbac);
+
+int rbac_role_index(const rbac_t *rbac, const char *name);
+int rbac_method_index(const char *method);
+
+/* NULL when the bitsets cannot be allocated. */
+uint64_t *rbac_compile_tools(const rbac_t *rbac, int n_tools,
+                             const mcp_tool_t *tools);
+uint64_t *rbac_compile_resources(const rbac_t *rbac, int n_resources,
+                                 const mcp_resource_t *resources);
+
+static inline int rbac_words(int n_items)
+{
+    return (n_items + 63) / 64;
+}
+
+static inline bool rbac_method_allowed(const rbac_t *rbac, int role,
+                                       int method)
+{
+    return (rbac->methods[role] >> method) & 1;
+}
+
+static inline bool rbac_test(const uint64_t *bits, int n_items, int role,
+                             int index)
+{
+    return (bits[role * rbac_words(n_items) + index / 64] >> (index % 64)) & 1;
+}
+
+#endif
@@ -0,0 +1,187 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "mem.h"
+#include "reconnect.h"
+
+struct reconnect {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    pthread_t       thread;
+    bool            stopping;
+    bool            pending;
+    bool            polled;
+    int64_t         due_ms; // of a pending attempt, when polled
+
+    int          min_ms;
+    int          max_ms;
+    int          attempt;
+    unsigned int seed;
+
+    reconnect_fn connect;
+    void        *ctx;
+};
+
+static int64_t backoff_ms(reconnect_t *reconnect)
+{
+    int64_t bound = reconnect->min_ms;
+
+    for (int i = 0; i < reconnect->attempt && bound < reconnect->max_ms; i++) {
+        bound *= 2;
+    }
+    if (bound > reconnect->max_ms) {
+        bound = reconnect->max_ms;
+    }
+    if (reconnect->attempt < 30) {
+        reconnect->attempt++;
+    }
+    return bound > 0 ? rand_r(&reconnect->seed) % (bound + 1) : 0;
+}
+
+static void *reconnect_thread(void *arg)
+{
+    reconnect_t *reconnect = arg;
+
+    pthread_mutex_lock(&reconnect->lock);
+    while (!reconnect->stopping) {
+        if (!reconnect->pending) {
+            pthread_cond_wait(&reconnect->cond, &reconnect->lock);
+            continue;
+        }
+
+        int64_t         delay = backoff_ms(reconnect);
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += delay / 1000;
+        ts.tv_nsec += (delay % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        while (!reconnect->stopping &&
+               pthread_cond_timedwait(&reconnect->cond, &reconnect->lock,
+                                      &ts) == 0) {
+        }
+        if (reconnect->stopping) {
+            break;
+        }
+
+        reconnect->pending = false;
+        pthread_mutex_unlock(&reconnect->lock);
+        reconnect->connect(reconnect->ctx);
+        pthread_mutex_lock(&reconnect->lock);
+    }
+    pthread_mutex_unlock(&reconnect->lock);
+    return NULL;
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static reconnect_t *reconnect_new(int min_ms, int max_ms, bool polled,
+                                  reconnect_fn connect, void *ctx)
+{
+    if (min_ms < 0 || max_ms < min_ms || connect == NULL) {
+        return NULL;
+    }
+
+    reconnect_t *reconnect = mem_calloc(1, sizeof(reconnect_t));
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&reconnect->lock, NULL);
+    pthread_cond_init(&reconnect->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    reconnect->seed    = (unsigned int) (ts.tv_nsec ^ (uintptr_t) reconnect);
+    reconnect->min_ms  = min_ms;
+    reconnect->max_ms  = max_ms;
+    reconnect->connect = connect;
+    reconnect->ctx     = ctx;
+    reconnect->polled  = polled;
+    if (!polled) {
+        pthread_create(&reconnect->thread, NULL, reconnect_thread, reconnect);
+    }
+
+    return reconnect;
+}
+
+reconnect_t *reconnect_create(int min_ms, int max_ms, reconnect_fn connect,
+                              void *ctx)
+{
+    return reconnect_new(min_ms, max_ms, false, connect, ctx);
+}
+
+reconnect_t *reconnect_create_polled(int min_ms, int max_ms,
+                                     reconnect_fn connect, void *ctx)
+{
+    return reconnect_new(min_ms, max_ms, true, connect, ctx);
+}
+
+int64_t reconnect_poll(reconnect_t *reconnect)
+{
+    pthread_mutex_lock(&reconnect->lock);
+    if (!reconnect->pending || reconnect->stopping) {
+        pthread_mutex_unlock(&reconnect->lock);
+        return 0;
+    }
+    if (reconnect->due_ms > now_ms()) {
+        int64_t due_ms = reconnect->due_ms;
+        pthread_mutex_unlock(&reconnect->lock);
+        return due_ms;
+    }
+    reconnect->pending = false;
+    pthread_mutex_unlock(&reconnect->lock);
+
+    reconnect->connect(reconnect->ctx);
+    return 0;
+}
+
+void reconnect_destroy(reconnect_t *reconnect)
+{
+    if (reconnect == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&reconnect->lock);
+    reconnect->stopping = true;
+    pthread_cond_signal(&reconnect->cond);
+    pthread_mutex_unlock(&reconnect->lock);
+    if (!reconnect->polled) {
+        pthread_join(reconnect->thread, NULL);
+    }
+
+    pthread_cond_destroy(&reconnect->cond);
+    pthread_mutex_destroy(&reconnect->lock);
+    mem_free(reconnect);
+}
+
+void reconnect_schedule(reconnect_t *reconnect)
+{
+    pthread_mutex_lock(&reconnect->lock);
+    if (!reconnect->pending) {
+        reconnect->pending = true;
+        if (reconnect->polled) {
+            reconnect->due_ms = now_ms() + backoff_ms(reconnect);
+        }
+        pthread_cond_signal(&reconnect->cond);
+    }
+    pthread_mutex_unlock(&reconnect->lock);
+}
+
+void reconnect_reset(reconnect_t *reconnect)
+{
+    pthread_mutex_lock(&reconnect->lock);
+    reconnect->attempt = 0;
+    pthread_mutex_unlock(&reconnect->lock);
+}
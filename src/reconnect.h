@@ -0,0 +1,33 @@
+#ifndef MCP_RECONNECT_H
+#define MCP_RECONNECT_H
+
+#include <stdint.h>
+
+/*
+ * Schedules reconnect attempts on a dedicated thread so that MQTT callbacks
+ * never sleep. Delays grow exponentially from min_ms up to max_ms and are
+ * drawn uniformly below that bound ("full jitter"), which spreads out the
+ * reconnects of many servers that lost the same broker at the same moment.
+ */
+typedef struct reconnect reconnect_t;
+
+typedef void (*reconnect_fn)(void *ctx);
+
+reconnect_t *reconnect_create(int min_ms, int max_ms, reconnect_fn connect,
+                              void *ctx);
+/* Without a thread, attempts are made by reconnect_poll once due. */
+reconnect_t *reconnect_create_polled(int min_ms, int max_ms,
+                                     reconnect_fn connect, void *ctx);
+void         reconnect_destroy(reconnect_t *reconnect);
+
+/* Requests another attempt after the next backoff delay. */
+void reconnect_schedule(reconnect_t *reconnect);
+/* Resets the backoff once a connection succeeded. */
+void reconnect_reset(reconnect_t *reconnect);
+/*
+ * Makes the attempt that is due, on the calling thread. Returns when the
+ * pending one will be due (monotonic ms), or 0 when none is pending.
+ */
+int64_t reconnect_poll(reconnect_t *reconnect);
+
+#endif
@@ -0,0 +1,359 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "mcp_json.h"
+#include "mem.h"
+#include "replay.h"
+
+#define REPLAY_BUCKETS 1024
+#define REPLAY_KEY_MAX 256
+#define REPLAY_IDLE_MS 5000 // without a response, the rest are not coming
+
+typedef struct pending {
+    struct pending *next;
+    int64_t         sent_ns;
+    char            key[];
+} pending_t;
+
+/* Requests waiting for their response, and the latencies of the answered. */
+typedef struct {
+    pending_t *buckets[REPLAY_BUCKETS];
+    int        outstanding;
+    long long  requests;
+    int64_t   *latencies;
+    long long  n_latencies;
+    long long  size;
+    int64_t    first_ns;
+    int64_t    last_ns;
+} pairing_t;
+
+struct replay {
+    pthread_mutex_t lock;
+    pthread_cond_t  answered;
+    pairing_t       live;
+    struct timespec start;
+};
+
+static int64_t elapsed_ns(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) (now.tv_sec - start->tv_sec) * 1000000000 +
+           (now.tv_nsec - start->tv_nsec);
+}
+
+static unsigned int hash_key(const char *key)
+{
+    unsigned int hash = 2166136261u; // FNV-1a
+    for (; *key; key++) {
+        hash = (hash ^ (unsigned char) *key) * 16777619u;
+    }
+    return hash % REPLAY_BUCKETS;
+}
+
+/*
+ * Writes topic and JSON-RPC id of a request (a method and an id) or of a
+ * response (an id and no method) to key. Returns false for anything else.
+ */
+static bool message_key(const char *topic, const char *json, bool request,
+                        char *key, size_t size)
+{
+    mcp_json_reader_t reader;
+    const char       *name;
+    size_t            name_len;
+    const char       *id     = NULL;
+    int               id_len = 0;
+    bool              method = false;
+
+    mcp_json_reader_init(&reader, json);
+    if (mcp_json_object_begin(&reader) != 0) {
+        return false;
+    }
+    int ret;
+    while ((ret = mcp_json_object_next(&reader, &name, &name_len)) == 1) {
+        while (*reader.pos == ' ' || *reader.pos == '\t' ||
+               *reader.pos == '\r' || *reader.pos == '\n') {
+            reader.pos++;
+        }
+        const char *value = reader.pos;
+        if (mcp_json_skip(&reader) != 0) {
+            return false;
+        }
+        if (mcp_json_key_is(name, name_len, "id")) {
+            id     = value;
+            id_len = (int) (reader.pos - value);
+        } else if (mcp_json_key_is(name, name_len, "method")) {
+            method = true;
+        }
+    }
+    if (ret != 0 || id == NULL || method != request ||
+        (id_len == 4 && memcmp(id, "null", 4) == 0)) {
+        return false;
+    }
+    return snprintf(key, size, "%s %.*s", topic, id_len, id) < (int) size;
+}
+
+static void pairing_request(pairing_t *pairing, const char *key, int64_t t)
+{
+    size_t       len     = strlen(key) + 1;
+    pending_t   *pending = mem_alloc(sizeof(pending_t) + len);
+    unsigned int bucket  = hash_key(key);
+
+    pending->sent_ns = t;
+    memcpy(pending->key, key, len);
+    pending->next            = pairing->buckets[bucket];
+    pairing->buckets[bucket] = pending;
+    if (pairing->requests++ == 0) {
+        pairing->first_ns = t;
+    }
+    pairing->outstanding++;
+}
+
+static void pairing_response(pairing_t *pairing, const char *key, int64_t t)
+{
+    pending_t **link = &pairing->buckets[hash_key(key)];
+
+    while (*link && strcmp((*link)->key, key) != 0) {
+        link = &(*link)->next;
+    }
+    pending_t *pending = *link;
+    if (pending == NULL) {
+        return; // a duplicate, or a request from before the capture
+    }
+    *link = pending->next;
+
+    if (pairing->n_latencies == pairing->size) {
+        pairing->size      = pairing->size ? pairing->size * 2 : 1024;
+        pairing->latencies = mem_realloc(pairing->latencies,
+                                         pairing->size * sizeof(int64_t));
+    }
+    pairing->latencies[pairing->n_latencies++] = t - pending->sent_ns;
+    pairing->last_ns                           = t;
+    pairing->outstanding--;
+    mem_free(pending);
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a;
+    int64_t y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void pairing_stats(pairing_t *pairing, mcp_replay_run_t *run)
+{
+    long long n = pairing->n_latencies;
+
+    memset(run, 0, sizeof(*run));
+    run->requests  = pairing->requests;
+    run->responses = n;
+    if (n == 0) {
+        return;
+    }
+    qsort(pairing->latencies, n, sizeof(int64_t), compare_ns);
+    run->p50_ms  = pairing->latencies[(n - 1) * 50 / 100] / 1e6;
+    run->p99_ms  = pairing->latencies[(n - 1) * 99 / 100] / 1e6;
+    run->max_ms  = pairing->latencies[n - 1] / 1e6;
+    run->seconds = (pairing->last_ns - pairing->first_ns) / 1e9;
+    if (run->seconds > 0) {
+        run->throughput = n / run->seconds;
+    }
+}
+
+static void pairing_clear(pairing_t *pairing)
+{
+    for (int i = 0; i < REPLAY_BUCKETS; i++) {
+        while (pairing->buckets[i]) {
+            pending_t *next = pairing->buckets[i]->next;
+            mem_free(pairing->buckets[i]);
+            pairing->buckets[i] = next;
+        }
+    }
+    mem_free(pairing->latencies);
+    memset(pairing, 0, sizeof(*pairing));
+}
+
+replay_t *replay_create(void)
+{
+    replay_t *replay = mem_calloc(1, sizeof(replay_t));
+    pthread_mutex_init(&replay->lock, NULL);
+    pthread_cond_init(&replay->answered, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &replay->start);
+    return replay;
+}
+
+void replay_destroy(replay_t *replay)
+{
+    if (replay == NULL) {
+        return;
+    }
+    pairing_clear(&replay->live);
+    pthread_cond_destroy(&replay->answered);
+    pthread_mutex_destroy(&replay->lock);
+    mem_free(replay);
+}
+
+void replay_published(replay_t *replay, const char *topic,
+                      const char *payload)
+{
+    char    key[REPLAY_KEY_MAX];
+    int64_t now = elapsed_ns(&replay->start);
+
+    if (!message_key(topic, payload, false, key, sizeof(key))) {
+        return; // progress, notifications and the like
+    }
+    pthread_mutex_lock(&replay->lock);
+    pairing_response(&replay->live, key, now);
+    pthread_cond_signal(&replay->answered);
+    pthread_mutex_unlock(&replay->lock);
+}
+
+/* Pairs the traffic as it was captured, the baseline of the replay. */
+static int pair_recorded(const char *path, mcp_replay_stats_t *stats)
+{
+    capture_reader_t *reader = capture_reader_open(path);
+    capture_record_t  record;
+    pairing_t         recorded = { 0 };
+    char              key[REPLAY_KEY_MAX];
+    int               ret;
+
+    if (reader == NULL) {
+        return -1;
+    }
+    while ((ret = capture_next(reader, &record)) == 1) {
+        bool request = record.kind == CAPTURE_IN;
+        if (request) {
+            stats->messages++;
+        }
+        if (strncmp(record.topic, "$mcp-rpc/", strlen("$mcp-rpc/")) != 0 ||
+            !message_key(record.topic, record.payload, request, key,
+                         sizeof(key))) {
+            continue;
+        }
+        if (request) {
+            pairing_request(&recorded, key, record.time_ns);
+        } else {
+            pairing_response(&recorded, key, record.time_ns);
+        }
+    }
+    pairing_stats(&recorded, &stats->recorded);
+    pairing_clear(&recorded);
+    capture_reader_close(reader);
+    return ret;
+}
+
+static void wait_until(const struct timespec *start, int64_t t)
+{
+    int64_t left = t - elapsed_ns(start);
+    if (left > 0) {
+        struct timespec ts = { .tv_sec  = left / 1000000000,
+                               .tv_nsec = left % 1000000000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void print_row(const char *name, double recorded, double replayed)
+{
+    if (recorded > 0) {
+        printf("%-10s %12.3f %12.3f %+9.1f%%\n", name, recorded, replayed,
+               (replayed - recorded) / recorded * 100);
+    } else {
+        printf("%-10s %12s %12.3f %10s\n", name, "-", replayed, "-");
+    }
+}
+
+int replay_run(replay_t *replay, const char *path, double speed,
+               replay_deliver_fn deliver, void *ctx,
+               mcp_replay_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (pair_recorded(path, stats) != 0) {
+        printf("Failed to read capture %s\n", path);
+        return -1;
+    }
+
+    capture_reader_t *reader = capture_reader_open(path);
+    capture_record_t  record;
+    char              key[REPLAY_KEY_MAX];
+    struct timespec   start;
+    int64_t           first_ns = -1;
+    int               ret;
+
+    if (reader == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&replay->lock);
+    pairing_clear(&replay->live); // of an earlier run
+    pthread_mutex_unlock(&replay->lock);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((ret = capture_next(reader, &record)) == 1) {
+        if (record.kind != CAPTURE_IN) {
+            continue;
+        }
+        if (first_ns < 0) {
+            first_ns = record.time_ns;
+        }
+        if (speed > 0) {
+            wait_until(&start, (int64_t) ((record.time_ns - first_ns) / speed));
+        }
+
+        MQTTAsync_message message = MQTTAsync_message_initializer;
+        message.payload           = record.payload;
+        message.payloadlen        = (int) record.len;
+        for (int i = 0; i < record.n_props; i++) {
+            MQTTProperty property = {
+                .identifier  = MQTTPROPERTY_CODE_USER_PROPERTY,
+                .value.data  = { .len  = (int) strlen(record.props[i].key),
+                                 .data = record.props[i].key },
+                .value.value = { .len  = (int) strlen(record.props[i].value),
+                                 .data = record.props[i].value },
+            };
+            MQTTProperties_add(&message.properties, &property);
+        }
+
+        // registered first, the response may be published before we return
+        if (strncmp(record.topic, "$mcp-rpc/", strlen("$mcp-rpc/")) == 0 &&
+            message_key(record.topic, record.payload, true, key,
+                        sizeof(key))) {
+            pthread_mutex_lock(&replay->lock);
+            pairing_request(&replay->live, key, elapsed_ns(&replay->start));
+            pthread_mutex_unlock(&replay->lock);
+        }
+        deliver(ctx, record.topic, (int) strlen(record.topic), &message);
+        MQTTProperties_free(&message.properties);
+    }
+    capture_reader_close(reader);
+
+    pthread_mutex_lock(&replay->lock);
+    while (replay->live.outstanding > 0) {
+        long long       answered = replay->live.n_latencies;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += REPLAY_IDLE_MS / 1000;
+        if (pthread_cond_timedwait(&replay->answered, &replay->lock,
+                                   &deadline) == ETIMEDOUT &&
+            replay->live.n_latencies == answered) {
+            break;
+        }
+    }
+    pairing_stats(&replay->live, &stats->replayed);
+    pthread_mutex_unlock(&replay->lock);
+
+    printf("Replayed %s: %lld messages, %lld of %lld requests answered\n",
+           path, stats->messages, stats->replayed.responses,
+           stats->replayed.requests);
+    printf("%-10s %12s %12s %10s\n", "", "recorded", "replayed", "delta");
+    print_row("p50 ms", stats->recorded.p50_ms, stats->replayed.p50_ms);
+    print_row("p99 ms", stats->recorded.p99_ms, stats->replayed.p99_ms);
+    print_row("max ms", stats->recorded.max_ms, stats->replayed.max_ms);
+    print_row("seconds", stats->recorded.seconds, stats->replayed.seconds);
+    print_row("req/s", stats->recorded.throughput,
+              stats->replayed.throughput);
+    return ret < 0 ? -1 : 0;
+}
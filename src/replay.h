@@ -0,0 +1,37 @@
+#ifndef MCP_REPLAY_H
+#define MCP_REPLAY_H
+
+#include <stddef.h>
+
+#include <MQTTAsync.h>
+
+#include "mcp_server.h"
+
+/* Hands a replayed message to the server, which must not free it. */
+typedef void (*replay_deliver_fn)(void *ctx, char *topic, int topic_len,
+                                  MQTTAsync_message *message);
+
+/*
+ * Feeds the incoming messages of a capture to the server and pairs the
+ * requests on session topics with the responses the server publishes, by
+ * topic and JSON-RPC id, the same way the recorded traffic is paired.
+ */
+typedef struct replay replay_t;
+
+replay_t *replay_create(void);
+void      replay_destroy(replay_t *replay);
+
+/* To be called with every message the server publishes. */
+void replay_published(replay_t *replay, const char *topic,
+                      const char *payload);
+
+/*
+ * Replays the capture at path at speed times the recorded pace, or as fast
+ * as possible for a speed of 0, and waits for the responses. Prints the
+ * recorded and replayed figures side by side and fills stats.
+ */
+int replay_run(replay_t *replay, const char *path, double speed,
+               replay_deliver_fn deliver, void *ctx,
+               mcp_replay_stats_t *stats);
+
+#endif
@@ -0,0 +1,277 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "call.h"
+#include "mem.h"
+#include "response_cache.h"
+
+#define RESPONSE_CACHE_STRIPES 16
+
+typedef struct cache_entry {
+    uint64_t      hash;
+    char         *topic;
+    jsonrpc_id_t *id;
+
+    char   *response;   // NULL while the request is in flight
+    int64_t expires_ms; // set once the response is stored
+
+    struct cache_entry *chain_next;
+    struct cache_entry *older;
+    struct cache_entry *newer;
+} cache_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+
+    int             n_buckets;
+    cache_entry_t **buckets;
+
+    int            count;
+    cache_entry_t *oldest;
+    cache_entry_t *newest;
+} cache_stripe_t;
+
+struct response_cache {
+    int            capacity; // per stripe
+    int            ttl_ms;
+    cache_stripe_t stripes[RESPONSE_CACHE_STRIPES];
+};
+
+static uint64_t entry_hash(const char *topic, const jsonrpc_id_t *id)
+{
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+
+    for (const char *p = topic; *p; p++) {
+        hash = (hash ^ (unsigned char) *p) * 1099511628211ULL;
+    }
+    return hash ^ jsonrpc_id_hash(id);
+}
+
+static cache_stripe_t *entry_stripe(response_cache_t *cache, uint64_t hash)
+{
+    // high bits pick the stripe, low bits the bucket within it
+    return &cache->stripes[(hash >> 32) % RESPONSE_CACHE_STRIPES];
+}
+
+static cache_entry_t **entry_slot(cache_stripe_t *stripe, uint64_t hash,
+                                  const char *topic, const jsonrpc_id_t *id)
+{
+    cache_entry_t **slot = &stripe->buckets[hash & (stripe->n_buckets - 1)];
+
+    while (*slot) {
+        if ((*slot)->hash == hash && jsonrpc_id_equal((*slot)->id, id) &&
+            strcmp((*slot)->topic, topic) == 0) {
+            break;
+        }
+        slot = &(*slot)->chain_next;
+    }
+    return slot;
+}
+
+static void entry_remove(cache_stripe_t *stripe, cache_entry_t *entry)
+{
+    cache_entry_t **slot =
+        entry_slot(stripe, entry->hash, entry->topic, entry->id);
+    *slot = entry->chain_next;
+
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        stripe->oldest = entry->newer;
+    }
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        stripe->newest = entry->older;
+    }
+    stripe->count--;
+
+    mem_free(entry->topic);
+    jsonrpc_id_free(entry->id);
+    mem_free(entry->response);
+    mem_free(entry);
+}
+
+/* An entry in flight, NULL leaves the request untracked. */
+static cache_entry_t *entry_alloc(uint64_t hash, const char *topic,
+                                  const jsonrpc_id_t *id)
+{
+    cache_entry_t *entry = mem_calloc(1, sizeof(cache_entry_t));
+
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->hash  = hash;
+    entry->topic = mem_strdup(topic);
+    entry->id    = jsonrpc_id_dup(id);
+    if (entry->topic == NULL || entry->id == NULL) {
+        mem_free(entry->topic);
+        jsonrpc_id_free(entry->id);
+        mem_free(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+/*
+ * Walks from the oldest entry dropping answered ones that expired, or any
+ * answered one while the stripe is full, until it meets a live answer.
+ */
+static bool stripe_make_room(response_cache_t *cache, cache_stripe_t *stripe,
+                             int64_t now)
+{
+    cache_entry_t *entry = stripe->oldest;
+
+    while (entry) {
+        cache_entry_t *newer = entry->newer;
+        if (entry->response != NULL) {
+            if (entry->expires_ms > now && stripe->count < cache->capacity) {
+                break;
+            }
+            entry_remove(stripe, entry);
+        }
+        entry = newer;
+    }
+    return stripe->count < cache->capacity;
+}
+
+response_cache_t *response_cache_create(int capacity, int ttl_ms)
+{
+    if (capacity <= 0 || ttl_ms <= 0) {
+        return NULL;
+    }
+
+    response_cache_t *cache = mem_calloc(1, sizeof(response_cache_t));
+
+    cache->capacity = (capacity + RESPONSE_CACHE_STRIPES - 1) /
+                      RESPONSE_CACHE_STRIPES;
+    cache->ttl_ms   = ttl_ms;
+
+    int n_buckets = 1;
+    while (n_buckets < cache->capacity) {
+        n_buckets <<= 1;
+    }
+    for (int i = 0; i < RESPONSE_CACHE_STRIPES; i++) {
+        pthread_mutex_init(&cache->stripes[i].lock, NULL);
+        cache->stripes[i].n_buckets = n_buckets;
+        cache->stripes[i].buckets =
+            mem_calloc(n_buckets, sizeof(cache_entry_t *));
+    }
+
+    return cache;
+}
+
+void response_cache_destroy(response_cache_t *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+    for (int i = 0; i < RESPONSE_CACHE_STRIPES; i++) {
+        cache_stripe_t *stripe = &cache->stripes[i];
+        while (stripe->oldest) {
+            entry_remove(stripe, stripe->oldest);
+        }
+        mem_free(stripe->buckets);
+        pthread_mutex_destroy(&stripe->lock);
+    }
+    mem_free(cache);
+}
+
+response_cache_lookup_e response_cache_begin(response_cache_t   *cache,
+                                             const char         *topic,
+                                             const jsonrpc_id_t *id,
+                                             char              **response)
+{
+    if (cache == NULL || !jsonrpc_id_exists(id)) {
+        return RESPONSE_CACHE_MISS;
+    }
+
+    uint64_t        hash   = entry_hash(topic, id);
+    cache_stripe_t *stripe = entry_stripe(cache, hash);
+    int64_t         now    = call_now_ms();
+
+    pthread_mutex_lock(&stripe->lock);
+    cache_entry_t *entry = *entry_slot(stripe, hash, topic, id);
+    if (entry && entry->response && entry->expires_ms <= now) {
+        entry_remove(stripe, entry);
+        entry = NULL;
+    }
+
+    if (entry) {
+        response_cache_lookup_e ret = RESPONSE_CACHE_IN_FLIGHT;
+        if (entry->response) {
+            *response = mem_strdup(entry->response);
+            ret       = RESPONSE_CACHE_HIT;
+        }
+        pthread_mutex_unlock(&stripe->lock);
+        return ret;
+    }
+
+    // untracked when the stripe is full of in-flight requests
+    if (stripe_make_room(cache, stripe, now)) {
+        entry = entry_alloc(hash, topic, id);
+    }
+    if (entry) {
+
+        cache_entry_t **slot =
+            &stripe->buckets[hash & (stripe->n_buckets - 1)];
+        entry->chain_next = *slot;
+        *slot             = entry;
+
+        entry->older = stripe->newest;
+        if (stripe->newest) {
+            stripe->newest->newer = entry;
+        } else {
+            stripe->oldest = entry;
+        }
+        stripe->newest = entry;
+        stripe->count++;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+
+    return RESPONSE_CACHE_MISS;
+}
+
+void response_cache_complete(response_cache_t *cache, const char *topic,
+                             const jsonrpc_id_t *id, const char *response)
+{
+    if (cache == NULL || !jsonrpc_id_exists(id)) {
+        return;
+    }
+
+    uint64_t        hash   = entry_hash(topic, id);
+    cache_stripe_t *stripe = entry_stripe(cache, hash);
+
+    pthread_mutex_lock(&stripe->lock);
+    cache_entry_t *entry = *entry_slot(stripe, hash, topic, id);
+    if (entry && entry->response == NULL) {
+        // a response that failed to encode is not worth replaying
+        entry->response = response ? mem_strdup(response) : NULL;
+        if (entry->response == NULL) {
+            entry_remove(stripe, entry);
+        } else {
+            entry->expires_ms = call_now_ms() + cache->ttl_ms;
+        }
+    }
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+void response_cache_abandon(response_cache_t *cache, const char *topic,
+                            const jsonrpc_id_t *id)
+{
+    if (cache == NULL || !jsonrpc_id_exists(id)) {
+        return;
+    }
+
+    uint64_t        hash   = entry_hash(topic, id);
+    cache_stripe_t *stripe = entry_stripe(cache, hash);
+
+    pthread_mutex_lock(&stripe->lock);
+    cache_entry_t *entry = *entry_slot(stripe, hash, topic, id);
+    if (entry && entry->response == NULL) {
+        entry_remove(stripe, entry);
+    }
+    pthread_mutex_unlock(&stripe->lock);
+}
@@ -0,0 +1,38 @@
+#ifndef MCP_RESPONSE_CACHE_H
+#define MCP_RESPONSE_CACHE_H
+
+#include "jsonrpc.h"
+
+typedef enum {
+    RESPONSE_CACHE_MISS = 0,  // first copy, caller executes the request
+    RESPONSE_CACHE_IN_FLIGHT, // duplicate of a request still executing
+    RESPONSE_CACHE_HIT,       // duplicate of an answered request
+} response_cache_lookup_e;
+
+typedef struct response_cache response_cache_t;
+
+response_cache_t *response_cache_create(int capacity, int ttl_ms);
+void              response_cache_destroy(response_cache_t *cache);
+
+/*
+ * Looks up the request identified by its session topic (which carries the
+ * client id) and JSON-RPC id. On a miss the request is recorded as in flight;
+ * on a hit *response receives a copy of the stored response bytes, or NULL
+ * when the memory pools cannot take one.
+ *
+ * A duplicate of a request in flight is attached to it and not answered on
+ * its own: sharing the topic and id, it is answered by whatever answers the
+ * original, be it the result, an error, a cancellation or a timeout. So
+ * every path that abandons an entry answers the request itself.
+ */
+response_cache_lookup_e response_cache_begin(response_cache_t   *cache,
+                                             const char         *topic,
+                                             const jsonrpc_id_t *id,
+                                             char              **response);
+/* Stores the response sent, a NULL response drops the entry instead. */
+void response_cache_complete(response_cache_t *cache, const char *topic,
+                             const jsonrpc_id_t *id, const char *response);
+void response_cache_abandon(response_cache_t *cache, const char *topic,
+                            const jsonrpc_id_t *id);
+
+#endif
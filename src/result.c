@@ -0,0 +1,274 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcp_json.h"
+#include "mem.h"
+#include "result.h"
+
+/*
+ * Makes room for n more bytes plus the terminating NUL. Returns NULL once
+ * the response outgrew the memory there is, which turns it into an error.
+ */
+static char *reserve(mcp_result_t *result, size_t n)
+{
+    size_t need = result->len + n + 1;
+
+    if (result->overflow) {
+        return NULL;
+    }
+    if (need > result->cap) {
+        size_t cap = result->cap * 2;
+        while (cap < need) {
+            cap *= 2;
+        }
+        char *buf;
+        if (result->buf == result->storage) {
+            buf = mem_alloc(cap);
+            if (buf != NULL) {
+                memcpy(buf, result->storage, result->len);
+            }
+        } else {
+            buf = mem_realloc(result->buf, cap);
+        }
+        if (buf == NULL) {
+            result->overflow = true;
+            return NULL;
+        }
+        result->buf = buf;
+        result->cap = cap;
+    }
+    return result->buf + result->len;
+}
+
+static void append(mcp_result_t *result, const char *data, size_t len)
+{
+    char *out = reserve(result, len);
+
+    if (out != NULL) {
+        memcpy(out, data, len);
+        result->len += len;
+    }
+}
+
+static void append_literal(mcp_result_t *result, const char *s)
+{
+    append(result, s, strlen(s));
+}
+
+static void append_escaped(mcp_result_t *result, const char *s, size_t len)
+{
+    size_t size = mcp_json_escaped_size(s, len);
+    char  *out  = reserve(result, size);
+
+    if (out != NULL) {
+        mcp_json_escape(out, s, len);
+        result->len += size;
+    }
+}
+
+static void append_member(mcp_result_t *result, const char *key,
+                          const char *value)
+{
+    append_literal(result, ",\"");
+    append_literal(result, key);
+    append_literal(result, "\":\"");
+    append_escaped(result, value, strlen(value));
+    append_literal(result, "\"");
+}
+
+static void text_end(mcp_result_t *result)
+{
+    if (result->in_text) {
+        append_literal(result, "\"}");
+        result->in_text = false;
+    }
+}
+
+static void item_begin(mcp_result_t *result, const char *type)
+{
+    text_end(result);
+    if (result->n_items++ > 0) {
+        append_literal(result, ",");
+    }
+    append_literal(result, "{\"type\":\"");
+    append_literal(result, type);
+    append_literal(result, "\"");
+}
+
+static void base64_encode(char *out, const unsigned char *in, size_t size)
+{
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    for (size_t i = 0; i < size; i += 3) {
+        uint32_t v = (uint32_t) in[i] << 16;
+        if (i + 1 < size) {
+            v |= (uint32_t) in[i + 1] << 8;
+        }
+        if (i + 2 < size) {
+            v |= in[i + 2];
+        }
+        *out++ = alphabet[v >> 18];
+        *out++ = alphabet[(v >> 12) & 0x3f];
+        *out++ = i + 1 < size ? alphabet[(v >> 6) & 0x3f] : '=';
+        *out++ = i + 2 < size ? alphabet[v & 0x3f] : '=';
+    }
+}
+
+void result_init(mcp_result_t *result, const jsonrpc_id_t *id)
+{
+    result->buf        = result->storage;
+    result->len        = 0;
+    result->cap        = sizeof(result->storage);
+    result->n_items    = 0;
+    result->in_text    = false;
+    result->is_error   = false;
+    result->done       = false;
+    result->overflow   = false;
+    result->overflowed = false;
+
+    append_literal(result, "{\"jsonrpc\":\"2.0\",\"id\":");
+    size_t len = jsonrpc_id_print(id, NULL, 0);
+    char  *out = reserve(result, len);
+    if (out != NULL) {
+        jsonrpc_id_print(id, out, len);
+        result->len += len;
+    }
+    result->head_len = result->len;
+    append_literal(result, ",\"result\":{\"content\":[");
+}
+
+const char *result_finish(mcp_result_t *result)
+{
+    if (!result->done) {
+        text_end(result);
+        append_literal(result, result->is_error ? "],\"isError\":true}}"
+                                                : "]}}");
+        if (result->overflow) {
+            // answered with an error in the room the result had so far
+            result->overflow   = false;
+            result->overflowed = true;
+            result->len        = result->head_len;
+            append_literal(result, ",\"error\":{\"code\":-32006,"
+                                   "\"message\":\"Result too large\"}}");
+        }
+        result->buf[result->len] = '\0';
+        result->done             = true;
+    }
+    return result->buf;
+}
+
+void result_release(mcp_result_t *result)
+{
+    if (result->buf != result->storage) {
+        mem_free(result->buf);
+    }
+    result->buf = result->storage;
+}
+
+int mcp_result_write(mcp_result_t *result, const char *data, size_t len)
+{
+    if (result->done || result->overflow) {
+        return -1;
+    }
+    if (!result->in_text) {
+        item_begin(result, "text");
+        append_literal(result, ",\"text\":\"");
+        result->in_text = true;
+    }
+    append_escaped(result, data, len);
+    return 0;
+}
+
+int mcp_result_text(mcp_result_t *result, const char *text)
+{
+    return mcp_result_write(result, text, strlen(text));
+}
+
+int mcp_result_printf(mcp_result_t *result, const char *format, ...)
+{
+    char    small[256];
+    va_list ap;
+
+    va_start(ap, format);
+    int len = vsnprintf(small, sizeof(small), format, ap);
+    va_end(ap);
+    if (len < 0) {
+        return -1;
+    }
+    if ((size_t) len < sizeof(small)) {
+        return mcp_result_write(result, small, (size_t) len);
+    }
+
+    char *large = mem_alloc((size_t) len + 1);
+    if (large == NULL) {
+        result->overflow = true;
+        return -1;
+    }
+    va_start(ap, format);
+    vsnprintf(large, (size_t) len + 1, format, ap);
+    va_end(ap);
+    int ret = mcp_result_write(result, large, (size_t) len);
+    mem_free(large);
+    return ret;
+}
+
+int mcp_result_text_end(mcp_result_t *result)
+{
+    if (result->done) {
+        return -1;
+    }
+    text_end(result);
+    return 0;
+}
+
+int mcp_result_image(mcp_result_t *result, const char *mime_type,
+                     const void *data, size_t size)
+{
+    if (result->done) {
+        return -1;
+    }
+
+    size_t len = (size + 2) / 3 * 4;
+
+    item_begin(result, "image");
+    append_literal(result, ",\"data\":\"");
+    char *out = reserve(result, len);
+    if (out != NULL) {
+        base64_encode(out, data, size);
+        result->len += len;
+    }
+    append_literal(result, "\"");
+    append_member(result, "mimeType", mime_type);
+    append_literal(result, "}");
+    return 0;
+}
+
+int mcp_result_resource_link(mcp_result_t *result, const char *uri,
+                             const char *name, const char *mime_type)
+{
+    if (result->done) {
+        return -1;
+    }
+
+    item_begin(result, "resource_link");
+    append_member(result, "uri", uri);
+    append_member(result, "name", name);
+    if (mime_type) {
+        append_member(result, "mimeType", mime_type);
+    }
+    append_literal(result, "}");
+    return 0;
+}
+
+int mcp_result_error(mcp_result_t *result)
+{
+    if (result->done) {
+        return -1;
+    }
+    result->is_error = true;
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef MCP_RESULT_H
+#define MCP_RESULT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "jsonrpc.h"
+#include "mcp_result.h"
+
+#define RESULT_INLINE_SIZE 512
+
+/* Lives on the stack of the worker executing the call. */
+struct mcp_result {
+    char  *buf; // storage until the response outgrows it
+    size_t len;
+    size_t cap;
+
+    size_t head_len; // up to the id, where an error response continues
+    int    n_items;
+    bool   in_text;
+    bool   is_error;
+    bool   done;
+    bool   overflow;   // a buffer could not grow, answered with an error
+    bool   overflowed; // the finished response is that error
+
+    char storage[RESULT_INLINE_SIZE];
+};
+
+void result_init(mcp_result_t *result, const jsonrpc_id_t *id);
+/* Closes the response and returns it, valid until result_release. */
+const char *result_finish(mcp_result_t *result);
+void        result_release(mcp_result_t *result);
+
+#endif
@@ -0,0 +1,173 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+#include "session.h"
+
+struct session_table {
+    pthread_rwlock_t lock;
+
+    int         n_buckets;
+    int         n_sessions;
+    session_t **buckets;
+};
+
+static uint64_t session_hash(const char *client_id, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char) client_id[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static session_t **session_slot(session_table_t *table, const char *client_id,
+                                size_t len)
+{
+    session_t **slot =
+        &table->buckets[session_hash(client_id, len) & (table->n_buckets - 1)];
+
+    while (*slot) {
+        if (strlen((*slot)->client_id) == len &&
+            memcmp((*slot)->client_id, client_id, len) == 0) {
+            break;
+        }
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+static void session_table_grow(session_table_t *table)
+{
+    int         n_buckets = table->n_buckets * 2;
+    session_t **buckets   = mem_calloc(n_buckets, sizeof(session_t *));
+
+    if (buckets == NULL) {
+        return; // longer chains until a later insert grows the table
+    }
+    for (int i = 0; i < table->n_buckets; i++) {
+        session_t *session = table->buckets[i];
+        while (session) {
+            session_t *next = session->next;
+            uint64_t   hash =
+                session_hash(session->client_id, strlen(session->client_id));
+            session->next = buckets[hash & (n_buckets - 1)];
+            buckets[hash & (n_buckets - 1)] = session;
+            session                         = next;
+        }
+    }
+    mem_free(table->buckets);
+    table->buckets   = buckets;
+    table->n_buckets = n_buckets;
+}
+
+session_table_t *session_table_create(void)
+{
+    session_table_t *table = mem_calloc(1, sizeof(session_table_t));
+
+    pthread_rwlock_init(&table->lock, NULL);
+    table->n_buckets = 64;
+    table->buckets   = mem_calloc(table->n_buckets, sizeof(session_t *));
+
+    return table;
+}
+
+void session_table_destroy(session_table_t *table)
+{
+    if (table == NULL) {
+        return;
+    }
+    for (int i = 0; i < table->n_buckets; i++) {
+        session_t *session = table->buckets[i];
+        while (session) {
+            session_t *next = session->next;
+            mem_free(session->client_id);
+            mem_free(session);
+            session = next;
+        }
+    }
+    mem_free(table->buckets);
+    pthread_rwlock_destroy(&table->lock);
+    mem_free(table);
+}
+
+void session_table_lock(session_table_t *table)
+{
+    pthread_rwlock_wrlock(&table->lock);
+}
+
+void session_table_read_lock(session_table_t *table)
+{
+    pthread_rwlock_rdlock(&table->lock);
+}
+
+void session_table_unlock(session_table_t *table)
+{
+    pthread_rwlock_unlock(&table->lock);
+}
+
+session_t *session_find(session_table_t *table, const char *client_id,
+                        size_t len)
+{
+    return *session_slot(table, client_id, len);
+}
+
+session_t *session_insert(session_table_t *table, const char *client_id,
+                          bool *created)
+{
+    session_t **slot = session_slot(table, client_id, strlen(client_id));
+    if (*slot) {
+        *created = false;
+        return *slot;
+    }
+
+    session_t *session = mem_calloc(1, sizeof(session_t));
+    char      *copy    = mem_strdup(client_id);
+    if (session == NULL || copy == NULL) {
+        mem_free(session);
+        mem_free(copy);
+        return NULL;
+    }
+    session->client_id = copy;
+    *slot              = session;
+    *created           = true;
+
+    if (++table->n_sessions > table->n_buckets) {
+        session_table_grow(table);
+    }
+    return session;
+}
+
+bool session_remove(session_table_t *table, const char *client_id, size_t len)
+{
+    session_t **slot    = session_slot(table, client_id, len);
+    session_t  *session = *slot;
+    if (session == NULL) {
+        return false;
+    }
+
+    *slot = session->next;
+    table->n_sessions--;
+    mem_free(session->client_id);
+    mem_free(session);
+    return true;
+}
+
+int session_count(const session_table_t *table)
+{
+    return table->n_sessions;
+}
+
+void session_foreach(session_table_t *table,
+                     void (*fn)(session_t *session, void *ctx), void *ctx)
+{
+    for (int i = 0; i < table->n_buckets; i++) {
+        for (session_t *session = table->buckets[i]; session;
+             session = session->next) {
+            fn(session, ctx);
+        }
+    }
+}
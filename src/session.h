@@ -0,0 +1,45 @@
+#ifndef MCP_SESSION_H
+#define MCP_SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "rate_limit.h"
+
+typedef struct session {
+    char *client_id;
+    bool  initialized;
+    int   role; // resolved once at initialize, -1 without RBAC
+
+    rate_limit_t limit;
+
+    struct session *next;
+} session_t;
+
+typedef struct session_table session_table_t;
+
+session_table_t *session_table_create(void);
+void             session_table_destroy(session_table_t *table);
+
+/*
+ * The table is shared between the MQTT callback threads and threads that
+ * notify sessions; lookups must hold the read lock and updates the table
+ * lock. Requests only read their session, so they never wait on each other.
+ */
+void session_table_lock(session_table_t *table);
+void session_table_read_lock(session_table_t *table);
+void session_table_unlock(session_table_t *table);
+
+session_t *session_find(session_table_t *table, const char *client_id,
+                        size_t len);
+/* NULL when the memory pools cannot take a new session. */
+session_t *session_insert(session_table_t *table, const char *client_id,
+                          bool *created);
+bool       session_remove(session_table_t *table, const char *client_id,
+                          size_t len);
+int        session_count(const session_table_t *table);
+void       session_foreach(session_table_t *table,
+                           void (*fn)(session_t *session, void *ctx),
+                           void *ctx);
+
+#endif
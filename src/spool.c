@@ -0,0 +1,283 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mem.h"
+#include "spool.h"
+
+#define SPOOL_MAGIC       "MCPSPOOL"
+#define SPOOL_VERSION     1
+#define SPOOL_HEADER_SIZE 64
+#define SPOOL_ALIGN       8
+
+#define RECORD_WRAP 0x1 // fills the end of the ring, the next record is at 0
+
+/*
+ * Start of the file. head and tail are positions that only grow, taken
+ * modulo the capacity to find a record; the tail is moved only after the
+ * record it covers has been written, so a crash never exposes half of one.
+ */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t capacity;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t dropped; // entries overwritten while the ring was full
+} spool_header_t;
+
+typedef struct {
+    uint32_t size; // of the whole record, padding included
+    uint32_t flags;
+    uint32_t topic_len;
+    uint32_t payload_len;
+    int64_t  expires_ms;
+    // followed by the topic, its NUL and the payload
+} spool_record_t;
+
+struct spool {
+    pthread_mutex_t lock;
+    int             fd;
+    size_t          map_size;
+    spool_header_t *header;
+    char           *data;
+    uint64_t        capacity;
+};
+
+int64_t spool_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static size_t align_up(size_t n)
+{
+    return (n + SPOOL_ALIGN - 1) & ~(size_t) (SPOOL_ALIGN - 1);
+}
+
+/* The record at pos, past a tail too short to hold one. */
+static spool_record_t *record_at(spool_t *spool, uint64_t *pos)
+{
+    uint64_t offset = *pos % spool->capacity;
+
+    if (spool->capacity - offset < sizeof(spool_record_t)) {
+        *pos += spool->capacity - offset;
+        offset = 0;
+    }
+    return (spool_record_t *) (spool->data + offset);
+}
+
+/*
+ * Whether the record at head, found by record_at, lies within what is
+ * pending. A file damaged outside of us would have the ring read anywhere.
+ */
+static bool record_valid(spool_t *spool, const spool_record_t *record,
+                         uint64_t head)
+{
+    uint64_t pending = spool->header->tail - head;
+
+    if (head > spool->header->tail || record->size < sizeof(spool_record_t) ||
+        record->size % SPOOL_ALIGN != 0 || record->size > pending) {
+        return false;
+    }
+    return (record->flags & RECORD_WRAP) ||
+           (uint64_t) record->topic_len + 1 + record->payload_len <=
+               record->size - sizeof(spool_record_t);
+}
+
+/* Drops whatever is pending, the ring cannot be walked any further. */
+static void reset_ring(spool_t *spool)
+{
+    printf("Spool is damaged, dropping %llu bytes\n",
+           (unsigned long long) (spool->header->tail - spool->header->head));
+    spool->header->head = spool->header->tail;
+}
+
+static void drop_head(spool_t *spool)
+{
+    uint64_t        head   = spool->header->head;
+    spool_record_t *record = record_at(spool, &head);
+
+    if (!record_valid(spool, record, head)) {
+        reset_ring(spool);
+        return;
+    }
+    if (!(record->flags & RECORD_WRAP)) {
+        spool->header->dropped++;
+    }
+    spool->header->head = head + record->size;
+}
+
+spool_t *spool_open(const char *path, size_t capacity)
+{
+    capacity &= ~(size_t) (SPOOL_ALIGN - 1);
+    if (capacity < 4096) {
+        return NULL;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        printf("Failed to open spool %s\n", path);
+        return NULL;
+    }
+
+    size_t      map_size = SPOOL_HEADER_SIZE + capacity;
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        ((size_t) st.st_size != map_size && ftruncate(fd, map_size) != 0)) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    spool_t *spool = mem_calloc(1, sizeof(spool_t));
+    if (spool == NULL) {
+        munmap(map, map_size);
+        close(fd);
+        return NULL;
+    }
+    spool->fd       = fd;
+    spool->map_size = map_size;
+    spool->header   = (spool_header_t *) map;
+    spool->data     = (char *) map + SPOOL_HEADER_SIZE;
+    spool->capacity = capacity;
+    pthread_mutex_init(&spool->lock, NULL);
+
+    spool_header_t *header = spool->header;
+    if (memcmp(header->magic, SPOOL_MAGIC, 8) == 0 &&
+        header->version == SPOOL_VERSION && header->capacity == capacity &&
+        header->head <= header->tail &&
+        header->tail - header->head <= capacity) {
+        printf("Resuming spool %s with %llu bytes pending\n", path,
+               (unsigned long long) (header->tail - header->head));
+    } else {
+        memset(header, 0, sizeof(spool_header_t));
+        memcpy(header->magic, SPOOL_MAGIC, 8);
+        header->version  = SPOOL_VERSION;
+        header->capacity = capacity;
+    }
+    return spool;
+}
+
+void spool_close(spool_t *spool)
+{
+    if (spool == NULL) {
+        return;
+    }
+    msync(spool->header, spool->map_size, MS_SYNC);
+    munmap(spool->header, spool->map_size);
+    close(spool->fd);
+    pthread_mutex_destroy(&spool->lock);
+    mem_free(spool);
+}
+
+int spool_append(spool_t *spool, const char *topic, const char *payload,
+                 size_t len, int64_t expires_ms)
+{
+    size_t topic_len = strlen(topic);
+    size_t size      = align_up(sizeof(spool_record_t) + topic_len + 1 + len);
+
+    if (size > spool->capacity / 2) {
+        return -1; // would wipe out most of what is waiting
+    }
+
+    pthread_mutex_lock(&spool->lock);
+    spool_header_t *header = spool->header;
+    uint64_t        tail   = header->tail;
+    uint64_t        offset = tail % spool->capacity;
+    uint64_t        room   = spool->capacity - offset;
+    uint64_t        wrap   = 0;
+
+    // records are never split, the rest of the ring is skipped instead
+    if (room < size) {
+        wrap = room;
+    }
+    while (header->tail - header->head + wrap + size > spool->capacity) {
+        drop_head(spool);
+    }
+    if (wrap >= sizeof(spool_record_t)) {
+        spool_record_t *filler = (spool_record_t *) (spool->data + offset);
+        memset(filler, 0, sizeof(spool_record_t));
+        filler->size  = (uint32_t) wrap;
+        filler->flags = RECORD_WRAP;
+    }
+    tail += wrap;
+
+    spool_record_t *record =
+        (spool_record_t *) (spool->data + tail % spool->capacity);
+    record->size        = (uint32_t) size;
+    record->flags       = 0;
+    record->topic_len   = (uint32_t) topic_len;
+    record->payload_len = (uint32_t) len;
+    record->expires_ms  = expires_ms;
+    char *body          = (char *) (record + 1);
+    memcpy(body, topic, topic_len + 1);
+    memcpy(body + topic_len + 1, payload, len);
+
+    __atomic_store_n(&header->tail, tail + size, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&spool->lock);
+    return 0;
+}
+
+bool spool_empty(spool_t *spool)
+{
+    pthread_mutex_lock(&spool->lock);
+    bool empty = spool->header->head == spool->header->tail;
+    pthread_mutex_unlock(&spool->lock);
+    return empty;
+}
+
+int spool_drain(spool_t *spool, spool_send_fn send, void *ctx)
+{
+    int     sent = 0;
+    int64_t now  = spool_now_ms();
+
+    pthread_mutex_lock(&spool->lock);
+    spool_header_t *header = spool->header;
+    while (header->head != header->tail) {
+        uint64_t        head   = header->head;
+        spool_record_t *record = record_at(spool, &head);
+
+        if (!record_valid(spool, record, head)) {
+            reset_ring(spool);
+            break;
+        }
+        if (!(record->flags & RECORD_WRAP)) {
+            int64_t left_ms = record->expires_ms - now;
+            if (record->expires_ms != 0 && left_ms <= 0) {
+                printf("Dropping an expired spooled message\n");
+            } else {
+                const char *topic    = (const char *) (record + 1);
+                int         expiry_s = 0;
+                if (record->expires_ms != 0) {
+                    expiry_s = (int) ((left_ms + 999) / 1000);
+                }
+                if (send(ctx, topic, topic + record->topic_len + 1,
+                         record->payload_len, expiry_s) != 0) {
+                    break;
+                }
+                sent++;
+            }
+        }
+        header->head = head + record->size;
+    }
+    if (header->dropped > 0) {
+        printf("Spool was full, %llu messages were lost\n",
+               (unsigned long long) header->dropped);
+        header->dropped = 0;
+    }
+    pthread_mutex_unlock(&spool->lock);
+    return sent;
+}
@@ -0,0 +1,44 @@
+#ifndef MCP_SPOOL_H
+#define MCP_SPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Outbound messages that could not be published, kept in a ring file mapped
+ * into memory so they survive a lost connection as well as a restart of the
+ * process. Entries are appended at the tail and replayed from the head in
+ * the order they were produced; when the ring is full the oldest entries
+ * make room. All functions are thread safe.
+ */
+typedef struct spool spool_t;
+
+/*
+ * Publishes an entry with expiry_s seconds left (0 never expires). Returns 0
+ * once the message was handed over, anything else keeps it for the next
+ * drain.
+ */
+typedef int (*spool_send_fn)(void *ctx, const char *topic,
+                             const char *payload, size_t len, int expiry_s);
+
+int64_t spool_now_ms(void); // wall clock, entries outlive the process
+
+/*
+ * Opens the spool at path, resuming the entries of a previous run when the
+ * file was written with the same capacity, else starting empty.
+ */
+spool_t *spool_open(const char *path, size_t capacity);
+void     spool_close(spool_t *spool);
+
+/* expires_ms is spool_now_ms() based, 0 never. Returns -1 when too big. */
+int  spool_append(spool_t *spool, const char *topic, const char *payload,
+                  size_t len, int64_t expires_ms);
+bool spool_empty(spool_t *spool);
+/*
+ * Replays entries in order until the spool is empty or send fails, skipping
+ * the expired ones. Returns the number of entries sent.
+ */
+int spool_drain(spool_t *spool, spool_send_fn send, void *ctx);
+
+#endif
@@ -0,0 +1,458 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mcp_json.h"
+#include "mem.h"
+#include "trace.h"
+
+/*
+ * Spans the ring holds, set MCP_TRACE_SPANS to change it. A static build
+ * fits the ring, and the batch the exporter copies it to, in a block each.
+ */
+#ifndef MCP_TRACE_SPANS
+#ifdef MCP_STATIC_MEMORY
+#define MCP_TRACE_SPANS (MCP_STATIC_MAX_BLOCK / sizeof(mcp_span_t))
+#else
+#define MCP_TRACE_SPANS 4096
+#endif
+#endif
+#ifdef MCP_STATIC_MEMORY
+_Static_assert(MCP_TRACE_SPANS * sizeof(mcp_span_t) <= MCP_STATIC_MAX_BLOCK,
+               "MCP_TRACE_SPANS spans do not fit in MCP_STATIC_MAX_BLOCK");
+#endif
+
+#define TRACE_RING_SIZE ((int) MCP_TRACE_SPANS)
+#define TRACE_FLUSH_MS  1000
+
+struct trace {
+    double             sample_ratio;
+    mcp_span_export_fn export;
+    void              *ctx;
+    atomic_ullong      random;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    mcp_span_t     *ring;
+    mcp_span_t     *batch; // of the exporter, taken out of the ring
+    int             head;  // oldest span
+    int             count;
+    long long       dropped;
+    bool            stopping;
+    pthread_t       thread;
+};
+
+struct trace_request {
+    trace_t *trace;
+    uint8_t  trace_id[16];
+    uint8_t  span_id[8];
+    uint8_t  parent_id[8];
+    char     name[32];
+    char     tool[64];
+    int64_t  start_ns;
+};
+
+struct mcp_trace_file {
+    pthread_mutex_t lock;
+    FILE           *out;
+    char           *service_name; // escaped for JSON
+};
+
+int64_t trace_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t next_random(trace_t *trace)
+{
+    // splitmix64 over a shared counter: no lock, no state per thread
+    uint64_t z = atomic_fetch_add(&trace->random, 0x9e3779b97f4a7c15ULL) +
+                 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void random_id(trace_t *trace, uint8_t *id, size_t size)
+{
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t r = next_random(trace) | 1; // all zero ids are invalid
+        memcpy(id + i, &r, size - i < 8 ? size - i : 8);
+    }
+}
+
+static bool is_zero(const uint8_t *id, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (id[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int hex_decode(const char *hex, uint8_t *out, size_t size)
+{
+    for (size_t i = 0; i < size * 2; i++) {
+        char c = hex[i];
+        int  v;
+        if (c >= '0' && c <= '9') {
+            v = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            v = c - 'a' + 10;
+        } else {
+            return -1; // upper case is not allowed either
+        }
+        out[i / 2] = (uint8_t) (i % 2 ? out[i / 2] | v : v << 4);
+    }
+    return 0;
+}
+
+static void hex_encode(char *out, const uint8_t *id, size_t size)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < size; i++) {
+        out[2 * i]     = hex[id[i] >> 4];
+        out[2 * i + 1] = hex[id[i] & 0xf];
+    }
+    out[2 * size] = '\0';
+}
+
+/* version-traceid-parentid-flags, see W3C Trace Context. */
+static int traceparent_parse(const char *s, uint8_t trace_id[16],
+                             uint8_t parent_id[8], uint8_t *flags)
+{
+    uint8_t version;
+    size_t  len = strlen(s);
+
+    if (len < TRACEPARENT_LEN || s[2] != '-' || s[35] != '-' ||
+        s[52] != '-' || hex_decode(s, &version, 1) != 0 || version == 0xff ||
+        (version == 0 && len != TRACEPARENT_LEN) ||
+        (len > TRACEPARENT_LEN && s[TRACEPARENT_LEN] != '-')) {
+        return -1;
+    }
+    if (hex_decode(s + 3, trace_id, 16) != 0 ||
+        hex_decode(s + 36, parent_id, 8) != 0 ||
+        hex_decode(s + 53, flags, 1) != 0 || is_zero(trace_id, 16) ||
+        is_zero(parent_id, 8)) {
+        return -1;
+    }
+    return 0;
+}
+
+static void record(trace_t *trace, const mcp_span_t *span)
+{
+    pthread_mutex_lock(&trace->lock);
+    if (trace->count == TRACE_RING_SIZE) {
+        trace->dropped++;
+    } else {
+        trace->ring[(trace->head + trace->count) % TRACE_RING_SIZE] = *span;
+        if (++trace->count == TRACE_RING_SIZE / 2) {
+            pthread_cond_signal(&trace->cond);
+        }
+    }
+    pthread_mutex_unlock(&trace->lock);
+}
+
+static void *export_run(void *arg)
+{
+    trace_t    *trace = (trace_t *) arg;
+    mcp_span_t *batch = trace->batch;
+
+    pthread_mutex_lock(&trace->lock);
+    for (;;) {
+        if (trace->count < TRACE_RING_SIZE / 2 && !trace->stopping) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_sec += TRACE_FLUSH_MS / 1000;
+            pthread_cond_timedwait(&trace->cond, &trace->lock, &ts);
+        }
+
+        int n = 0;
+        while (trace->count > 0) {
+            batch[n++]  = trace->ring[trace->head];
+            trace->head = (trace->head + 1) % TRACE_RING_SIZE;
+            trace->count--;
+        }
+        long long dropped = trace->dropped;
+        bool      stopped = trace->stopping;
+        trace->dropped    = 0;
+        pthread_mutex_unlock(&trace->lock);
+
+        if (dropped > 0) {
+            printf("Dropped %lld spans, the exporter falls behind\n", dropped);
+        }
+        if (n > 0) {
+            trace->export(trace->ctx, n, batch);
+        }
+        if (stopped) {
+            break; // drained what was recorded before the stop
+        }
+        pthread_mutex_lock(&trace->lock);
+    }
+    return NULL;
+}
+
+trace_t *trace_create(double sample_ratio, mcp_span_export_fn export,
+                      void *ctx)
+{
+    if (export == NULL || sample_ratio < 0 || sample_ratio > 1) {
+        return NULL;
+    }
+
+    trace_t *trace = mem_calloc(1, sizeof(trace_t));
+    if (trace == NULL) {
+        return NULL;
+    }
+    trace->ring  = mem_alloc(sizeof(mcp_span_t) * TRACE_RING_SIZE);
+    trace->batch = mem_alloc(sizeof(mcp_span_t) * TRACE_RING_SIZE);
+    if (trace->ring == NULL || trace->batch == NULL) {
+        mem_free(trace->ring);
+        mem_free(trace->batch);
+        mem_free(trace);
+        return NULL;
+    }
+    trace->sample_ratio = sample_ratio;
+    trace->export       = export;
+    trace->ctx          = ctx;
+    atomic_init(&trace->random,
+                (uint64_t) trace_now_ns() ^ (uint64_t) (uintptr_t) trace);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&trace->thread, NULL, export_run, trace) != 0) {
+        pthread_cond_destroy(&trace->cond);
+        pthread_mutex_destroy(&trace->lock);
+        mem_free(trace->ring);
+        mem_free(trace->batch);
+        mem_free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+void trace_destroy(trace_t *trace)
+{
+    if (trace == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&trace->lock);
+    trace->stopping = true;
+    pthread_cond_signal(&trace->cond);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->thread, NULL);
+
+    pthread_cond_destroy(&trace->cond);
+    pthread_mutex_destroy(&trace->lock);
+    mem_free(trace->ring);
+    mem_free(trace->batch);
+    mem_free(trace);
+}
+
+trace_request_t *trace_begin(trace_t *trace, const char *traceparent,
+                             int64_t start_ns)
+{
+    uint8_t trace_id[16], parent_id[8], flags;
+
+    if (trace == NULL) {
+        return NULL;
+    }
+    if (traceparent &&
+        traceparent_parse(traceparent, trace_id, parent_id, &flags) == 0) {
+        if (!(flags & 0x01)) {
+            return NULL; // the caller decided against recording this trace
+        }
+    } else {
+        double draw = (double) (next_random(trace) >> 11) * 0x1p-53;
+        if (draw >= trace->sample_ratio) {
+            return NULL;
+        }
+        random_id(trace, trace_id, sizeof(trace_id));
+        memset(parent_id, 0, sizeof(parent_id));
+    }
+
+    // untraced when the memory pools cannot take the request
+    trace_request_t *request = mem_calloc(1, sizeof(trace_request_t));
+    if (request == NULL) {
+        return NULL;
+    }
+    request->trace    = trace;
+    request->start_ns = start_ns;
+    memcpy(request->trace_id, trace_id, sizeof(trace_id));
+    memcpy(request->parent_id, parent_id, sizeof(parent_id));
+    random_id(trace, request->span_id, sizeof(request->span_id));
+    return request;
+}
+
+void trace_set_name(trace_request_t *request, const char *method,
+                    const char *tool)
+{
+    if (request) {
+        snprintf(request->name, sizeof(request->name), "%s", method);
+        snprintf(request->tool, sizeof(request->tool), "%s",
+                 tool ? tool : "");
+    }
+}
+
+void trace_span(trace_request_t *request, const char *phase,
+                int64_t start_ns, int64_t end_ns)
+{
+    if (request == NULL) {
+        return;
+    }
+
+    mcp_span_t span = {
+        .start_ns = start_ns,
+        .end_ns   = end_ns,
+    };
+    memcpy(span.trace_id, request->trace_id, sizeof(span.trace_id));
+    memcpy(span.parent_id, request->span_id, sizeof(span.parent_id));
+    random_id(request->trace, span.span_id, sizeof(span.span_id));
+    snprintf(span.name, sizeof(span.name), "%s", phase);
+    if (strcmp(phase, "tool") == 0) {
+        memcpy(span.tool, request->tool, sizeof(span.tool));
+    }
+    record(request->trace, &span);
+}
+
+void trace_traceparent(const trace_request_t *request,
+                       char                   buf[TRACEPARENT_LEN + 1])
+{
+    char trace_id[33], span_id[17];
+
+    hex_encode(trace_id, request->trace_id, sizeof(request->trace_id));
+    hex_encode(span_id, request->span_id, sizeof(request->span_id));
+    snprintf(buf, TRACEPARENT_LEN + 1, "00-%s-%s-01", trace_id, span_id);
+}
+
+int64_t trace_clock(const trace_request_t *request)
+{
+    return request ? trace_now_ns() : 0;
+}
+
+void trace_end(trace_request_t *request, int64_t end_ns)
+{
+    if (request == NULL) {
+        return;
+    }
+
+    mcp_span_t span = {
+        .request  = true,
+        .start_ns = request->start_ns,
+        .end_ns   = end_ns,
+    };
+    memcpy(span.trace_id, request->trace_id, sizeof(span.trace_id));
+    memcpy(span.span_id, request->span_id, sizeof(span.span_id));
+    memcpy(span.parent_id, request->parent_id, sizeof(span.parent_id));
+    memcpy(span.name, request->name, sizeof(span.name));
+    memcpy(span.tool, request->tool, sizeof(span.tool));
+    record(request->trace, &span);
+    mem_free(request);
+}
+
+static char *json_escaped(const char *s)
+{
+    size_t len     = strlen(s);
+    size_t size    = mcp_json_escaped_size(s, len);
+    char  *escaped = mem_alloc(size + 1);
+
+    if (escaped == NULL) {
+        return NULL;
+    }
+    mcp_json_escape(escaped, s, len);
+    escaped[size] = '\0';
+    return escaped;
+}
+
+mcp_trace_file_t *mcp_trace_file_open(const char *path,
+                                      const char *service_name)
+{
+    FILE *out = fopen(path, "a");
+    if (out == NULL) {
+        return NULL;
+    }
+
+    mcp_trace_file_t *file = mem_calloc(1, sizeof(mcp_trace_file_t));
+    file->out              = out;
+    file->service_name     = json_escaped(service_name);
+    pthread_mutex_init(&file->lock, NULL);
+    return file;
+}
+
+static void write_span(FILE *out, const mcp_span_t *span)
+{
+    char trace_id[33], span_id[17], parent_id[17];
+
+    hex_encode(trace_id, span->trace_id, sizeof(span->trace_id));
+    hex_encode(span_id, span->span_id, sizeof(span->span_id));
+    hex_encode(parent_id, span->parent_id, sizeof(span->parent_id));
+
+    // kind 2 is SPAN_KIND_SERVER, 1 SPAN_KIND_INTERNAL; the method name
+    // comes from the client, like the tool name
+    char *name = json_escaped(span->name);
+    fprintf(out,
+            "{\"traceId\":\"%s\",\"spanId\":\"%s\",\"name\":\"%s\","
+            "\"kind\":%d,\"startTimeUnixNano\":\"%" PRId64 "\","
+            "\"endTimeUnixNano\":\"%" PRId64 "\"",
+            trace_id, span_id, name ? name : "", span->request ? 2 : 1,
+            span->start_ns, span->end_ns);
+    mem_free(name);
+    if (!is_zero(span->parent_id, sizeof(span->parent_id))) {
+        fprintf(out, ",\"parentSpanId\":\"%s\"", parent_id);
+    }
+    char *tool = span->tool[0] ? json_escaped(span->tool) : NULL;
+    if (tool) {
+        fprintf(out,
+                ",\"attributes\":[{\"key\":\"mcp.tool.name\","
+                "\"value\":{\"stringValue\":\"%s\"}}]",
+                tool);
+        mem_free(tool);
+    }
+    fputc('}', out);
+}
+
+void mcp_trace_file_export(void *ctx, int n_spans, const mcp_span_t *spans)
+{
+    mcp_trace_file_t *file = (mcp_trace_file_t *) ctx;
+
+    pthread_mutex_lock(&file->lock);
+    fprintf(file->out,
+            "{\"resourceSpans\":[{\"resource\":{\"attributes\":[{\"key\":"
+            "\"service.name\",\"value\":{\"stringValue\":\"%s\"}}]},"
+            "\"scopeSpans\":[{\"scope\":{\"name\":\"mcp-over-mqtt\"},"
+            "\"spans\":[",
+            file->service_name);
+    for (int i = 0; i < n_spans; i++) {
+        if (i > 0) {
+            fputc(',', file->out);
+        }
+        write_span(file->out, &spans[i]);
+    }
+    fputs("]}]}]}\n", file->out);
+    fflush(file->out);
+    pthread_mutex_unlock(&file->lock);
+}
+
+void mcp_trace_file_close(mcp_trace_file_t *file)
+{
+    if (file == NULL) {
+        return;
+    }
+    fclose(file->out);
+    pthread_mutex_destroy(&file->lock);
+    mem_free(file->service_name);
+    mem_free(file);
+}
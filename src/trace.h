@@ -0,0 +1,46 @@
+#ifndef MCP_TRACE_H
+#define MCP_TRACE_H
+
+#include <stdint.h>
+
+#include "mcp_trace.h"
+
+/* Length of a version 00 traceparent, without the terminating NUL. */
+#define TRACEPARENT_LEN 55
+
+typedef struct trace         trace_t;
+typedef struct trace_request trace_request_t;
+
+int64_t trace_now_ns(void);
+
+/*
+ * Recorder of sampled spans. Spans go into a bounded ring under a short
+ * lock and a thread of the recorder hands them to export in batches, so a
+ * slow exporter costs dropped spans rather than request latency. Returns
+ * NULL for a bad ratio or export, or when the ring cannot be allocated.
+ */
+trace_t *trace_create(double sample_ratio, mcp_span_export_fn export,
+                      void *ctx);
+void     trace_destroy(trace_t *trace);
+
+/*
+ * Starts the span of a request that arrived at start_ns. A sampled parent
+ * is always followed; without one the request is sampled at the ratio.
+ * Returns NULL when tracing is off or the request is not sampled, and every
+ * function below accepts NULL and then does nothing.
+ */
+trace_request_t *trace_begin(trace_t *trace, const char *traceparent,
+                             int64_t start_ns);
+void trace_set_name(trace_request_t *request, const char *method,
+                    const char *tool);
+void trace_span(trace_request_t *request, const char *phase,
+                int64_t start_ns, int64_t end_ns);
+/* Writes the traceparent naming the request span to its response. */
+void trace_traceparent(const trace_request_t *request,
+                       char                   buf[TRACEPARENT_LEN + 1]);
+/* The time for a span of request, without reading the clock when NULL. */
+int64_t trace_clock(const trace_request_t *request);
+/* Records the request span and frees the request. */
+void trace_end(trace_request_t *request, int64_t end_ns);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef MCP_TEST_H
+#define MCP_TEST_H
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Checks of the unit tests. A failed check reports its line and the test
+ * carries on, so one run shows every failure; main returns test_result().
+ */
+static int test_failures;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);    \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_STR(actual, expected)                                            \
+    do {                                                                       \
+        const char *a_ = (actual);                                             \
+        const char *e_ = (expected);                                           \
+        if (a_ == NULL || strcmp(a_, e_) != 0) {                               \
+            printf("%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__,         \
+                   __LINE__, #actual, a_ ? a_ : "(null)", e_);                 \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+static inline int test_result(void)
+{
+    if (test_failures > 0) {
+        printf("%d checks failed\n", test_failures);
+        return 1;
+    }
+    return 0;
+}
+
+#endif
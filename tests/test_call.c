@@ -0,0 +1,171 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "call.h"
+#include "test.h"
+
+typedef struct {
+    atomic_int  n_executed;
+    atomic_int  n_finished;
+    atomic_int  n_aborted;
+    atomic_int  reason;
+    atomic_bool running;
+    atomic_bool release; // lets a blocked tool return
+    bool        block;
+} recorder_t;
+
+static mcp_tool_t tool = { .name = "slow" };
+
+static void execute(void *ctx, mcp_call_t *call)
+{
+    recorder_t *rec = ctx;
+
+    atomic_fetch_add(&rec->n_executed, 1);
+    atomic_store(&rec->running, true);
+    while (rec->block && !atomic_load(&rec->release)) {
+        usleep(1000);
+    }
+    if (call_finish(call)) {
+        atomic_fetch_add(&rec->n_finished, 1);
+    }
+}
+
+static void abort_call(void *ctx, mcp_call_t *call, call_abort_reason_e reason)
+{
+    recorder_t *rec = ctx;
+
+    (void) call;
+    atomic_store(&rec->reason, reason);
+    atomic_fetch_add(&rec->n_aborted, 1);
+}
+
+static void notify(void *ctx, const mcp_call_t *call, const char *notification)
+{
+    (void) ctx;
+    (void) call;
+    (void) notification;
+}
+
+static mcp_call_t *new_call(catalog_t *catalog, const char *topic,
+                            const char *request, int64_t deadline_ms)
+{
+    jsonrpc_id_t *id   = jsonrpc_id_scan(request, strlen(request));
+    mcp_call_t   *call = call_create(topic, id, catalog_acquire(catalog),
+                                     &tool, 0, NULL, NULL, deadline_ms);
+    jsonrpc_id_free(id);
+    return call;
+}
+
+static bool wait_for(atomic_int *counter, int value)
+{
+    for (int i = 0; i < 2000 && atomic_load(counter) < value; i++) {
+        usleep(1000);
+    }
+    return atomic_load(counter) >= value;
+}
+
+/* The watchdog answers a running call once its deadline passes. */
+static void test_watchdog(catalog_t *catalog)
+{
+    recorder_t   rec  = { .block = true };
+    call_pool_t *pool = call_pool_create(1, execute, abort_call, notify, &rec);
+
+    mcp_call_t *call = new_call(catalog, "c/1", "{\"id\":1}",
+                                call_now_ms() + 50);
+    CHECK(call_pool_submit(pool, call) == 0);
+    CHECK(wait_for(&rec.n_aborted, 1));
+    CHECK(atomic_load(&rec.running));
+    CHECK(atomic_load(&rec.reason) == CALL_TIMED_OUT);
+
+    // the tool returns late, its result must not be published
+    atomic_store(&rec.release, true);
+    for (int i = 0; i < 2000 && call_pool_pending(pool) > 0; i++) {
+        usleep(1000);
+    }
+    CHECK(call_pool_pending(pool) == 0);
+    CHECK(atomic_load(&rec.n_finished) == 0);
+    CHECK(atomic_load(&rec.n_aborted) == 1);
+    call_pool_destroy(pool);
+}
+
+/* A call that expires while queued is answered without running. */
+static void test_expired_in_queue(catalog_t *catalog)
+{
+    recorder_t   rec  = { 0 };
+    call_pool_t *pool = call_pool_create(0, execute, abort_call, notify, &rec);
+    int64_t      next = -1;
+
+    CHECK(call_pool_submit(pool, new_call(catalog, "c/1", "{\"id\":1}",
+                                          call_now_ms() - 1)) == 0);
+    CHECK(call_pool_submit(pool, new_call(catalog, "c/1", "{\"id\":2}",
+                                          0)) == 0);
+    call_pool_run(pool, &next);
+    CHECK(atomic_load(&rec.n_aborted) == 1);
+    CHECK(atomic_load(&rec.reason) == CALL_TIMED_OUT);
+    CHECK(atomic_load(&rec.n_executed) == 1);
+    CHECK(atomic_load(&rec.n_finished) == 1);
+    CHECK(next == 0);
+    CHECK(call_pool_pending(pool) == 0);
+    call_pool_destroy(pool);
+}
+
+static void test_cancel(catalog_t *catalog)
+{
+    recorder_t    rec  = { 0 };
+    call_pool_t  *pool = call_pool_create(0, execute, abort_call, notify, &rec);
+    jsonrpc_id_t *one  = jsonrpc_id_scan("{\"id\":1}", 8);
+    int64_t       next = -1;
+
+    CHECK(call_pool_submit(pool, new_call(catalog, "c/1", "{\"id\":1}",
+                                          0)) == 0);
+    CHECK(call_pool_submit(pool, new_call(catalog, "c/1", "{\"id\":2}",
+                                          call_now_ms() + 60000)) == 0);
+    // ids are per session
+    CHECK(!call_pool_cancel(pool, "c/2", one));
+    CHECK(call_pool_cancel(pool, "c/1", one));
+    CHECK(atomic_load(&rec.n_aborted) == 1);
+    CHECK(atomic_load(&rec.reason) == CALL_CANCELLED);
+    // answered once only
+    CHECK(!call_pool_cancel(pool, "c/1", one));
+
+    CHECK(call_pool_run(pool, &next) == 2);
+    CHECK(atomic_load(&rec.n_executed) == 1);
+    CHECK(atomic_load(&rec.n_finished) == 1);
+    CHECK(call_pool_pending(pool) == 0);
+    CHECK(!call_pool_cancel(pool, "c/1", one));
+    jsonrpc_id_free(one);
+    call_pool_destroy(pool);
+}
+
+static void test_capacity(catalog_t *catalog)
+{
+    recorder_t   rec  = { 0 };
+    call_pool_t *pool = call_pool_create(0, execute, abort_call, notify, &rec);
+    int64_t      next = -1;
+
+    call_pool_set_capacity(pool, 1);
+    CHECK(call_pool_submit(pool, new_call(catalog, "c/1", "{\"id\":1}",
+                                          0)) == 0);
+    mcp_call_t *over = new_call(catalog, "c/1", "{\"id\":2}", 0);
+    CHECK(call_pool_submit(pool, over) == -2);
+    CHECK(call_pool_pending(pool) == 1);
+    CHECK(call_pool_run(pool, &next) == 1);
+    CHECK(call_pool_submit(pool, over) == 0);
+    CHECK(call_pool_run(pool, &next) == 1);
+    CHECK(atomic_load(&rec.n_finished) == 2);
+    call_pool_destroy(pool);
+}
+
+int main(void)
+{
+    catalog_t *catalog = catalog_create();
+
+    test_watchdog(catalog);
+    test_expired_in_queue(catalog);
+    test_cancel(catalog);
+    test_capacity(catalog);
+    catalog_destroy(catalog);
+    return test_result();
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "replay.h"
+#include "test.h"
+
+#define SESSION  "$mcp-rpc/c1/s1/math"
+#define REQUEST  "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"tools/list\"}"
+#define RESPONSE "{\"jsonrpc\":\"2.0\",\"id\":%d,\"result\":{}}"
+
+static char path[] = "/tmp/mcp-capture-XXXXXX";
+
+static void write_capture(int n_requests)
+{
+    capture_t     *capture = capture_open(path);
+    MQTTProperties props   = MQTTProperties_initializer;
+    MQTTProperty   name    = {
+        .identifier  = MQTTPROPERTY_CODE_USER_PROPERTY,
+        .value.data  = { .len = 6, .data = "MCP-MQ" },
+        .value.value = { .len = 5, .data = "1.0.0" },
+    };
+    char payload[128];
+
+    MQTTProperties_add(&props, &name);
+    for (int i = 1; i <= n_requests; i++) {
+        int len = snprintf(payload, sizeof(payload), REQUEST, i);
+        capture_message(capture, CAPTURE_IN, SESSION, payload, len, &props);
+        len = snprintf(payload, sizeof(payload), RESPONSE, i);
+        capture_message(capture, CAPTURE_OUT, SESSION, payload, len, NULL);
+    }
+    // neither a request nor a response, only fed to the server
+    capture_message(capture, CAPTURE_IN, "$mcp-server/presence/s1", "{}", 2,
+                    NULL);
+    capture_message(NULL, CAPTURE_IN, SESSION, "{}", 2, NULL);
+    capture_close(capture);
+    MQTTProperties_free(&props);
+}
+
+static void test_records(void)
+{
+    capture_reader_t *reader;
+    capture_record_t  record;
+    int64_t           last = 0;
+
+    write_capture(2);
+    reader = capture_reader_open(path);
+    CHECK(reader != NULL);
+    for (int i = 1; i <= 2; i++) {
+        char expected[128];
+
+        CHECK(capture_next(reader, &record) == 1);
+        snprintf(expected, sizeof(expected), REQUEST, i);
+        CHECK(record.kind == CAPTURE_IN);
+        CHECK_STR(record.topic, SESSION);
+        CHECK_STR(record.payload, expected);
+        CHECK(record.len == strlen(expected));
+        CHECK(record.n_props == 1);
+        CHECK_STR(record.props[0].key, "MCP-MQ");
+        CHECK_STR(record.props[0].value, "1.0.0");
+        CHECK(record.time_ns >= last);
+        last = record.time_ns;
+
+        CHECK(capture_next(reader, &record) == 1);
+        snprintf(expected, sizeof(expected), RESPONSE, i);
+        CHECK(record.kind == CAPTURE_OUT);
+        CHECK_STR(record.payload, expected);
+        CHECK(record.n_props == 0);
+    }
+    CHECK(capture_next(reader, &record) == 1);
+    CHECK_STR(record.payload, "{}");
+    CHECK(capture_next(reader, &record) == 0);
+    capture_reader_close(reader);
+
+    // a record cut short
+    CHECK(truncate(path, 160) == 0);
+    reader = capture_reader_open(path);
+    CHECK(capture_next(reader, &record) == 1);
+    CHECK(capture_next(reader, &record) == -1);
+    capture_reader_close(reader);
+
+    CHECK(truncate(path, 4) == 0);
+    CHECK(capture_reader_open(path) == NULL);
+}
+
+typedef struct {
+    replay_t *replay;
+    int       delivered;
+    int       answered;
+} server_t;
+
+/* Answers all but the requests with an odd id above 2. */
+static void deliver(void *ctx, char *topic, int topic_len,
+                    MQTTAsync_message *message)
+{
+    server_t *server = ctx;
+    char      response[128];
+    int       id;
+
+    CHECK((int) strlen(topic) == topic_len);
+    server->delivered++;
+    if (strcmp(topic, SESSION) != 0) {
+        return;
+    }
+    CHECK(message->properties.count == 1);
+    CHECK(sscanf(message->payload, "{\"jsonrpc\":\"2.0\",\"id\":%d", &id) == 1);
+    if (id > 2 && id % 2 == 1) {
+        return;
+    }
+    snprintf(response, sizeof(response), RESPONSE, id);
+    replay_published(server->replay, SESSION, response);
+    replay_published(server->replay, SESSION, response); // a duplicate
+    replay_published(server->replay, SESSION,
+                     "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/x\"}");
+    server->answered++;
+}
+
+static void test_replay(void)
+{
+    server_t           server = { .replay = replay_create() };
+    mcp_replay_stats_t stats;
+
+    write_capture(4);
+    CHECK(replay_run(server.replay, path, 0, deliver, &server, &stats) == 0);
+    CHECK(server.delivered == 5 && server.answered == 3);
+    CHECK(stats.messages == 5);
+    CHECK(stats.recorded.requests == 4 && stats.recorded.responses == 4);
+    CHECK(stats.replayed.requests == 4 && stats.replayed.responses == 3);
+    CHECK(stats.replayed.p50_ms >= 0);
+    CHECK(stats.replayed.max_ms >= stats.replayed.p99_ms);
+
+    // a second run starts over
+    write_capture(2);
+    CHECK(replay_run(server.replay, path, 1, deliver, &server, &stats) == 0);
+    CHECK(stats.replayed.requests == 2 && stats.replayed.responses == 2);
+
+    CHECK(replay_run(server.replay, "/nonexistent", 0, deliver, &server,
+                     &stats) == -1);
+    replay_destroy(server.replay);
+}
+
+int main(void)
+{
+    int fd = mkstemp(path);
+
+    close(fd);
+    test_records();
+    test_replay();
+    unlink(path);
+    return test_result();
+}
@@ -0,0 +1,111 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "catalog.h"
+#include "test.h"
+
+static property_t props[] = {
+    { .name = "a", .type = PROPERTY_STRING },
+};
+
+static mcp_tool_t tools[] = {
+    { .name = "add", .description = "adds", .property_count = 1,
+      .properties = props },
+    { .name = "sub", .description = "subtracts" },
+};
+
+static atomic_bool stop;
+
+/* Snapshots taken while the writer swaps them never change under us. */
+static void *reader(void *arg)
+{
+    catalog_t *catalog = arg;
+
+    while (!atomic_load(&stop)) {
+        catalog_snapshot_t *snapshot = catalog_acquire(catalog);
+        int                 n        = snapshot->n_tools;
+        for (int i = 0; i < n; i++) {
+            CHECK(catalog_find_tool(snapshot, snapshot->tools[i].name) ==
+                  &snapshot->tools[i]);
+        }
+        CHECK(snapshot->n_tools == n);
+        catalog_release(snapshot);
+    }
+    return NULL;
+}
+
+static void test_updates(void)
+{
+    catalog_t          *catalog = catalog_create();
+    catalog_snapshot_t *empty   = catalog_acquire(catalog);
+
+    CHECK(empty->n_tools == 0);
+    CHECK(catalog_find_tool(empty, "add") == NULL);
+
+    CHECK(catalog_set_tools(catalog, 2, tools) == 0);
+    catalog_snapshot_t *two = catalog_acquire(catalog);
+    CHECK(two->version > empty->version);
+    CHECK(two->n_tools == 2);
+    // copied, the caller's table may go away
+    mcp_tool_t *add = catalog_find_tool(two, "add");
+    CHECK(add != NULL && add != &tools[0]);
+    CHECK_STR(add ? add->description : NULL, "adds");
+    CHECK(add && add->properties != props);
+    CHECK_STR(add ? add->properties[0].name : NULL, "a");
+    // a snapshot held across an update keeps its contents
+    CHECK(empty->n_tools == 0);
+    catalog_release(empty);
+
+    mcp_tool_t mul = { .name = "mul", .description = "multiplies" };
+    CHECK(catalog_add_tool(catalog, &mul) == 0);
+    CHECK(catalog_add_tool(catalog, &mul) == -2);
+    CHECK(catalog_remove_tool(catalog, "sub") == 0);
+    CHECK(catalog_remove_tool(catalog, "sub") == -2);
+    CHECK(catalog_add_tool(catalog, NULL) == -1);
+
+    catalog_snapshot_t *now = catalog_acquire(catalog);
+    CHECK(now->n_tools == 2);
+    CHECK(catalog_find_tool(now, "mul") != NULL);
+    CHECK(catalog_find_tool(now, "sub") == NULL);
+    CHECK(catalog_find_tool(two, "sub") != NULL);
+    CHECK(now->version > two->version);
+    catalog_release(now);
+    catalog_release(two);
+
+    mcp_tool_t unnamed = { 0 };
+    CHECK(catalog_set_tools(catalog, 1, &unnamed) == -1);
+    CHECK(catalog_set_tools(catalog, -1, tools) == -1);
+    catalog_destroy(catalog);
+}
+
+static void test_concurrent_readers(void)
+{
+    catalog_t *catalog = catalog_create();
+    pthread_t  threads[4];
+
+    atomic_store(&stop, false);
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, reader, catalog);
+    }
+    for (int i = 0; i < 2000; i++) {
+        catalog_set_tools(catalog, 1 + i % 2, tools);
+        if (i % 3 == 0) {
+            mcp_tool_t extra = { .name = "extra" };
+            catalog_add_tool(catalog, &extra);
+        }
+    }
+    atomic_store(&stop, true);
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    catalog_destroy(catalog);
+}
+
+int main(void)
+{
+    test_updates();
+    test_concurrent_readers();
+    return test_result();
+}
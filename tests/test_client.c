@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cjson/cJSON.h"
+
+#include "jsonrpc.h"
+#include "mem.h"
+#include "pending.h"
+#include "test.h"
+
+static pending_t *pending_new(long long id)
+{
+    pending_t *pending = mem_calloc(1, sizeof(pending_t));
+    pending->id        = id;
+    return pending;
+}
+
+/* Enough requests outstanding that the table grows under them. */
+static void test_pending(void)
+{
+    pending_table_t *table = pending_table_create();
+
+    for (long long id = 1; id <= 1000; id++) {
+        pending_insert(table, pending_new(id));
+    }
+    for (long long id = 1000; id >= 1; id -= 2) {
+        pending_t *pending = pending_take(table, id);
+        CHECK(pending != NULL && pending->id == id);
+        mem_free(pending);
+    }
+    CHECK(pending_take(table, 1000) == NULL);
+    CHECK(pending_take(table, 1001) == NULL);
+    CHECK(pending_take(table, -1) == NULL);
+
+    int       n_left = 0;
+    long long sum    = 0;
+    for (pending_t *pending = pending_take_all(table); pending;) {
+        pending_t *next = pending->next;
+        CHECK(pending->id % 2 == 1);
+        sum += pending->id;
+        n_left++;
+        mem_free(pending);
+        pending = next;
+    }
+    CHECK(n_left == 500);
+    CHECK(sum == 500 * 500);
+    CHECK(pending_take_all(table) == NULL);
+
+    // whatever is still pending goes with the table
+    pending_insert(table, pending_new(7));
+    pending_table_destroy(table);
+}
+
+static void test_scan(void)
+{
+    jsonrpc_response_t response;
+    const char        *json;
+
+    json = "{\"jsonrpc\":\"2.0\",\"result\":{\"content\":[{\"text\":\"}\"}]},"
+           "\"id\":12} \n";
+    CHECK(jsonrpc_response_scan(json, strlen(json), &response) == 0);
+    CHECK(response.id == 12);
+    CHECK(response.method == NULL && response.error_code == 0);
+    CHECK(response.result_len == strlen("{\"content\":[{\"text\":\"}\"}]}"));
+    CHECK(response.result &&
+          strncmp(response.result, "{\"content\"", 10) == 0);
+    jsonrpc_response_free(&response);
+
+    json = "{\"jsonrpc\":\"2.0\",\"id\":3,\"error\":{\"code\":-32601,"
+           "\"message\":\"Method not found\"}}";
+    CHECK(jsonrpc_response_scan(json, strlen(json), &response) == 0);
+    CHECK(response.id == 3 && response.error_code == -32601);
+    CHECK_STR(response.error_message, "Method not found");
+    jsonrpc_response_free(&response);
+
+    json = "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/progress\","
+           "\"params\":{\"progress\":1}}";
+    CHECK(jsonrpc_response_scan(json, strlen(json), &response) == 0);
+    CHECK(response.id == -1);
+    CHECK(response.method_len == strlen("notifications/progress") &&
+          strncmp(response.method, "notifications/progress",
+                  response.method_len) == 0);
+    CHECK(response.result_len == strlen("{\"progress\":1}"));
+    jsonrpc_response_free(&response);
+
+    // ids the client never hands out are not mistaken for its own
+    json = "{\"id\":\"12\",\"result\":{}}";
+    CHECK(jsonrpc_response_scan(json, strlen(json), &response) == 0);
+    CHECK(response.id == -1);
+    jsonrpc_response_free(&response);
+
+    json = "{\"id\":1,\"result\":{}";
+    CHECK(jsonrpc_response_scan(json, strlen(json), &response) == -1);
+    CHECK(jsonrpc_response_scan("[]", 2, &response) == -1);
+    // only len bytes are read
+    CHECK(jsonrpc_response_scan("{\"id\":45}", 8, &response) == -1);
+}
+
+/* Calls are sent with their arguments as kwargs, as the server decodes them. */
+static void test_requests(void)
+{
+    jsonrpc_t *request =
+        jsonrpc_tool_call_request(5, "add", "{\"a\":1,\"b\":2}", 1500);
+    char      *json    = jsonrpc_encode(request);
+    cJSON     *root    = cJSON_Parse(json);
+    cJSON     *params  = cJSON_GetObjectItem(root, "params");
+
+    CHECK(cJSON_GetNumberValue(cJSON_GetObjectItem(root, "id")) == 5);
+    CHECK_STR(cJSON_GetStringValue(cJSON_GetObjectItem(root, "method")),
+              "tools/call");
+    CHECK_STR(cJSON_GetStringValue(cJSON_GetObjectItem(params, "name")),
+              "add");
+    cJSON *kwargs = cJSON_GetObjectItem(
+        cJSON_GetObjectItem(params, "arguments"), "kwargs");
+    CHECK(cJSON_GetNumberValue(cJSON_GetObjectItem(kwargs, "b")) == 2);
+    cJSON_Delete(root);
+    mem_free(json);
+}
+
+int main(void)
+{
+    test_pending();
+    test_scan();
+    test_requests();
+    return test_result();
+}
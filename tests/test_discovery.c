@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "discovery.h"
+#include "mem.h"
+#include "test.h"
+
+static mcp_server_info_t math1 = { .server_id = "id1", .server_name = "math" };
+static mcp_server_info_t math2 = { .server_id = "id2", .server_name = "math" };
+static mcp_server_info_t text  = { .server_id   = "id3",
+                                   .server_name = "text",
+                                   .description = "Text tools" };
+
+static char **names(int n, const char *const *list)
+{
+    char **copy = mem_calloc(n, sizeof(char *));
+
+    for (int i = 0; i < n; i++) {
+        copy[i] = mem_strdup(list[i]);
+    }
+    return copy;
+}
+
+static void test_servers(void)
+{
+    discovery_t *discovery = discovery_create();
+    char         id[8];
+
+    CHECK(discovery_find_server(discovery, "math", NULL, id, sizeof(id)) ==
+          -1);
+    CHECK(discovery_online(discovery, &math1));
+    CHECK(!discovery_online(discovery, &math1));
+    CHECK(discovery_online(discovery, &math2));
+    CHECK(discovery_online(discovery, &text));
+
+    CHECK(discovery_find_server(discovery, "math", "id2", id, sizeof(id)) ==
+          0);
+    CHECK_STR(id, "id2");
+    CHECK(discovery_find_server(discovery, "math", NULL, id, sizeof(id)) ==
+          0);
+    CHECK(strcmp(id, "id1") == 0 || strcmp(id, "id2") == 0);
+    CHECK(discovery_find_server(discovery, "math", "id3", id, sizeof(id)) ==
+          -1);
+    // a buffer too small is an error, not a truncated id
+    CHECK(discovery_find_server(discovery, "text", NULL, id, 3) == -1);
+
+    CHECK(discovery_offline(discovery, "id1", "math"));
+    CHECK(!discovery_offline(discovery, "id1", "math"));
+    CHECK(discovery_find_server(discovery, "math", NULL, id, sizeof(id)) ==
+          0);
+    CHECK_STR(id, "id2");
+    discovery_destroy(discovery);
+}
+
+static void test_tools(void)
+{
+    discovery_t *discovery = discovery_create();
+    const char  *first[]   = { "add", "sub" };
+    const char  *later[]   = { "mul" };
+    char         id[8], name[8];
+
+    discovery_online(discovery, &math1);
+    discovery_set_tools(discovery, "id1", "math", 2, names(2, first));
+    CHECK(discovery_find_tool(discovery, "sub", id, sizeof(id), name,
+                              sizeof(name)) == 0);
+    CHECK_STR(id, "id1");
+    CHECK_STR(name, "math");
+    CHECK(discovery_find_tool(discovery, "mul", id, sizeof(id), name,
+                              sizeof(name)) == -1);
+
+    // a new list replaces the old one
+    discovery_set_tools(discovery, "id1", "math", 1, names(1, later));
+    CHECK(discovery_find_tool(discovery, "add", id, sizeof(id), name,
+                              sizeof(name)) == -1);
+    CHECK(discovery_find_tool(discovery, "mul", id, sizeof(id), name,
+                              sizeof(name)) == 0);
+
+    // the tools of an unknown server are dropped
+    discovery_set_tools(discovery, "id9", "gone", 2, names(2, first));
+    CHECK(discovery_find_tool(discovery, "add", id, sizeof(id), name,
+                              sizeof(name)) == -1);
+
+    // and go away with their server
+    discovery_offline(discovery, "id1", "math");
+    CHECK(discovery_find_tool(discovery, "mul", id, sizeof(id), name,
+                              sizeof(name)) == -1);
+    discovery_destroy(discovery);
+}
+
+/* Many servers and tools, so the indexes grow. */
+static void test_many(void)
+{
+    discovery_t *discovery = discovery_create();
+    char         id[16], name[16], tool[16];
+
+    for (int i = 0; i < 300; i++) {
+        snprintf(id, sizeof(id), "id%d", i);
+        snprintf(name, sizeof(name), "server%d", i);
+        snprintf(tool, sizeof(tool), "tool%d", i);
+        mcp_server_info_t server  = { .server_id = id, .server_name = name };
+        const char       *tools[] = { tool };
+        discovery_online(discovery, &server);
+        discovery_set_tools(discovery, id, name, 1, names(1, tools));
+    }
+    for (int i = 0; i < 300; i++) {
+        char expected[16];
+        snprintf(tool, sizeof(tool), "tool%d", i);
+        snprintf(expected, sizeof(expected), "server%d", i);
+        CHECK(discovery_find_tool(discovery, tool, id, sizeof(id), name,
+                                  sizeof(name)) == 0);
+        CHECK_STR(name, expected);
+    }
+    discovery_destroy(discovery);
+}
+
+int main(void)
+{
+    test_servers();
+    test_tools();
+    test_many();
+    return test_result();
+}
@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mcp_json.h"
+#include "test.h"
+
+static const char *kernels[] = { "scalar", "sse4.2", "avx2" };
+
+static uint32_t seed = 12345;
+
+static uint32_t next_random(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+/* Escapes byte by byte, as the kernels must agree with. */
+static size_t escape_reference(char *out, const char *s, size_t len)
+{
+    char *o = out;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c     = (unsigned char) s[i];
+        const char   *named = NULL;
+
+        switch (c) {
+        case '"':
+            named = "\\\"";
+            break;
+        case '\\':
+            named = "\\\\";
+            break;
+        case '\b':
+            named = "\\b";
+            break;
+        case '\f':
+            named = "\\f";
+            break;
+        case '\n':
+            named = "\\n";
+            break;
+        case '\r':
+            named = "\\r";
+            break;
+        case '\t':
+            named = "\\t";
+            break;
+        }
+        if (named) {
+            o += sprintf(o, "%s", named);
+        } else if (c < 0x20) {
+            o += sprintf(o, "\\u%04x", c);
+        } else {
+            *o++ = (char) c;
+        }
+    }
+    return (size_t) (o - out);
+}
+
+/* Text with a few bytes to escape and multibyte sequences, valid or not. */
+static void random_text(char *s, size_t len, bool valid)
+{
+    static const char *pieces[] = { "\xc3\xa9", "\xe2\x80\x93",
+                                    "\xf0\x9f\x98\x80", "\"", "\\", "\n",
+                                    "\x01", "\x1f" };
+
+    size_t i = 0;
+
+    while (i < len) {
+        uint32_t r = next_random();
+        if (r % 16 == 0) {
+            const char *piece = pieces[(r >> 8) % 8];
+            size_t      n     = strlen(piece);
+            if (i + n > len) {
+                n = len - i; // a truncated sequence at the end
+            }
+            memcpy(s + i, piece, n);
+            i += n;
+        } else if (!valid && r % 61 == 1) {
+            s[i++] = (char) (0x80 | (r >> 8)); // a stray continuation byte
+        } else {
+            s[i++] = (char) (' ' + (r >> 8) % 95);
+        }
+    }
+}
+
+static void test_escape(const char *kernel)
+{
+    static char s[1100], out[6600], expected[6600];
+
+    for (int round = 0; round < 2000; round++) {
+        size_t len    = next_random() % 300;
+        size_t offset = next_random() % 64; // unaligned loads
+        random_text(s + offset, len, true);
+
+        size_t n = escape_reference(expected, s + offset, len);
+        CHECK(mcp_json_escaped_size(s + offset, len) == n);
+        CHECK(mcp_json_escape(out, s + offset, len) == n);
+        if (memcmp(out, expected, n) != 0) {
+            printf("%s: escape differs at round %d\n", kernel, round);
+            CHECK(0);
+            return;
+        }
+    }
+}
+
+static void test_utf8(const char *kernel)
+{
+    static char s[1100];
+
+    static const struct {
+        const char *text;
+        bool        valid;
+    } cases[] = {
+        { "plain ascii", true },
+        { "\xc3\xa9\xe2\x80\x93\xf0\x9f\x98\x80\xf4\x8f\xbf\xbf", true },
+        { "\xc0\xaf", false },         // overlong
+        { "\xe0\x80\xaf", false },     // overlong
+        { "\xed\xa0\x80", false },     // a surrogate
+        { "\xf4\x90\x80\x80", false }, // above U+10FFFF
+        { "\xe2\x80", false },         // cut short
+        { "abc\x80", false },
+        { "\xff", false },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        // at the start and behind a long ASCII run, so each path sees it
+        size_t len  = strlen(cases[i].text);
+        size_t head = 70;
+        memset(s, 'a', head);
+        memcpy(s + head, cases[i].text, len);
+        CHECK(mcp_json_valid_utf8(cases[i].text, len) == cases[i].valid);
+        CHECK(mcp_json_valid_utf8(s, head + len) == cases[i].valid);
+    }
+
+    // the kernels agree with the scalar one on anything
+    for (int round = 0; round < 2000; round++) {
+        size_t len = next_random() % 1000;
+        random_text(s, len, round % 2 == 0);
+        mcp_json_set_kernel("scalar");
+        bool expected = mcp_json_valid_utf8(s, len);
+        mcp_json_set_kernel(kernel);
+        if (mcp_json_valid_utf8(s, len) != expected) {
+            printf("%s: validation differs at round %d\n", kernel, round);
+            CHECK(0);
+            return;
+        }
+    }
+}
+
+int main(void)
+{
+    const char *chosen = mcp_json_kernel();
+
+    CHECK(mcp_json_set_kernel("mmx") == -1);
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (mcp_json_set_kernel(kernels[i]) != 0) {
+            printf("skipping %s, not supported here\n", kernels[i]);
+            continue;
+        }
+        CHECK_STR(mcp_json_kernel(), kernels[i]);
+        test_escape(kernels[i]);
+        test_utf8(kernels[i]);
+    }
+    mcp_json_set_kernel(chosen);
+    return test_result();
+}
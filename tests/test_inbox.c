@@ -0,0 +1,112 @@
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#include "inbox.h"
+#include "mem.h"
+#include "test.h"
+
+#define N_THREADS 4
+#define N_EVENTS  1000
+
+typedef struct {
+    inbox_t *inbox;
+    int      index;
+} poster_t;
+
+static bool readable(inbox_t *inbox, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = inbox_fd(inbox), .events = POLLIN };
+    return poll(&pfd, 1, timeout_ms) == 1 && (pfd.revents & POLLIN);
+}
+
+static inbox_event_t *event_new(int code)
+{
+    inbox_event_t *event = mem_calloc(1, sizeof(inbox_event_t));
+    event->kind          = INBOX_CONNECTED;
+    event->code          = code;
+    return event;
+}
+
+static void test_order(void)
+{
+    inbox_t *inbox = inbox_create();
+
+    CHECK(inbox_empty(inbox));
+    CHECK(inbox_take(inbox) == NULL);
+    CHECK(!readable(inbox, 0));
+
+    for (int i = 0; i < 3; i++) {
+        inbox_post(inbox, event_new(i));
+        CHECK(readable(inbox, 0));
+    }
+    CHECK(!inbox_empty(inbox));
+
+    inbox_event_t *event = inbox_take(inbox);
+    CHECK(!readable(inbox, 0)); // until more are posted
+    CHECK(inbox_empty(inbox));
+    for (int i = 0; i < 3; i++) {
+        CHECK(event != NULL && event->code == i);
+        inbox_event_t *next = event ? event->next : NULL;
+        if (event) {
+            inbox_event_free(event);
+        }
+        event = next;
+    }
+    CHECK(event == NULL);
+
+    // what was never taken goes with the inbox
+    inbox_post(inbox, event_new(0));
+    inbox_post(inbox, event_new(1));
+    inbox_destroy(inbox);
+}
+
+static void *post_events(void *arg)
+{
+    poster_t *poster = arg;
+
+    for (int i = 0; i < N_EVENTS; i++) {
+        inbox_post(poster->inbox, event_new(poster->index * N_EVENTS + i));
+    }
+    return NULL;
+}
+
+/* Events of each thread arrive in the order it posted them, none lost. */
+static void test_threads(void)
+{
+    inbox_t  *inbox = inbox_create();
+    poster_t  posters[N_THREADS];
+    pthread_t threads[N_THREADS];
+    int       next[N_THREADS] = { 0 };
+    int       n_taken         = 0;
+
+    for (int i = 0; i < N_THREADS; i++) {
+        posters[i] = (poster_t) { .inbox = inbox, .index = i };
+        pthread_create(&threads[i], NULL, post_events, &posters[i]);
+    }
+    while (n_taken < N_THREADS * N_EVENTS && readable(inbox, 1000)) {
+        inbox_event_t *event = inbox_take(inbox);
+        while (event) {
+            inbox_event_t *following = event->next;
+            int            thread    = event->code / N_EVENTS;
+            CHECK(event->code % N_EVENTS == next[thread]);
+            next[thread]++;
+            n_taken++;
+            inbox_event_free(event);
+            event = following;
+        }
+    }
+    for (int i = 0; i < N_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    CHECK(n_taken == N_THREADS * N_EVENTS);
+    CHECK(inbox_empty(inbox));
+    inbox_destroy(inbox);
+}
+
+int main(void)
+{
+    test_order();
+    test_threads();
+    return test_result();
+}
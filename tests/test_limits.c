@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "jsonrpc.h"
+#include "mcp_json.h"
+#include "mcp_server.h"
+#include "test.h"
+
+#define SESSION "$mcp-rpc/client0/srv/math"
+
+static char input[]  = "/tmp/mcp-limits-in-XXXXXX";
+static char output[] = "/tmp/mcp-limits-out-XXXXXX";
+
+static const char *add(int n_args, property_t *args)
+{
+    static char sum[32];
+
+    CHECK(n_args == 2);
+    snprintf(sum, sizeof(sum), "%lld",
+             args[0].value.integer_value + args[1].value.integer_value);
+    return sum;
+}
+
+static property_t operands[] = {
+    { .name = "a", .type = PROPERTY_INTEGER },
+    { .name = "b", .type = PROPERTY_INTEGER },
+};
+
+static mcp_tool_t tool = {
+    .name           = "add",
+    .call           = add,
+    .property_count = 2,
+    .properties     = operands,
+};
+
+static void test_depth(void)
+{
+    const char *nested = "{\"a\":[[1],{\"b\":[]}]}";
+
+    CHECK(mcp_json_depth_within(nested, strlen(nested), 4));
+    CHECK(!mcp_json_depth_within(nested, strlen(nested), 3));
+    // brackets in strings do not count, escaped quotes do not end them
+    const char *quoted = "[\"[[[\\\"[[\"]";
+    CHECK(mcp_json_depth_within(quoted, strlen(quoted), 1));
+    // only len bytes are scanned
+    CHECK(mcp_json_depth_within("[[[", 1, 1));
+    CHECK(!mcp_json_depth_within("[[[", 2, 1));
+}
+
+/* What a decode costs is counted, and given back with the tree. */
+static void test_accounting(void)
+{
+    const char *request = "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":"
+                          "\"tools/call\",\"params\":{\"name\":\"add\","
+                          "\"arguments\":{\"kwargs\":{\"a\":1,\"b\":2}}}}";
+    size_t      in_use, peak, before;
+
+    jsonrpc_track_memory();
+    jsonrpc_memory_usage(&before, &peak);
+    size_t     allocated = jsonrpc_memory_allocated();
+    jsonrpc_t *jsonrpc   = jsonrpc_decode(request, strlen(request));
+    CHECK(jsonrpc != NULL);
+    CHECK(jsonrpc_memory_allocated() > allocated);
+    jsonrpc_memory_usage(&in_use, &peak);
+    CHECK(in_use > before);
+    CHECK(peak >= in_use);
+    jsonrpc_decode_free(jsonrpc);
+    jsonrpc_memory_usage(&in_use, &peak);
+    CHECK(in_use == before);
+}
+
+static void add_property(MQTTProperties *props, char *key, char *value)
+{
+    MQTTProperty property = {
+        .identifier  = MQTTPROPERTY_CODE_USER_PROPERTY,
+        .value.data  = { .len = (int) strlen(key), .data = key },
+        .value.value = { .len = (int) strlen(value), .data = value },
+    };
+    MQTTProperties_add(props, &property);
+}
+
+static void write_input(void)
+{
+    capture_t *capture = capture_open(input);
+    char       client_id[16], payload[1024];
+    int        len;
+
+    for (int i = 0; i < 3; i++) {
+        MQTTProperties props = MQTTProperties_initializer;
+        snprintf(client_id, sizeof(client_id), "client%d", i);
+        add_property(&props, "MCP-MQTT-CLIENT-ID", client_id);
+        len = snprintf(payload, sizeof(payload),
+                       "{\"jsonrpc\":\"2.0\",\"id\":%d,"
+                       "\"method\":\"initialize\"}",
+                       i);
+        capture_message(capture, CAPTURE_IN, "$mcp-server/srv/math", payload,
+                        len, &props);
+        MQTTProperties_free(&props);
+    }
+
+    const char *calls[] = {
+        "{\"a\":1,\"b\":2,\"c\":3}",
+        "{\"a\":1,\"b\":2,\"pad\":\"%600s\"}",
+        "{\"a\":1,\"b\":[[[[[[[[[]]]]]]]]]}",
+        "{\"a\":1,\"b\":2}",
+    };
+    for (int i = 0; i < 4; i++) {
+        char kwargs[700];
+        snprintf(kwargs, sizeof(kwargs), calls[i], "");
+        len = snprintf(payload, sizeof(payload),
+                       "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":"
+                       "\"tools/call\",\"params\":{\"name\":\"add\","
+                       "\"arguments\":{\"kwargs\":%s}}}",
+                       i + 1, kwargs);
+        capture_message(capture, CAPTURE_IN, SESSION, payload, len, NULL);
+    }
+    capture_close(capture);
+}
+
+/* The responses the server published on topic, in order. */
+static int read_responses(const char *topic, char responses[][256], int max)
+{
+    capture_reader_t *reader = capture_reader_open(output);
+    capture_record_t  record;
+    int               n = 0;
+
+    while (capture_next(reader, &record) == 1) {
+        if (record.kind == CAPTURE_OUT && strcmp(record.topic, topic) == 0 &&
+            n < max) {
+            snprintf(responses[n++], 256, "%s", record.payload);
+        }
+    }
+    capture_reader_close(reader);
+    return n;
+}
+
+static mcp_server_t *server_new(const mcp_limits_t *limits)
+{
+    mcp_server_t *server =
+        mcp_server_init("math", "Math tools", "tcp://localhost:1883", "srv",
+                        NULL, NULL, NULL);
+
+    mcp_server_register_tool(server, 1, &tool);
+    CHECK(mcp_server_set_limits(server, limits) == 0);
+    CHECK(mcp_server_set_capture(server, output) == 0);
+    return server;
+}
+
+static void test_limits(void)
+{
+    mcp_limits_t       limits = { .max_payload   = 512,
+                                  .max_depth     = 8,
+                                  .max_arguments = 2,
+                                  .max_sessions  = 2 };
+    mcp_limits_t       bad    = { .max_depth = -1 };
+    mcp_server_t      *server = server_new(&limits);
+    mcp_replay_stats_t replay;
+    mcp_memory_stats_t stats;
+    char               responses[8][256];
+
+    CHECK(mcp_server_set_limits(server, &bad) == -1);
+    CHECK(mcp_server_replay(server, input, 0, &replay) == 0);
+    CHECK(replay.replayed.responses == 4);
+    mcp_server_memory_stats(server, &stats);
+    CHECK(stats.rejected == 4);
+    CHECK(stats.in_flight == 0); // given back once answered
+    CHECK(stats.in_flight_peak > 0);
+    CHECK(stats.json_peak > 0);
+    // limits are set before the server runs
+    CHECK(mcp_server_set_limits(server, &limits) == -1);
+    mcp_server_close(server);
+
+    CHECK(read_responses("$mcp-rpc/client2/srv/math", responses, 8) == 1);
+    CHECK(strstr(responses[0], "Too many sessions") != NULL);
+    CHECK(read_responses(SESSION, responses, 8) == 5);
+    CHECK(strstr(responses[0], "\"protocolVersion\"") != NULL);
+    CHECK(strstr(responses[1], "Too many arguments") != NULL);
+    CHECK(strstr(responses[2], "Request too large") != NULL);
+    CHECK(strstr(responses[3], "Request nested too deeply") != NULL);
+    CHECK(strstr(responses[4], "\"3\"") != NULL);
+    CHECK(strstr(responses[4], "\"id\":4") != NULL);
+}
+
+/* Requests that would take the budget past its size are turned away. */
+static void test_budget(void)
+{
+    mcp_limits_t       limits = { .max_in_flight = 64 };
+    mcp_server_t      *server = server_new(&limits);
+    mcp_replay_stats_t replay;
+    mcp_memory_stats_t stats;
+    char               responses[8][256];
+
+    CHECK(mcp_server_replay(server, input, 0, &replay) == 0);
+    mcp_server_memory_stats(server, &stats);
+    CHECK(stats.rejected == 4);
+    CHECK(stats.in_flight == 0);
+    mcp_server_close(server);
+
+    // the initialize requests are small enough
+    CHECK(read_responses(SESSION, responses, 8) == 5);
+    CHECK(strstr(responses[0], "\"protocolVersion\"") != NULL);
+    for (int i = 1; i < 5; i++) {
+        CHECK(strstr(responses[i], "Memory budget exceeded") != NULL);
+    }
+}
+
+/* A session topic past 256 bytes is refused on the whole topic. */
+static void test_long_client_id(void)
+{
+    capture_t         *capture = capture_open(input);
+    MQTTProperties     props   = MQTTProperties_initializer;
+    mcp_limits_t       limits  = { 0 };
+    mcp_replay_stats_t replay;
+    char               client_id[241], topic[300], responses[2][256];
+    const char        *request = "{\"jsonrpc\":\"2.0\",\"id\":1,"
+                                 "\"method\":\"initialize\"}";
+
+    memset(client_id, 'c', sizeof(client_id) - 1);
+    client_id[sizeof(client_id) - 1] = '\0';
+    add_property(&props, "MCP-MQTT-CLIENT-ID", client_id);
+    capture_message(capture, CAPTURE_IN, "$mcp-server/srv/math", request,
+                    strlen(request), &props);
+    MQTTProperties_free(&props);
+    capture_close(capture);
+
+    mcp_server_t *server = server_new(&limits);
+    CHECK(mcp_server_replay(server, input, 0, &replay) == 0);
+    mcp_server_close(server);
+
+    snprintf(topic, sizeof(topic), "$mcp-rpc/%s/srv/math", client_id);
+    CHECK(read_responses(topic, responses, 2) == 1);
+    CHECK(strstr(responses[0], "Client id too long") != NULL);
+}
+
+int main(void)
+{
+    close(mkstemp(input));
+    close(mkstemp(output));
+    test_depth();
+    test_accounting();
+    write_input();
+    test_limits();
+    test_budget();
+    test_long_client_id();
+    unlink(input);
+    unlink(output);
+    return test_result();
+}
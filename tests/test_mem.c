@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "catalog.h"
+#include "jsonrpc.h"
+#include "mem.h"
+#include "rbac.h"
+#include "result.h"
+#include "test.h"
+#include "trace.h"
+
+#ifndef MCP_STATIC_MEMORY
+#error "built with MCP_STATIC_MEMORY only"
+#endif
+
+static size_t pool_used(void)
+{
+    size_t    used, capacity;
+    long long exhausted;
+
+    mem_stats(&used, &capacity, &exhausted);
+    return used;
+}
+
+static long long pool_exhausted(void)
+{
+    size_t    used, capacity;
+    long long exhausted;
+
+    mem_stats(&used, &capacity, &exhausted);
+    return exhausted;
+}
+
+static void test_blocks(void)
+{
+    size_t used = pool_used();
+
+    // rounded up to the next power of two from 32 bytes
+    char *small = mem_alloc(1);
+    char *block = mem_alloc(100);
+    CHECK(mem_size(small) == 32);
+    CHECK(mem_size(block) == 128);
+    CHECK(pool_used() == used + 32 + 128);
+
+    // a block freed is the next one handed out
+    mem_free(block);
+    CHECK(mem_alloc(65) == block);
+
+    // shrinking by less than half keeps the block, growing moves it
+    memcpy(block, "abc", 4);
+    CHECK(mem_realloc(block, 80) == block);
+    char *grown = mem_realloc(block, 1000);
+    CHECK(grown != block && mem_size(grown) == 1024);
+    CHECK_STR(grown, "abc");
+
+    char *copy = mem_strndup("abcdef", 3);
+    CHECK_STR(copy, "abc");
+
+    long long exhausted = pool_exhausted();
+    CHECK(mem_alloc(MCP_STATIC_MAX_BLOCK + 1) == NULL);
+    CHECK(pool_exhausted() == exhausted + 1);
+
+    // blocks of the C heap are freed where they came from
+    mem_free(malloc(16));
+    mem_free(NULL);
+
+    mem_free(small);
+    mem_free(grown);
+    mem_free(copy);
+    CHECK(pool_used() == used);
+}
+
+/* A pool that ran out lends from the larger ones, then NULL comes back. */
+static void test_exhaustion(void)
+{
+    size_t    used, capacity;
+    long long exhausted;
+    void    **blocks;
+    int       n = 0, n_larger = 0;
+
+    mem_stats(&used, &capacity, &exhausted);
+    blocks = malloc(capacity / 2048 * sizeof(void *));
+    CHECK(mem_headroom());
+    for (;;) {
+        void *p = mem_alloc(2048);
+        if (p == NULL) {
+            break;
+        }
+        n_larger += mem_size(p) > 2048;
+        blocks[n++] = p;
+    }
+    CHECK(n > 0 && n_larger > 0);
+    CHECK(!mem_headroom());
+    CHECK(pool_exhausted() == exhausted + 1);
+    void *small = mem_alloc(32); // smaller pools are left alone
+    CHECK(small != NULL && mem_size(small) == 32);
+    mem_free(small);
+
+    while (n > 0) {
+        mem_free(blocks[--n]);
+    }
+    free(blocks);
+    CHECK(mem_headroom());
+    CHECK(pool_used() == used);
+}
+
+/* Decoding and answering a request gives back every block it took. */
+static void test_request(void)
+{
+    const char *request = "{\"jsonrpc\":\"2.0\",\"id\":7,\"method\":"
+                          "\"tools/call\",\"params\":{\"name\":\"add\","
+                          "\"arguments\":{\"kwargs\":{\"a\":1,\"b\":2}}}}";
+    size_t      used    = pool_used();
+
+    jsonrpc_track_memory(); // cJSON allocates from the pools as well
+    jsonrpc_t *jsonrpc = jsonrpc_decode(request, strlen(request));
+    CHECK(jsonrpc != NULL);
+    CHECK(pool_used() > used);
+    char *response = jsonrpc_encode(
+        jsonrpc_error_response(jsonrpc_get_id(jsonrpc), -32601, "No such"));
+    CHECK(response != NULL);
+    mem_free(response);
+    jsonrpc_decode_free(jsonrpc);
+    CHECK(pool_used() == used);
+}
+
+/* A result past the largest block is answered with an error instead. */
+static void test_result_overflow(void)
+{
+    static char   chunk[1024];
+    jsonrpc_id_t *id = jsonrpc_id_scan("{\"id\":7}", 8);
+    mcp_result_t  result;
+    int           ret = 0;
+
+    memset(chunk, 'x', sizeof(chunk));
+    result_init(&result, id);
+    for (int i = 0; i < MCP_STATIC_MAX_BLOCK / 1024 + 1 && ret == 0; i++) {
+        ret = mcp_result_write(&result, chunk, sizeof(chunk));
+    }
+    CHECK(ret == -1);
+    CHECK_STR(result_finish(&result),
+              "{\"jsonrpc\":\"2.0\",\"id\":7,\"error\":{\"code\":-32006,"
+              "\"message\":\"Result too large\"}}");
+    result_release(&result);
+
+    // one that fits is written out whole
+    result_init(&result, id);
+    CHECK(mcp_result_write(&result, chunk, 100) == 0);
+    CHECK(strstr(result_finish(&result), "\"result\"") != NULL);
+    result_release(&result);
+    jsonrpc_id_free(id);
+}
+
+static int n_exported;
+
+static void count_spans(void *ctx, int n, const mcp_span_t *spans)
+{
+    (void) ctx;
+    (void) spans;
+    n_exported += n;
+}
+
+/* The span ring of the recorder fits in the pools. */
+static void test_trace(void)
+{
+    trace_t         *trace   = trace_create(1, count_spans, NULL);
+    trace_request_t *request = trace_begin(trace, NULL, 1);
+
+    CHECK(trace != NULL && request != NULL);
+    trace_span(request, "decode", 1, 2);
+    trace_end(request, 3);
+    trace_destroy(trace);
+    CHECK(n_exported == 2);
+}
+
+/* A tool the pools cannot copy leaves the published catalog as it was. */
+static void test_catalog(void)
+{
+    static char description[MCP_STATIC_MAX_BLOCK + 1];
+    catalog_t  *catalog = catalog_create();
+    mcp_tool_t  tool    = { .name = "add" };
+    property_t  args[]  = {
+        { .name = "a", .type = PROPERTY_INTEGER },
+        { .name = "b", .description = description },
+    };
+
+    memset(description, 'x', sizeof(description) - 1);
+    CHECK(catalog_add_tool(catalog, &tool) == 0);
+    CHECK(catalog_add_tool(catalog, &tool) == -2); // its index is built now
+    size_t used = pool_used();
+
+    mcp_tool_t big = { .name = "big", .description = description };
+    CHECK(catalog_add_tool(catalog, &big) == -1);
+    // and one that fails deep in its properties
+    mcp_tool_t nested = { .name = "nested", .property_count = 2,
+                          .properties = args };
+    CHECK(catalog_set_tools(catalog, 1, &nested) == -1);
+    CHECK(pool_used() == used);
+
+    catalog_snapshot_t *snapshot = catalog_acquire(catalog);
+    CHECK(snapshot->n_tools == 1);
+    CHECK(catalog_find_tool(snapshot, "add") != NULL);
+    catalog_release(snapshot);
+    catalog_destroy(catalog);
+}
+
+/* Roles the pools cannot copy are refused whole. */
+static void test_rbac(void)
+{
+    static char     pattern[MCP_STATIC_MAX_BLOCK + 1];
+    char           *tools[] = { "add", pattern };
+    mcp_mqtt_role_t roles[] = {
+        { .name = "user" },
+        { .name = "admin", .n_allowed_tools = 2, .allowed_tools = tools },
+    };
+    size_t used = pool_used();
+
+    memset(pattern, '*', sizeof(pattern) - 1);
+    CHECK(rbac_create(2, roles) == NULL);
+    CHECK(pool_used() == used);
+    roles[1].n_allowed_tools = 1; // without the pattern they fit
+
+    rbac_t *rbac = rbac_create(2, roles);
+    CHECK(rbac != NULL);
+    rbac_release(rbac);
+    CHECK(pool_used() == used);
+}
+
+int main(void)
+{
+    test_blocks();
+    test_exhaustion();
+    test_request();
+    test_result_overflow();
+    test_trace();
+    test_catalog();
+    test_rbac();
+    return test_result();
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mem.h"
+#include "memo.h"
+#include "test.h"
+
+static mcp_tool_t square = { .name = "square", .pure = true };
+static mcp_tool_t cube   = { .name = "cube", .pure = true };
+
+static jsonrpc_id_t *id_of(int n)
+{
+    char request[32];
+    int  len = snprintf(request, sizeof(request), "{\"id\":%d}", n);
+    return jsonrpc_id_scan(request, len);
+}
+
+static void key_of(memo_key_t *key, mcp_tool_t *tool, long long x)
+{
+    property_t arg = { .name    = "x",
+                       .type    = PROPERTY_INTEGER,
+                       .present = true,
+                       .value   = { .integer_value = x } };
+    memo_key_build(key, tool, 1, &arg, NULL);
+}
+
+static bool same_key(const memo_key_t *a, const memo_key_t *b)
+{
+    return a->hash == b->hash && a->len == b->len &&
+           memcmp(a->data, b->data, a->len) == 0;
+}
+
+/* The canonical arguments of a tools/call written with kwargs. */
+static char *canonical(const char *kwargs)
+{
+    char request[256];
+    int  len = snprintf(request, sizeof(request),
+                        "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":"
+                        "\"tools/call\",\"params\":{\"name\":\"cube\","
+                        "\"arguments\":{\"kwargs\":%s}}}",
+                        kwargs);
+
+    jsonrpc_t *jsonrpc   = jsonrpc_decode(request, len);
+    char      *arguments = jsonrpc_tool_call_canonical_arguments(jsonrpc);
+    jsonrpc_decode_free(jsonrpc);
+    return arguments;
+}
+
+static void test_keys(void)
+{
+    memo_key_t a, b, c, d;
+
+    key_of(&a, &square, 3);
+    key_of(&b, &square, 3);
+    key_of(&c, &square, 4);
+    key_of(&d, &cube, 3);
+    CHECK(same_key(&a, &b));
+    CHECK(!same_key(&a, &c));
+    CHECK(!same_key(&a, &d));
+    memo_key_free(&a);
+    memo_key_free(&b);
+    memo_key_free(&c);
+    memo_key_free(&d);
+
+    // JSON tools: member order and spacing do not matter, values do
+    char *one   = canonical("{\"b\":{\"y\":1,\"x\":[1, 2]},\"a\":\"s\"}");
+    char *two   = canonical("{ \"a\" : \"s\", \"b\" : {\"x\":[1,2],\"y\":1}}");
+    char *other = canonical("{\"a\":\"s\",\"b\":{\"x\":[2,1],\"y\":1}}");
+    CHECK_STR(one, two);
+    CHECK(one && other && strcmp(one, other) != 0);
+    memo_key_build(&a, &cube, 0, NULL, one);
+    memo_key_build(&b, &cube, 0, NULL, two);
+    CHECK(same_key(&a, &b));
+    memo_key_free(&a);
+    memo_key_free(&b);
+    mem_free(one);
+    mem_free(two);
+    mem_free(other);
+}
+
+static void test_cache(void)
+{
+    memo_cache_t *cache = memo_cache_create(64);
+    jsonrpc_id_t *first = id_of(1);
+    jsonrpc_id_t *later = id_of(22);
+    memo_key_t    key;
+    long long     hits, misses;
+
+    key_of(&key, &square, 3);
+    CHECK(memo_cache_lookup(cache, &key, first) == NULL);
+    memo_cache_store(cache, &key, first,
+                     "{\"jsonrpc\":\"2.0\",\"id\":1,\"result\":{\"v\":9}}", 0);
+    memo_key_free(&key);
+
+    // the stored result answers another request under its own id
+    key_of(&key, &square, 3);
+    char *response = memo_cache_lookup(cache, &key, later);
+    CHECK_STR(response, "{\"jsonrpc\":\"2.0\",\"id\":22,\"result\":{\"v\":9}}");
+    mem_free(response);
+    memo_key_free(&key);
+
+    // a result looked up before a clear is not kept, the tool may have changed
+    key_of(&key, &square, 4);
+    CHECK(memo_cache_lookup(cache, &key, first) == NULL);
+    memo_cache_clear(cache);
+    memo_cache_store(cache, &key, first,
+                     "{\"jsonrpc\":\"2.0\",\"id\":1,\"result\":{}}", 0);
+    CHECK(memo_cache_lookup(cache, &key, first) == NULL);
+    memo_key_free(&key);
+    key_of(&key, &square, 3);
+    CHECK(memo_cache_lookup(cache, &key, first) == NULL);
+    memo_key_free(&key);
+
+    memo_cache_stats(cache, &hits, &misses);
+    CHECK(hits == 1 && misses == 4);
+
+    jsonrpc_id_free(first);
+    jsonrpc_id_free(later);
+    memo_cache_destroy(cache);
+}
+
+static void test_expiry(void)
+{
+    memo_cache_t *cache = memo_cache_create(64);
+    jsonrpc_id_t *id    = id_of(1);
+    memo_key_t    key;
+
+    key_of(&key, &square, 5);
+    CHECK(memo_cache_lookup(cache, &key, id) == NULL);
+    memo_cache_store(cache, &key, id,
+                     "{\"jsonrpc\":\"2.0\",\"id\":1,\"result\":{}}", 20);
+    char *response = memo_cache_lookup(cache, &key, id);
+    CHECK(response != NULL);
+    mem_free(response);
+    usleep(40 * 1000);
+    CHECK(memo_cache_lookup(cache, &key, id) == NULL);
+    memo_key_free(&key);
+
+    jsonrpc_id_free(id);
+    memo_cache_destroy(cache);
+}
+
+int main(void)
+{
+    test_keys();
+    test_cache();
+    test_expiry();
+    return test_result();
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "catalog.h"
+#include "mem.h"
+#include "test.h"
+
+static char       names[12][8];
+static mcp_tool_t tools[12];
+
+static void tools_init(void)
+{
+    for (int i = 0; i < 12; i++) {
+        snprintf(names[i], sizeof(names[i]), "t%02d", i);
+        tools[i] = (mcp_tool_t) { .name = names[i] };
+    }
+}
+
+/* Which of the tools a page lists, as a bitmask. */
+static int page_tools(const catalog_page_t *page)
+{
+    int seen = 0;
+
+    for (int i = 0; i < 12; i++) {
+        if (strstr(page->items, names[i]) != NULL) {
+            seen |= 1 << i;
+        }
+    }
+    return seen;
+}
+
+static void test_walk(void)
+{
+    catalog_t     *catalog = catalog_create();
+    catalog_page_t page;
+    int            seen    = 0;
+    int            n_pages = 0;
+    char          *cursor  = NULL;
+
+    catalog_set_tools(catalog, 10, tools);
+    catalog_set_page_size(catalog, 3);
+    catalog_snapshot_t *snapshot = catalog_acquire(catalog);
+    do {
+        CHECK(catalog_list_page(snapshot, CATALOG_TOOLS, -1, cursor, &page) ==
+              0);
+        int on_page = page_tools(&page);
+        CHECK((seen & on_page) == 0);
+        seen |= on_page;
+        n_pages++;
+        mem_free(cursor);
+        cursor           = page.next_cursor;
+        page.next_cursor = NULL;
+        catalog_page_free(&page);
+    } while (cursor != NULL && n_pages < 10);
+    CHECK(n_pages == 4);
+    CHECK(seen == 0x3ff);
+    catalog_release(snapshot);
+
+    // a page size of 0 lists everything at once
+    catalog_set_page_size(catalog, 0);
+    snapshot = catalog_acquire(catalog);
+    CHECK(catalog_list_page(snapshot, CATALOG_TOOLS, -1, NULL, &page) == 0);
+    CHECK(page_tools(&page) == 0x3ff);
+    CHECK(page.next_cursor == NULL);
+    catalog_page_free(&page);
+    catalog_release(snapshot);
+    CHECK(catalog_set_page_size(catalog, -1) == -1);
+    catalog_destroy(catalog);
+}
+
+/* A cursor from before an update resumes at the entry it named. */
+static void test_resume(void)
+{
+    catalog_t     *catalog = catalog_create();
+    catalog_page_t page;
+
+    catalog_set_tools(catalog, 10, tools);
+    catalog_set_page_size(catalog, 3);
+    catalog_snapshot_t *old = catalog_acquire(catalog);
+    CHECK(catalog_list_page(old, CATALOG_TOOLS, -1, NULL, &page) == 0);
+    CHECK(page_tools(&page) == 0x7);
+    char *cursor     = page.next_cursor;
+    page.next_cursor = NULL;
+    catalog_page_free(&page);
+    catalog_release(old);
+
+    // t00 and t01 go away, t03 moves to the front
+    catalog_set_tools(catalog, 10, &tools[2]);
+    catalog_snapshot_t *now = catalog_acquire(catalog);
+    CHECK(catalog_list_page(now, CATALOG_TOOLS, -1, cursor, &page) == 0);
+    CHECK(page_tools(&page) == 0x38);
+    catalog_page_free(&page);
+
+    // cursors the catalog never issued are rejected
+    CHECK(catalog_list_page(now, CATALOG_TOOLS, -1, "not a cursor", &page) ==
+          -1);
+    CHECK(catalog_list_page(now, CATALOG_TOOLS, -1, "", &page) == -1);
+    mem_free(cursor);
+    catalog_release(now);
+    catalog_destroy(catalog);
+}
+
+int main(void)
+{
+    tools_init();
+    test_walk();
+    test_resume();
+    return test_result();
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cjson/cJSON.h"
+
+#include "call.h"
+#include "mem.h"
+#include "test.h"
+
+static mcp_tool_t tool = { .name = "long" };
+
+static cJSON *sent[16]; // the notifications, parsed
+static int    n_sent;
+static int    after_finish;
+
+static void execute(void *ctx, mcp_call_t *call)
+{
+    (void) ctx;
+    CHECK(mcp_call_current() == call);
+    mcp_call_progress(call, 1, 4, "one");
+    mcp_call_partial(call, "ab");
+    mcp_call_progress(call, 2, 4, NULL);
+    mcp_call_partial(call, "cd");
+    mcp_call_progress(call, 3, 0, "three");
+    call_flush(call);
+    if (call_finish(call)) {
+        after_finish = mcp_call_progress(call, 4, 4, NULL);
+    }
+}
+
+static void abort_call(void *ctx, mcp_call_t *call, call_abort_reason_e reason)
+{
+    (void) ctx;
+    (void) call;
+    (void) reason;
+    CHECK(0);
+}
+
+static void notify(void *ctx, const mcp_call_t *call, const char *notification)
+{
+    (void) ctx;
+    CHECK_STR(call->topic, "c/1");
+    if (n_sent < 16) {
+        sent[n_sent++] = cJSON_Parse(notification);
+    }
+}
+
+static void sent_clear(void)
+{
+    for (int i = 0; i < n_sent; i++) {
+        cJSON_Delete(sent[i]);
+    }
+    n_sent = 0;
+}
+
+/* Runs the tool for a client that asked for progress every interval_ms. */
+static void run(const char *token, int interval_ms)
+{
+    catalog_t    *catalog = catalog_create();
+    call_pool_t  *pool    = call_pool_create(0, execute, abort_call, notify,
+                                             NULL);
+    jsonrpc_id_t *id      = jsonrpc_id_scan("{\"id\":1}", 8);
+    int64_t       next;
+
+    sent_clear();
+    after_finish = 0;
+
+    mcp_call_t *call = call_create("c/1", id, catalog_acquire(catalog), &tool,
+                                   0, NULL, NULL, 0);
+    call->progress_token       = token ? mem_strdup(token) : NULL;
+    call->progress_interval_ms = interval_ms;
+    CHECK(call_pool_submit(pool, call) == 0);
+    CHECK(call_pool_run(pool, &next) == 1);
+    CHECK(after_finish == -1);
+
+    jsonrpc_id_free(id);
+    call_pool_destroy(pool);
+    catalog_destroy(catalog);
+}
+
+static cJSON *params_of(int i)
+{
+    return cJSON_GetObjectItem(i < n_sent ? sent[i] : NULL, "params");
+}
+
+static const char *method_of(int i)
+{
+    return cJSON_GetStringValue(
+        cJSON_GetObjectItem(i < n_sent ? sent[i] : NULL, "method"));
+}
+
+static const char *partial_of(int i)
+{
+    cJSON *content = cJSON_GetObjectItem(params_of(i), "content");
+    return cJSON_GetStringValue(
+        cJSON_GetObjectItem(cJSON_GetArrayItem(content, 0), "text"));
+}
+
+static void test_every_report(void)
+{
+    run("\"tok\"", 0);
+    CHECK(n_sent == 5);
+    CHECK_STR(method_of(0), "notifications/progress");
+    cJSON *params = params_of(0);
+    CHECK_STR(cJSON_GetStringValue(cJSON_GetObjectItem(params,
+                                                       "progressToken")),
+              "tok");
+    CHECK(cJSON_GetNumberValue(cJSON_GetObjectItem(params, "progress")) == 1);
+    CHECK(cJSON_GetNumberValue(cJSON_GetObjectItem(params, "total")) == 4);
+    CHECK_STR(cJSON_GetStringValue(cJSON_GetObjectItem(params, "message")),
+              "one");
+    CHECK_STR(method_of(1), "notifications/tools/partial");
+    CHECK_STR(partial_of(1), "ab");
+    CHECK_STR(partial_of(3), "cd");
+    // an unknown total is left out
+    CHECK(cJSON_GetObjectItem(params_of(4), "total") == NULL);
+}
+
+/* Reports within the interval are coalesced, flushing sends the content. */
+static void test_coalesced(void)
+{
+    run("7", 60000);
+    CHECK(n_sent == 2);
+    CHECK_STR(method_of(0), "notifications/progress");
+    CHECK(cJSON_GetNumberValue(
+              cJSON_GetObjectItem(params_of(0), "progressToken")) == 7);
+    CHECK_STR(method_of(1), "notifications/tools/partial");
+    CHECK_STR(partial_of(1), "abcd");
+}
+
+static void test_not_asked(void)
+{
+    run(NULL, 0);
+    CHECK(n_sent == 0);
+    CHECK(mcp_call_progress(NULL, 1, 1, NULL) == -1);
+    CHECK(mcp_call_partial(NULL, "x") == -1);
+    CHECK(mcp_call_current() == NULL);
+}
+
+int main(void)
+{
+    test_every_report();
+    test_coalesced();
+    test_not_asked();
+    sent_clear();
+    return test_result();
+}
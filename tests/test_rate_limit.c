@@ -0,0 +1,91 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "rate_limit.h"
+#include "test.h"
+
+#define T0 1000000000 // any start works, the bucket begins full
+
+static rate_limit_t shared;
+static atomic_int   n_admitted;
+
+static void test_bucket(void)
+{
+    rate_limit_t limit;
+
+    // 10 per second: a token every 100 ms, 3 at once
+    rate_limit_init(&limit, 10, 3);
+    CHECK(rate_limit_enabled(&limit));
+    for (int i = 0; i < 3; i++) {
+        CHECK(rate_limit_acquire(&limit, T0) == 0);
+    }
+    CHECK(rate_limit_acquire(&limit, T0) == 100000);
+    CHECK(rate_limit_acquire(&limit, T0 + 40000) == 60000);
+    CHECK(rate_limit_acquire(&limit, T0 + 100000) == 0);
+    CHECK(rate_limit_acquire(&limit, T0 + 100000) == 100000);
+
+    // a request that never ran gives its token back
+    rate_limit_refund(&limit);
+    CHECK(rate_limit_acquire(&limit, T0 + 100000) == 0);
+
+    // idle time refills up to the burst only
+    for (int i = 0; i < 3; i++) {
+        CHECK(rate_limit_acquire(&limit, T0 + 10000000) == 0);
+    }
+    CHECK(rate_limit_acquire(&limit, T0 + 10000000) > 0);
+}
+
+static void test_params(void)
+{
+    rate_limit_t limit;
+
+    rate_limit_init(&limit, 0, 5);
+    CHECK(!rate_limit_enabled(&limit));
+    for (int i = 0; i < 1000; i++) {
+        CHECK(rate_limit_acquire(&limit, T0) == 0);
+    }
+    rate_limit_refund(&limit);
+
+    // a burst below one still lets a single request through
+    rate_limit_init(&limit, 2, 0);
+    CHECK(rate_limit_same(&limit, 2, 1));
+    CHECK(!rate_limit_same(&limit, 2, 2));
+    CHECK(!rate_limit_same(&limit, 4, 1));
+    CHECK(rate_limit_acquire(&limit, T0) == 0);
+    CHECK(rate_limit_acquire(&limit, T0) == 500000);
+}
+
+static void *acquire(void *arg)
+{
+    (void) arg;
+    for (int i = 0; i < 1000; i++) {
+        if (rate_limit_acquire(&shared, T0) == 0) {
+            atomic_fetch_add(&n_admitted, 1);
+        }
+    }
+    return NULL;
+}
+
+/* Racing callers never get more than the burst between them. */
+static void test_concurrent(void)
+{
+    pthread_t threads[4];
+
+    rate_limit_init(&shared, 1, 50);
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, acquire, NULL);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    CHECK(atomic_load(&n_admitted) == 50);
+}
+
+int main(void)
+{
+    test_bucket();
+    test_params();
+    test_concurrent();
+    return test_result();
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "catalog.h"
+#include "mem.h"
+#include "rbac.h"
+#include "test.h"
+
+static char *reader_methods[] = { "tools/list", "resources/*" };
+static char *reader_tools[]   = { "get_*", "t?" };
+static char *admin_all[]      = { "*" };
+
+static mcp_mqtt_role_t roles[] = {
+    { .name                = "reader",
+      .n_allowed_methods   = 2,
+      .allowed_methods     = reader_methods,
+      .n_allowed_tools     = 2,
+      .allowed_tools       = reader_tools },
+    { .name                = "admin",
+      .n_allowed_methods   = 1,
+      .allowed_methods     = admin_all,
+      .n_allowed_tools     = 1,
+      .allowed_tools       = admin_all,
+      .n_allowed_resources = 1,
+      .allowed_resources   = admin_all },
+};
+
+static void test_methods(void)
+{
+    rbac_t *rbac = rbac_create(2, roles);
+
+    CHECK(rbac_role_index(rbac, "reader") == 0);
+    CHECK(rbac_role_index(rbac, "admin") == 1);
+    CHECK(rbac_role_index(rbac, "guest") == -1);
+    CHECK(rbac_method_index("tools/call") == RBAC_METHOD_TOOLS_CALL);
+    CHECK(rbac_method_index("initialize") == -1);
+
+    CHECK(rbac_method_allowed(rbac, 0, RBAC_METHOD_TOOLS_LIST));
+    CHECK(!rbac_method_allowed(rbac, 0, RBAC_METHOD_TOOLS_CALL));
+    CHECK(rbac_method_allowed(rbac, 0, RBAC_METHOD_RESOURCES_LIST));
+    CHECK(rbac_method_allowed(rbac, 0, RBAC_METHOD_RESOURCES_READ));
+    for (int m = 0; m < RBAC_METHOD_COUNT; m++) {
+        CHECK(rbac_method_allowed(rbac, 1, m));
+    }
+
+    mcp_mqtt_role_t unnamed = { 0 };
+    CHECK(rbac_create(1, &unnamed) == NULL);
+    CHECK(rbac_create(0, roles) == NULL);
+    rbac_release(rbac);
+}
+
+/* Enough tools that the bits of a role span several words. */
+static void test_compile(void)
+{
+    rbac_t    *rbac = rbac_create(2, roles);
+    mcp_tool_t tools[130];
+    char       names[130][16];
+
+    for (int i = 0; i < 130; i++) {
+        snprintf(names[i], sizeof(names[i]), "%s%d",
+                 i % 2 ? "get_" : "set_", i);
+        tools[i] = (mcp_tool_t) { .name = names[i] };
+    }
+    tools[129].name = "t1";
+
+    uint64_t *bits = rbac_compile_tools(rbac, 130, tools);
+    for (int i = 0; i < 130; i++) {
+        CHECK(rbac_test(bits, 130, 0, i) == (i % 2 == 1));
+        CHECK(rbac_test(bits, 130, 1, i));
+    }
+    mem_free(bits);
+    rbac_release(rbac);
+}
+
+static void test_catalog(void)
+{
+    catalog_t     *catalog = catalog_create();
+    rbac_t        *rbac    = rbac_create(2, roles);
+    catalog_page_t page;
+    mcp_tool_t     tools[] = { { .name = "get_a" }, { .name = "set_a" } };
+
+    catalog_set_tools(catalog, 2, tools);
+    catalog_set_rbac(catalog, rbac);
+    rbac_release(rbac);
+
+    catalog_snapshot_t *snapshot = catalog_acquire(catalog);
+    mcp_tool_t         *get      = catalog_find_tool(snapshot, "get_a");
+    mcp_tool_t         *set      = catalog_find_tool(snapshot, "set_a");
+    CHECK(catalog_tool_allowed(snapshot, 0, get));
+    CHECK(!catalog_tool_allowed(snapshot, 0, set));
+    CHECK(catalog_tool_allowed(snapshot, 1, set));
+    // a session without a role sees nothing once roles are registered
+    CHECK(!catalog_tool_allowed(snapshot, -1, get));
+
+    CHECK(catalog_list_page(snapshot, CATALOG_TOOLS, 0, NULL, &page) == 0);
+    CHECK(strstr(page.items, "get_a") != NULL);
+    CHECK(strstr(page.items, "set_a") == NULL);
+    catalog_page_free(&page);
+    CHECK(catalog_list_page(snapshot, CATALOG_TOOLS, 1, NULL, &page) == 0);
+    CHECK(strstr(page.items, "set_a") != NULL);
+    catalog_page_free(&page);
+    catalog_release(snapshot);
+
+    // without roles everything is allowed again
+    catalog_set_rbac(catalog, NULL);
+    snapshot = catalog_acquire(catalog);
+    CHECK(catalog_tool_allowed(snapshot, -1,
+                               catalog_find_tool(snapshot, "set_a")));
+    catalog_release(snapshot);
+    catalog_destroy(catalog);
+}
+
+int main(void)
+{
+    test_methods();
+    test_compile();
+    test_catalog();
+    return test_result();
+}
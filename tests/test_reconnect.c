@@ -0,0 +1,94 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "reconnect.h"
+#include "test.h"
+
+static atomic_int n_connects;
+
+static void connect_fn(void *ctx)
+{
+    (void) ctx;
+    atomic_fetch_add(&n_connects, 1);
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Schedules one attempt and polls until it is made, returning its delay. */
+static int64_t attempt(reconnect_t *reconnect)
+{
+    int before = atomic_load(&n_connects);
+
+    reconnect_schedule(reconnect);
+    // a second request while one is pending is the same attempt
+    reconnect_schedule(reconnect);
+    int64_t start = now_ms();
+    int64_t due   = reconnect_poll(reconnect);
+    while (reconnect_poll(reconnect) != 0) {
+        usleep(500);
+    }
+    CHECK(atomic_load(&n_connects) == before + 1);
+    return due == 0 ? 0 : due - start;
+}
+
+static void test_backoff(void)
+{
+    reconnect_t *reconnect = reconnect_create_polled(2, 16, connect_fn, NULL);
+    int64_t      longest   = 0;
+
+    CHECK(reconnect_poll(reconnect) == 0);
+    // the bounds double from 2 ms, the delay is drawn below them
+    CHECK(attempt(reconnect) <= 2);
+    CHECK(attempt(reconnect) <= 4);
+    CHECK(attempt(reconnect) <= 8);
+    for (int i = 0; i < 30; i++) {
+        int64_t delay = attempt(reconnect);
+        CHECK(delay <= 16);
+        if (delay > longest) {
+            longest = delay;
+        }
+    }
+    CHECK(longest > 2);
+
+    reconnect_reset(reconnect);
+    CHECK(attempt(reconnect) <= 2);
+    reconnect_destroy(reconnect);
+
+    CHECK(reconnect_create_polled(10, 5, connect_fn, NULL) == NULL);
+    CHECK(reconnect_create_polled(-1, 5, connect_fn, NULL) == NULL);
+    CHECK(reconnect_create_polled(0, 5, NULL, NULL) == NULL);
+}
+
+static void test_thread(void)
+{
+    reconnect_t *reconnect = reconnect_create(0, 0, connect_fn, NULL);
+
+    atomic_store(&n_connects, 0);
+    reconnect_schedule(reconnect);
+    for (int i = 0; i < 2000 && atomic_load(&n_connects) == 0; i++) {
+        usleep(1000);
+    }
+    CHECK(atomic_load(&n_connects) == 1);
+
+    // destroying it with an attempt pending makes none
+    reconnect_destroy(reconnect);
+    reconnect = reconnect_create(1000, 1000, connect_fn, NULL);
+    reconnect_reset(reconnect);
+    reconnect_schedule(reconnect);
+    reconnect_destroy(reconnect);
+    CHECK(atomic_load(&n_connects) == 1);
+}
+
+int main(void)
+{
+    test_backoff();
+    test_thread();
+    return test_result();
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mem.h"
+#include "response_cache.h"
+#include "test.h"
+
+static jsonrpc_id_t *id_of(int n)
+{
+    char request[32];
+    int  len = snprintf(request, sizeof(request), "{\"id\":%d}", n);
+    return jsonrpc_id_scan(request, len);
+}
+
+static void test_duplicates(void)
+{
+    response_cache_t *cache    = response_cache_create(16, 60000);
+    jsonrpc_id_t     *one      = id_of(1);
+    jsonrpc_id_t     *two      = id_of(2);
+    char             *response = NULL;
+
+    CHECK(response_cache_begin(cache, "c/1", one, &response) ==
+          RESPONSE_CACHE_MISS);
+    CHECK(response_cache_begin(cache, "c/1", one, &response) ==
+          RESPONSE_CACHE_IN_FLIGHT);
+    // the id only repeats within the session that sent it
+    CHECK(response_cache_begin(cache, "c/2", one, &response) ==
+          RESPONSE_CACHE_MISS);
+
+    response_cache_complete(cache, "c/1", one, "{\"result\":1}");
+    CHECK(response_cache_begin(cache, "c/1", one, &response) ==
+          RESPONSE_CACHE_HIT);
+    CHECK_STR(response, "{\"result\":1}");
+    mem_free(response);
+    response = NULL;
+    // a second answer does not replace the first
+    response_cache_complete(cache, "c/1", one, "{\"result\":2}");
+    CHECK(response_cache_begin(cache, "c/1", one, &response) ==
+          RESPONSE_CACHE_HIT);
+    CHECK_STR(response, "{\"result\":1}");
+    mem_free(response);
+    response = NULL;
+
+    // abandoned and failed answers are forgotten, the retry executes
+    CHECK(response_cache_begin(cache, "c/1", two, &response) ==
+          RESPONSE_CACHE_MISS);
+    response_cache_abandon(cache, "c/1", two);
+    CHECK(response_cache_begin(cache, "c/1", two, &response) ==
+          RESPONSE_CACHE_MISS);
+    response_cache_complete(cache, "c/1", two, NULL);
+    CHECK(response_cache_begin(cache, "c/1", two, &response) ==
+          RESPONSE_CACHE_MISS);
+    CHECK(response == NULL);
+
+    jsonrpc_id_free(one);
+    jsonrpc_id_free(two);
+    response_cache_destroy(cache);
+}
+
+static void test_expiry(void)
+{
+    response_cache_t *cache    = response_cache_create(16, 20);
+    jsonrpc_id_t     *one      = id_of(1);
+    char             *response = NULL;
+
+    CHECK(response_cache_begin(cache, "c/1", one, &response) ==
+          RESPONSE_CACHE_MISS);
+    response_cache_complete(cache, "c/1", one, "{}");
+    usleep(40 * 1000);
+    CHECK(response_cache_begin(cache, "c/1", one, &response) ==
+          RESPONSE_CACHE_MISS);
+    CHECK(response == NULL);
+
+    jsonrpc_id_free(one);
+    response_cache_destroy(cache);
+}
+
+/* A full cache drops the oldest answers and keeps what is in flight. */
+static void test_capacity(void)
+{
+    response_cache_t *cache    = response_cache_create(1, 60000);
+    jsonrpc_id_t     *pending  = id_of(0);
+    char             *response = NULL;
+    int               n_hits   = 0;
+
+    CHECK(response_cache_begin(cache, "c/1", pending, &response) ==
+          RESPONSE_CACHE_MISS);
+    for (int i = 1; i <= 64; i++) {
+        jsonrpc_id_t *id = id_of(i);
+        if (response_cache_begin(cache, "c/1", id, &response) ==
+            RESPONSE_CACHE_MISS) {
+            response_cache_complete(cache, "c/1", id, "{}");
+        }
+        jsonrpc_id_free(id);
+    }
+    for (int i = 1; i <= 64; i++) {
+        jsonrpc_id_t *id = id_of(i);
+        if (response_cache_begin(cache, "c/1", id, &response) ==
+            RESPONSE_CACHE_HIT) {
+            n_hits++;
+            mem_free(response);
+            response = NULL;
+        }
+        jsonrpc_id_free(id);
+    }
+    CHECK(n_hits < 64);
+    CHECK(response_cache_begin(cache, "c/1", pending, &response) ==
+          RESPONSE_CACHE_IN_FLIGHT);
+
+    jsonrpc_id_free(pending);
+    response_cache_destroy(cache);
+}
+
+int main(void)
+{
+    char *response = NULL;
+
+    CHECK(response_cache_create(0, 100) == NULL);
+    CHECK(response_cache_begin(NULL, "c/1", NULL, &response) ==
+          RESPONSE_CACHE_MISS);
+    test_duplicates();
+    test_expiry();
+    test_capacity();
+    return test_result();
+}
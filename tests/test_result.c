@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cjson/cJSON.h"
+
+#include "result.h"
+#include "test.h"
+
+static jsonrpc_id_t *id;
+
+static void test_items(void)
+{
+    mcp_result_t result;
+
+    result_init(&result, id);
+    CHECK(mcp_result_text(&result, "a \"b\"\n") == 0);
+    CHECK(mcp_result_printf(&result, "%d\t%s", 42, "\xc3\xa9") == 0);
+    CHECK(mcp_result_text_end(&result) == 0);
+    CHECK(mcp_result_text(&result, "\x01") == 0);
+    CHECK(mcp_result_image(&result, "image/png", "abcd", 4) == 0);
+    CHECK(mcp_result_resource_link(&result, "file:///x", "x", NULL) == 0);
+    CHECK(mcp_result_error(&result) == 0);
+    CHECK_STR(result_finish(&result),
+              "{\"jsonrpc\":\"2.0\",\"id\":7,\"result\":{\"content\":["
+              "{\"type\":\"text\",\"text\":\"a \\\"b\\\"\\n42\\t\xc3\xa9\"},"
+              "{\"type\":\"text\",\"text\":\"\\u0001\"},"
+              "{\"type\":\"image\",\"data\":\"YWJjZA==\","
+              "\"mimeType\":\"image/png\"},"
+              "{\"type\":\"resource_link\",\"uri\":\"file:///x\","
+              "\"name\":\"x\"}],\"isError\":true}}");
+    // finishing again returns the same response, writing fails
+    CHECK(mcp_result_text(&result, "late") == -1);
+    CHECK(mcp_result_error(&result) == -1);
+    CHECK(strstr(result_finish(&result), "late") == NULL);
+    CHECK(result.buf == result.storage);
+    result_release(&result);
+
+    result_init(&result, id);
+    CHECK_STR(result_finish(&result),
+              "{\"jsonrpc\":\"2.0\",\"id\":7,\"result\":{\"content\":[]}}");
+    result_release(&result);
+}
+
+/* Results outgrowing the inline storage move to the heap intact. */
+static void test_large(void)
+{
+    mcp_result_t result;
+    static char  line[1001];
+
+    memset(line, 'x', 1000);
+    result_init(&result, id);
+    for (int i = 0; i < 100; i++) {
+        CHECK(mcp_result_printf(&result, "%s%d", line, i % 10) == 0);
+    }
+    const char *json = result_finish(&result);
+    CHECK(result.buf != result.storage);
+
+    cJSON *response = cJSON_Parse(json);
+    cJSON *content  = cJSON_GetObjectItem(
+        cJSON_GetObjectItem(response, "result"), "content");
+    CHECK(cJSON_GetArraySize(content) == 1);
+    const char *text =
+        cJSON_GetStringValue(cJSON_GetObjectItem(content->child, "text"));
+    CHECK(text != NULL && strlen(text) == 100100);
+    CHECK(text && text[1000] == '0' && text[100099] == '9');
+    cJSON_Delete(response);
+    result_release(&result);
+    CHECK(result.buf == result.storage);
+}
+
+int main(void)
+{
+    id = jsonrpc_id_scan("{\"id\":7}", 8);
+    test_items();
+    test_large();
+    jsonrpc_id_free(id);
+    return test_result();
+}
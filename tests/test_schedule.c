@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "call.h"
+#include "test.h"
+
+static mcp_tool_t tools[] = {
+    { .name = "high", .priority = MCP_PRIORITY_HIGH },
+    { .name = "normal" },
+    { .name = "low", .priority = MCP_PRIORITY_LOW },
+};
+
+static catalog_t *catalog;
+static char       ran_topics[64][8];
+static int        ran_classes[64];
+static int        n_ran;
+
+static void execute(void *ctx, mcp_call_t *call)
+{
+    (void) ctx;
+    if (n_ran < 64) {
+        snprintf(ran_topics[n_ran], sizeof(ran_topics[n_ran]), "%s",
+                 call->topic);
+        ran_classes[n_ran++] = call->cls;
+    }
+    call_finish(call);
+}
+
+static void abort_call(void *ctx, mcp_call_t *call, call_abort_reason_e reason)
+{
+    (void) ctx;
+    (void) call;
+    (void) reason;
+    CHECK(0);
+}
+
+static void notify(void *ctx, const mcp_call_t *call, const char *notification)
+{
+    (void) ctx;
+    (void) call;
+    (void) notification;
+}
+
+/* Queues a call of tool, or a tools/list when tool is NULL. */
+static void submit(call_pool_t *pool, const char *topic, mcp_tool_t *tool)
+{
+    static int    next_id;
+    char          request[32];
+    int           len = snprintf(request, sizeof(request), "{\"id\":%d}",
+                                 ++next_id);
+    jsonrpc_id_t *id  = jsonrpc_id_scan(request, len);
+    mcp_call_t   *call;
+
+    if (tool) {
+        call = call_create(topic, id, catalog_acquire(catalog), tool, 0, NULL,
+                           NULL, 0);
+    } else {
+        call = call_create_query(topic, id, catalog_acquire(catalog), -1,
+                                 CALL_QUERY_LIST_TOOLS, NULL);
+    }
+    CHECK(call_pool_submit(pool, call) == 0);
+    jsonrpc_id_free(id);
+}
+
+static call_pool_t *pool_new(void)
+{
+    n_ran = 0;
+    return call_pool_create(0, execute, abort_call, notify, NULL);
+}
+
+static int count(int first, int last, const char *topic, int cls)
+{
+    int n = 0;
+
+    for (int i = first; i <= last && i < n_ran; i++) {
+        if ((topic == NULL || strcmp(ran_topics[i], topic) == 0) &&
+            (cls < 0 || ran_classes[i] == cls)) {
+            n++;
+        }
+    }
+    return n;
+}
+
+/* Sessions with calls queued in a class take turns. */
+static void test_sessions(void)
+{
+    call_pool_t *pool = pool_new();
+    int64_t      next;
+
+    for (int i = 0; i < 6; i++) {
+        submit(pool, "a", &tools[1]);
+    }
+    submit(pool, "b", &tools[1]);
+    submit(pool, "b", &tools[1]);
+    submit(pool, "c", &tools[1]);
+
+    CHECK(call_pool_run(pool, &next) == 9);
+    CHECK(count(0, 2, "a", -1) == 1);
+    CHECK(count(0, 2, "b", -1) == 1);
+    CHECK(count(0, 2, "c", -1) == 1);
+    CHECK(count(3, 4, "a", -1) == 1);
+    CHECK(count(3, 4, "b", -1) == 1);
+    CHECK(count(5, 8, "a", -1) == 4);
+    call_pool_destroy(pool);
+}
+
+/* Classes share by weight, the lowest still gets its turn. */
+static void test_classes(void)
+{
+    call_pool_t *pool = pool_new();
+    int64_t      next;
+
+    for (int i = 0; i < 16; i++) {
+        submit(pool, "a", &tools[2]);
+        submit(pool, "a", &tools[1]);
+        submit(pool, "a", &tools[0]);
+        submit(pool, "a", NULL);
+    }
+
+    CHECK(call_pool_run(pool, &next) == 64);
+    CHECK(count(0, 14, NULL, CALL_CLASS_QUERY) == 8);
+    CHECK(count(0, 14, NULL, CALL_CLASS_TOOL_HIGH) == 4);
+    CHECK(count(0, 14, NULL, CALL_CLASS_TOOL) == 2);
+    CHECK(count(0, 14, NULL, CALL_CLASS_TOOL_LOW) == 1);
+    CHECK(count(15, 29, NULL, CALL_CLASS_TOOL_LOW) == 1);
+    CHECK(count(0, 63, NULL, CALL_CLASS_TOOL_LOW) == 16);
+    call_pool_destroy(pool);
+}
+
+/* A class with nothing queued leaves its share to the others. */
+static void test_idle_class(void)
+{
+    call_pool_t *pool = pool_new();
+    int64_t      next;
+
+    for (int i = 0; i < 4; i++) {
+        submit(pool, "a", &tools[2]);
+    }
+    CHECK(call_pool_run(pool, &next) == 4);
+    CHECK(count(0, 3, NULL, CALL_CLASS_TOOL_LOW) == 4);
+    call_pool_destroy(pool);
+}
+
+int main(void)
+{
+    catalog = catalog_create();
+    test_sessions();
+    test_classes();
+    test_idle_class();
+    catalog_destroy(catalog);
+    return test_result();
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "mcp_server.h"
+#include "test.h"
+
+#define N_CLIENTS 16
+
+static char input[]  = "/tmp/mcp-shard-in-XXXXXX";
+static char output[] = "/tmp/mcp-shard-out-XXXXXX";
+
+static const char *answer(int n_args, property_t *args)
+{
+    (void) n_args;
+    (void) args;
+    return "";
+}
+
+static mcp_tool_t tools[] = {
+    { .name = "even", .call = answer },
+    { .name = "odd", .call = answer },
+};
+
+static char *methods[]    = { "tools/list" };
+static char *even_tools[] = { "even" };
+static char *odd_tools[]  = { "odd" };
+
+static mcp_mqtt_role_t roles[] = {
+    { .name              = "even",
+      .n_allowed_methods = 1,
+      .allowed_methods   = methods,
+      .n_allowed_tools   = 1,
+      .allowed_tools     = even_tools },
+    { .name              = "odd",
+      .n_allowed_methods = 1,
+      .allowed_methods   = methods,
+      .n_allowed_tools   = 1,
+      .allowed_tools     = odd_tools },
+};
+
+static void add_property(MQTTProperties *props, char *key, char *value)
+{
+    MQTTProperty property = {
+        .identifier  = MQTTPROPERTY_CODE_USER_PROPERTY,
+        .value.data  = { .len = (int) strlen(key), .data = key },
+        .value.value = { .len = (int) strlen(value), .data = value },
+    };
+    MQTTProperties_add(props, &property);
+}
+
+/*
+ * Every client but the last initializes with the role of its parity, then
+ * all of them list the tools.
+ */
+static void write_input(void)
+{
+    capture_t *capture = capture_open(input);
+    char       client_id[16], topic[128], payload[128];
+
+    for (int i = 0; i < N_CLIENTS - 1; i++) {
+        MQTTProperties props = MQTTProperties_initializer;
+        snprintf(client_id, sizeof(client_id), "client%d", i);
+        add_property(&props, "MCP-MQTT-CLIENT-ID", client_id);
+        add_property(&props, "MCP-RBAC-ROLE", i % 2 ? "odd" : "even");
+        int len = snprintf(payload, sizeof(payload),
+                           "{\"jsonrpc\":\"2.0\",\"id\":%d,"
+                           "\"method\":\"initialize\"}",
+                           i);
+        capture_message(capture, CAPTURE_IN, "$mcp-server/srv/math", payload,
+                        len, &props);
+        MQTTProperties_free(&props);
+    }
+    for (int i = 0; i < N_CLIENTS; i++) {
+        snprintf(topic, sizeof(topic), "$mcp-rpc/client%d/srv/math", i);
+        int len = snprintf(payload, sizeof(payload),
+                           "{\"jsonrpc\":\"2.0\",\"id\":%d,"
+                           "\"method\":\"tools/list\"}",
+                           i);
+        capture_message(capture, CAPTURE_IN, topic, payload, len, NULL);
+    }
+    capture_close(capture);
+}
+
+/* Sessions are found on the shard they were created on. */
+static void test_sessions(int n_shards)
+{
+    mcp_server_t *server =
+        mcp_server_init("math", "Math tools", "tcp://localhost:1883", "srv",
+                        NULL, NULL, NULL);
+    mcp_replay_stats_t stats;
+    capture_reader_t  *reader;
+    capture_record_t   record;
+    int                n_listed = 0, n_initialized = 0;
+
+    CHECK(mcp_server_set_shards(server, 0) == -1);
+    CHECK(mcp_server_set_shards(server, n_shards) == 0);
+    mcp_server_register_tool(server, 2, tools);
+    mcp_server_register_roles(server, 2, roles);
+    CHECK(mcp_server_set_capture(server, output) == 0);
+    CHECK(mcp_server_replay(server, input, 0, &stats) == 0);
+    CHECK(stats.replayed.requests == N_CLIENTS);
+    CHECK(stats.replayed.responses == N_CLIENTS);
+    // connections are only opened before the server runs
+    CHECK(mcp_server_set_shards(server, 2) == -1);
+    mcp_server_close(server);
+
+    reader = capture_reader_open(output);
+    while (capture_next(reader, &record) == 1) {
+        int i;
+        if (record.kind != CAPTURE_OUT ||
+            sscanf(record.topic, "$mcp-rpc/client%d/", &i) != 1) {
+            continue;
+        }
+        if (strstr(record.payload, "\"protocolVersion\"")) {
+            n_initialized++;
+        } else if (i == N_CLIENTS - 1) { // without a session
+            CHECK(strstr(record.payload, "Forbidden") != NULL);
+        } else {
+            const char *own   = i % 2 ? "\"odd\"" : "\"even\"";
+            const char *other = i % 2 ? "\"even\"" : "\"odd\"";
+            CHECK(strstr(record.payload, own) != NULL);
+            CHECK(strstr(record.payload, other) == NULL);
+            n_listed++;
+        }
+    }
+    capture_reader_close(reader);
+    CHECK(n_initialized == N_CLIENTS - 1);
+    CHECK(n_listed == N_CLIENTS - 1);
+}
+
+int main(void)
+{
+    close(mkstemp(input));
+    close(mkstemp(output));
+    write_input();
+    test_sessions(1);
+    test_sessions(4);
+    unlink(input);
+    unlink(output);
+    return test_result();
+}
@@ -0,0 +1,167 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "spool.h"
+#include "test.h"
+
+static char path[] = "/tmp/mcp-spool-XXXXXX";
+
+typedef struct {
+    int  n_sent;
+    int  fail_after; // sends accepted before the broker goes away, -1 never
+    char payloads[512][16];
+    char topics[512][16];
+    int  expiries[512];
+} sink_t;
+
+static int send_to(void *ctx, const char *topic, const char *payload,
+                   size_t len, int expiry_s)
+{
+    sink_t *sink = ctx;
+
+    if (sink->n_sent == sink->fail_after || sink->n_sent == 512) {
+        return -1;
+    }
+    snprintf(sink->topics[sink->n_sent], 16, "%s", topic);
+    snprintf(sink->payloads[sink->n_sent], 16, "%.*s", (int) len, payload);
+    sink->expiries[sink->n_sent++] = expiry_s;
+    return 0;
+}
+
+static void append_n(spool_t *spool, int first, int n)
+{
+    for (int i = first; i < first + n; i++) {
+        char payload[16];
+        int  len = snprintf(payload, sizeof(payload), "m%d", i);
+        CHECK(spool_append(spool, "t", payload, len, 0) == 0);
+    }
+}
+
+static void test_order(void)
+{
+    spool_t *spool = spool_open(path, 4096);
+    sink_t   sink  = { .fail_after = 2 };
+
+    CHECK(spool_empty(spool));
+    append_n(spool, 0, 5);
+    CHECK(!spool_empty(spool));
+
+    // a failed send keeps that entry and the ones behind it
+    CHECK(spool_drain(spool, send_to, &sink) == 2);
+    CHECK(!spool_empty(spool));
+    sink.fail_after = -1;
+    CHECK(spool_drain(spool, send_to, &sink) == 3);
+    CHECK(spool_empty(spool));
+    for (int i = 0; i < 5; i++) {
+        char expected[16];
+        snprintf(expected, sizeof(expected), "m%d", i);
+        CHECK_STR(sink.payloads[i], expected);
+        CHECK_STR(sink.topics[i], "t");
+    }
+    spool_close(spool);
+}
+
+static void test_expiry(void)
+{
+    spool_t *spool = spool_open(path, 4096);
+    sink_t   sink  = { .fail_after = -1 };
+    int64_t  now   = spool_now_ms();
+
+    CHECK(spool_append(spool, "t", "old", 3, now - 1) == 0);
+    CHECK(spool_append(spool, "t", "new", 3, now + 9500) == 0);
+    CHECK(spool_append(spool, "t", "ever", 4, 0) == 0);
+    CHECK(spool_drain(spool, send_to, &sink) == 2);
+    CHECK_STR(sink.payloads[0], "new");
+    CHECK(sink.expiries[0] == 10); // what is left, rounded up
+    CHECK_STR(sink.payloads[1], "ever");
+    CHECK(sink.expiries[1] == 0);
+    CHECK(spool_empty(spool));
+    spool_close(spool);
+}
+
+/* Entries outlive the process, unless the capacity changed. */
+static void test_reopen(void)
+{
+    spool_t *spool = spool_open(path, 4096);
+    sink_t   sink  = { .fail_after = -1 };
+
+    append_n(spool, 0, 3);
+    spool_close(spool);
+    spool = spool_open(path, 4096);
+    CHECK(spool_drain(spool, send_to, &sink) == 3);
+    CHECK_STR(sink.payloads[2], "m2");
+
+    append_n(spool, 0, 3);
+    spool_close(spool);
+    spool = spool_open(path, 8192);
+    CHECK(spool_empty(spool));
+    spool_close(spool);
+}
+
+/* A full ring makes room by dropping the oldest, across the wrap. */
+static void test_full(void)
+{
+    spool_t *spool = spool_open(path, 4096);
+    sink_t   sink  = { .fail_after = -1 };
+    char     big[3000];
+
+    memset(big, 'x', sizeof(big));
+    CHECK(spool_append(spool, "t", big, sizeof(big), 0) == -1);
+    CHECK(spool_open(path, 1024) == NULL);
+
+    append_n(spool, 0, 400);
+    int n = spool_drain(spool, send_to, &sink);
+    CHECK(n > 0 && n < 400);
+    for (int i = 0; i < n; i++) {
+        char expected[16];
+        snprintf(expected, sizeof(expected), "m%d", 400 - n + i);
+        CHECK_STR(sink.payloads[i], expected);
+    }
+    CHECK(spool_empty(spool));
+    spool_close(spool);
+}
+
+/* A record size damaged in the file drops the ring instead of walking off. */
+static void test_damaged(void)
+{
+    uint32_t sizes[] = { 4, 36, 1 << 20 }; // short, unaligned, past the tail
+
+    for (int i = 0; i < 3; i++) {
+        CHECK(truncate(path, 0) == 0); // a new ring, starting at offset 0
+        spool_t *spool = spool_open(path, 4096);
+        sink_t   sink  = { .fail_after = -1 };
+
+        append_n(spool, 0, 3);
+        spool_close(spool);
+        // the first record follows the 64 byte header, its size leads it
+        int fd = open(path, O_WRONLY);
+        CHECK(pwrite(fd, &sizes[i], sizeof(uint32_t), 64) == 4);
+        close(fd);
+
+        spool = spool_open(path, 4096);
+        CHECK(spool_drain(spool, send_to, &sink) == 0);
+        CHECK(spool_empty(spool));
+        append_n(spool, 3, 1);
+        CHECK(spool_drain(spool, send_to, &sink) == 1);
+        CHECK_STR(sink.payloads[0], "m3");
+        spool_close(spool);
+    }
+}
+
+int main(void)
+{
+    int fd = mkstemp(path);
+
+    close(fd);
+    test_order();
+    test_expiry();
+    test_reopen();
+    test_full();
+    test_damaged();
+    unlink(path);
+    return test_result();
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "catalog.h"
+#include "test.h"
+
+#define N_TOOLS 1000
+
+static char           names[N_TOOLS][16];
+static mcp_tool_t     tools[N_TOOLS];
+static mcp_resource_t resources[] = {
+    { .uri = "file:///a", .name = "a" },
+    { .uri = "file:///b", .name = "b" },
+};
+
+static void test_in_place(void)
+{
+    catalog_t *catalog = catalog_create();
+
+    for (int i = 0; i < N_TOOLS; i++) {
+        snprintf(names[i], sizeof(names[i]), "tool_%d", i);
+        tools[i] = (mcp_tool_t) { .name = names[i] };
+    }
+    tools[7].rate_limit = 5;
+
+    CHECK(catalog_set_static_tools(catalog, N_TOOLS, tools) == 0);
+    CHECK(catalog_set_static_resources(catalog, 2, resources) == 0);
+    catalog_snapshot_t *snapshot = catalog_acquire(catalog);
+    CHECK(snapshot->static_tools && snapshot->tools == tools);
+    CHECK(snapshot->static_resources && snapshot->resources == resources);
+    for (int i = 0; i < N_TOOLS; i++) {
+        CHECK(catalog_find_tool(snapshot, names[i]) == &tools[i]);
+    }
+    CHECK(catalog_find_tool(snapshot, "tool_1000") == NULL);
+    CHECK(catalog_find_resource(snapshot, "file:///b") == &resources[1]);
+    CHECK(catalog_find_resource(snapshot, "file:///c") == NULL);
+    // only rate limited tools carry state
+    CHECK(catalog_tool_state(snapshot, &tools[0]) == NULL);
+    catalog_tool_state_t *state = catalog_tool_state(snapshot, &tools[7]);
+    CHECK(state != NULL);
+
+    // an update that leaves the tables alone keeps sharing them
+    catalog_set_page_size(catalog, 10);
+    catalog_snapshot_t *next = catalog_acquire(catalog);
+    CHECK(next->version > snapshot->version);
+    CHECK(next->tools == tools && next->resources == resources);
+    CHECK(catalog_tool_state(next, &tools[7]) == state);
+    catalog_release(snapshot);
+
+    // a single addition copies the table and leaves the original alone
+    mcp_tool_t extra = { .name = "extra" };
+    CHECK(catalog_add_tool(catalog, &extra) == 0);
+    catalog_snapshot_t *added = catalog_acquire(catalog);
+    CHECK(!added->static_tools && added->tools != tools);
+    CHECK(added->n_tools == N_TOOLS + 1);
+    CHECK(catalog_find_tool(added, "extra") != NULL);
+    mcp_tool_t *copy = catalog_find_tool(added, "tool_7");
+    CHECK(copy != NULL && copy != &tools[7]);
+    CHECK(copy && catalog_tool_state(added, copy) == state);
+    CHECK(added->resources == resources);
+    CHECK(next->tools == tools && next->n_tools == N_TOOLS);
+    catalog_release(added);
+    catalog_release(next);
+
+    CHECK(catalog_set_static_tools(catalog, 1, NULL) == -1);
+    catalog_destroy(catalog);
+}
+
+int main(void)
+{
+    test_in_place();
+    return test_result();
+}
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "jsonrpc.h"
+#include "test.h"
+
+static const char *modes[] = { "fast", "slow" };
+
+static property_t integer = { .type = PROPERTY_INTEGER };
+static property_t real    = { .type = PROPERTY_REAL };
+static property_t string  = { .type = PROPERTY_STRING };
+static property_t row     = { .type = PROPERTY_ARRAY, .items = &real };
+
+static property_t box_members[] = {
+    { .name = "w", .type = PROPERTY_INTEGER },
+    { .name = "h", .type = PROPERTY_INTEGER, .optional = true },
+};
+
+static property_t schema[] = {
+    { .name               = "mode",
+      .type               = PROPERTY_STRING,
+      .n_enum             = 2,
+      .enum_values        = modes,
+      .has_default        = true,
+      .value.string_value = "fast" },
+    { .name = "scale", .type = PROPERTY_REAL, .optional = true },
+    { .name = "points", .type = PROPERTY_ARRAY, .items = &integer },
+    { .name = "tags", .type = PROPERTY_ARRAY, .items = &string,
+      .optional = true },
+    { .name           = "box",
+      .type           = PROPERTY_OBJECT,
+      .optional       = true,
+      .property_count = 2,
+      .properties     = box_members },
+    { .name = "rows", .type = PROPERTY_ARRAY, .items = &row,
+      .optional = true },
+};
+
+static mcp_tool_t tool = { .name = "t", .property_count = 6,
+                           .properties = schema };
+
+/* Decodes kwargs for tool, a NULL kwargs sends no arguments at all. */
+static int decode(const mcp_tool_t *t, const char *kwargs, property_t **args)
+{
+    const char *head = "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":"
+                       "\"tools/call\",\"params\":{\"name\":\"t\"";
+    char        request[512];
+    int         len;
+
+    if (kwargs) {
+        len = snprintf(request, sizeof(request),
+                       "%s,\"arguments\":{\"kwargs\":%s}}}", head, kwargs);
+    } else {
+        len = snprintf(request, sizeof(request), "%s}}", head);
+    }
+
+    jsonrpc_t *jsonrpc = jsonrpc_decode(request, len);
+    int        ret     = jsonrpc_tool_call_args(jsonrpc, t, args);
+    jsonrpc_decode_free(jsonrpc);
+    return ret;
+}
+
+static void test_full(void)
+{
+    property_t *args = NULL;
+
+    CHECK(decode(&tool,
+                 "{\"rows\":[[1.5],[],[2,3]],\"box\":{\"w\":4,\"h\":5},"
+                 "\"tags\":[\"a\",\"bc\"],\"points\":[1,-2,3],"
+                 "\"scale\":0.25,\"mode\":\"slow\",\"extra\":null}",
+                 &args) == 0);
+    // schema order, whatever order they were sent in
+    CHECK_STR(args[0].name, "mode");
+    CHECK_STR(args[0].value.string_value, "slow");
+    CHECK(args[1].present && args[1].value.real_value == 0.25);
+
+    property_array_t *points = &args[2].value.array_value;
+    CHECK(points->item_type == PROPERTY_INTEGER && points->count == 3);
+    CHECK(points->integers[0] == 1 && points->integers[1] == -2 &&
+          points->integers[2] == 3);
+
+    property_array_t *tags = &args[3].value.array_value;
+    CHECK(tags->count == 2);
+    CHECK_STR(tags->strings[0], "a");
+    CHECK_STR(tags->strings[1], "bc");
+
+    property_object_t *box = &args[4].value.object_value;
+    CHECK(box->count == 2);
+    CHECK(box->properties[0].value.integer_value == 4);
+    CHECK(box->properties[1].present &&
+          box->properties[1].value.integer_value == 5);
+
+    property_array_t *rows = &args[5].value.array_value;
+    CHECK(rows->item_type == PROPERTY_ARRAY && rows->count == 3);
+    CHECK(rows->items[0].value.array_value.reals[0] == 1.5);
+    CHECK(rows->items[1].value.array_value.count == 0);
+    CHECK(rows->items[2].value.array_value.reals[1] == 3);
+    jsonrpc_tool_call_args_free(tool.property_count, args);
+}
+
+static void test_defaults(void)
+{
+    property_t *args = NULL;
+
+    CHECK(decode(&tool, "{\"points\":[],\"box\":{\"w\":1}}", &args) == 0);
+    CHECK(args[0].present);
+    CHECK_STR(args[0].value.string_value, "fast");
+    // the default is copied, not handed out
+    CHECK(args[0].value.string_value != schema[0].value.string_value);
+    CHECK(!args[1].present);
+    CHECK(args[2].present && args[2].value.array_value.count == 0);
+    CHECK(!args[3].present && !args[5].present);
+    CHECK(!args[4].value.object_value.properties[1].present);
+    jsonrpc_tool_call_args_free(tool.property_count, args);
+
+    // tools without required arguments can be called without kwargs
+    mcp_tool_t bare = { .name = "t" };
+    CHECK(decode(&bare, NULL, &args) == 0);
+    CHECK(args == NULL);
+    CHECK(decode(&tool, NULL, &args) == -4);
+}
+
+static void test_mismatches(void)
+{
+    static const char *invalid[] = {
+        "{}",                                   // points is required
+        "{\"points\":[1],\"mode\":\"medium\"}", // not in the enum
+        "{\"points\":[1.5]}",                   // not an integer
+        "{\"points\":[1,\"2\"]}",
+        "{\"points\":{}}",
+        "{\"points\":[],\"scale\":\"1\"}",
+        "{\"points\":[],\"tags\":[\"a\",1]}",
+        "{\"points\":[],\"box\":{\"h\":1}}",    // w is required
+        "{\"points\":[],\"rows\":[[1],[\"x\"]]}",
+    };
+    property_t *args = NULL;
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        if (decode(&tool, invalid[i], &args) != -4) {
+            printf("accepted %s\n", invalid[i]);
+            CHECK(0);
+        }
+        CHECK(args == NULL);
+    }
+    CHECK(decode(&tool, "[1]", &args) == -10);
+}
+
+int main(void)
+{
+    test_full();
+    test_defaults();
+    test_mismatches();
+    return test_result();
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cjson/cJSON.h"
+
+#include "catalog.h"
+#include "example_tools.h"
+#include "test.h"
+
+static char greeted[32];
+static bool greeted_loud;
+static int  n_greeted;
+
+int add_numbers(const example_add_args_t *args, mcp_result_t *result)
+{
+    (void) result;
+    return (int) (args->a + args->b);
+}
+
+int example_greet(const example_greet_args_t *args, mcp_result_t *result)
+{
+    (void) result;
+    n_greeted++;
+    greeted_loud = args->shout;
+    snprintf(greeted, sizeof(greeted), "%s", args->name);
+    return 0;
+}
+
+static void test_decoders(void)
+{
+    example_add_args_t   add;
+    example_greet_args_t greet;
+
+    CHECK(example_add_decode("{\"b\":2,\"x\":[1,{}],\"a\":-40}", &add) == 0);
+    CHECK(add.a == -40 && add.b == 2);
+    // required arguments and their types are enforced
+    CHECK(example_add_decode("{\"a\":1}", &add) == -1);
+    CHECK(example_add_decode("{\"a\":1,\"b\":\"2\"}", &add) == -1);
+    CHECK(example_add_decode("[1,2]", &add) == -1);
+    CHECK(example_add_decode("{\"a\":1,\"b\":2", &add) == -1);
+
+    CHECK(example_greet_decode("{\"name\":\"a\\u00e9\\n\"}", &greet) == 0);
+    CHECK_STR(greet.name, "a\xc3\xa9\n");
+    CHECK(!greet.shout);
+    example_greet_free(&greet);
+    CHECK(example_greet_decode("{\"shout\":true,\"name\":\"x\"}", &greet) ==
+          0);
+    CHECK(greet.shout);
+    example_greet_free(&greet);
+    CHECK(example_greet_decode("{\"shout\":true}", &greet) == -1);
+}
+
+/* The binders decode the arguments and call the application's handler. */
+static void test_binders(void)
+{
+    CHECK(EXAMPLE_N_TOOLS == 2);
+    CHECK_STR(example_tools[0].name, "add");
+    CHECK(example_tools[0].call_json("{\"a\":2,\"b\":3}", NULL) == 5);
+    CHECK(example_tools[0].call_json("{\"a\":2}", NULL) ==
+          MCP_RESULT_INVALID_PARAMS);
+
+    CHECK(example_tools[1].timeout_ms == 1000);
+    CHECK(example_tools[1].call_json("{\"name\":\"bob\",\"shout\":true}",
+                                     NULL) == 0);
+    CHECK(n_greeted == 1);
+    CHECK_STR(greeted, "bob");
+    CHECK(greeted_loud);
+}
+
+/* The pre-serialized schemas are valid and listed as generated. */
+static void test_schemas(void)
+{
+    for (int i = 0; i < EXAMPLE_N_TOOLS; i++) {
+        cJSON *schema = cJSON_Parse(example_tools[i].schema_json);
+        CHECK(schema != NULL);
+        CHECK_STR(cJSON_GetStringValue(cJSON_GetObjectItem(schema, "name")),
+                  example_tools[i].name);
+        cJSON_Delete(schema);
+    }
+
+    catalog_t     *catalog = catalog_create();
+    catalog_page_t page;
+
+    catalog_set_static_tools(catalog, EXAMPLE_N_TOOLS, example_tools);
+    catalog_snapshot_t *snapshot = catalog_acquire(catalog);
+    CHECK(catalog_list_page(snapshot, CATALOG_TOOLS, -1, NULL, &page) == 0);
+    CHECK_STR(page.items, example_tools_json);
+    catalog_page_free(&page);
+    catalog_release(snapshot);
+    catalog_destroy(catalog);
+}
+
+int main(void)
+{
+    test_decoders();
+    test_binders();
+    test_schemas();
+    return test_result();
+}
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cjson/cJSON.h"
+
+#include "test.h"
+#include "trace.h"
+
+#define PARENT "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"
+
+static mcp_span_t spans[64];
+static int        n_spans;
+
+/* Runs on the recorder's thread, read once it was destroyed. */
+static void collect(void *ctx, int n, const mcp_span_t *batch)
+{
+    (void) ctx;
+    for (int i = 0; i < n && n_spans < 64; i++) {
+        spans[n_spans++] = batch[i];
+    }
+}
+
+static void discard(void *ctx, int n, const mcp_span_t *batch)
+{
+    (void) ctx;
+    (void) n;
+    (void) batch;
+}
+
+static void hex(char *out, const uint8_t *id, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        sprintf(out + 2 * i, "%02x", id[i]);
+    }
+}
+
+static void test_parent(void)
+{
+    // a sampled parent is followed even when nothing else is sampled
+    trace_t         *trace   = trace_create(0, collect, NULL);
+    trace_request_t *request = trace_begin(trace, PARENT, 100);
+    char             traceparent[TRACEPARENT_LEN + 1];
+    char             id[33];
+
+    n_spans = 0;
+    CHECK(request != NULL);
+    trace_set_name(request, "tools/call", "add");
+    trace_span(request, "tool", 110, 150);
+    trace_traceparent(request, traceparent);
+    CHECK(strncmp(traceparent, PARENT, 36) == 0);
+    CHECK(strcmp(traceparent + 36, "00f067aa0ba902b7-01") != 0);
+    CHECK_STR(traceparent + 52, "-01");
+    CHECK(strlen(traceparent) == TRACEPARENT_LEN);
+    trace_end(request, 200);
+    trace_destroy(trace);
+
+    CHECK(n_spans == 2);
+    mcp_span_t *phase = &spans[0], *whole = &spans[1];
+    CHECK(!phase->request && whole->request);
+    CHECK_STR(phase->name, "tool");
+    CHECK_STR(phase->tool, "add");
+    CHECK(phase->start_ns == 110 && phase->end_ns == 150);
+    CHECK(memcmp(phase->parent_id, whole->span_id, 8) == 0);
+    CHECK_STR(whole->name, "tools/call");
+    CHECK(whole->start_ns == 100 && whole->end_ns == 200);
+    hex(id, whole->trace_id, 16);
+    CHECK_STR(id, "4bf92f3577b34da6a3ce929d0e0e4736");
+    hex(id, whole->parent_id, 8);
+    CHECK_STR(id, "00f067aa0ba902b7");
+    hex(id, whole->span_id, 8);
+    CHECK(strncmp(traceparent + 36, id, 16) == 0);
+}
+
+static void test_sampling(void)
+{
+    static const char *invalid[] = {
+        "00-00000000000000000000000000000000-00f067aa0ba902b7-01",
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000000-01",
+        "ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-x",
+        "00-4bf92f3577b34da6a3ce929d0e0e473g-00f067aa0ba902b7-01",
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7",
+    };
+    trace_t *none = trace_create(0, collect, NULL);
+    trace_t *all  = trace_create(1, collect, NULL);
+    trace_t *half = trace_create(0.5, discard, NULL);
+
+    n_spans = 0;
+    // the caller decided against recording
+    CHECK(trace_begin(all, "00-4bf92f3577b34da6a3ce929d0e0e4736-"
+                           "00f067aa0ba902b7-00", 0) == NULL);
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        CHECK(trace_begin(none, invalid[i], 0) == NULL);
+        // a new trace then, without a parent
+        trace_request_t *request = trace_begin(all, invalid[i], 0);
+        CHECK(request != NULL);
+        trace_end(request, 1);
+    }
+    // a later version may add fields
+    trace_request_t *request = trace_begin(
+        none, "01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-ab", 0);
+    CHECK(request != NULL);
+    trace_end(request, 1);
+
+    int n_sampled = 0;
+    for (int i = 0; i < 2000; i++) {
+        request = trace_begin(half, NULL, 0);
+        if (request) {
+            n_sampled++;
+            trace_end(request, 1);
+        }
+    }
+    CHECK(n_sampled > 850 && n_sampled < 1150);
+    CHECK(trace_begin(NULL, PARENT, 0) == NULL);
+    CHECK(trace_create(1.5, collect, NULL) == NULL);
+
+    trace_destroy(none);
+    trace_destroy(all);
+    trace_destroy(half);
+    // only the later version kept its parent
+    static const uint8_t zero[8];
+    int                  n_roots = 0;
+    CHECK(n_spans == 7);
+    for (int i = 0; i < n_spans; i++) {
+        n_roots += memcmp(spans[i].parent_id, zero, 8) == 0;
+    }
+    CHECK(n_roots == 6);
+}
+
+/* Batches are written as OTLP/JSON lines. */
+static void test_file(void)
+{
+    char path[] = "/tmp/mcp-trace-XXXXXX";
+    int  fd     = mkstemp(path);
+    char line[4096];
+
+    close(fd);
+    mcp_trace_file_t *file    = mcp_trace_file_open(path, "svc");
+    trace_t          *trace   = trace_create(0, mcp_trace_file_export, file);
+    trace_request_t  *request = trace_begin(trace, PARENT, 1000);
+    trace_set_name(request, "tools/call", "say \"hi\"");
+    trace_span(request, "tool", 1100, 1200);
+    trace_end(request, 2000);
+    trace_destroy(trace);
+    mcp_trace_file_close(file);
+
+    FILE *in = fopen(path, "r");
+    CHECK(in && fgets(line, sizeof(line), in) != NULL);
+    cJSON *root  = cJSON_Parse(line);
+    cJSON *batch = cJSON_GetArrayItem(cJSON_GetObjectItem(root,
+                                                          "resourceSpans"),
+                                      0);
+    cJSON *scope = cJSON_GetArrayItem(cJSON_GetObjectItem(batch,
+                                                          "scopeSpans"),
+                                      0);
+    cJSON *list  = cJSON_GetObjectItem(scope, "spans");
+    CHECK(cJSON_GetArraySize(list) == 2);
+    cJSON *whole = cJSON_GetArrayItem(list, 1);
+    CHECK_STR(cJSON_GetStringValue(cJSON_GetObjectItem(whole, "traceId")),
+              "4bf92f3577b34da6a3ce929d0e0e4736");
+    CHECK_STR(cJSON_GetStringValue(cJSON_GetObjectItem(whole,
+                                                       "parentSpanId")),
+              "00f067aa0ba902b7");
+    CHECK_STR(cJSON_GetStringValue(cJSON_GetObjectItem(whole,
+                                                       "startTimeUnixNano")),
+              "1000");
+    cJSON *attribute =
+        cJSON_GetArrayItem(cJSON_GetObjectItem(whole, "attributes"), 0);
+    CHECK_STR(cJSON_GetStringValue(cJSON_GetObjectItem(
+                  cJSON_GetObjectItem(attribute, "value"), "stringValue")),
+              "say \"hi\"");
+    cJSON_Delete(root);
+    if (in) {
+        fclose(in);
+    }
+    unlink(path);
+}
+
+int main(void)
+{
+    test_parent();
+    test_sampling();
+    test_file();
+    return test_result();
+}
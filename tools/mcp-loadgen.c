@@ -0,0 +1,672 @@
+/*
+ * mcp-loadgen: measures what an MCP-over-MQTT server sustains.
+ *
+ *     mcp-loadgen [options]
+ *
+ *     -b <uri>       broker, default tcp://localhost:1883
+ *     -s <name>      server name to load, default "ESP32 Demo Server Name"
+ *     -S             start an in-process stand-in server and load that one
+ *     -c <clients>   concurrent clients, each with its own connection and
+ *                    session, default 10
+ *     -d <seconds>   duration, default 10
+ *     -r <rate>      requests per second over all clients, issued on a fixed
+ *                    schedule whether or not earlier ones were answered
+ *     -w <window>    without -r, requests each client keeps in flight,
+ *                    default 16
+ *     -m <mix>       weights of list, call and read, default "list=1,call=8"
+ *     -t <tool>      tool to call, default "add"
+ *     -a <json>      its arguments, default {"a":1,"b":2}
+ *     -u <uri>       resource to read, default "loadgen://static"
+ *     -e <bytes>     instead of loading a server, measure how fast a text of
+ *                    that size is escaped and validated as UTF-8 with each
+ *                    kernel this CPU supports
+ *
+ * Every client runs the initialize handshake on $mcp-server/{id}/{name},
+ * then draws methods from the mix. At a fixed rate latency counts from the
+ * time a request was due, so a server that falls behind is not hidden by
+ * requests that were sent late. Throughput, errors and a latency histogram
+ * are reported at the end.
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mcp_client.h"
+#include "mcp_json.h"
+#include "mcp_result.h"
+#include "mcp_server.h"
+
+#define STANDIN_NAME "mcp-loadgen stand-in"
+
+// log-linear latency buckets: 16 per power of two of microseconds
+#define HIST_SUB_BITS 4
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  (40 * HIST_SUB)
+
+typedef enum {
+    METHOD_LIST = 0,
+    METHOD_CALL,
+    METHOD_READ,
+    N_METHODS,
+} method_e;
+
+static const char *method_names[N_METHODS] = { "list", "call", "read" };
+
+typedef struct {
+    atomic_llong sent;
+    atomic_llong ok;
+    atomic_llong failed;
+    atomic_llong lost; // never answered, failed with MCP_CLIENT_CLOSED
+} method_stats_t;
+
+typedef struct {
+    const char *broker_uri;
+    const char *server_name;
+    bool        standin;
+    int         n_clients;
+    int         duration_s;
+    double      rate;
+    int         window;
+    int         weights[N_METHODS];
+    const char *tool;
+    const char *arguments;
+    const char *uri;
+} options_t;
+
+typedef struct {
+    const options_t      *options;
+    int                   index;
+    mcp_client_t         *client;
+    mcp_client_session_t *session;
+    pthread_t             thread;
+    uint64_t              random;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             inflight;
+} loadgen_client_t;
+
+typedef struct {
+    loadgen_client_t *client;
+    method_e          method;
+    int64_t           due_ns;
+} request_t;
+
+static method_stats_t stats[N_METHODS];
+static atomic_llong   histogram[HIST_BUCKETS];
+static atomic_bool    stopping;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t deadline_ns)
+{
+    struct timespec ts = {
+        .tv_sec  = deadline_ns / 1000000000,
+        .tv_nsec = deadline_ns % 1000000000,
+    };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static int hist_bucket(int64_t us)
+{
+    if (us < HIST_SUB) {
+        return (int) us;
+    }
+
+    int shift = 63 - __builtin_clzll((unsigned long long) us) - HIST_SUB_BITS;
+    int index = (shift + 1) * HIST_SUB + (int) ((us >> shift) - HIST_SUB);
+    return index < HIST_BUCKETS ? index : HIST_BUCKETS - 1;
+}
+
+// the lowest latency in microseconds that falls into a bucket
+static int64_t hist_floor(int bucket)
+{
+    if (bucket < HIST_SUB) {
+        return bucket;
+    }
+
+    int shift = bucket / HIST_SUB - 1;
+    return (int64_t) (HIST_SUB + bucket % HIST_SUB) << shift;
+}
+
+static void on_response(void *ctx, const mcp_client_response_t *response)
+{
+    request_t        *request = (request_t *) ctx;
+    loadgen_client_t *client  = request->client;
+    method_stats_t   *method  = &stats[request->method];
+
+    if (response->error == 0) {
+        atomic_fetch_add(&method->ok, 1);
+        int64_t us = (now_ns() - request->due_ns) / 1000;
+        atomic_fetch_add(&histogram[hist_bucket(us)], 1);
+    } else if (response->error == MCP_CLIENT_CLOSED) {
+        atomic_fetch_add(&method->lost, 1);
+    } else {
+        atomic_fetch_add(&method->failed, 1);
+    }
+    free(request);
+
+    pthread_mutex_lock(&client->lock);
+    client->inflight--;
+    pthread_cond_signal(&client->cond);
+    pthread_mutex_unlock(&client->lock);
+}
+
+static method_e pick_method(loadgen_client_t *client)
+{
+    const int *weights = client->options->weights;
+    int        total   = weights[0] + weights[1] + weights[2];
+
+    // xorshift64, seeded per client
+    client->random ^= client->random << 13;
+    client->random ^= client->random >> 7;
+    client->random ^= client->random << 17;
+
+    int pick = (int) (client->random % (uint64_t) total);
+    for (int i = 0; i < N_METHODS; i++) {
+        if (pick < weights[i]) {
+            return (method_e) i;
+        }
+        pick -= weights[i];
+    }
+    return METHOD_CALL;
+}
+
+static void issue(loadgen_client_t *client, int64_t due_ns)
+{
+    const options_t *options = client->options;
+    request_t       *request = malloc(sizeof(request_t));
+    long long        id      = -1;
+
+    request->client = client;
+    request->method = pick_method(client);
+    request->due_ns = due_ns;
+
+    pthread_mutex_lock(&client->lock);
+    client->inflight++;
+    pthread_mutex_unlock(&client->lock);
+    atomic_fetch_add(&stats[request->method].sent, 1);
+
+    switch (request->method) {
+    case METHOD_LIST:
+        id = mcp_client_list_tools(client->session, NULL, on_response,
+                                   request);
+        break;
+    case METHOD_CALL:
+        id = mcp_client_call_tool(client->session, options->tool,
+                                  options->arguments, on_response, request);
+        break;
+    case METHOD_READ:
+        id = mcp_client_read_resource(client->session, options->uri,
+                                      on_response, request);
+        break;
+    default:
+        break;
+    }
+
+    if (id < 0) {
+        // never published, so its callback will not run
+        mcp_client_response_t failure = {
+            .error   = MCP_CLIENT_CLOSED,
+            .message = "Failed to publish",
+        };
+        on_response(request, &failure);
+    }
+}
+
+static void *client_run(void *arg)
+{
+    loadgen_client_t *client  = (loadgen_client_t *) arg;
+    const options_t  *options = client->options;
+
+    if (options->rate > 0) {
+        // clients start spread over one interval instead of all at once
+        int64_t interval_ns = (int64_t) (1e9 * options->n_clients /
+                                         options->rate);
+        int64_t due_ns      = now_ns() + interval_ns * client->index /
+                                        options->n_clients;
+        while (!atomic_load(&stopping)) {
+            sleep_until(due_ns);
+            issue(client, due_ns);
+            due_ns += interval_ns;
+        }
+    } else {
+        while (!atomic_load(&stopping)) {
+            pthread_mutex_lock(&client->lock);
+            while (client->inflight >= options->window &&
+                   !atomic_load(&stopping)) {
+                pthread_cond_wait(&client->cond, &client->lock);
+            }
+            pthread_mutex_unlock(&client->lock);
+            if (!atomic_load(&stopping)) {
+                issue(client, now_ns());
+            }
+        }
+    }
+    return NULL;
+}
+
+static int standin_add(int n_args, property_t *args, mcp_result_t *result)
+{
+    (void) n_args;
+    return mcp_result_printf(result, "%lld",
+                             args[0].value.integer_value +
+                                 args[1].value.integer_value);
+}
+
+static const char *standin_read(const char *uri)
+{
+    (void) uri;
+    return "mcp-loadgen static resource";
+}
+
+static mcp_tool_t standin_tool = {
+    .name           = "add",
+    .description    = "Adds two numbers",
+    .invoke         = standin_add,
+    .property_count = 2,
+    .properties =
+        (property_t[]) {
+            { .name = "a", .type = PROPERTY_INTEGER },
+            { .name = "b", .type = PROPERTY_INTEGER },
+        },
+};
+
+static mcp_resource_t standin_resource = {
+    .uri       = "loadgen://static",
+    .name      = "static",
+    .mime_type = "text/plain",
+};
+
+static mcp_server_t *standin_start(const char *broker_uri)
+{
+    char client_id[64];
+
+    snprintf(client_id, sizeof(client_id), "mcp-loadgen-server-%d",
+             (int) getpid());
+    mcp_server_t *server =
+        mcp_server_init(STANDIN_NAME, "In-process server of mcp-loadgen",
+                        broker_uri, client_id, NULL, NULL, NULL);
+    if (server == NULL) {
+        return NULL;
+    }
+    mcp_server_register_static_tools(server, 1, &standin_tool);
+    mcp_server_register_static_resources(server, 1, &standin_resource,
+                                         standin_read);
+    if (mcp_server_run(server) != 0) {
+        mcp_server_close(server);
+        return NULL;
+    }
+    return server;
+}
+
+static int client_start(loadgen_client_t *client, const options_t *options,
+                        int index)
+{
+    char client_id[64];
+
+    snprintf(client_id, sizeof(client_id), "mcp-loadgen-%d-%d",
+             (int) getpid(), index);
+    client->options = options;
+    client->index   = index;
+    client->random  = 0x9E3779B97F4A7C15ULL * (uint64_t) (index + 1);
+    pthread_mutex_init(&client->lock, NULL);
+    pthread_cond_init(&client->cond, NULL);
+
+    client->client = mcp_client_init("mcp-loadgen", options->broker_uri,
+                                     client_id, NULL, NULL, NULL);
+    if (client->client == NULL ||
+        mcp_client_connect(client->client, 5000) != 0) {
+        fprintf(stderr, "client %d: failed to connect\n", index);
+        return -1;
+    }
+    client->session =
+        mcp_client_open(client->client, NULL, options->server_name, 10000);
+    if (client->session == NULL) {
+        fprintf(stderr, "client %d: %s did not answer initialize\n", index,
+                options->server_name);
+        return -1;
+    }
+    return 0;
+}
+
+static void client_stop(loadgen_client_t *client)
+{
+    // whatever is still pending fails with MCP_CLIENT_CLOSED
+    mcp_client_session_close(client->session);
+    mcp_client_close(client->client);
+    pthread_cond_destroy(&client->cond);
+    pthread_mutex_destroy(&client->lock);
+}
+
+static int parse_mix(const char *mix, int *weights)
+{
+    char *copy = strdup(mix);
+    char *save = NULL;
+    int   ret  = 0;
+
+    memset(weights, 0, N_METHODS * sizeof(int));
+    for (char *item = strtok_r(copy, ",", &save); item && ret == 0;
+         item       = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(item, '=');
+        int   i     = 0;
+
+        if (value) {
+            *value++ = '\0';
+        }
+        while (i < N_METHODS && strcmp(item, method_names[i]) != 0) {
+            i++;
+        }
+        if (i == N_METHODS || value == NULL || atoi(value) < 0) {
+            ret = -1;
+        } else {
+            weights[i] = atoi(value);
+        }
+    }
+    free(copy);
+
+    if (weights[0] + weights[1] + weights[2] <= 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+static double percentile(long long total, double p)
+{
+    long long rank = (long long) (total * p / 100.0);
+    long long seen = 0;
+
+    if (rank >= total) {
+        rank = total - 1;
+    }
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += atomic_load(&histogram[i]);
+        if (seen > rank) {
+            return hist_floor(i) / 1000.0;
+        }
+    }
+    return hist_floor(HIST_BUCKETS - 1) / 1000.0;
+}
+
+static void report(double elapsed_s)
+{
+    long long sent = 0, ok = 0, failed = 0, lost = 0;
+
+    printf("\n%-6s %10s %10s %10s %10s %12s\n", "method", "sent", "ok",
+           "errors", "lost", "ok/s");
+    for (int i = 0; i < N_METHODS; i++) {
+        method_stats_t *method = &stats[i];
+        if (atomic_load(&method->sent) == 0) {
+            continue;
+        }
+        printf("%-6s %10lld %10lld %10lld %10lld %12.1f\n", method_names[i],
+               atomic_load(&method->sent), atomic_load(&method->ok),
+               atomic_load(&method->failed), atomic_load(&method->lost),
+               atomic_load(&method->ok) / elapsed_s);
+        sent += atomic_load(&method->sent);
+        ok += atomic_load(&method->ok);
+        failed += atomic_load(&method->failed);
+        lost += atomic_load(&method->lost);
+    }
+    printf("%-6s %10lld %10lld %10lld %10lld %12.1f\n", "total", sent, ok,
+           failed, lost, ok / elapsed_s);
+    printf("error rate %.3f%%\n",
+           sent ? 100.0 * (double) (failed + lost) / (double) sent : 0.0);
+    if (ok == 0) {
+        return;
+    }
+
+    printf("latency ms: p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+           percentile(ok, 50), percentile(ok, 90), percentile(ok, 99),
+           percentile(ok, 99.9), percentile(ok, 100));
+
+    // printed per power of two, the finer buckets only feed percentiles
+    long long rows[HIST_BUCKETS / HIST_SUB] = { 0 };
+    long long peak                          = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        rows[i / HIST_SUB] += atomic_load(&histogram[i]);
+    }
+    for (int row = 0; row < HIST_BUCKETS / HIST_SUB; row++) {
+        if (rows[row] > peak) {
+            peak = rows[row];
+        }
+    }
+    printf("\n%12s %10s\n", "below ms", "count");
+    for (int row = 0; row < HIST_BUCKETS / HIST_SUB; row++) {
+        if (rows[row] == 0) {
+            continue;
+        }
+        int  width = (int) (50 * rows[row] / peak);
+        char bar[51];
+        memset(bar, '#', width);
+        bar[width] = '\0';
+        printf("%12.3f %10lld %s\n", hist_floor((row + 1) * HIST_SUB) / 1000.0,
+               rows[row], bar);
+    }
+}
+
+static double kernel_rate(const char *text, size_t size, char *out,
+                          bool validate)
+{
+    int64_t start_ns = now_ns();
+    int64_t elapsed_ns;
+    long    rounds = 0;
+
+    // at least half a second, so short texts are timed over many rounds
+    do {
+        if (validate) {
+            mcp_json_valid_utf8(text, size);
+        } else {
+            mcp_json_escape(out, text, size);
+        }
+        rounds++;
+        elapsed_ns = now_ns() - start_ns;
+    } while (elapsed_ns < 500000000);
+
+    return (double) size * rounds / (elapsed_ns / 1e9) / 1e6;
+}
+
+static void bench_encoding(size_t size)
+{
+    static const char *names[] = { "scalar", "sse4.2", "avx2" };
+    // prose with quotes, newlines and a multibyte dash, like resource texts
+    static const char line[] =
+        "The \"quick\" brown fox \xe2\x80\x93 jumps over the lazy dog.\n";
+    const char *chosen = mcp_json_kernel();
+    char       *text   = malloc(size);
+    char       *out    = malloc(size * 6);
+
+    for (size_t i = 0; i < size; i++) {
+        text[i] = line[i % (sizeof(line) - 1)];
+    }
+    // the tail may cut the dash, keep the text valid
+    while (size > 0 && (unsigned char) text[size - 1] >= 0x80) {
+        text[--size] = '\0';
+    }
+    memset(out, 0, size * 6); // fault the pages in before timing
+
+    printf("%zu bytes, %zu escaped\n", size, mcp_json_escaped_size(text, size));
+    printf("%-8s %14s %14s\n", "kernel", "escape MB/s", "validate MB/s");
+    for (int i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++) {
+        if (mcp_json_set_kernel(names[i]) != 0) {
+            continue;
+        }
+        printf("%-8s %14.1f %14.1f%s\n", names[i],
+               kernel_rate(text, size, out, false),
+               kernel_rate(text, size, out, true),
+               strcmp(names[i], chosen) == 0 ? "  (used)" : "");
+    }
+    mcp_json_set_kernel(chosen);
+
+    free(text);
+    free(out);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-b broker] [-s server | -S] [-c clients] "
+            "[-d seconds]\n"
+            "       [-r rate | -w window] [-m list=1,call=8,read=0] "
+            "[-t tool] [-a json] [-u uri]\n"
+            "       %s -e bytes\n",
+            argv0, argv0);
+}
+
+int main(int argc, char **argv)
+{
+    options_t options = {
+        .broker_uri  = "tcp://localhost:1883",
+        .server_name = "ESP32 Demo Server Name",
+        .n_clients   = 10,
+        .duration_s  = 10,
+        .window      = 16,
+        .weights     = { 1, 8, 0 },
+        .tool        = "add",
+        .arguments   = "{\"a\":1,\"b\":2}",
+        .uri         = "loadgen://static",
+    };
+    long long encoding = 0;
+    int       opt;
+
+    while ((opt = getopt(argc, argv, "b:s:Sc:d:r:w:m:t:a:u:e:h")) != -1) {
+        switch (opt) {
+        case 'b':
+            options.broker_uri = optarg;
+            break;
+        case 's':
+            options.server_name = optarg;
+            break;
+        case 'S':
+            options.standin = true;
+            break;
+        case 'c':
+            options.n_clients = atoi(optarg);
+            break;
+        case 'd':
+            options.duration_s = atoi(optarg);
+            break;
+        case 'r':
+            options.rate = atof(optarg);
+            break;
+        case 'w':
+            options.window = atoi(optarg);
+            break;
+        case 't':
+            options.tool = optarg;
+            break;
+        case 'a':
+            options.arguments = optarg;
+            break;
+        case 'u':
+            options.uri = optarg;
+            break;
+        case 'e':
+            encoding = atoll(optarg);
+            if (encoding <= 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'm':
+            if (parse_mix(optarg, options.weights) != 0) {
+                fprintf(stderr, "invalid mix: %s\n", optarg);
+                return 2;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.n_clients <= 0 || options.duration_s <= 0 ||
+        options.rate < 0 || options.window <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (encoding > 0) {
+        bench_encoding((size_t) encoding);
+        return 0;
+    }
+
+    mcp_server_t *standin = NULL;
+    if (options.standin) {
+        standin = standin_start(options.broker_uri);
+        if (standin == NULL) {
+            fprintf(stderr, "failed to start the stand-in server\n");
+            return 1;
+        }
+        options.server_name = STANDIN_NAME;
+    }
+
+    loadgen_client_t *clients =
+        calloc(options.n_clients, sizeof(loadgen_client_t));
+    int n_started = 0;
+    while (n_started < options.n_clients &&
+           client_start(&clients[n_started], &options, n_started) == 0) {
+        n_started++;
+    }
+    if (n_started < options.n_clients) {
+        // the one that failed is half set up
+        mcp_client_close(clients[n_started].client);
+        for (int i = 0; i < n_started; i++) {
+            client_stop(&clients[i]);
+        }
+        free(clients);
+        mcp_server_close(standin);
+        return 1;
+    }
+
+    printf("%d clients loading \"%s\" for %d s, ", options.n_clients,
+           options.server_name, options.duration_s);
+    if (options.rate > 0) {
+        printf("%.1f requests/s\n", options.rate);
+    } else {
+        printf("%d in flight per client\n", options.window);
+    }
+
+    int64_t start_ns = now_ns();
+    for (int i = 0; i < options.n_clients; i++) {
+        pthread_create(&clients[i].thread, NULL, client_run, &clients[i]);
+    }
+    sleep_until(start_ns + (int64_t) options.duration_s * 1000000000);
+    atomic_store(&stopping, true);
+    for (int i = 0; i < options.n_clients; i++) {
+        pthread_mutex_lock(&clients[i].lock);
+        pthread_cond_signal(&clients[i].cond);
+        pthread_mutex_unlock(&clients[i].lock);
+        pthread_join(clients[i].thread, NULL);
+    }
+    double elapsed_s = (now_ns() - start_ns) / 1e9;
+
+    // give the answers still on their way a moment
+    int64_t drain_ns = now_ns() + 5000000000LL;
+    for (int i = 0; i < options.n_clients; i++) {
+        pthread_mutex_lock(&clients[i].lock);
+        while (clients[i].inflight > 0 && now_ns() < drain_ns) {
+            pthread_mutex_unlock(&clients[i].lock);
+            sleep_until(now_ns() + 10000000);
+            pthread_mutex_lock(&clients[i].lock);
+        }
+        pthread_mutex_unlock(&clients[i].lock);
+    }
+    for (int i = 0; i < options.n_clients; i++) {
+        client_stop(&clients[i]);
+    }
+    free(clients);
+    mcp_server_close(standin);
+
+    report(elapsed_s);
+    return 0;
+}
@@ -0,0 +1,866 @@
+/*
+ * mcp-toolgen: compiles a declarative tool description into C.
+ *
+ *     mcp-toolgen <tools.json> <prefix> <output-dir>
+ *
+ * writes <prefix>_tools.h and <prefix>_tools.c with the mcp_tool_t table
+ * (ready for mcp_server_register_static_tools), the tools/list entries
+ * serialized at build time, and for every tool a typed argument struct, a
+ * decoder filling it straight from the request and a binder calling the
+ * handler the application implements, which writes its result through the
+ * mcp_result_t writer:
+ *
+ *     {
+ *         "tools": [{
+ *             "name": "add",
+ *             "description": "Adds two numbers",
+ *             "handler": "add_numbers",
+ *             "timeout_ms": 1000,
+ *             "priority": "high",
+ *             "pure": true,
+ *             "memo_ttl_ms": 60000,
+ *             "properties": [
+ *                 { "name": "a", "type": "integer", "description": "..." }
+ *             ]
+ *         }]
+ *     }
+ *
+ * "handler" defaults to <prefix>_<tool>; property types are "string",
+ * "number", "integer", "boolean" and "array", whose "items" gives the element
+ * type, one of the others. Arrays are decoded into a pointer to the elements
+ * and a <name>_count field. A property may also have:
+ *
+ *     "optional": true     adds a has_<name> field set when it was passed
+ *     "default": <value>   makes a scalar optional, used when it is absent
+ *     "enum": [...]        restricts a string to the listed values
+ *
+ * Nested objects are left to tools implemented with mcp_tool_t.call.
+ */
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cjson/cJSON.h"
+
+#include "jsonrpc.h"
+#include "mcp_json.h"
+
+#define TOOLGEN_MAX_PROPERTIES 64
+#define TOOLGEN_MAX_FIELDS     16
+#define TOOLGEN_CODE_SIZE      64
+
+typedef struct {
+    const char     *json;
+    property_type_e type;
+    const char     *c_type;
+    const char     *enum_name;
+    const char     *reader;
+    const char     *array_reader;
+} type_info_t;
+
+static const type_info_t types[] = {
+    { "string", PROPERTY_STRING, "char", "PROPERTY_STRING",
+      "mcp_json_read_string", "mcp_json_read_strings" },
+    { "number", PROPERTY_REAL, "double", "PROPERTY_REAL",
+      "mcp_json_read_real", "mcp_json_read_reals" },
+    { "integer", PROPERTY_INTEGER, "long long", "PROPERTY_INTEGER",
+      "mcp_json_read_integer", "mcp_json_read_integers" },
+    { "boolean", PROPERTY_BOOLEAN, "bool", "PROPERTY_BOOLEAN",
+      "mcp_json_read_boolean", "mcp_json_read_booleans" },
+};
+
+typedef struct {
+    char              *ident; // C identifier derived from the name
+    const char        *handler;
+    mcp_tool_t         tool;
+    const type_info_t **types; // of the elements for arrays
+} gen_tool_t;
+
+/* A designated initializer, value is a C string literal or plain code. */
+typedef struct {
+    const char *designator;
+    const char *value;
+    bool        literal;
+    char        code[TOOLGEN_CODE_SIZE];
+} field_t;
+
+static const char *input_path;
+
+static void fail(const char *what, const char *name)
+{
+    fprintf(stderr, "%s: %s%s%s\n", input_path, what, name ? ": " : "",
+            name ? name : "");
+    exit(1);
+}
+
+static char *read_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fail("cannot open", NULL);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char *data = malloc((size_t) size + 1);
+    if (fread(data, 1, (size_t) size, f) != (size_t) size) {
+        fail("cannot read", NULL);
+    }
+    data[size] = '\0';
+    fclose(f);
+    return data;
+}
+
+static char *c_ident(const char *name)
+{
+    size_t len   = strlen(name);
+    char  *ident = malloc(len + 2);
+    char  *p     = ident;
+
+    if (isdigit((unsigned char) name[0])) {
+        *p++ = '_';
+    }
+    for (size_t i = 0; i < len; i++) {
+        *p++ = isalnum((unsigned char) name[i]) ? name[i] : '_';
+    }
+    *p = '\0';
+    return ident;
+}
+
+static const char *string_member(const cJSON *obj, const char *key,
+                                 bool required, const char *owner)
+{
+    cJSON *item = cJSON_GetObjectItem(obj, key);
+    if (item == NULL && !required) {
+        return NULL;
+    }
+    if (!cJSON_IsString(item)) {
+        fail(required ? "missing string member" : "member must be a string",
+             owner ? owner : key);
+    }
+    return item->valuestring;
+}
+
+static const type_info_t *find_type(const char *json)
+{
+    for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        if (strcmp(types[t].json, json) == 0) {
+            return &types[t];
+        }
+    }
+    return NULL;
+}
+
+static double number_member(const cJSON *obj, const char *key)
+{
+    cJSON *item = cJSON_GetObjectItem(obj, key);
+    if (item == NULL) {
+        return 0;
+    }
+    if (!cJSON_IsNumber(item)) {
+        fail("member must be a number", key);
+    }
+    return item->valuedouble;
+}
+
+static void parse_default(const cJSON *json, property_t *p)
+{
+    bool ok = false;
+
+    switch (p->type) {
+    case PROPERTY_STRING:
+        ok = cJSON_IsString(json) &&
+             (p->n_enum == 0 || mcp_json_enum_index(json->valuestring,
+                                                    p->n_enum,
+                                                    p->enum_values) >= 0);
+        p->value.string_value = ok ? json->valuestring : NULL;
+        break;
+    case PROPERTY_REAL:
+        ok                  = cJSON_IsNumber(json);
+        p->value.real_value = json->valuedouble;
+        break;
+    case PROPERTY_INTEGER:
+        ok = cJSON_IsNumber(json) && json->valuedouble > -9.2e18 &&
+             json->valuedouble < 9.2e18 &&
+             (double) (long long) json->valuedouble == json->valuedouble;
+        p->value.integer_value = (long long) json->valuedouble;
+        break;
+    case PROPERTY_BOOLEAN:
+        ok                     = cJSON_IsBool(json);
+        p->value.boolean_value = cJSON_IsTrue(json);
+        break;
+    default:
+        fail("defaults are supported on scalars only", p->name);
+    }
+    if (!ok) {
+        fail("default does not match the type", p->name);
+    }
+    p->has_default = true;
+}
+
+static void parse_type(const cJSON *json, property_t *p,
+                       const type_info_t **info)
+{
+    const char *type = string_member(json, "type", true, p->name);
+
+    if (strcmp(type, "array") == 0) {
+        cJSON *items = cJSON_GetObjectItem(json, "items");
+        if (!cJSON_IsObject(items)) {
+            fail("missing items of array", p->name);
+        }
+        type     = string_member(items, "type", true, p->name);
+        p->type  = PROPERTY_ARRAY;
+        p->items = calloc(1, sizeof(property_t));
+    }
+    if ((*info = find_type(type)) == NULL) {
+        fail("unsupported type", type);
+    }
+    if (p->items) {
+        p->items->type = (*info)->type;
+    } else {
+        p->type = (*info)->type;
+    }
+
+    cJSON *values = cJSON_GetObjectItem(json, "enum");
+    if (values != NULL) {
+        if (p->type != PROPERTY_STRING || !cJSON_IsArray(values) ||
+            cJSON_GetArraySize(values) == 0) {
+            fail("enum must list the values of a string", p->name);
+        }
+        p->n_enum      = cJSON_GetArraySize(values);
+        p->enum_values = calloc(p->n_enum, sizeof(char *));
+        for (int k = 0; k < p->n_enum; k++) {
+            cJSON *value = cJSON_GetArrayItem(values, k);
+            if (!cJSON_IsString(value)) {
+                fail("enum must list the values of a string", p->name);
+            }
+            p->enum_values[k] = value->valuestring;
+        }
+    }
+
+    cJSON *optional = cJSON_GetObjectItem(json, "optional");
+    if (optional != NULL && !cJSON_IsBool(optional)) {
+        fail("optional must be a boolean", p->name);
+    }
+    p->optional = cJSON_IsTrue(optional);
+
+    cJSON *def = cJSON_GetObjectItem(json, "default");
+    if (def != NULL) {
+        parse_default(def, p);
+    }
+}
+
+static void parse_tool(const cJSON *json, const char *prefix, gen_tool_t *gen)
+{
+    mcp_tool_t *tool = &gen->tool;
+
+    tool->name        = (char *) string_member(json, "name", true, NULL);
+    tool->description =
+        (char *) string_member(json, "description", false, tool->name);
+    tool->timeout_ms = (int) number_member(json, "timeout_ms");
+    tool->rate_limit = number_member(json, "rate_limit");
+    tool->rate_burst = (int) number_member(json, "rate_burst");
+
+    cJSON *pure = cJSON_GetObjectItem(json, "pure");
+    if (pure != NULL && !cJSON_IsBool(pure)) {
+        fail("pure must be a boolean", tool->name);
+    }
+    tool->pure        = cJSON_IsTrue(pure);
+    tool->memo_ttl_ms = (int) number_member(json, "memo_ttl_ms");
+
+    const char *priority = string_member(json, "priority", false, tool->name);
+    if (priority == NULL || strcmp(priority, "normal") == 0) {
+        tool->priority = MCP_PRIORITY_NORMAL;
+    } else if (strcmp(priority, "high") == 0) {
+        tool->priority = MCP_PRIORITY_HIGH;
+    } else if (strcmp(priority, "low") == 0) {
+        tool->priority = MCP_PRIORITY_LOW;
+    } else {
+        fail("priority must be high, normal or low", tool->name);
+    }
+
+    gen->ident   = c_ident(tool->name);
+    gen->handler = string_member(json, "handler", false, tool->name);
+    if (gen->handler == NULL) {
+        char *handler = malloc(strlen(prefix) + strlen(gen->ident) + 2);
+        sprintf(handler, "%s_%s", prefix, gen->ident);
+        gen->handler = handler;
+    }
+
+    cJSON *props = cJSON_GetObjectItem(json, "properties");
+    if (props != NULL && !cJSON_IsArray(props)) {
+        fail("properties must be an array", tool->name);
+    }
+    tool->property_count = cJSON_GetArraySize(props);
+    if (tool->property_count > TOOLGEN_MAX_PROPERTIES) {
+        fail("too many properties", tool->name);
+    }
+    tool->properties = calloc(tool->property_count + 1, sizeof(property_t));
+    gen->types = calloc(tool->property_count + 1, sizeof(type_info_t *));
+
+    for (int i = 0; i < tool->property_count; i++) {
+        cJSON      *prop = cJSON_GetArrayItem(props, i);
+        property_t *p    = &tool->properties[i];
+
+        p->name = (char *) string_member(prop, "name", true, tool->name);
+        p->description =
+            (char *) string_member(prop, "description", false, p->name);
+        parse_type(prop, p, &gen->types[i]);
+        for (int k = 0; k < i; k++) {
+            if (strcmp(tool->properties[k].name, p->name) == 0) {
+                fail("duplicate property", p->name);
+            }
+        }
+    }
+}
+
+/* Writes s as a C string literal, split over lines of the given indent. */
+static void emit_string(FILE *out, const char *s, int indent)
+{
+    int width = indent < 40 ? 76 - indent : 36;
+    int col   = 0;
+
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *) s; *p; p++) {
+        if (col >= width) {
+            fprintf(out, "\"\n%*s\"", indent, "");
+            col = 0;
+        }
+        if (*p == '"' || *p == '\\') {
+            col += fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20 || *p >= 0x7f) {
+            col += fprintf(out, "\\%03o", *p);
+        } else {
+            fputc(*p, out);
+            col++;
+        }
+    }
+    fputc('"', out);
+}
+
+static void emit_or_null(FILE *out, const char *s, int indent)
+{
+    if (s) {
+        emit_string(out, s, indent);
+    } else {
+        fputs("NULL", out);
+    }
+}
+
+/* Levels of indirection of the struct field holding p. */
+static int pointer_depth(const property_t *p)
+{
+    const property_t *scalar = p->items ? p->items : p;
+
+    return (scalar->type == PROPERTY_STRING) + (p->items != NULL);
+}
+
+static void emit_field(FILE *out, int width, int depth, const char *type,
+                       int stars, const char *name, const char *suffix)
+{
+    fprintf(out, "    %-*s %*s%.*s%s%s;\n", width, type, depth - stars, "",
+            stars, "**", name, suffix);
+}
+
+static void emit_args_struct(FILE *out, const char *prefix,
+                             const gen_tool_t *gen)
+{
+    const mcp_tool_t *tool  = &gen->tool;
+    int               width = 0;
+    int               depth = 0;
+
+    // names line up, with the '*' of pointers just before them
+    for (int i = 0; i < tool->property_count; i++) {
+        const property_t *p     = &tool->properties[i];
+        int               len   = (int) strlen(gen->types[i]->c_type);
+        int               stars = pointer_depth(p);
+        width = len > width ? len : width;
+        depth = stars > depth ? stars : depth;
+    }
+
+    fprintf(out, "typedef struct {\n");
+    if (tool->property_count == 0) {
+        fprintf(out, "    char unused; // the tool takes no arguments\n");
+    }
+    for (int i = 0; i < tool->property_count; i++) {
+        const property_t *p    = &tool->properties[i];
+        char             *name = c_ident(p->name);
+
+        emit_field(out, width, depth, gen->types[i]->c_type, pointer_depth(p),
+                   name, "");
+        if (p->type == PROPERTY_ARRAY) {
+            emit_field(out, width, depth, "int", 0, name, "_count");
+        }
+        if (p->optional && !p->has_default) {
+            fprintf(out, "    %-*s %*shas_%s;\n", width, "bool", depth, "",
+                    name);
+        }
+        free(name);
+    }
+    fprintf(out, "} %s_%s_args_t;\n\n", prefix, gen->ident);
+}
+
+static void emit_header(FILE *out, const char *prefix, int n_tools,
+                        const gen_tool_t *gens)
+{
+    char *guard = c_ident(prefix);
+    for (char *p = guard; *p; p++) {
+        *p = (char) toupper((unsigned char) *p);
+    }
+
+    fprintf(out, "/* Generated by mcp-toolgen, do not edit. */\n");
+    fprintf(out, "#ifndef %s_TOOLS_H\n#define %s_TOOLS_H\n\n", guard, guard);
+    fprintf(out, "#include <stdbool.h>\n\n#include \"mcp.h\"\n");
+    fprintf(out, "#include \"mcp_result.h\"\n\n");
+    fprintf(out, "#define %s_N_TOOLS %d\n\n", guard, n_tools);
+    fprintf(out, "extern const mcp_tool_t %s_tools[%s_N_TOOLS];\n", prefix,
+            guard);
+    fprintf(out, "// the complete tools/list array\n");
+    fprintf(out, "extern const char %s_tools_json[];\n\n", prefix);
+
+    for (int i = 0; i < n_tools; i++) {
+        const gen_tool_t *gen = &gens[i];
+
+        emit_args_struct(out, prefix, gen);
+        fprintf(out,
+                "int  %s_%s_decode(const char *json, %s_%s_args_t *args);\n",
+                prefix, gen->ident, prefix, gen->ident);
+        fprintf(out, "void %s_%s_free(%s_%s_args_t *args);\n", prefix,
+                gen->ident, prefix, gen->ident);
+        fprintf(out, "// implemented by the application\n");
+        fprintf(out, "int %s(const %s_%s_args_t *args, mcp_result_t *result);"
+                     "\n\n",
+                gen->handler, prefix, gen->ident);
+    }
+    fprintf(out, "#endif\n");
+    free(guard);
+}
+
+static char *enum_symbol(const char *prefix, const gen_tool_t *gen,
+                         const property_t *p)
+{
+    char *field  = c_ident(p->name);
+    char *symbol = malloc(strlen(prefix) + strlen(gen->ident) +
+                          strlen(field) + 8);
+    sprintf(symbol, "%s_%s_%s_enum", prefix, gen->ident, field);
+    free(field);
+    return symbol;
+}
+
+static void emit_default(FILE *out, const char *field, const property_t *p)
+{
+    fprintf(out, "        args->%s = ", field);
+    switch (p->type) {
+    case PROPERTY_STRING:
+        fprintf(out, "strdup(");
+        emit_string(out, p->value.string_value, 12);
+        fprintf(out, ")");
+        break;
+    case PROPERTY_REAL:
+        fprintf(out, "%.17g", p->value.real_value);
+        break;
+    case PROPERTY_INTEGER:
+        fprintf(out, "%lldLL", p->value.integer_value);
+        break;
+    default:
+        fprintf(out, "%s", p->value.boolean_value ? "true" : "false");
+        break;
+    }
+    fprintf(out, ";\n");
+}
+
+static void emit_decoder(FILE *out, const char *prefix, const gen_tool_t *gen)
+{
+    const mcp_tool_t *tool     = &gen->tool;
+    uint64_t          required = 0;
+
+    for (int i = 0; i < tool->property_count; i++) {
+        const property_t *p = &tool->properties[i];
+        if (!p->optional && !p->has_default) {
+            required |= UINT64_C(1) << i;
+        }
+    }
+
+    fprintf(out, "int %s_%s_decode(const char *json, %s_%s_args_t *args)\n",
+            prefix, gen->ident, prefix, gen->ident);
+    fprintf(out, "{\n");
+    fprintf(out, "    mcp_json_reader_t reader;\n");
+    fprintf(out, "    const char       *key;\n");
+    fprintf(out, "    size_t            key_len;\n");
+    fprintf(out, "    uint64_t          seen = 0;\n");
+    fprintf(out, "    int               ret;\n\n");
+    fprintf(out, "    memset(args, 0, sizeof(*args));\n");
+    fprintf(out, "    mcp_json_reader_init(&reader, json);\n");
+    fprintf(out, "    if (mcp_json_object_begin(&reader) != 0) {\n");
+    fprintf(out, "        return -1;\n    }\n");
+    fprintf(out, "    while ((ret = mcp_json_object_next(&reader, &key, "
+                 "&key_len)) == 1) {\n");
+    for (int i = 0; i < tool->property_count; i++) {
+        const property_t *p     = &tool->properties[i];
+        char             *field = c_ident(p->name);
+
+        fprintf(out, "        %sif (mcp_json_key_is(key, key_len, ",
+                i == 0 ? "" : "} else ");
+        emit_string(out, p->name, 12);
+        fprintf(out, ")) {\n");
+        if (p->type == PROPERTY_STRING || p->type == PROPERTY_ARRAY) {
+            // a repeated key replaces the earlier value
+            fprintf(out, "            mcp_json_free(args->%s);\n", field);
+        }
+        if (p->type == PROPERTY_ARRAY) {
+            const char *reader = gen->types[i]->array_reader;
+            fprintf(out, "            ret = %s(&reader, &args->%s,\n", reader,
+                    field);
+            fprintf(out, "%*s&args->%s_count);\n",
+                    (int) strlen(reader) + 19, "", field);
+        } else {
+            fprintf(out, "            ret = %s(&reader, &args->%s);\n",
+                    gen->types[i]->reader, field);
+        }
+        if (p->n_enum > 0) {
+            char *symbol = enum_symbol(prefix, gen, p);
+            fprintf(out, "            if (ret == 0 && mcp_json_enum_index("
+                         "args->%s, %d,\n",
+                    field, p->n_enum);
+            fprintf(out, "                                                "
+                         "%s) < 0) {\n",
+                    symbol);
+            fprintf(out, "                ret = -1;\n            }\n");
+            free(symbol);
+        }
+        fprintf(out, "            seen |= UINT64_C(1) << %d;\n", i);
+        free(field);
+    }
+    if (tool->property_count > 0) {
+        fprintf(out, "        } else {\n");
+        fprintf(out, "            ret = mcp_json_skip(&reader);\n");
+        fprintf(out, "        }\n");
+    } else {
+        fprintf(out, "        ret = mcp_json_skip(&reader);\n");
+    }
+    fprintf(out, "        if (ret != 0) {\n");
+    fprintf(out, "            break;\n        }\n    }\n");
+    fprintf(out,
+            "    if (ret != 0 || (seen & UINT64_C(0x%llx)) != "
+            "UINT64_C(0x%llx)) {\n",
+            (unsigned long long) required, (unsigned long long) required);
+    fprintf(out, "        %s_%s_free(args);\n", prefix, gen->ident);
+    fprintf(out, "        return -1;\n    }\n");
+    for (int i = 0; i < tool->property_count; i++) {
+        const property_t *p     = &tool->properties[i];
+        char             *field = c_ident(p->name);
+
+        if (p->has_default) {
+            fprintf(out, "    if (!(seen & (UINT64_C(1) << %d))) {\n", i);
+            emit_default(out, field, p);
+            fprintf(out, "    }\n");
+        } else if (p->optional) {
+            fprintf(out,
+                    "    args->has_%s = (seen & (UINT64_C(1) << %d)) != 0;\n",
+                    field, i);
+        }
+        free(field);
+    }
+    fprintf(out, "    return 0;\n}\n\n");
+
+    fprintf(out, "void %s_%s_free(%s_%s_args_t *args)\n{\n", prefix,
+            gen->ident, prefix, gen->ident);
+    bool owns = false;
+    for (int i = 0; i < tool->property_count; i++) {
+        const property_t *p = &tool->properties[i];
+        if (p->type == PROPERTY_STRING || p->type == PROPERTY_ARRAY) {
+            char *field = c_ident(p->name);
+            fprintf(out, "    mcp_json_free(args->%s);\n", field);
+            free(field);
+            owns = true;
+        }
+    }
+    if (!owns) {
+        fprintf(out, "    (void) args;\n");
+    }
+    fprintf(out, "}\n\n");
+
+    fprintf(out, "static int %s_%s_call_json(const char   *arguments,\n",
+            prefix, gen->ident);
+    fprintf(out, "%*smcp_result_t *result)\n",
+            (int) (strlen(prefix) + strlen(gen->ident)) + 23, "");
+    fprintf(out, "{\n");
+    fprintf(out, "    %s_%s_args_t args;\n\n", prefix, gen->ident);
+    fprintf(out, "    if (%s_%s_decode(arguments, &args) != 0) {\n", prefix,
+            gen->ident);
+    fprintf(out, "        return MCP_RESULT_INVALID_PARAMS;\n    }\n");
+    fprintf(out, "    int ret = %s(&args, result);\n", gen->handler);
+    fprintf(out, "    %s_%s_free(&args);\n", prefix, gen->ident);
+    fprintf(out, "    return ret;\n}\n\n");
+}
+
+static field_t *add_field(field_t *fields, int *n, const char *designator)
+{
+    field_t *field = &fields[(*n)++];
+
+    memset(field, 0, sizeof(*field));
+    field->designator = designator;
+    field->value      = field->code;
+    return field;
+}
+
+static void add_code(field_t *fields, int *n, const char *designator,
+                     const char *format, ...)
+{
+    field_t *field = add_field(fields, n, designator);
+    va_list  ap;
+
+    va_start(ap, format);
+    vsnprintf(field->code, sizeof(field->code), format, ap);
+    va_end(ap);
+}
+
+static void add_literal(field_t *fields, int *n, const char *designator,
+                        const char *value)
+{
+    field_t *field = add_field(fields, n, designator);
+    field->value   = value;
+    field->literal = true;
+}
+
+/* Writes the initializers one per line, with their '=' lined up. */
+static void emit_fields(FILE *out, int indent, int n, const field_t *fields)
+{
+    int width = 0;
+
+    for (int i = 0; i < n; i++) {
+        int len = (int) strlen(fields[i].designator);
+        width   = len > width ? len : width;
+    }
+    for (int i = 0; i < n; i++) {
+        fprintf(out, "%*s%-*s = ", indent, "", width, fields[i].designator);
+        if (fields[i].literal) {
+            emit_or_null(out, fields[i].value, indent + width + 4);
+        } else {
+            fputs(fields[i].value, out);
+        }
+        fprintf(out, ",\n");
+    }
+}
+
+static void emit_properties(FILE *out, const char *prefix,
+                            const gen_tool_t *gen)
+{
+    const mcp_tool_t *tool = &gen->tool;
+    field_t           fields[TOOLGEN_MAX_FIELDS];
+    int               n;
+
+    for (int k = 0; k < tool->property_count; k++) {
+        const property_t *p     = &tool->properties[k];
+        char             *field = c_ident(p->name);
+
+        if (p->n_enum > 0) {
+            char *symbol = enum_symbol(prefix, gen, p);
+            fprintf(out, "static const char *%s[] = {\n", symbol);
+            for (int e = 0; e < p->n_enum; e++) {
+                fprintf(out, "    ");
+                emit_string(out, p->enum_values[e], 4);
+                fprintf(out, ",\n");
+            }
+            fprintf(out, "};\n\n");
+            free(symbol);
+        }
+        if (p->items) {
+            fprintf(out, "static property_t %s_%s_%s_items = {\n", prefix,
+                    gen->ident, field);
+            fprintf(out, "    .type = %s,\n};\n\n",
+                    gen->types[k]->enum_name);
+        }
+        free(field);
+    }
+
+    fprintf(out, "static property_t %s_%s_properties[] = {\n", prefix,
+            gen->ident);
+    for (int k = 0; k < tool->property_count; k++) {
+        const property_t *p     = &tool->properties[k];
+        char             *ident = c_ident(p->name);
+
+        n = 0;
+        add_literal(fields, &n, ".name", p->name);
+        add_literal(fields, &n, ".description", p->description);
+        add_code(fields, &n, ".type", "%s",
+                 p->items ? "PROPERTY_ARRAY" : gen->types[k]->enum_name);
+        if (p->optional) {
+            add_code(fields, &n, ".optional", "true");
+        }
+        if (p->has_default) {
+            add_code(fields, &n, ".has_default", "true");
+            switch (p->type) {
+            case PROPERTY_STRING:
+                add_literal(fields, &n, ".value.string_value",
+                            p->value.string_value);
+                break;
+            case PROPERTY_REAL:
+                add_code(fields, &n, ".value.real_value", "%.17g",
+                         p->value.real_value);
+                break;
+            case PROPERTY_INTEGER:
+                add_code(fields, &n, ".value.integer_value", "%lldLL",
+                         p->value.integer_value);
+                break;
+            default:
+                add_code(fields, &n, ".value.boolean_value", "%s",
+                         p->value.boolean_value ? "true" : "false");
+                break;
+            }
+        }
+        if (p->n_enum > 0) {
+            char *symbol = enum_symbol(prefix, gen, p);
+            add_code(fields, &n, ".n_enum", "%d", p->n_enum);
+            add_code(fields, &n, ".enum_values", "%s", symbol);
+            free(symbol);
+        }
+        if (p->items) {
+            add_code(fields, &n, ".items", "&%s_%s_%s_items", prefix,
+                     gen->ident, ident);
+        }
+        fprintf(out, "    {\n");
+        emit_fields(out, 8, n, fields);
+        fprintf(out, "    },\n");
+        free(ident);
+    }
+    fprintf(out, "};\n\n");
+}
+
+static void emit_source(FILE *out, const char *prefix, int n_tools,
+                        const gen_tool_t *gens, const char *list_json)
+{
+    field_t fields[TOOLGEN_MAX_FIELDS];
+    int     n;
+
+    fprintf(out, "/* Generated by mcp-toolgen, do not edit. */\n");
+    fprintf(out, "#include <stdint.h>\n#include <stdlib.h>\n");
+    fprintf(out, "#include <string.h>\n\n#include \"mcp_json.h\"\n\n");
+    fprintf(out, "#include \"%s_tools.h\"\n\n", prefix);
+
+    for (int i = 0; i < n_tools; i++) {
+        if (gens[i].tool.property_count > 0) {
+            emit_properties(out, prefix, &gens[i]);
+        }
+        emit_decoder(out, prefix, &gens[i]);
+    }
+
+    char *guard = c_ident(prefix);
+    for (char *p = guard; *p; p++) {
+        *p = (char) toupper((unsigned char) *p);
+    }
+    fprintf(out, "const mcp_tool_t %s_tools[%s_N_TOOLS] = {\n", prefix, guard);
+    free(guard);
+    for (int i = 0; i < n_tools; i++) {
+        const gen_tool_t *gen   = &gens[i];
+        const mcp_tool_t *tool  = &gen->tool;
+        char             *entry = jsonrpc_tool_list_items(1, tool);
+
+        // the list entry alone, without the enclosing brackets
+        entry[strlen(entry) - 1] = '\0';
+
+        n = 0;
+        add_literal(fields, &n, ".name", tool->name);
+        add_literal(fields, &n, ".description", tool->description);
+        add_code(fields, &n, ".property_count", "%d", tool->property_count);
+        if (tool->property_count > 0) {
+            add_code(fields, &n, ".properties", "%s_%s_properties", prefix,
+                     gen->ident);
+        }
+        add_literal(fields, &n, ".schema_json", entry + 1);
+        add_code(fields, &n, ".call_json", "%s_%s_call_json", prefix,
+                 gen->ident);
+        if (tool->timeout_ms) {
+            add_code(fields, &n, ".timeout_ms", "%d", tool->timeout_ms);
+        }
+        if (tool->priority != MCP_PRIORITY_NORMAL) {
+            add_code(fields, &n, ".priority", "%s",
+                     tool->priority == MCP_PRIORITY_HIGH ? "MCP_PRIORITY_HIGH"
+                                                         : "MCP_PRIORITY_LOW");
+        }
+        if (tool->pure) {
+            add_code(fields, &n, ".pure", "true");
+            if (tool->memo_ttl_ms) {
+                add_code(fields, &n, ".memo_ttl_ms", "%d", tool->memo_ttl_ms);
+            }
+        }
+        if (tool->rate_limit > 0) {
+            add_code(fields, &n, ".rate_limit", "%.17g", tool->rate_limit);
+            add_code(fields, &n, ".rate_burst", "%d", tool->rate_burst);
+        }
+        fprintf(out, "    {\n");
+        emit_fields(out, 8, n, fields);
+        fprintf(out, "    },\n");
+        free(entry);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "const char %s_tools_json[] =\n    ", prefix);
+    emit_string(out, list_json, 4);
+    fprintf(out, ";\n");
+}
+
+static FILE *open_output(const char *dir, const char *prefix,
+                         const char *suffix, char **path)
+{
+    *path = malloc(strlen(dir) + strlen(prefix) + strlen(suffix) + 2);
+    sprintf(*path, "%s/%s%s", dir, prefix, suffix);
+
+    FILE *f = fopen(*path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "cannot write %s\n", *path);
+        exit(1);
+    }
+    return f;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <tools.json> <prefix> <output-dir>\n",
+                argv[0]);
+        return 2;
+    }
+    input_path         = argv[1];
+    const char *prefix = argv[2];
+
+    char  *text = read_file(input_path);
+    cJSON *root = cJSON_Parse(text);
+    if (root == NULL) {
+        fail("invalid JSON", NULL);
+    }
+    cJSON *json_tools = cJSON_GetObjectItem(root, "tools");
+    if (!cJSON_IsArray(json_tools)) {
+        fail("missing tools array", NULL);
+    }
+
+    int         n_tools = cJSON_GetArraySize(json_tools);
+    gen_tool_t *gens    = calloc(n_tools + 1, sizeof(gen_tool_t));
+    mcp_tool_t *tools   = calloc(n_tools + 1, sizeof(mcp_tool_t));
+    for (int i = 0; i < n_tools; i++) {
+        parse_tool(cJSON_GetArrayItem(json_tools, i), prefix, &gens[i]);
+        for (int k = 0; k < i; k++) {
+            if (strcmp(gens[k].tool.name, gens[i].tool.name) == 0) {
+                fail("duplicate tool", gens[i].tool.name);
+            }
+        }
+        tools[i] = gens[i].tool;
+    }
+    char *list_json = jsonrpc_tool_list_items(n_tools, tools);
+
+    char *h_path, *c_path;
+    FILE *h = open_output(argv[3], prefix, "_tools.h", &h_path);
+    emit_header(h, prefix, n_tools, gens);
+    fclose(h);
+
+    FILE *c = open_output(argv[3], prefix, "_tools.c", &c_path);
+    emit_source(c, prefix, n_tools, gens, list_json);
+    fclose(c);
+
+    // everything is released with the process
+    return 0;
+}